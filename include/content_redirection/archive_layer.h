@@ -0,0 +1,47 @@
+#pragma once
+
+#include "redirection.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Adds a layer that replaces single members of a SARC archive instead of the whole archive. <br>
+ * A mod only has to ship the members it changes, the archive is rebuilt from the original archive and the files in "memberDir":
+ * the member "Model/Link.bfres" is replaced with "<memberDir>/Model/Link.bfres" if that file exists. Files in "memberDir" that are
+ * no member of the archive are ignored, members can't be added or removed. <br>
+ * <br>
+ * The rebuilt archive is described once when the layer is added: the header and file table with the recomputed member offsets are
+ * kept in memory, the data of the members is read from the original archive or the replacement files when it's needed.
+ * Members keep the alignment of their original offset. Only uncompressed archives are supported, Yaz0 compressed archives are rejected. <br>
+ * <br>
+ * The layer has the type FS_LAYER_TYPE_EX_ARCHIVE. The rebuilt archive is provided by a read-only device of this lib ("crvirtual:"),
+ * which is added to the module with the first patch or archive layer. Opening the rebuilt archive for writing fails with EROFS. <br>
+ * "ContentRedirection_RefreshFSLayer" rebuilds the archive from the current content of "memberDir", files that are already open keep
+ * using the old archive. The layer can't be watched via "ContentRedirection_WatchFSLayer".
+ *
+ * **Requires API version 3 or higher**
+ *
+ * @param handlePtr     The handle of the layer is written to this pointer.
+ * @param layerName     Name of the layer, used for debugging.
+ * @param targetPath    Path of the archive that will be replaced, e.g. "/vol/content/Pack/Dungeon.pack".
+ * @param basePath      Path of the original archive on a registered newlib device, e.g. "fs:/vol/content/Pack/Dungeon.pack".
+ *                      It must not be redirected by another layer, otherwise the members are replaced in the redirected archive.
+ * @param memberDir     Dir on a registered newlib device that holds the replaced members, e.g. "fs:/vol/external01/mods/A/Dungeon.pack".
+ * @param priority      Priority of the layer, see "ContentRedirection_AddFSLayerExWithPriority".
+ * @return CONTENT_REDIRECTION_RESULT_SUCCESS:              The layer has been added. <br>
+ *         CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED:    "ContentRedirection_InitLibrary()" was not called. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND:  This command is not supported by the currently loaded Module. <br>
+ *         CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT:     A pointer is NULL, a path doesn't belong to a registered device, "memberDir" can't be read,
+ *                                                          the original file is no valid uncompressed SARC archive or the rebuilt archive would exceed 4 GiB. <br>
+ *         CONTENT_REDIRECTION_RESULT_NO_MEMORY:            The file table doesn't fit into the memory budget. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNKNOWN_ERROR:        Unknown error.
+ */
+ContentRedirectionStatus ContentRedirection_AddFSLayerArchive(CRLayerHandle *handlePtr, const char *layerName, const char *targetPath,
+                                                              const char *basePath, const char *memberDir, int32_t priority);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ContentRedirectionContentCacheStats {
+    uint32_t entries;           /**< Number of distinct file contents in the cache */
+    uint32_t bytesCached;       /**< Memory used by the contents in the cache */
+    uint32_t bytesDeduplicated; /**< Memory currently saved because several open files share one copy */
+    uint32_t hits;              /**< Opens that have been served from a copy that already was in the cache */
+    uint32_t misses;            /**< Opens that had to read the file from the device */
+    uint32_t hashesComputed;    /**< Files whose hash wasn't known and has been computed */
+    uint64_t bytesReadSaved;    /**< Bytes that haven't been read from devices because of hits */
+} ContentRedirectionContentCacheStats;
+
+/**
+ * Fast non-cryptographic 64 bit hash of a file content, used as key of the content cache.
+ */
+uint64_t ContentRedirection_HashContent(const void *data, size_t len);
+
+/**
+ * Looks up the content hash of a file in the hash index, see "ContentRedirection_LoadContentHashes".
+ * The entry only matches if size and modification time are still the same.
+ *
+ * @param path      Full path of the file, including the device, e.g. "sd:/mods/A/content/model.bin".
+ * @param size      Current size of the file.
+ * @param mtime     Current modification time of the file.
+ * @param hashOut   The hash is written to this pointer.
+ * @return true if the hash is known.
+ */
+bool ContentRedirection_LookupContentHash(const char *path, int64_t size, int64_t mtime, uint64_t *hashOut);
+
+/**
+ * Adds or updates the content hash of a file in the hash index.
+ */
+void ContentRedirection_StoreContentHash(const char *path, int64_t size, int64_t mtime, uint64_t hash);
+
+/**
+ * Returns the cached content with the given hash and size and takes a reference to it, or NULL if it isn't cached. <br>
+ * Counts a hit if the content was found. Every returned pointer has to be released via "ContentRedirection_ReleaseCachedContent".
+ */
+const void *ContentRedirection_AcquireCachedContent(uint64_t hash, uint32_t size);
+
+/**
+ * Allocates a buffer for a content that will be inserted via "ContentRedirection_InsertCachedContent". <br>
+ * Unused contents are evicted if the memory budget or the capacity of the cache is exhausted.
+ *
+ * @return The buffer, NULL if the content doesn't fit.
+ */
+void *ContentRedirection_AllocateCachedContent(uint32_t size);
+
+/**
+ * Frees a buffer returned by "ContentRedirection_AllocateCachedContent" that hasn't been inserted, e.g. because reading the file failed.
+ */
+void ContentRedirection_FreeCachedContent(void *data, uint32_t size);
+
+/**
+ * Inserts a content into the cache and takes a reference to it. Counts a miss. <br>
+ * If the same content has been inserted in the meantime, "data" is freed and the existing copy is returned.
+ *
+ * @param hash  Hash of the content, see "ContentRedirection_HashContent".
+ * @param data  Buffer returned by "ContentRedirection_AllocateCachedContent", the cache takes ownership of it.
+ * @param size  Size of the content.
+ * @return The cached copy, has to be released via "ContentRedirection_ReleaseCachedContent".
+ */
+const void *ContentRedirection_InsertCachedContent(uint64_t hash, void *data, uint32_t size);
+
+/**
+ * Releases a reference returned by "ContentRedirection_AcquireCachedContent" or "ContentRedirection_InsertCachedContent". <br>
+ * Contents without references stay cached until they are evicted.
+ */
+void ContentRedirection_ReleaseCachedContent(const void *data);
+
+/**
+ * Sets how many bytes of contents without references are kept in the cache, default is 4 MiB.
+ * 0 drops every content as soon as the last file using it has been closed.
+ */
+void ContentRedirection_SetContentCacheCapacity(uint32_t bytes);
+
+/**
+ * Loads the hash index from a sidecar file, replacing the current index.
+ * Hashes of files that are opened while the index doesn't know them are computed once and added to the index.
+ *
+ * @param sidecarPath   Path of the sidecar file, e.g. "fs:/vol/external01/wiiu/content_hashes.bin".
+ * @return false if the file doesn't exist or is no valid hash index, the index is empty in this case.
+ */
+bool ContentRedirection_LoadContentHashes(const char *sidecarPath);
+
+/**
+ * Writes the hash index to a sidecar file, so the hashes don't have to be computed again on the next boot.
+ *
+ * @param sidecarPath   Path of the sidecar file.
+ * @return false if the file can't be written.
+ */
+bool ContentRedirection_SaveContentHashes(const char *sidecarPath);
+
+/**
+ * Retrieves the counters of the content cache since the last reset.
+ * "entries", "bytesCached" and "bytesDeduplicated" are current values and aren't affected by a reset.
+ */
+void ContentRedirection_GetContentCacheStats(ContentRedirectionContentCacheStats *statsOut);
+
+void ContentRedirection_ResetContentCacheStats(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -8,7 +8,7 @@ extern "C" {
 #endif
 
 #define CONTENT_REDIRECTION_DEVICE_MAGIC   0x43524456 // "CRDV"
-#define CONTENT_REDIRECTION_DEVICE_VERSION 1
+#define CONTENT_REDIRECTION_DEVICE_VERSION 6
 
 typedef struct {
     uint32_t dev;
@@ -26,6 +26,11 @@ typedef struct {
     int64_t blocks;
 } CR_Stat;
 
+typedef struct {
+    int32_t result; /**< 0 on success, negative errno on failure */
+    CR_Stat st;     /**< Only valid if "result" is 0 */
+} CR_StatResult;
+
 typedef struct {
     uint64_t bsize;
     uint64_t frsize;
@@ -233,6 +238,96 @@ typedef struct ContentRedirectionDeviceABI {
      * @return Number of bytes placed in buf on success, negative errno on failure.
      */
     ssize_t (*readlink)(void *deviceData, const char *path, char *buf, size_t bufsiz);
+
+    // --- Version 2 ---
+    // The following members are only present if version >= 2.
+
+    /**
+     * @brief Maps a range of an open file into memory for reading, without copying it. Optional, may be NULL.
+     * Intended for devices whose content already is in memory. The returned pointer must not be written to and stays valid
+     * until "unmap" is called for it. Every successful "map" has to be followed by an "unmap" before the file is closed.
+     * The file offset is not changed.
+     * @return 0 on success, negative errno on failure. -ENOTSUP if this range can't be mapped, the caller has to use "read" instead.
+     */
+    int (*map)(void *deviceData, void *fd, int64_t offset, size_t len, const void **out);
+
+    /**
+     * @brief Releases a pointer returned by "map". Must be set if "map" is set.
+     * @return 0 on success, negative errno on failure.
+     */
+    int (*unmap)(void *deviceData, void *fd, const void *ptr, size_t len);
+
+    // --- Version 3 ---
+    // The following members are only present if version >= 3.
+
+    /**
+     * @brief Copies a range from one open file to another open file of the same device. Optional, may be NULL.
+     * Both files may be the same file, but the ranges must not overlap. The file offsets are not changed.
+     * @return Number of bytes copied on success, which is less than "len" if the end of the source file has been reached.
+     *         Negative errno on failure. -ENOTSUP or -ENOMEM if the caller has to copy via "read" and "write" instead.
+     */
+    int64_t (*copy_range)(void *deviceData, void *srcFd, int64_t srcOffset, void *dstFd, int64_t dstOffset, size_t len);
+
+    // --- Version 4 ---
+    // The following members are only present if version >= 4.
+
+    /**
+     * @brief Allocates memory for the file struct of one open file ("structSize" bytes). Optional, may be NULL.
+     * Lets the device provide pooled memory, so opening and closing files doesn't allocate from the heap.
+     * @return Pointer to the memory, NULL if there is not enough memory.
+     */
+    void *(*alloc_file_struct)(void *deviceData);
+
+    /**
+     * @brief Frees memory returned by "alloc_file_struct". Must be set if "alloc_file_struct" is set.
+     */
+    void (*free_file_struct)(void *deviceData, void *fileStruct);
+
+    /**
+     * @brief Allocates memory for the dir struct of one open directory ("dirStateSize" bytes). Optional, may be NULL.
+     * @return Pointer to the memory, NULL if there is not enough memory.
+     */
+    void *(*alloc_dir_struct)(void *deviceData);
+
+    /**
+     * @brief Frees memory returned by "alloc_dir_struct". Must be set if "alloc_dir_struct" is set.
+     */
+    void (*free_dir_struct)(void *deviceData, void *dirStruct);
+
+    // --- Version 5 ---
+    // The following members are only present if version >= 5.
+    // "path" is relative to a directory that has been opened via "diropen" or "diropenat" and is still open, e.g. "Chr/Link.bfres".
+    // This lets the module keep the directory of a deep path open and resolve its siblings without walking the shared prefix again.
+    // All three are optional and may be NULL, the module concatenates the paths and uses "open", "stat" and "diropen" instead.
+
+    /**
+     * @brief Opens a file relative to an open directory.
+     * @return 0 or a positive identifier on success, negative errno on failure.
+     */
+    int (*openat)(void *deviceData, void *dirStruct, void *fileStruct, const char *path, int flags, uint32_t mode);
+
+    /**
+     * @brief Retrieves information about a file relative to an open directory.
+     * @return 0 on success, negative errno on failure.
+     */
+    int (*fstatat)(void *deviceData, void *dirStruct, const char *path, CR_Stat *st);
+
+    /**
+     * @brief Opens a directory stream relative to an open directory. Both directories stay open independently.
+     * @return 0 on success, negative errno on failure.
+     */
+    int (*diropenat)(void *deviceData, void *parentDirStruct, void *dirStruct, const char *path);
+
+    // --- Version 6 ---
+    // The following members are only present if version >= 6.
+
+    /**
+     * @brief Retrieves information about several files by their paths in one call. Optional, may be NULL, the module calls "stat" for every path instead.
+     * The paths may be in any order and in different directories. Devices can group them by directory and resolve each directory once.
+     * "results[i]" receives the result of "paths[i]", a missing file is reported as -ENOENT in its result and doesn't fail the call.
+     * @return 0 if all results have been written, negative errno on failure.
+     */
+    int (*stat_many)(void *deviceData, const char *const *paths, uint32_t count, CR_StatResult *results);
 } ContentRedirectionDeviceABI;
 
 #ifdef __cplusplus
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "defines.h"
+#include "status.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ContentRedirectionDeviceTestConfig {
+    /**
+     * Writable directory on the device that is created and removed again by the tests, e.g. "mydev:/crtest". It must not exist yet.
+     */
+    const char *scratchDir;
+    /**
+     * Called for every line of the report. May be NULL if only the results are needed.
+     */
+    void (*print)(void *context, const char *line);
+    void *printContext;
+    /**
+     * Performance profile only: number of files in the directory that is listed via dirnext. 0 uses 512.
+     */
+    uint32_t largeDirEntries;
+    /**
+     * Performance profile only: size in bytes of the file that is read. 0 uses 4 MiB.
+     */
+    uint32_t readFileSize;
+    /**
+     * Performance profile only: number of threads that read the file at the same time. 0 uses 4.
+     */
+    uint32_t concurrentReaders;
+} ContentRedirectionDeviceTestConfig;
+
+typedef struct ContentRedirectionDeviceConformanceResult {
+    uint32_t passed;  /**< Checks the device passed */
+    uint32_t failed;  /**< Checks the device failed, see the report for details */
+    uint32_t skipped; /**< Checks of optional entries the device doesn't implement */
+} ContentRedirectionDeviceConformanceResult;
+
+typedef struct ContentRedirectionDevicePerfResult {
+    uint64_t openCloseNs;               /**< Average time to open and close an existing file */
+    uint64_t statHitNs;                 /**< Average time of stat for an existing file */
+    uint64_t statMissNs;                /**< Average time of stat for a missing file */
+    uint64_t readBytesPerSec[3];        /**< Sequential read throughput with reads of 4 KiB, 64 KiB and 1 MiB */
+    uint64_t dirnextNsPerEntry;         /**< Average time per entry to list the large directory, including diropen and dirclose */
+    uint64_t concurrentReadBytesPerSec; /**< Combined read throughput of all concurrent readers */
+} ContentRedirectionDevicePerfResult;
+
+/**
+ * Drives a device through a conformance suite that checks the contract of ContentRedirectionDeviceABI: every entry the device implements
+ * is called with valid and invalid arguments, and results and errors are compared with the documented behaviour, e.g. negative errno
+ * values, -ENOENT at the end of a directory stream and file offsets after reads and seeks. Entries of newer ABI versions are only checked
+ * if the device reports that version. <br>
+ * The suite only uses the entries of "device" and the standard library, so it can be built for the host together with a device
+ * implementation and doesn't require the device to be added via "ContentRedirection_AddDeviceABI", see "tools/device_test_kit".
+ *
+ * @param device    The device that will be tested.
+ * @param config    Configuration of the tests, "scratchDir" is required.
+ * @param resultOut The number of passed, failed and skipped checks is written to this pointer.
+ * @return CONTENT_REDIRECTION_RESULT_SUCCESS:          All checks have been run, see "resultOut" for the outcome. <br>
+ *         CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT: A pointer is NULL or "device" has no valid magic.
+ */
+ContentRedirectionStatus ContentRedirection_RunDeviceConformanceTests(const ContentRedirectionDeviceABI *device, const ContentRedirectionDeviceTestConfig *config,
+                                                                      ContentRedirectionDeviceConformanceResult *resultOut);
+
+/**
+ * Runs a standard performance profile against a device: open and close, stat of existing and missing files, sequential reads of
+ * different sizes, dirnext on a large directory and concurrent readers. The report uses the same lines for every device,
+ * so reports of different devices or builds can be compared line by line.
+ *
+ * @param device    The device that will be measured, has to implement open, close, read, write, stat, mkdir, unlink, rmdir and the directory entries.
+ * @param config    Configuration of the profile, "scratchDir" is required.
+ * @param resultOut The measurements are written to this pointer.
+ * @return CONTENT_REDIRECTION_RESULT_SUCCESS:              The profile has been run. <br>
+ *         CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT:     A pointer is NULL or "device" has no valid magic. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND:  "device" lacks an entry the profile needs. <br>
+ *         CONTENT_REDIRECTION_RESULT_NO_MEMORY:            Not enough memory for the read buffers. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNKNOWN_ERROR:        The test files couldn't be created, see the report.
+ */
+ContentRedirectionStatus ContentRedirection_RunDevicePerformanceProfile(const ContentRedirectionDeviceABI *device, const ContentRedirectionDeviceTestConfig *config,
+                                                                        ContentRedirectionDevicePerfResult *resultOut);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
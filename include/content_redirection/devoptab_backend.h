@@ -0,0 +1,444 @@
+#pragma once
+
+#ifdef __cplusplus
+
+#include "defines.h"
+
+#include <cstring>
+#include <errno.h>
+#include <sys/iosupport.h>
+#include <sys/reent.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/time.h>
+
+namespace CR_DevoptabWrapper {
+    namespace internal {
+        /**
+         * Memory accounting of the caches and buffers of the wrapper, see "ContentRedirection_SetMemoryBudget". <br>
+         * Implemented by the lib for the wrapper only, this is not part of the public API.
+         */
+        bool ReserveLibraryMemory(uint32_t size);
+        void ReleaseLibraryMemory(uint32_t size);
+    } // namespace internal
+
+    struct Backend {
+        static void stat_to_cr_stat(const struct stat &src, CR_Stat *dst) {
+            if (!dst) {
+                return;
+            }
+            dst->dev     = src.st_dev;
+            dst->ino     = src.st_ino;
+            dst->mode    = src.st_mode;
+            dst->nlink   = src.st_nlink;
+            dst->uid     = src.st_uid;
+            dst->gid     = src.st_gid;
+            dst->rdev    = src.st_rdev;
+            dst->size    = src.st_size;
+            dst->atime   = src.st_atime;
+            dst->mtime   = src.st_mtime;
+            dst->ctime   = src.st_ctime;
+            dst->blksize = src.st_blksize;
+            dst->blocks  = src.st_blocks;
+        }
+
+        static void statvfs_to_cr_statvfs(const struct statvfs &src, CR_Statvfs *dst) {
+            if (!dst) {
+                return;
+            }
+            dst->bsize   = src.f_bsize;
+            dst->frsize  = src.f_frsize;
+            dst->blocks  = src.f_blocks;
+            dst->bfree   = src.f_bfree;
+            dst->bavail  = src.f_bavail;
+            dst->files   = src.f_files;
+            dst->ffree   = src.f_ffree;
+            dst->favail  = src.f_favail;
+            dst->fsid    = src.f_fsid;
+            dst->flag    = src.f_flag;
+            dst->namemax = src.f_namemax;
+        }
+
+        static int get_error(struct _reent *r) {
+            return r->_errno != 0 ? -(r->_errno) : -EIO;
+        }
+
+        static struct _reent *get_reent(const devoptab_t *dev) {
+            auto *r       = _REENT;
+            r->deviceData = dev->deviceData;
+            return r;
+        }
+
+        static int open(const devoptab_t *dev, void *fileStruct, const char *path, int flags, uint32_t mode) {
+            if (!dev || !dev->open_r) {
+                return -ENOSYS;
+            }
+            auto *r       = get_reent(dev);
+            const int res = dev->open_r(r, fileStruct, path, flags, static_cast<int>(mode));
+            if (res == -1) {
+                return get_error(r);
+            }
+            return res;
+        }
+
+        static int close(const devoptab_t *dev, void *fd) {
+            if (!dev || !dev->close_r) {
+                return -ENOSYS;
+            }
+            auto *r       = get_reent(dev);
+            const int res = dev->close_r(r, fd);
+            if (res == -1) {
+                return get_error(r);
+            }
+            return res;
+        }
+
+        static ssize_t write(const devoptab_t *dev, void *fd, const char *ptr, size_t len) {
+            if (!dev || !dev->write_r) {
+                return -ENOSYS;
+            }
+            auto *r           = get_reent(dev);
+            const ssize_t res = dev->write_r(r, fd, ptr, len);
+            if (res == -1) {
+                return get_error(r);
+            }
+            return res;
+        }
+
+        static ssize_t read(const devoptab_t *dev, void *fd, char *ptr, size_t len) {
+            if (!dev || !dev->read_r) {
+                return -ENOSYS;
+            }
+            auto *r           = get_reent(dev);
+            const ssize_t res = dev->read_r(r, fd, ptr, len);
+            if (res == -1) {
+                return get_error(r);
+            }
+            return res;
+        }
+
+        static int64_t seek(const devoptab_t *dev, void *fd, int64_t pos, int dir) {
+            if (!dev || !dev->seek_r) {
+                return -ENOSYS;
+            }
+            auto *r         = get_reent(dev);
+            const off_t res = dev->seek_r(r, fd, static_cast<off_t>(pos), dir);
+            if (res == static_cast<off_t>(-1)) {
+                return get_error(r);
+            }
+            return static_cast<int64_t>(res);
+        }
+
+        static int fstat(const devoptab_t *dev, void *fd, CR_Stat *st) {
+            if (!dev || !dev->fstat_r) {
+                return -ENOSYS;
+            }
+            auto *r = get_reent(dev);
+            struct stat local_st {};
+            const int res = dev->fstat_r(r, fd, &local_st);
+            if (res == -1) {
+                return get_error(r);
+            }
+            stat_to_cr_stat(local_st, st);
+            return res;
+        }
+
+        static int stat(const devoptab_t *dev, const char *file, CR_Stat *st) {
+            if (!dev || !dev->stat_r) {
+                return -ENOSYS;
+            }
+            auto *r = get_reent(dev);
+            struct stat local_st {};
+            const int res = dev->stat_r(r, file, &local_st);
+            if (res == -1) {
+                return get_error(r);
+            }
+            stat_to_cr_stat(local_st, st);
+            return res;
+        }
+
+        static int link(const devoptab_t *dev, const char *existing, const char *newLink) {
+            if (!dev || !dev->link_r) {
+                return -ENOSYS;
+            }
+            auto *r       = get_reent(dev);
+            const int res = dev->link_r(r, existing, newLink);
+            if (res == -1) {
+                return get_error(r);
+            }
+            return res;
+        }
+
+        static int unlink(const devoptab_t *dev, const char *name) {
+            if (!dev || !dev->unlink_r) {
+                return -ENOSYS;
+            }
+            auto *r       = get_reent(dev);
+            const int res = dev->unlink_r(r, name);
+            if (res == -1) {
+                return get_error(r);
+            }
+            return res;
+        }
+
+        static int chdir(const devoptab_t *dev, const char *name) {
+            if (!dev || !dev->chdir_r) {
+                return -ENOSYS;
+            }
+            auto *r       = get_reent(dev);
+            const int res = dev->chdir_r(r, name);
+            if (res == -1) {
+                return get_error(r);
+            }
+            return res;
+        }
+
+        static int rename(const devoptab_t *dev, const char *oldName, const char *newName) {
+            if (!dev || !dev->rename_r) {
+                return -ENOSYS;
+            }
+            auto *r       = get_reent(dev);
+            const int res = dev->rename_r(r, oldName, newName);
+            if (res == -1) {
+                return get_error(r);
+            }
+            return res;
+        }
+
+        static int mkdir(const devoptab_t *dev, const char *path, uint32_t mode) {
+            if (!dev || !dev->mkdir_r) {
+                return -ENOSYS;
+            }
+            auto *r       = get_reent(dev);
+            const int res = dev->mkdir_r(r, path, static_cast<int>(mode));
+            if (res == -1) {
+                return get_error(r);
+            }
+            return res;
+        }
+
+        static int diropen(const devoptab_t *dev, int deviceId, void *dirStruct, const char *path) {
+            if (!dev || !dev->diropen_r) {
+                return -ENOSYS;
+            }
+            auto *r = get_reent(dev);
+            DIR_ITER dummy{};
+            dummy.device    = deviceId;
+            dummy.dirStruct = dirStruct;
+
+            if (dev->diropen_r(r, &dummy, path) == nullptr) {
+                return get_error(r);
+            }
+            return 0;
+        }
+
+        static int dirreset(const devoptab_t *dev, int deviceId, void *dirStruct) {
+            if (!dev || !dev->dirreset_r) {
+                return -ENOSYS;
+            }
+            auto *r = get_reent(dev);
+            DIR_ITER dummy{};
+            dummy.device    = deviceId;
+            dummy.dirStruct = dirStruct;
+
+            const int res = dev->dirreset_r(r, &dummy);
+            if (res == -1) {
+                return get_error(r);
+            }
+            return res;
+        }
+
+        static int dirnext(const devoptab_t *dev, int deviceId, void *dirStruct, char *filename, CR_Stat *filestat) {
+            if (!dev || !dev->dirnext_r) {
+                return -ENOSYS;
+            }
+            auto *r = get_reent(dev);
+            DIR_ITER dummy{};
+            dummy.device    = deviceId;
+            dummy.dirStruct = dirStruct;
+            struct stat local_st {};
+            const int res = dev->dirnext_r(r, &dummy, filename, &local_st);
+            if (res == -1) {
+                return get_error(r);
+            }
+            stat_to_cr_stat(local_st, filestat);
+            return res;
+        }
+
+        static int dirclose(const devoptab_t *dev, int deviceId, void *dirStruct) {
+            if (!dev || !dev->dirclose_r) {
+                return -ENOSYS;
+            }
+            auto *r = get_reent(dev);
+            DIR_ITER dummy{};
+            dummy.device    = deviceId;
+            dummy.dirStruct = dirStruct;
+            const int res   = dev->dirclose_r(r, &dummy);
+            if (res == -1) {
+                return get_error(r);
+            }
+            return res;
+        }
+
+        static int statvfs(const devoptab_t *dev, const char *path, CR_Statvfs *buf) {
+            if (!dev || !dev->statvfs_r) {
+                return -ENOSYS;
+            }
+            auto *r = get_reent(dev);
+            struct statvfs local_buf {};
+            const int res = dev->statvfs_r(r, path, &local_buf);
+            if (res == -1) {
+                return get_error(r);
+            }
+            statvfs_to_cr_statvfs(local_buf, buf);
+            return res;
+        }
+
+        static int ftruncate(const devoptab_t *dev, void *fd, int64_t len) {
+            if (!dev || !dev->ftruncate_r) {
+                return -ENOSYS;
+            }
+            auto *r       = get_reent(dev);
+            const int res = dev->ftruncate_r(r, fd, static_cast<off_t>(len));
+            if (res == -1) {
+                return get_error(r);
+            }
+            return res;
+        }
+
+        static int fsync(const devoptab_t *dev, void *fd) {
+            if (!dev || !dev->fsync_r) {
+                return -ENOSYS;
+            }
+            auto *r       = get_reent(dev);
+            const int res = dev->fsync_r(r, fd);
+            if (res == -1) {
+                return get_error(r);
+            }
+            return res;
+        }
+
+        static int chmod(const devoptab_t *dev, const char *path, uint32_t mode) {
+            if (!dev || !dev->chmod_r) {
+                return -ENOSYS;
+            }
+            auto *r       = get_reent(dev);
+            const int res = dev->chmod_r(r, path, static_cast<mode_t>(mode));
+            if (res == -1) {
+                return get_error(r);
+            }
+            return res;
+        }
+
+        static int fchmod(const devoptab_t *dev, void *fd, uint32_t mode) {
+            if (!dev || !dev->fchmod_r) {
+                return -ENOSYS;
+            }
+            auto *r       = get_reent(dev);
+            const int res = dev->fchmod_r(r, fd, static_cast<mode_t>(mode));
+            if (res == -1) {
+                return get_error(r);
+            }
+            return res;
+        }
+
+        static int rmdir(const devoptab_t *dev, const char *name) {
+            if (!dev || !dev->rmdir_r) {
+                return -ENOSYS;
+            }
+            auto *r = get_reent(dev);
+            int res = dev->rmdir_r(r, name);
+            if (res == -1) {
+                return get_error(r);
+            }
+            return res;
+        }
+
+        static int lstat(const devoptab_t *dev, const char *file, CR_Stat *st) {
+            if (!dev || !dev->lstat_r) {
+                return -ENOSYS;
+            }
+            auto *r = get_reent(dev);
+            struct stat local_st {};
+            const int res = dev->lstat_r(r, file, &local_st);
+            if (res == -1) {
+                return get_error(r);
+            }
+            stat_to_cr_stat(local_st, st);
+            return res;
+        }
+
+        static int utimes(const devoptab_t *dev, const char *filename, const CR_Timeval times[2]) {
+            if (!dev || !dev->utimes_r) {
+                return -ENOSYS;
+            }
+            auto *r = get_reent(dev);
+
+            int res;
+            if (!times) {
+                res = dev->utimes_r(r, filename, nullptr);
+            } else {
+                timeval local_times[2];
+                local_times[0].tv_sec  = static_cast<time_t>(times[0].tv_sec);
+                local_times[0].tv_usec = static_cast<suseconds_t>(times[0].tv_usec);
+                local_times[1].tv_sec  = static_cast<time_t>(times[1].tv_sec);
+                local_times[1].tv_usec = static_cast<suseconds_t>(times[1].tv_usec);
+                res                    = dev->utimes_r(r, filename, local_times);
+            }
+            if (res == -1) {
+                return get_error(r);
+            }
+            return res;
+        }
+
+        static int64_t fpathconf(const devoptab_t *dev, void *fd, int name) {
+            if (!dev || !dev->fpathconf_r) {
+                return -ENOSYS;
+            }
+            auto *r        = get_reent(dev);
+            const long res = dev->fpathconf_r(r, fd, name);
+            if (res == -1) {
+                return get_error(r);
+            }
+            return res;
+        }
+
+        static int64_t pathconf(const devoptab_t *dev, const char *path, int name) {
+            if (!dev || !dev->pathconf_r) {
+                return -ENOSYS;
+            }
+            auto *r        = get_reent(dev);
+            const long res = dev->pathconf_r(r, path, name);
+            if (res == -1) {
+                return get_error(r);
+            }
+            return static_cast<int64_t>(res);
+        }
+
+        static int symlink(const devoptab_t *dev, const char *target, const char *linkpath) {
+            if (!dev || !dev->symlink_r) {
+                return -ENOSYS;
+            }
+            auto *r       = get_reent(dev);
+            const int res = dev->symlink_r(r, target, linkpath);
+            if (res == -1) {
+                return get_error(r);
+            }
+            return res;
+        }
+
+        static ssize_t readlink(const devoptab_t *dev, const char *path, char *buf, size_t bufsiz) {
+            if (!dev || !dev->readlink_r) {
+                return -ENOSYS;
+            }
+            auto *r           = get_reent(dev);
+            const ssize_t res = dev->readlink_r(r, path, buf, bufsiz);
+            if (res == -1) {
+                return get_error(r);
+            }
+            return res;
+        }
+    };
+} // namespace CR_DevoptabWrapper
+
+#endif // __cplusplus
@@ -0,0 +1,148 @@
+#pragma once
+
+#ifdef __cplusplus
+
+#include "content_cache.h"
+#include "devoptab_backend.h"
+
+#include <algorithm>
+#include <cstring>
+#include <errno.h>
+#include <stdio.h>
+#include <string>
+#include <sys/stat.h>
+
+namespace CR_DevoptabWrapper {
+    /**
+     * @brief Per-file view of the content-hash cache, see "ContentRedirection_AcquireCachedContent".
+     *
+     * When a small read-only file is opened, its content hash is looked up in the hash index of the lib, or computed once from the content.
+     * Files with the same content share one copy in memory, no matter via which layer or device path they have been opened.
+     * Reads, seeks and fstat are served from that copy. The device fd stays open, its offset is only synced when it's used directly.
+     */
+    struct ContentCacheFile {
+        const devoptab_t *dev = nullptr;
+        void *fd              = nullptr;
+        const char *data      = nullptr;
+        int64_t size          = 0;
+        int64_t position      = 0;  /**< Logical file offset */
+        int64_t deviceOffset  = -1; /**< Offset of the device fd, -1 if unknown */
+        CR_Stat st            = {};
+
+        [[nodiscard]] bool enabled() const {
+            return data != nullptr;
+        }
+
+        /**
+         * Attaches the file to the cache if it's a regular file of at most "maxFileSize" bytes. Has to be called right after the file has been opened.
+         * The file is read from the device like before if the cache can't hold it.
+         */
+        void init(const devoptab_t *device, void *deviceFd, const char *path, size_t maxFileSize) {
+            dev = device;
+            fd  = deviceFd;
+            if (Backend::fstat(dev, fd, &st) < 0 || !S_ISREG(st.mode) || st.size <= 0 || static_cast<uint64_t>(st.size) > maxFileSize) {
+                return;
+            }
+            const auto length = static_cast<uint32_t>(st.size);
+
+            std::string key = path;
+            if (key.find(':') == std::string::npos) {
+                key.insert(0, std::string(dev->name) + ":");
+            }
+            uint64_t hash;
+            const bool hashKnown = ContentRedirection_LookupContentHash(key.c_str(), st.size, st.mtime, &hash);
+            if (hashKnown) {
+                data = static_cast<const char *>(ContentRedirection_AcquireCachedContent(hash, length));
+                if (data != nullptr) {
+                    size         = st.size;
+                    deviceOffset = 0;
+                    return;
+                }
+            }
+
+            auto *buffer = static_cast<char *>(ContentRedirection_AllocateCachedContent(length));
+            if (buffer == nullptr) {
+                return;
+            }
+            uint32_t done = 0;
+            while (done < length) {
+                const ssize_t res = Backend::read(dev, fd, buffer + done, length - done);
+                if (res <= 0) {
+                    break;
+                }
+                done += static_cast<uint32_t>(res);
+            }
+            if (done != length) {
+                // The file has changed or can't be read, leave it to the device.
+                ContentRedirection_FreeCachedContent(buffer, length);
+                Backend::seek(dev, fd, 0, SEEK_SET);
+                return;
+            }
+            const uint64_t contentHash = ContentRedirection_HashContent(buffer, length);
+            if (!hashKnown || contentHash != hash) {
+                ContentRedirection_StoreContentHash(key.c_str(), st.size, st.mtime, contentHash);
+            }
+            data         = static_cast<const char *>(ContentRedirection_InsertCachedContent(contentHash, buffer, length));
+            size         = st.size;
+            deviceOffset = st.size;
+        }
+
+        void release() {
+            if (data != nullptr) {
+                ContentRedirection_ReleaseCachedContent(data);
+                data = nullptr;
+            }
+        }
+
+        ssize_t read(char *ptr, size_t len) {
+            if (position >= size) {
+                return 0;
+            }
+            const size_t n = std::min(len, static_cast<size_t>(size - position));
+            memcpy(ptr, data + position, n);
+            position += static_cast<int64_t>(n);
+            return static_cast<ssize_t>(n);
+        }
+
+        int64_t seek(int64_t pos, int dir) {
+            int64_t base;
+            switch (dir) {
+                case SEEK_SET:
+                    base = 0;
+                    break;
+                case SEEK_CUR:
+                    base = position;
+                    break;
+                case SEEK_END:
+                    base = size;
+                    break;
+                default:
+                    return -EINVAL;
+            }
+            if (base + pos < 0) {
+                return -EINVAL;
+            }
+            position = base + pos;
+            return position;
+        }
+
+        int fstat(CR_Stat *out) const {
+            *out = st;
+            return 0;
+        }
+
+        /**
+         * Moves the offset of the device fd to the logical file offset. Has to be called before the device fd is used directly.
+         */
+        int sync() {
+            if (!enabled() || deviceOffset == position) {
+                return 0;
+            }
+            const int64_t res = Backend::seek(dev, fd, position, SEEK_SET);
+            deviceOffset      = res < 0 ? -1 : res;
+            return res < 0 ? static_cast<int>(res) : 0;
+        }
+    };
+} // namespace CR_DevoptabWrapper
+
+#endif
@@ -0,0 +1,83 @@
+#pragma once
+
+#ifdef __cplusplus
+
+#include "devoptab_backend.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <errno.h>
+#include <stdio.h>
+
+namespace CR_DevoptabWrapper {
+    /**
+     * @brief copy_range for devices without native support.
+     *
+     * Copies through one large buffer, so a copy only crosses the module boundary once instead of once per chunk.
+     * The offsets of both files are restored afterwards.
+     */
+    struct CopyRangeFallback {
+        static int64_t copy(const devoptab_t *dev, size_t bufferSize, void *srcFd, int64_t srcOffset, void *dstFd, int64_t dstOffset, size_t len) {
+            if (srcOffset < 0 || dstOffset < 0) {
+                return -EINVAL;
+            }
+            if (len == 0) {
+                return 0;
+            }
+            const size_t size = std::min(bufferSize, len);
+            if (!internal::ReserveLibraryMemory(size)) {
+                return -ENOMEM;
+            }
+            auto *buffer = static_cast<char *>(malloc(size));
+            if (buffer == nullptr) {
+                internal::ReleaseLibraryMemory(size);
+                return -ENOMEM;
+            }
+
+            const int64_t srcPos = Backend::seek(dev, srcFd, 0, SEEK_CUR);
+            const int64_t dstPos = dstFd != srcFd ? Backend::seek(dev, dstFd, 0, SEEK_CUR) : srcPos;
+
+            int64_t result = srcPos < 0 ? srcPos : (dstPos < 0 ? dstPos : 0);
+            while (result >= 0 && static_cast<size_t>(result) < len) {
+                const size_t chunk = std::min(size, len - static_cast<size_t>(result));
+                int64_t res        = Backend::seek(dev, srcFd, srcOffset + result, SEEK_SET);
+                ssize_t read       = 0;
+                if (res >= 0) {
+                    read = Backend::read(dev, srcFd, buffer, chunk);
+                    res  = read;
+                }
+                if (res > 0) {
+                    res = Backend::seek(dev, dstFd, dstOffset + result, SEEK_SET);
+                }
+                ssize_t written = 0;
+                while (res >= 0 && written < read) {
+                    const ssize_t cur = Backend::write(dev, dstFd, buffer + written, read - written);
+                    res               = cur > 0 ? cur : (cur < 0 ? cur : -EIO);
+                    written += cur > 0 ? cur : 0;
+                }
+                if (res < 0) {
+                    // Report the bytes that have been copied so far, if any.
+                    result = result > 0 ? result : res;
+                    break;
+                }
+                result += read;
+                if (static_cast<size_t>(read) < chunk) {
+                    // End of the source file.
+                    break;
+                }
+            }
+
+            if (srcPos >= 0) {
+                Backend::seek(dev, srcFd, srcPos, SEEK_SET);
+            }
+            if (dstPos >= 0 && dstFd != srcFd) {
+                Backend::seek(dev, dstFd, dstPos, SEEK_SET);
+            }
+            free(buffer);
+            internal::ReleaseLibraryMemory(size);
+            return result;
+        }
+    };
+} // namespace CR_DevoptabWrapper
+
+#endif // __cplusplus
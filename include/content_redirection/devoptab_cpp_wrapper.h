@@ -3,13 +3,27 @@
 #ifdef __cplusplus
 
 #include "defines.h"
+#include "devoptab_backend.h"
+#include "devoptab_content_cache.h"
+#include "devoptab_copy_range.h"
+#include "devoptab_dir_snapshot.h"
+#include "devoptab_read_ahead.h"
+#include "devoptab_stat_many.h"
+#include "devoptab_write_back.h"
+#include "io_scheduler.h"
+#include "slab_pool.h"
 
 #include <array>
 #include <cctype>
+#include <climits>
 #include <coreinit/debug.h>
+#include <cstddef>
 #include <cstring>
 #include <errno.h>
+#include <fcntl.h>
 #include <mutex>
+#include <new>
+#include <string>
 #include <sys/iosupport.h>
 #include <sys/reent.h>
 #include <sys/stat.h>
@@ -17,479 +31,480 @@
 #include <sys/time.h>
 #include <utility>
 
+/**
+ * @brief Optional features of the devoptab wrapper, see ContentRedirection_AddDeviceEx.
+ * The default constructed options behave like a plain ContentRedirection_AddDevice.
+ */
+struct ContentRedirectionDeviceOptions {
+    /**
+     * Size in bytes of the per-file write-back buffer. Small sequential or overlapping writes are merged in this buffer and
+     * written to the device in one call once it's full, or on fsync, ftruncate and close. Reads on the same file see the buffered data.
+     * Files opened read-only or with O_APPEND are never buffered. 0 disables write-back buffering.
+     */
+    size_t writeBackBufferSize = 0;
+
+    /**
+     * Optional, maps a range of an open file of the device into memory. See ContentRedirectionDeviceABI::map.
+     * Only useful for devices whose content already is in memory, e.g. a romfs image that has been loaded into RAM.
+     * "fileStruct" is the fileStruct of the device. Return -ENOTSUP for ranges that can't be mapped.
+     */
+    int (*map)(void *deviceData, void *fileStruct, int64_t offset, size_t len, const void **out) = nullptr;
+
+    /**
+     * Releases a pointer returned by "map". Has to be set if "map" is set.
+     */
+    int (*unmap)(void *deviceData, void *fileStruct, const void *ptr, size_t len) = nullptr;
+
+    /**
+     * Optional, native implementation of ContentRedirectionDeviceABI::copy_range. "srcFileStruct" and "dstFileStruct" are fileStructs of the device.
+     * If not set, copy_range is implemented via read and write of the device with a buffer of "copyRangeBufferSize" bytes.
+     */
+    int64_t (*copy_range)(void *deviceData, void *srcFileStruct, int64_t srcOffset, void *dstFileStruct, int64_t dstOffset, size_t len) = nullptr;
+
+    /**
+     * Size in bytes of the buffer used by copy_range if the device has no native implementation, e.g. 256 KiB.
+     * 0 doesn't export copy_range for such devices, the module copies via read and write of the device then.
+     */
+    size_t copyRangeBufferSize = 0;
+
+    /**
+     * Maximum size in bytes of a directory snapshot. If not 0, diropen reads the whole directory into memory and closes it on the device again.
+     * dirnext and dirreset are served from memory afterwards, so dirreset also works if the device doesn't implement it.
+     * Directories that don't fit, or whose listing fails midway, are streamed from the device after the entries that have been read.
+     * 0 disables directory snapshots.
+     */
+    size_t dirSnapshotMaxBytes = 0;
+
+    /**
+     * Lets the module allocate the per-handle state of this device from the slab pool of this lib, see "ContentRedirection_SlabAlloc".
+     * Exports alloc_file_struct and alloc_dir_struct, which needs a module that supports device version 4.
+     */
+    bool useSlabPool = false;
+
+    /**
+     * Number of file structs / dir structs of this device that are preallocated in the slab pool when the device is added.
+     * The pool grows on demand. Only used if "useSlabPool" is set.
+     */
+    uint32_t preallocatedFileStructs = 16;
+    uint32_t preallocatedDirStructs  = 4;
+
+    /**
+     * Size in bytes of each of the two readahead buffers of a file in streaming mode, see CR_DevoptabWrapper::ReadAheadBuffer.
+     * Only files opened read-only can switch to streaming mode. 0 disables readahead.
+     */
+    size_t readAheadBufferSize = 0;
+
+    /**
+     * Number of reads smaller than "readAheadBufferSize" without a seek in between, after which a file switches to streaming mode.
+     */
+    uint32_t readAheadSequentialReads = 4;
+
+    /**
+     * Optional, called when a file is opened read-only. Files for which it returns true switch to streaming mode with the first read,
+     * e.g. audio and video files identified by their extension.
+     */
+    bool (*isStreamingFile)(const char *path) = nullptr;
+
+    /**
+     * Maximum size in bytes of a file that is served from the content-hash cache of the lib, see CR_DevoptabWrapper::ContentCacheFile.
+     * Only files opened read-only use the cache, they don't use readahead. 0 disables the cache for this device.
+     */
+    size_t contentCacheMaxFileSize = 0;
+
+    /**
+     * Optional, native implementations of ContentRedirectionDeviceABI::openat, fstatat and diropenat. "dirStruct" and "parentDirStruct"
+     * are dirStructs of the device, "fileStruct" is a fileStruct of the device.
+     * The wrapper only exports openat, fstatat and diropenat if at least one of them is set, otherwise the module joins the paths itself.
+     * Entries without a hook join the path of the open directory and "path" and use open, stat and diropen of the device.
+     * For this the wrapper keeps the path of each open directory, joined paths that don't fit into PATH_MAX bytes fail with -ENAMETOOLONG.
+     * Not used if "dirSnapshotMaxBytes" is set, snapshots close the directory of the device after it has been read.
+     */
+    int (*openat)(void *deviceData, void *dirStruct, void *fileStruct, const char *path, int flags, uint32_t mode) = nullptr;
+    int (*fstatat)(void *deviceData, void *dirStruct, const char *path, CR_Stat *st)                               = nullptr;
+    int (*diropenat)(void *deviceData, void *parentDirStruct, void *dirStruct, const char *path)                  = nullptr;
+
+    /**
+     * Optional, native implementation of ContentRedirectionDeviceABI::stat_many.
+     * If not set and "statManyDirScanThreshold" is set, stat_many is implemented via stat and dirnext of the device, see CR_DevoptabWrapper::StatManyFallback.
+     * If neither is set, the wrapper doesn't export stat_many and the module calls stat for each path.
+     */
+    int (*stat_many)(void *deviceData, const char *const *paths, uint32_t count, CR_StatResult *results) = nullptr;
+
+    /**
+     * Minimum number of paths in one directory for which the stat_many fallback reads the directory once via dirnext instead of
+     * calling stat for each path. Only set it if dirnext of the device returns the same information as stat. 0 disables the fallback.
+     */
+    uint32_t statManyDirScanThreshold = 0;
+
+    /**
+     * Uses the metadata cache of the lib for stat and, if "dirSnapshotMaxBytes" is set, for directory listings, see "ContentRedirection_LoadMetadataCache".
+     * Creating, modifying or removing files via this device invalidates the affected entries.
+     */
+    bool metadataCache = false;
+};
+
 namespace CR_DevoptabWrapper {
 #ifndef CR_MAX_RUNTIME_DEVICES
 #define CR_MAX_RUNTIME_DEVICES 4
 #endif
     constexpr size_t MAX_RUNTIME_DEVICES = CR_MAX_RUNTIME_DEVICES;
 
-    struct Backend {
-        static void stat_to_cr_stat(const struct stat &src, CR_Stat *dst) {
-            if (!dst) {
-                return;
-            }
-            dst->dev     = src.st_dev;
-            dst->ino     = src.st_ino;
-            dst->mode    = src.st_mode;
-            dst->nlink   = src.st_nlink;
-            dst->uid     = src.st_uid;
-            dst->gid     = src.st_gid;
-            dst->rdev    = src.st_rdev;
-            dst->size    = src.st_size;
-            dst->atime   = src.st_atime;
-            dst->mtime   = src.st_mtime;
-            dst->ctime   = src.st_ctime;
-            dst->blksize = src.st_blksize;
-            dst->blocks  = src.st_blocks;
-        }
-
-        static void statvfs_to_cr_statvfs(const struct statvfs &src, CR_Statvfs *dst) {
-            if (!dst) {
-                return;
-            }
-            dst->bsize   = src.f_bsize;
-            dst->frsize  = src.f_frsize;
-            dst->blocks  = src.f_blocks;
-            dst->bfree   = src.f_bfree;
-            dst->bavail  = src.f_bavail;
-            dst->files   = src.f_files;
-            dst->ffree   = src.f_ffree;
-            dst->favail  = src.f_favail;
-            dst->fsid    = src.f_fsid;
-            dst->flag    = src.f_flag;
-            dst->namemax = src.f_namemax;
-        }
-
-        static int get_error(struct _reent *r) {
-            return r->_errno != 0 ? -(r->_errno) : -EIO;
-        }
-
-        static struct _reent *get_reent(const devoptab_t *dev) {
-            auto *r       = _REENT;
-            r->deviceData = dev->deviceData;
-            return r;
-        }
-
-        static int open(const devoptab_t *dev, void *fileStruct, const char *path, int flags, uint32_t mode) {
-            if (!dev || !dev->open_r) {
-                return -ENOSYS;
-            }
-            auto *r       = get_reent(dev);
-            const int res = dev->open_r(r, fileStruct, path, flags, static_cast<int>(mode));
-            if (res == -1) {
-                return get_error(r);
-            }
-            return res;
-        }
+    /**
+     * @brief Wrapper state which is stored in front of the fileStruct of the wrapped device.
+     * Only used if the device was added with options that need per-file state.
+     */
+    struct FileState {
+        WriteBackBuffer writeBack;
+        ReadAheadBuffer readAhead;
+        ContentCacheFile contentCache;
+        std::string metadataPath; /**< Full path of a file opened for writing, invalidated in the metadata cache on close */
+    };
 
-        static int close(const devoptab_t *dev, void *fd) {
-            if (!dev || !dev->close_r) {
-                return -ENOSYS;
-            }
-            auto *r       = get_reent(dev);
-            const int res = dev->close_r(r, fd);
-            if (res == -1) {
-                return get_error(r);
-            }
-            return res;
-        }
+    constexpr size_t FILE_STATE_SIZE = (sizeof(FileState) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
 
-        static ssize_t write(const devoptab_t *dev, void *fd, const char *ptr, size_t len) {
-            if (!dev || !dev->write_r) {
-                return -ENOSYS;
-            }
-            auto *r           = get_reent(dev);
-            const ssize_t res = dev->write_r(r, fd, ptr, len);
-            if (res == -1) {
-                return get_error(r);
-            }
-            return res;
-        }
-
-        static ssize_t read(const devoptab_t *dev, void *fd, char *ptr, size_t len) {
-            if (!dev || !dev->read_r) {
-                return -ENOSYS;
-            }
-            auto *r           = get_reent(dev);
-            const ssize_t res = dev->read_r(r, fd, ptr, len);
-            if (res == -1) {
-                return get_error(r);
-            }
-            return res;
-        }
+    /**
+     * @brief Wrapper state which is stored in front of the dirStruct of the wrapped device.
+     * Only used if the device was added with directory snapshots or openat, fstatat and diropenat hooks.
+     */
+    struct DirState {
+        DirSnapshot snapshot;
+        char *path = nullptr; /**< Path the directory has been opened with, allocated from the slab pool. Only set if openat, fstatat and diropenat are exported */
 
-        static int64_t seek(const devoptab_t *dev, void *fd, int64_t pos, int dir) {
-            if (!dev || !dev->seek_r) {
-                return -ENOSYS;
-            }
-            auto *r         = get_reent(dev);
-            const off_t res = dev->seek_r(r, fd, static_cast<off_t>(pos), dir);
-            if (res == static_cast<off_t>(-1)) {
-                return get_error(r);
-            }
-            return static_cast<int64_t>(res);
+        ~DirState() {
+            ContentRedirection_SlabFree(path);
         }
+    };
 
-        static int fstat(const devoptab_t *dev, void *fd, CR_Stat *st) {
-            if (!dev || !dev->fstat_r) {
-                return -ENOSYS;
-            }
-            auto *r = get_reent(dev);
-            struct stat local_st {};
-            const int res = dev->fstat_r(r, fd, &local_st);
-            if (res == -1) {
-                return get_error(r);
-            }
-            stat_to_cr_stat(local_st, st);
-            return res;
-        }
+    constexpr size_t DIR_STATE_SIZE = (sizeof(DirState) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
 
-        static int stat(const devoptab_t *dev, const char *file, CR_Stat *st) {
-            if (!dev || !dev->stat_r) {
-                return -ENOSYS;
-            }
-            auto *r = get_reent(dev);
-            struct stat local_st {};
-            const int res = dev->stat_r(r, file, &local_st);
-            if (res == -1) {
-                return get_error(r);
-            }
-            stat_to_cr_stat(local_st, st);
-            return res;
-        }
+    template<size_t Slot>
+    struct RuntimeSlot {
+        inline static const devoptab_t *dev                   = nullptr;
+        inline static ContentRedirectionDeviceABI abi         = {};
+        inline static int deviceId                            = -1;
+        inline static ContentRedirectionDeviceOptions options = {};
+        inline static size_t fileStateSize                    = 0;
+        inline static size_t dirStateSize                     = 0;
+        inline static bool snapshots                          = false;
+        inline static bool dirPaths                           = false;
 
-        static int link(const devoptab_t *dev, const char *existing, const char *newLink) {
-            if (!dev || !dev->link_r) {
-                return -ENOSYS;
-            }
-            auto *r       = get_reent(dev);
-            const int res = dev->link_r(r, existing, newLink);
-            if (res == -1) {
-                return get_error(r);
-            }
-            return res;
+        static FileState *file_state(void *fd) {
+            return fileStateSize != 0 ? static_cast<FileState *>(fd) : nullptr;
         }
 
-        static int unlink(const devoptab_t *dev, const char *name) {
-            if (!dev || !dev->unlink_r) {
-                return -ENOSYS;
-            }
-            auto *r       = get_reent(dev);
-            const int res = dev->unlink_r(r, name);
-            if (res == -1) {
-                return get_error(r);
-            }
-            return res;
+        static void *dev_fd(void *fd) {
+            return static_cast<char *>(fd) + fileStateSize;
         }
 
-        static int chdir(const devoptab_t *dev, const char *name) {
-            if (!dev || !dev->chdir_r) {
-                return -ENOSYS;
-            }
-            auto *r       = get_reent(dev);
-            const int res = dev->chdir_r(r, name);
-            if (res == -1) {
-                return get_error(r);
-            }
-            return res;
+        static DirState *dir_state(void *dirStruct) {
+            return dirStateSize != 0 ? static_cast<DirState *>(dirStruct) : nullptr;
         }
 
-        static int rename(const devoptab_t *dev, const char *oldName, const char *newName) {
-            if (!dev || !dev->rename_r) {
-                return -ENOSYS;
-            }
-            auto *r       = get_reent(dev);
-            const int res = dev->rename_r(r, oldName, newName);
-            if (res == -1) {
-                return get_error(r);
-            }
-            return res;
+        static void *dev_dir(void *dirStruct) {
+            return static_cast<char *>(dirStruct) + dirStateSize;
         }
 
-        static int mkdir(const devoptab_t *dev, const char *path, uint32_t mode) {
-            if (!dev || !dev->mkdir_r) {
-                return -ENOSYS;
-            }
-            auto *r       = get_reent(dev);
-            const int res = dev->mkdir_r(r, path, static_cast<int>(mode));
-            if (res == -1) {
-                return get_error(r);
+        /**
+         * Joins the path of an open directory and a path relative to it into "out", which holds PATH_MAX bytes.
+         * @return 0 on success, -ENAMETOOLONG if the joined path doesn't fit.
+         */
+        static int join_path(void *dirStruct, const char *path, char *out) {
+            const char *dirPath = dir_state(dirStruct)->path;
+            while (*path == '/') {
+                path++;
             }
-            return res;
-        }
-
-        static int diropen(const devoptab_t *dev, int deviceId, void *dirStruct, const char *path) {
-            if (!dev || !dev->diropen_r) {
-                return -ENOSYS;
+            const size_t dirLength  = strlen(dirPath);
+            const size_t pathLength = strlen(path);
+            const bool addSlash     = dirLength == 0 || dirPath[dirLength - 1] != '/';
+            if (dirLength + addSlash + pathLength >= PATH_MAX) {
+                return -ENAMETOOLONG;
             }
-            auto *r = get_reent(dev);
-            DIR_ITER dummy{};
-            dummy.device    = deviceId;
-            dummy.dirStruct = dirStruct;
-
-            if (dev->diropen_r(r, &dummy, path) == nullptr) {
-                return get_error(r);
+            memcpy(out, dirPath, dirLength);
+            if (addSlash) {
+                out[dirLength] = '/';
             }
+            memcpy(out + dirLength + addSlash, path, pathLength + 1);
             return 0;
         }
 
-        static int dirreset(const devoptab_t *dev, int deviceId, void *dirStruct) {
-            if (!dev || !dev->dirreset_r) {
-                return -ENOSYS;
-            }
-            auto *r = get_reent(dev);
-            DIR_ITER dummy{};
-            dummy.device    = deviceId;
-            dummy.dirStruct = dirStruct;
-
-            const int res = dev->dirreset_r(r, &dummy);
-            if (res == -1) {
-                return get_error(r);
-            }
-            return res;
-        }
-
-        static int dirnext(const devoptab_t *dev, int deviceId, void *dirStruct, char *filename, CR_Stat *filestat) {
-            if (!dev || !dev->dirnext_r) {
-                return -ENOSYS;
-            }
-            auto *r = get_reent(dev);
-            DIR_ITER dummy{};
-            dummy.device    = deviceId;
-            dummy.dirStruct = dirStruct;
-            struct stat local_st {};
-            const int res = dev->dirnext_r(r, &dummy, filename, &local_st);
-            if (res == -1) {
-                return get_error(r);
-            }
-            stat_to_cr_stat(local_st, filestat);
-            return res;
-        }
-
-        static int dirclose(const devoptab_t *dev, int deviceId, void *dirStruct) {
-            if (!dev || !dev->dirclose_r) {
-                return -ENOSYS;
-            }
-            auto *r = get_reent(dev);
-            DIR_ITER dummy{};
-            dummy.device    = deviceId;
-            dummy.dirStruct = dirStruct;
-            const int res   = dev->dirclose_r(r, &dummy);
-            if (res == -1) {
-                return get_error(r);
-            }
-            return res;
-        }
-
-        static int statvfs(const devoptab_t *dev, const char *path, CR_Statvfs *buf) {
-            if (!dev || !dev->statvfs_r) {
-                return -ENOSYS;
-            }
-            auto *r = get_reent(dev);
-            struct statvfs local_buf {};
-            const int res = dev->statvfs_r(r, path, &local_buf);
-            if (res == -1) {
-                return get_error(r);
+        /**
+         * Constructs the state of a directory that is opened with "path", the path is only kept if openat, fstatat and diropenat are exported.
+         * @return 0 on success, -ENOMEM if the path can't be allocated.
+         */
+        static int init_dir_state(DirState *state, const char *path) {
+            new (state) DirState;
+            if (dirPaths) {
+                const size_t length = strlen(path);
+                state->path         = static_cast<char *>(ContentRedirection_SlabAlloc(static_cast<uint32_t>(length + 1)));
+                if (!state->path) {
+                    state->~DirState();
+                    return -ENOMEM;
+                }
+                memcpy(state->path, path, length + 1);
             }
-            statvfs_to_cr_statvfs(local_buf, buf);
-            return res;
+            return 0;
         }
 
-        static int ftruncate(const devoptab_t *dev, void *fd, int64_t len) {
-            if (!dev || !dev->ftruncate_r) {
-                return -ENOSYS;
+        /**
+         * Full path including the device name, used as key of the caches of the lib. Empty for paths relative to the working directory.
+         */
+        static std::string cache_key(const char *path) {
+            if (strchr(path, ':') != nullptr) {
+                return path;
             }
-            auto *r       = get_reent(dev);
-            const int res = dev->ftruncate_r(r, fd, static_cast<off_t>(len));
-            if (res == -1) {
-                return get_error(r);
+            if (path[0] != '/') {
+                return {};
             }
-            return res;
+            return std::string(dev->name) + ":" + path;
         }
 
-        static int fsync(const devoptab_t *dev, void *fd) {
-            if (!dev || !dev->fsync_r) {
-                return -ENOSYS;
-            }
-            auto *r       = get_reent(dev);
-            const int res = dev->fsync_r(r, fd);
-            if (res == -1) {
-                return get_error(r);
+        static void invalidate_metadata(const char *path) {
+            if (options.metadataCache) {
+                const std::string key = cache_key(path);
+                if (!key.empty()) {
+                    internal::InvalidateCachedMetadata(key.c_str());
+                }
             }
-            return res;
         }
 
-        static int chmod(const devoptab_t *dev, const char *path, uint32_t mode) {
-            if (!dev || !dev->chmod_r) {
-                return -ENOSYS;
+        /**
+         * Makes sure the cached metadata of a directory may be used, by checking its fingerprint once.
+         */
+        static bool metadata_dir_valid(const std::string &dirPath) {
+            if (internal::GetMetadataDirState(dirPath.c_str()) == internal::MetadataDirState::Valid) {
+                return true;
             }
-            auto *r       = get_reent(dev);
-            const int res = dev->chmod_r(r, path, static_cast<mode_t>(mode));
-            if (res == -1) {
-                return get_error(r);
+            CR_Stat st{};
+            if (Backend::stat(dev, dirPath.c_str(), &st) < 0 || !S_ISDIR(st.mode)) {
+                return false;
             }
-            return res;
+            internal::ValidateMetadataDir(dirPath.c_str(), st.mtime);
+            return true;
         }
 
-        static int fchmod(const devoptab_t *dev, void *fd, uint32_t mode) {
-            if (!dev || !dev->fchmod_r) {
-                return -ENOSYS;
+        /**
+         * stat of the device, served from the metadata cache if enabled. Results and misses are added to the cache.
+         */
+        static int stat_path(const char *path, CR_Stat *st) {
+            if (!options.metadataCache) {
+                return Backend::stat(dev, path, st);
             }
-            auto *r       = get_reent(dev);
-            const int res = dev->fchmod_r(r, fd, static_cast<mode_t>(mode));
-            if (res == -1) {
-                return get_error(r);
+            const std::string key = cache_key(path);
+            const size_t slash    = key.find_last_of('/');
+            if (key.empty() || slash == std::string::npos || slash + 1 == key.size()) {
+                return Backend::stat(dev, path, st);
             }
-            return res;
-        }
-
-        static int rmdir(const devoptab_t *dev, const char *name) {
-            if (!dev || !dev->rmdir_r) {
-                return -ENOSYS;
-            }
-            auto *r = get_reent(dev);
-            int res = dev->rmdir_r(r, name);
-            if (res == -1) {
-                return get_error(r);
+            const bool isRoot = key[slash - 1] == ':';
+            if (!metadata_dir_valid(key.substr(0, isRoot ? slash + 1 : slash))) {
+                return Backend::stat(dev, path, st);
             }
-            return res;
-        }
-
-        static int lstat(const devoptab_t *dev, const char *file, CR_Stat *st) {
-            if (!dev || !dev->lstat_r) {
-                return -ENOSYS;
+            int32_t cached;
+            if (internal::LookupCachedStat(key.c_str(), &cached, st)) {
+                return cached;
             }
-            auto *r = get_reent(dev);
-            struct stat local_st {};
-            const int res = dev->lstat_r(r, file, &local_st);
-            if (res == -1) {
-                return get_error(r);
+            const int res = Backend::stat(dev, path, st);
+            if (res == 0 || res == -ENOENT) {
+                internal::StoreCachedStat(key.c_str(), res, st);
             }
-            stat_to_cr_stat(local_st, st);
             return res;
         }
 
-        static int utimes(const devoptab_t *dev, const char *filename, const CR_Timeval times[2]) {
-            if (!dev || !dev->utimes_r) {
-                return -ENOSYS;
-            }
-            auto *r = get_reent(dev);
-
-            int res;
-            if (!times) {
-                res = dev->utimes_r(r, filename, nullptr);
-            } else {
-                timeval local_times[2];
-                local_times[0].tv_sec  = static_cast<time_t>(times[0].tv_sec);
-                local_times[0].tv_usec = static_cast<suseconds_t>(times[0].tv_usec);
-                local_times[1].tv_sec  = static_cast<time_t>(times[1].tv_sec);
-                local_times[1].tv_usec = static_cast<suseconds_t>(times[1].tv_usec);
-                res                    = dev->utimes_r(r, filename, local_times);
-            }
-            if (res == -1) {
-                return get_error(r);
+        /**
+         * Opens a file via open of the device, or via the native openat if "devDir" is set. "fullPath" is the path including all directories.
+         */
+        static int open_file(void *devDir, void *fileStruct, const char *path, const char *fullPath, int flags, uint32_t mode) {
+            ForegroundIO io;
+            auto devOpen = [&](void *devFd) {
+                return devDir ? options.openat(dev->deviceData, devDir, devFd, path, flags, mode) : Backend::open(dev, devFd, path, flags, mode);
+            };
+            auto *state = file_state(fileStruct);
+            if (!state) {
+                return devOpen(fileStruct);
+            }
+            new (state) FileState();
+            if (options.metadataCache && ((flags & O_ACCMODE) != O_RDONLY || (flags & (O_CREAT | O_TRUNC)) != 0)) {
+                state->metadataPath = cache_key(fullPath);
+            }
+            // Writes to a read-only file have to reach the device, which rejects them with EBADF.
+            const bool bufferWrites = (flags & O_ACCMODE) != O_RDONLY && (flags & O_APPEND) == 0;
+            state->writeBack.init(bufferWrites ? options.writeBackBufferSize : 0);
+            if ((flags & O_ACCMODE) == O_RDONLY && dev->seek_r) {
+                const bool hint = options.isStreamingFile && options.isStreamingFile(fullPath);
+                state->readAhead.init(dev, dev_fd(fileStruct), options.readAheadBufferSize, options.readAheadSequentialReads, hint);
+            }
+            const int res = devOpen(dev_fd(fileStruct));
+            if (!state->metadataPath.empty()) {
+                internal::InvalidateCachedMetadata(state->metadataPath.c_str());
+            }
+            if (res < 0) {
+                state->~FileState();
+            } else if ((flags & O_ACCMODE) == O_RDONLY && options.contentCacheMaxFileSize != 0 && dev->fstat_r && dev->seek_r) {
+                state->contentCache.init(dev, dev_fd(fileStruct), fullPath, options.contentCacheMaxFileSize);
             }
             return res;
         }
 
-        static int64_t fpathconf(const devoptab_t *dev, void *fd, int name) {
-            if (!dev || !dev->fpathconf_r) {
-                return -ENOSYS;
-            }
-            auto *r        = get_reent(dev);
-            const long res = dev->fpathconf_r(r, fd, name);
-            if (res == -1) {
-                return get_error(r);
-            }
-            return res;
+        static int open(void *deviceData, void *fileStruct, const char *path, int flags, uint32_t mode) {
+            (void) deviceData;
+            return open_file(nullptr, fileStruct, path, path, flags, mode);
         }
 
-        static int64_t pathconf(const devoptab_t *dev, const char *path, int name) {
-            if (!dev || !dev->pathconf_r) {
-                return -ENOSYS;
+        static int openat(void *deviceData, void *dirStruct, void *fileStruct, const char *path, int flags, uint32_t mode) {
+            (void) deviceData;
+            char fullPath[PATH_MAX];
+            const int res = join_path(dirStruct, path, fullPath);
+            if (res < 0) {
+                return res;
             }
-            auto *r        = get_reent(dev);
-            const long res = dev->pathconf_r(r, path, name);
-            if (res == -1) {
-                return get_error(r);
+            if (options.openat && !snapshots) {
+                return open_file(dev_dir(dirStruct), fileStruct, path, fullPath, flags, mode);
             }
-            return static_cast<int64_t>(res);
+            return open_file(nullptr, fileStruct, fullPath, fullPath, flags, mode);
         }
 
-        static int symlink(const devoptab_t *dev, const char *target, const char *linkpath) {
-            if (!dev || !dev->symlink_r) {
-                return -ENOSYS;
-            }
-            auto *r       = get_reent(dev);
-            const int res = dev->symlink_r(r, target, linkpath);
-            if (res == -1) {
-                return get_error(r);
+        /**
+         * Brings the device fd up to date with the buffered state, has to be called before the device fd is used directly.
+         */
+        static int sync_state(void *fd) {
+            auto *state = file_state(fd);
+            if (!state) {
+                return 0;
             }
-            return res;
-        }
-
-        static ssize_t readlink(const devoptab_t *dev, const char *path, char *buf, size_t bufsiz) {
-            if (!dev || !dev->readlink_r) {
-                return -ENOSYS;
+            int res = state->contentCache.sync();
+            if (res < 0) {
+                return res;
             }
-            auto *r           = get_reent(dev);
-            const ssize_t res = dev->readlink_r(r, path, buf, bufsiz);
-            if (res == -1) {
-                return get_error(r);
+            res = state->readAhead.sync();
+            if (res < 0) {
+                return res;
             }
-            return res;
-        }
-    };
-
-    template<size_t Slot>
-    struct RuntimeSlot {
-        inline static const devoptab_t *dev           = nullptr;
-        inline static ContentRedirectionDeviceABI abi = {};
-        inline static int deviceId                    = -1;
-
-        static int open(void *deviceData, void *fileStruct, const char *path, int flags, uint32_t mode) {
-            (void) deviceData;
-            return Backend::open(dev, fileStruct, path, flags, mode);
+            return state->writeBack.flush(dev, dev_fd(fd));
         }
 
         static int close(void *deviceData, void *fd) {
             (void) deviceData;
-            return Backend::close(dev, fd);
+            auto *state = file_state(fd);
+            if (!state) {
+                return Backend::close(dev, fd);
+            }
+            state->contentCache.release();
+            state->readAhead.release();
+            const int flushRes = state->writeBack.flush(dev, dev_fd(fd));
+            state->writeBack.release();
+            const int res = Backend::close(dev, dev_fd(fd));
+            if (!state->metadataPath.empty()) {
+                internal::InvalidateCachedMetadata(state->metadataPath.c_str());
+            }
+            state->~FileState();
+            return flushRes < 0 ? flushRes : res;
         }
 
         static ssize_t write(void *deviceData, void *fd, const char *ptr, size_t len) {
             (void) deviceData;
-            return Backend::write(dev, fd, ptr, len);
+            ForegroundIO io;
+            auto *state = file_state(fd);
+            if (!state) {
+                const ssize_t res = Backend::write(dev, fd, ptr, len);
+                io.bytes          = res > 0 ? static_cast<uint32_t>(res) : 0;
+                return res;
+            }
+            const int syncRes = state->readAhead.sync();
+            if (syncRes < 0) {
+                return syncRes;
+            }
+            const ssize_t res = state->writeBack.write(dev, dev_fd(fd), ptr, len);
+            io.bytes          = res > 0 ? static_cast<uint32_t>(res) : 0;
+            return res;
         }
 
         static ssize_t read(void *deviceData, void *fd, char *ptr, size_t len) {
             (void) deviceData;
-            return Backend::read(dev, fd, ptr, len);
+            auto *state = file_state(fd);
+            if (state && state->contentCache.enabled()) {
+                return state->contentCache.read(ptr, len);
+            }
+            ForegroundIO io;
+            ssize_t res;
+            if (!state) {
+                res = Backend::read(dev, fd, ptr, len);
+            } else if (state->readAhead.enabled()) {
+                res = state->readAhead.read(ptr, len);
+            } else {
+                res = state->writeBack.read(dev, dev_fd(fd), ptr, len);
+            }
+            io.bytes = res > 0 ? static_cast<uint32_t>(res) : 0;
+            return res;
         }
 
         static int64_t seek(void *deviceData, void *fd, int64_t pos, int dir) {
             (void) deviceData;
+            auto *state = file_state(fd);
+            if (state && state->contentCache.enabled()) {
+                return state->contentCache.seek(pos, dir);
+            }
+            if (state && state->readAhead.enabled()) {
+                return state->readAhead.seek(pos, dir);
+            }
+            if (state) {
+                return state->writeBack.seek(dev, dev_fd(fd), pos, dir);
+            }
             return Backend::seek(dev, fd, pos, dir);
         }
 
         static int fstat(void *deviceData, void *fd, CR_Stat *st) {
             (void) deviceData;
+            auto *state = file_state(fd);
+            if (state && state->contentCache.enabled()) {
+                return state->contentCache.fstat(st);
+            }
+            if (state && state->readAhead.enabled()) {
+                return state->readAhead.fstat(st);
+            }
+            if (state) {
+                return state->writeBack.fstat(dev, dev_fd(fd), st);
+            }
             return Backend::fstat(dev, fd, st);
         }
 
         static int stat(void *deviceData, const char *file, CR_Stat *st) {
             (void) deviceData;
-            return Backend::stat(dev, file, st);
+            ForegroundIO io;
+            return stat_path(file, st);
+        }
+
+        static int fstatat(void *deviceData, void *dirStruct, const char *path, CR_Stat *st) {
+            ForegroundIO io;
+            if (options.fstatat && !snapshots) {
+                return options.fstatat(deviceData, dev_dir(dirStruct), path, st);
+            }
+            char fullPath[PATH_MAX];
+            const int res = join_path(dirStruct, path, fullPath);
+            if (res < 0) {
+                return res;
+            }
+            return stat_path(fullPath, st);
+        }
+
+        static int stat_many(void *deviceData, const char *const *paths, uint32_t count, CR_StatResult *results) {
+            ForegroundIO io;
+            if (options.stat_many) {
+                return options.stat_many(deviceData, paths, count, results);
+            }
+            return StatManyFallback::stat_many(dev, deviceId, options.statManyDirScanThreshold, paths, count, results);
         }
 
         static int link(void *deviceData, const char *existing, const char *newLink) {
             (void) deviceData;
-            return Backend::link(dev, existing, newLink);
+            const int res = Backend::link(dev, existing, newLink);
+            invalidate_metadata(newLink);
+            return res;
         }
 
         static int unlink(void *deviceData, const char *name) {
             (void) deviceData;
-            return Backend::unlink(dev, name);
+            const int res = Backend::unlink(dev, name);
+            invalidate_metadata(name);
+            return res;
         }
         static int chdir(void *deviceData, const char *name) {
             (void) deviceData;
@@ -498,32 +513,114 @@ namespace CR_DevoptabWrapper {
 
         static int rename(void *deviceData, const char *oldName, const char *newName) {
             (void) deviceData;
-            return Backend::rename(dev, oldName, newName);
+            const int res = Backend::rename(dev, oldName, newName);
+            invalidate_metadata(oldName);
+            invalidate_metadata(newName);
+            return res;
         }
 
         static int mkdir(void *deviceData, const char *path, uint32_t mode) {
             (void) deviceData;
-            return Backend::mkdir(dev, path, mode);
+            const int res = Backend::mkdir(dev, path, mode);
+            invalidate_metadata(path);
+            return res;
         }
 
         static int diropen(void *deviceData, void *dirStruct, const char *path) {
             (void) deviceData;
-            return Backend::diropen(dev, deviceId, dirStruct, path);
+            ForegroundIO io;
+            auto *state = dir_state(dirStruct);
+            if (!state) {
+                return Backend::diropen(dev, deviceId, dirStruct, path);
+            }
+            int res = init_dir_state(state, path);
+            if (res < 0) {
+                return res;
+            }
+            if (snapshots && options.metadataCache) {
+                res = open_snapshot_cached(state, dev_dir(dirStruct), path);
+            } else if (snapshots) {
+                res = state->snapshot.open(dev, deviceId, dev_dir(dirStruct), path, options.dirSnapshotMaxBytes);
+            } else {
+                res = Backend::diropen(dev, deviceId, dev_dir(dirStruct), path);
+            }
+            if (res < 0) {
+                state->~DirState();
+            }
+            return res;
+        }
+
+        /**
+         * Serves the snapshot from the listing in the metadata cache, or adds the listing to the cache once it has been read from the device.
+         */
+        static int open_snapshot_cached(DirState *state, void *devDir, const char *path) {
+            const std::string key = cache_key(path);
+            if (key.empty() || !metadata_dir_valid(key)) {
+                return state->snapshot.open(dev, deviceId, devDir, path, options.dirSnapshotMaxBytes);
+            }
+            if (state->snapshot.open_cached(key.c_str())) {
+                return 0;
+            }
+            const int res = state->snapshot.open(dev, deviceId, devDir, path, options.dirSnapshotMaxBytes);
+            if (res == 0 && !state->snapshot.streaming) {
+                internal::StoreCachedListing(key.c_str(), state->snapshot.arena, state->snapshot.used);
+            }
+            return res;
+        }
+
+        static int diropenat(void *deviceData, void *parentDirStruct, void *dirStruct, const char *path) {
+            char fullPath[PATH_MAX];
+            int res = join_path(parentDirStruct, path, fullPath);
+            if (res < 0) {
+                return res;
+            }
+            if (!options.diropenat || snapshots) {
+                return diropen(deviceData, dirStruct, fullPath);
+            }
+            ForegroundIO io;
+            auto *state = dir_state(dirStruct);
+            res         = init_dir_state(state, fullPath);
+            if (res < 0) {
+                return res;
+            }
+            res = options.diropenat(deviceData, dev_dir(parentDirStruct), dev_dir(dirStruct), path);
+            if (res < 0) {
+                state->~DirState();
+            }
+            return res;
         }
 
         static int dirreset(void *deviceData, void *dirStruct) {
             (void) deviceData;
-            return Backend::dirreset(dev, deviceId, dirStruct);
+            if (snapshots) {
+                return dir_state(dirStruct)->snapshot.reset(dev, deviceId, dev_dir(dirStruct));
+            }
+            return Backend::dirreset(dev, deviceId, dev_dir(dirStruct));
         }
 
         static int dirnext(void *deviceData, void *dirStruct, char *filename, CR_Stat *filestat) {
             (void) deviceData;
-            return Backend::dirnext(dev, deviceId, dirStruct, filename, filestat);
+            ForegroundIO io;
+            if (snapshots) {
+                return dir_state(dirStruct)->snapshot.next(dev, deviceId, dev_dir(dirStruct), filename, filestat);
+            }
+            return Backend::dirnext(dev, deviceId, dev_dir(dirStruct), filename, filestat);
         }
 
         static int dirclose(void *deviceData, void *dirStruct) {
             (void) deviceData;
-            return Backend::dirclose(dev, deviceId, dirStruct);
+            auto *state = dir_state(dirStruct);
+            if (!state) {
+                return Backend::dirclose(dev, deviceId, dirStruct);
+            }
+            int res;
+            if (snapshots) {
+                res = state->snapshot.close(dev, deviceId, dev_dir(dirStruct));
+            } else {
+                res = Backend::dirclose(dev, deviceId, dev_dir(dirStruct));
+            }
+            state->~DirState();
+            return res;
         }
 
         static int statvfs(void *deviceData, const char *path, CR_Statvfs *buf) {
@@ -533,42 +630,65 @@ namespace CR_DevoptabWrapper {
 
         static int ftruncate(void *deviceData, void *fd, int64_t len) {
             (void) deviceData;
-            return Backend::ftruncate(dev, fd, len);
+            const int res = sync_state(fd);
+            if (res < 0) {
+                return res;
+            }
+            return Backend::ftruncate(dev, dev_fd(fd), len);
         }
 
         static int fsync(void *deviceData, void *fd) {
             (void) deviceData;
-            return Backend::fsync(dev, fd);
+            const int res = sync_state(fd);
+            if (res < 0) {
+                return res;
+            }
+            return Backend::fsync(dev, dev_fd(fd));
         }
 
         static int chmod(void *deviceData, const char *path, uint32_t mode) {
             (void) deviceData;
-            return Backend::chmod(dev, path, mode);
+            const int res = Backend::chmod(dev, path, mode);
+            invalidate_metadata(path);
+            return res;
         }
 
         static int fchmod(void *deviceData, void *fd, uint32_t mode) {
             (void) deviceData;
-            return Backend::fchmod(dev, fd, mode);
+            const int res = sync_state(fd);
+            if (res < 0) {
+                return res;
+            }
+            return Backend::fchmod(dev, dev_fd(fd), mode);
         }
 
         static int rmdir(void *deviceData, const char *name) {
             (void) deviceData;
-            return Backend::rmdir(dev, name);
+            const int res = Backend::rmdir(dev, name);
+            invalidate_metadata(name);
+            return res;
         }
 
         static int lstat(void *deviceData, const char *file, CR_Stat *st) {
             (void) deviceData;
+            ForegroundIO io;
             return Backend::lstat(dev, file, st);
         }
 
         static int utimes(void *deviceData, const char *filename, const CR_Timeval times[2]) {
             (void) deviceData;
-            return Backend::utimes(dev, filename, times);
+            const int res = Backend::utimes(dev, filename, times);
+            invalidate_metadata(filename);
+            return res;
         }
 
         static int64_t fpathconf(void *deviceData, void *fd, int name) {
             (void) deviceData;
-            return Backend::fpathconf(dev, fd, name);
+            const int res = sync_state(fd);
+            if (res < 0) {
+                return res;
+            }
+            return Backend::fpathconf(dev, dev_fd(fd), name);
         }
 
         static int64_t pathconf(void *deviceData, const char *path, int name) {
@@ -578,7 +698,9 @@ namespace CR_DevoptabWrapper {
 
         static int symlink(void *deviceData, const char *target, const char *linkpath) {
             (void) deviceData;
-            return Backend::symlink(dev, target, linkpath);
+            const int res = Backend::symlink(dev, target, linkpath);
+            invalidate_metadata(linkpath);
+            return res;
         }
 
         static ssize_t readlink(void *deviceData, const char *path, char *buf, size_t bufsiz) {
@@ -586,13 +708,60 @@ namespace CR_DevoptabWrapper {
             return Backend::readlink(dev, path, buf, bufsiz);
         }
 
-        static ContentRedirectionDeviceABI *bind(const devoptab_t *device) {
-            dev              = device;
+        static int map(void *deviceData, void *fd, int64_t offset, size_t len, const void **out) {
+            // The mapping has to contain the buffered writes.
+            const int res = sync_state(fd);
+            if (res < 0) {
+                return res;
+            }
+            return options.map(deviceData, dev_fd(fd), offset, len, out);
+        }
+
+        static int unmap(void *deviceData, void *fd, const void *ptr, size_t len) {
+            return options.unmap(deviceData, dev_fd(fd), ptr, len);
+        }
+
+        static int64_t copy_range(void *deviceData, void *srcFd, int64_t srcOffset, void *dstFd, int64_t dstOffset, size_t len) {
+            for (void *fd : {srcFd, dstFd}) {
+                const int res = sync_state(fd);
+                if (res < 0) {
+                    return res;
+                }
+            }
+            if (options.copy_range) {
+                return options.copy_range(deviceData, dev_fd(srcFd), srcOffset, dev_fd(dstFd), dstOffset, len);
+            }
+            return CopyRangeFallback::copy(dev, options.copyRangeBufferSize, dev_fd(srcFd), srcOffset, dev_fd(dstFd), dstOffset, len);
+        }
+
+        static void *alloc_file_struct(void *deviceData) {
+            (void) deviceData;
+            return ContentRedirection_SlabAlloc(abi.structSize);
+        }
+
+        static void *alloc_dir_struct(void *deviceData) {
+            (void) deviceData;
+            return ContentRedirection_SlabAlloc(abi.dirStateSize);
+        }
+
+        static void free_struct(void *deviceData, void *ptr) {
+            (void) deviceData;
+            ContentRedirection_SlabFree(ptr);
+        }
+
+        static ContentRedirectionDeviceABI *bind(const devoptab_t *device, const ContentRedirectionDeviceOptions &deviceOptions) {
+            dev           = device;
+            options       = deviceOptions;
+            fileStateSize = options.writeBackBufferSize != 0 || options.readAheadBufferSize != 0 || options.contentCacheMaxFileSize != 0 || options.metadataCache ? FILE_STATE_SIZE : 0;
+            // Snapshots need dirnext and dirclose of the device while the directory is read.
+            snapshots    = options.dirSnapshotMaxBytes != 0 && dev->dirnext_r && dev->dirclose_r;
+            dirPaths     = dev->diropen_r && (options.openat || options.fstatat || options.diropenat);
+            dirStateSize = dev->diropen_r && (snapshots || dirPaths) ? DIR_STATE_SIZE : 0;
+
             abi.magic        = CONTENT_REDIRECTION_DEVICE_MAGIC;
-            abi.version      = CONTENT_REDIRECTION_DEVICE_VERSION;
             abi.name         = dev->name;
-            abi.structSize   = dev->structSize;
-            abi.dirStateSize = dev->dirStateSize;
+            abi.structSize   = static_cast<int>(dev->structSize + fileStateSize);
+            abi.dirStateSize = static_cast<int>(dev->dirStateSize + dirStateSize);
             abi.deviceData   = dev->deviceData;
 
             deviceId = -1;
@@ -617,7 +786,7 @@ namespace CR_DevoptabWrapper {
             abi.mkdir  = dev->mkdir_r ? mkdir : nullptr;
 
             abi.diropen  = dev->diropen_r ? diropen : nullptr;
-            abi.dirreset = dev->dirreset_r ? dirreset : nullptr;
+            abi.dirreset = dev->dirreset_r || snapshots ? dirreset : nullptr;
             abi.dirnext  = dev->dirnext_r ? dirnext : nullptr;
             abi.dirclose = dev->dirclose_r ? dirclose : nullptr;
 
@@ -634,11 +803,49 @@ namespace CR_DevoptabWrapper {
             abi.symlink   = dev->symlink_r ? symlink : nullptr;
             abi.readlink  = dev->readlink_r ? readlink : nullptr;
 
+            abi.map   = options.map && options.unmap ? map : nullptr;
+            abi.unmap = options.map && options.unmap ? unmap : nullptr;
+
+            const bool canFallbackCopy = options.copyRangeBufferSize != 0 && dev->read_r && dev->write_r && dev->seek_r;
+            abi.copy_range             = options.copy_range || canFallbackCopy ? copy_range : nullptr;
+
+            abi.openat    = dirPaths && dev->open_r ? openat : nullptr;
+            abi.fstatat   = dirPaths && dev->stat_r ? fstatat : nullptr;
+            abi.diropenat = dirPaths ? diropenat : nullptr;
+
+            abi.stat_many = options.stat_many || (options.statManyDirScanThreshold != 0 && dev->stat_r) ? stat_many : nullptr;
+
+            abi.alloc_file_struct = options.useSlabPool ? alloc_file_struct : nullptr;
+            abi.free_file_struct  = options.useSlabPool ? free_struct : nullptr;
+            abi.alloc_dir_struct  = options.useSlabPool ? alloc_dir_struct : nullptr;
+            abi.free_dir_struct   = options.useSlabPool ? free_struct : nullptr;
+            if (options.useSlabPool && abi.structSize > 0) {
+                ContentRedirection_SlabReserve(abi.structSize, options.preallocatedFileStructs);
+            }
+            if (options.useSlabPool && abi.dirStateSize > 0) {
+                ContentRedirection_SlabReserve(abi.dirStateSize, options.preallocatedDirStructs);
+            }
+
+            // The lowest version that has all entries that are set, so modules that only know older versions can use the device.
+            if (abi.stat_many) {
+                abi.version = 6;
+            } else if (abi.openat || abi.fstatat || abi.diropenat) {
+                abi.version = 5;
+            } else if (abi.alloc_file_struct) {
+                abi.version = 4;
+            } else if (abi.copy_range) {
+                abi.version = 3;
+            } else if (abi.map) {
+                abi.version = 2;
+            } else {
+                abi.version = 1;
+            }
+
             return &abi;
         }
     };
 
-    using RuntimeBinder = ContentRedirectionDeviceABI *(*) (const devoptab_t *);
+    using RuntimeBinder = ContentRedirectionDeviceABI *(*) (const devoptab_t *, const ContentRedirectionDeviceOptions &);
 
     template<size_t... Is>
     constexpr auto make_runtime_binders(std::index_sequence<Is...>) {
@@ -654,10 +861,14 @@ namespace CR_DevoptabWrapper {
 } // namespace CR_DevoptabWrapper
 
 /**
- * @brief Transparent, ABI-safe wrapper for registering devoptab_t devices.
+ * @brief Transparent, ABI-safe wrapper for registering devoptab_t devices with additional wrapper features.
  * Because this is inline C++, it is compiled entirely inside the calling plugin's environment.
+ *
+ * @param device    Device that will be added
+ * @param options   Wrapper features that should be enabled for this device, see ContentRedirectionDeviceOptions.
+ * @param resultOut Will hold the result of the "AddDevice" call.
  */
-static inline ContentRedirectionStatus ContentRedirection_AddDevice(const devoptab_t *device, int *resultOut) {
+static inline ContentRedirectionStatus ContentRedirection_AddDeviceEx(const devoptab_t *device, const ContentRedirectionDeviceOptions &options, int *resultOut) {
     if (!device || !resultOut) {
         return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
     }
@@ -670,7 +881,7 @@ static inline ContentRedirectionStatus ContentRedirection_AddDevice(const devopt
         if (GlobalState::activeDevices[i] == nullptr || GlobalState::activeDevices[i] == device) {
             GlobalState::activeDevices[i] = device;
 
-            const auto *abiDevice = GlobalState::binders[i](device);
+            const auto *abiDevice = GlobalState::binders[i](device, options);
 
             lock.unlock();
 
@@ -689,6 +900,14 @@ static inline ContentRedirectionStatus ContentRedirection_AddDevice(const devopt
     return CONTENT_REDIRECTION_RESULT_NO_MEMORY;
 }
 
+/**
+ * @brief Transparent, ABI-safe wrapper for registering devoptab_t devices.
+ * Because this is inline C++, it is compiled entirely inside the calling plugin's environment.
+ */
+static inline ContentRedirectionStatus ContentRedirection_AddDevice(const devoptab_t *device, int *resultOut) {
+    return ContentRedirection_AddDeviceEx(device, ContentRedirectionDeviceOptions{}, resultOut);
+}
+
 static inline ContentRedirectionStatus ContentRedirection_RemoveDevice(const char *deviceName, int *resultOut) {
     if (!deviceName || !resultOut) {
         return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
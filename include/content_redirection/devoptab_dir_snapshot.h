@@ -0,0 +1,188 @@
+#pragma once
+
+#ifdef __cplusplus
+
+#include "devoptab_backend.h"
+#include "devoptab_metadata_cache.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <limits.h>
+
+namespace CR_DevoptabWrapper {
+    /**
+     * @brief Per-directory snapshot of all entries.
+     *
+     * On open the whole directory is read into one arena and the directory of the device is closed again.
+     * Afterwards dirnext only advances a cursor in the arena and dirreset moves the cursor back to the start.
+     * If the directory doesn't fit into the size cap or reading it fails midway, the entries that have been read are served from
+     * the arena and the remaining entries are streamed from the still open directory of the device.
+     */
+    struct DirSnapshot {
+        /**
+         * Entries are stored back-to-back: header, name including the null terminator, padding to the alignment of the header.
+         */
+        struct EntryHeader {
+            CR_Stat stat;
+            uint16_t nameLength;
+        };
+
+        char *arena     = nullptr;
+        size_t capacity = 0;
+        size_t used     = 0;
+        size_t cursor   = 0;
+        bool streaming  = false; /**< The directory of the device is open and has entries that are not in the arena */
+
+        static size_t entry_size(size_t nameLength) {
+            const size_t size = sizeof(EntryHeader) + nameLength + 1;
+            return (size + alignof(EntryHeader) - 1) & ~(alignof(EntryHeader) - 1);
+        }
+
+        void release() {
+            if (arena != nullptr) {
+                free(arena);
+                internal::ReleaseLibraryMemory(capacity);
+            }
+            arena    = nullptr;
+            capacity = 0;
+            used     = 0;
+            cursor   = 0;
+        }
+
+        bool reserve(size_t size, size_t maxBytes) {
+            if (used + size <= capacity) {
+                return true;
+            }
+            size_t newCapacity = capacity != 0 ? capacity : 4096;
+            while (newCapacity < used + size) {
+                newCapacity *= 2;
+            }
+            if (newCapacity > maxBytes) {
+                newCapacity = maxBytes;
+                if (newCapacity < used + size) {
+                    return false;
+                }
+            }
+            if (!internal::ReserveLibraryMemory(newCapacity - capacity)) {
+                return false;
+            }
+            auto *newArena = static_cast<char *>(realloc(arena, newCapacity));
+            if (newArena == nullptr) {
+                internal::ReleaseLibraryMemory(newCapacity - capacity);
+                return false;
+            }
+            arena    = newArena;
+            capacity = newCapacity;
+            return true;
+        }
+
+        int open(const devoptab_t *dev, int deviceId, void *dirStruct, const char *path, size_t maxBytes) {
+            arena     = nullptr;
+            capacity  = 0;
+            used      = 0;
+            cursor    = 0;
+            streaming = false;
+
+            int res = Backend::diropen(dev, deviceId, dirStruct, path);
+            if (res < 0) {
+                return res;
+            }
+
+            char name[NAME_MAX + 1];
+            CR_Stat st{};
+            while (true) {
+                // Make sure the next entry fits before it's read from the device, otherwise stream the remaining entries.
+                if (!reserve(entry_size(NAME_MAX), maxBytes)) {
+                    streaming = true;
+                    return 0;
+                }
+                res = Backend::dirnext(dev, deviceId, dirStruct, name, &st);
+                if (res < 0) {
+                    break;
+                }
+                const size_t nameLength = strnlen(name, NAME_MAX);
+                auto *entry             = reinterpret_cast<EntryHeader *>(arena + used);
+                entry->stat             = st;
+                entry->nameLength       = static_cast<uint16_t>(nameLength);
+                memcpy(entry + 1, name, nameLength);
+                reinterpret_cast<char *>(entry + 1)[nameLength] = '\0';
+                used += entry_size(nameLength);
+            }
+            if (res != -ENOENT) {
+                // Let the device report the error (or recover) when the remaining entries are streamed.
+                streaming = true;
+                return 0;
+            }
+            // Everything is in the arena, the directory of the device isn't needed anymore.
+            Backend::dirclose(dev, deviceId, dirStruct);
+            return 0;
+        }
+
+        /**
+         * Fills the snapshot from the listing the metadata cache of the lib holds for "cacheKey", without opening the directory of the device.
+         * Returns false if the listing isn't cached or doesn't fit into memory.
+         */
+        bool open_cached(const char *cacheKey) {
+            arena     = nullptr;
+            capacity  = 0;
+            used      = 0;
+            cursor    = 0;
+            streaming = false;
+
+            size_t size;
+            if (!internal::CopyCachedListing(cacheKey, nullptr, 0, &size)) {
+                return false;
+            }
+            if (size == 0) {
+                return true;
+            }
+            if (!reserve(size, size) || !internal::CopyCachedListing(cacheKey, arena, capacity, &size)) {
+                release();
+                return false;
+            }
+            used = size;
+            return true;
+        }
+
+        int reset(const devoptab_t *dev, int deviceId, void *dirStruct) {
+            if (!streaming) {
+                cursor = 0;
+                return 0;
+            }
+            if (!dev->dirreset_r) {
+                return -ENOSYS;
+            }
+            // The device starts over, the entries in the arena would be returned twice.
+            release();
+            return Backend::dirreset(dev, deviceId, dirStruct);
+        }
+
+        int next(const devoptab_t *dev, int deviceId, void *dirStruct, char *filename, CR_Stat *filestat) {
+            if (cursor < used) {
+                const auto *entry = reinterpret_cast<const EntryHeader *>(arena + cursor);
+                memcpy(filename, entry + 1, entry->nameLength + 1);
+                if (filestat) {
+                    *filestat = entry->stat;
+                }
+                cursor += entry_size(entry->nameLength);
+                return 0;
+            }
+            if (streaming) {
+                return Backend::dirnext(dev, deviceId, dirStruct, filename, filestat);
+            }
+            return -ENOENT;
+        }
+
+        int close(const devoptab_t *dev, int deviceId, void *dirStruct) {
+            release();
+            if (streaming) {
+                streaming = false;
+                return Backend::dirclose(dev, deviceId, dirStruct);
+            }
+            return 0;
+        }
+    };
+} // namespace CR_DevoptabWrapper
+
+#endif // __cplusplus
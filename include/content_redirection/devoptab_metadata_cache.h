@@ -0,0 +1,62 @@
+#pragma once
+
+#ifdef __cplusplus
+
+#include "defines.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace CR_DevoptabWrapper {
+    namespace internal {
+        /**
+         * Access of the devoptab wrapper to the metadata cache of the lib, see "ContentRedirection_LoadMetadataCache". <br>
+         * Implemented by the lib for the wrapper only, this is not part of the public API.
+         * All paths are full paths including the device, e.g. "sd:/mods/A/content".
+         */
+        enum class MetadataDirState {
+            Unknown,         /**< The cache doesn't know the directory yet */
+            NeedsValidation, /**< The directory has been loaded or changed, its fingerprint has to be checked */
+            Valid,           /**< The cached metadata of the directory can be used */
+        };
+
+        MetadataDirState GetMetadataDirState(const char *dirPath);
+
+        /**
+         * Marks a directory as valid with its current modification time. If the cache knows a different modification time,
+         * the cached metadata of the directory is dropped first. Adds the directory if the cache doesn't know it.
+         */
+        void ValidateMetadataDir(const char *dirPath, int64_t mtime);
+
+        /**
+         * Looks up the cached stat result of a path whose parent directory is valid.
+         * "resultOut" is 0 or a negative errno, "statOut" is only written if the result is 0.
+         * Returns false for files loaded from the cache file until a stat of the device has confirmed their size and modification time.
+         */
+        bool LookupCachedStat(const char *path, int32_t *resultOut, CR_Stat *statOut);
+
+        /**
+         * Caches the result of a stat call. Ignored if the parent directory isn't valid. "st" is only read if "result" is 0.
+         */
+        void StoreCachedStat(const char *path, int32_t result, const CR_Stat *st);
+
+        /**
+         * Copies the cached listing of a valid directory. Call with "buffer" set to nullptr to get the size of the listing.
+         * Returns true if the listing is cached and has been copied or "buffer" is nullptr.
+         */
+        bool CopyCachedListing(const char *dirPath, void *buffer, size_t bufferSize, size_t *sizeOut);
+
+        /**
+         * Caches the complete listing of a directory, an opaque blob of the wrapper. Ignored if the directory isn't valid.
+         */
+        void StoreCachedListing(const char *dirPath, const void *data, size_t size);
+
+        /**
+         * Has to be called whenever a file or directory is created, modified or removed without the fingerprint of its parent directory
+         * being checked again. Drops the cached metadata of the path, of everything below it and of its parent directory.
+         */
+        void InvalidateCachedMetadata(const char *path);
+    } // namespace internal
+} // namespace CR_DevoptabWrapper
+
+#endif
@@ -0,0 +1,418 @@
+#pragma once
+
+#ifdef __cplusplus
+
+#include "devoptab_backend.h"
+#include "io_scheduler.h"
+#include "read_ahead.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <mutex>
+#include <stdio.h>
+
+namespace CR_DevoptabWrapper {
+    /**
+     * @brief Per-file readahead for sequentially streamed files.
+     *
+     * A file switches to streaming mode after a number of small sequential reads, or with the first read if it has been opened with the streaming hint.
+     * In streaming mode two buffers are filled on the readahead thread of the lib, one ahead of the other. Reads are served from memory
+     * while the next buffer is filled, so a latency spike of the device only stalls the reader if both buffers have been drained.
+     * A seek outside the buffered range discards the readahead and leaves streaming mode, unless the file has the streaming hint.
+     *
+     * The fills are foreground requests of the I/O scheduler although they run on the readahead thread: they only happen while the game
+     * is streaming the file, limiting them to the background share would stall the stream.
+     *
+     * The device fd is either used by the readahead thread or by the caller, never by both. While streaming, the file offset is tracked here
+     * and the offset of the underlying device is only synced when needed.
+     */
+    struct ReadAheadBuffer {
+        struct Buffer {
+            char *data    = nullptr;
+            int64_t start = 0;
+            size_t length = 0;
+            bool valid    = false;
+
+            [[nodiscard]] int64_t end() const {
+                return start + static_cast<int64_t>(length);
+            }
+        };
+
+        std::mutex mutex;
+        std::condition_variable condition;
+        const devoptab_t *dev        = nullptr;
+        void *fd                     = nullptr;
+        Buffer buffers[2]            = {};
+        size_t capacity              = 0;
+        uint32_t sequentialThreshold = 0;
+        uint32_t sequentialReads     = 0;
+        bool streamingHint           = false;
+        bool streaming               = false;
+        bool paused                  = false;
+        int64_t position             = 0;  /**< Logical file offset */
+        int64_t deviceOffset         = 0;  /**< Offset of the device fd, -1 if unknown */
+        int fillIndex                = -1; /**< Buffer that is filled on the readahead thread, -1 if none */
+        int64_t fillStart            = 0;
+        int fillError                = 0;
+        uint32_t generation          = 0;  /**< Incremented whenever the readahead is discarded */
+        bool eof                     = false;
+        int64_t eofOffset            = 0;
+
+        void init(const devoptab_t *device, void *deviceFd, size_t bufferSize, uint32_t sequentialReadsToStream, bool hint) {
+            dev                 = device;
+            fd                  = deviceFd;
+            capacity            = bufferSize;
+            sequentialThreshold = sequentialReadsToStream;
+            streamingHint       = hint;
+        }
+
+        [[nodiscard]] bool enabled() const {
+            return capacity != 0;
+        }
+
+        void release() {
+            std::unique_lock lock(mutex);
+            streaming = false;
+            generation++;
+            condition.wait(lock, [this] { return fillIndex == -1; });
+            if (buffers[0].data != nullptr) {
+                free(buffers[0].data);
+                free(buffers[1].data);
+                internal::ReleaseLibraryMemory(2 * capacity);
+                buffers[0].data = nullptr;
+                buffers[1].data = nullptr;
+            }
+            capacity = 0;
+        }
+
+        ssize_t read(char *ptr, size_t len) {
+            std::unique_lock lock(mutex);
+            if (!streaming) {
+                sequentialReads   = len < capacity ? sequentialReads + 1 : 0;
+                const ssize_t res = read_direct(lock, ptr, len);
+                if (res > 0 && (streamingHint || sequentialReads >= sequentialThreshold)) {
+                    start_streaming();
+                }
+                return res;
+            }
+
+            size_t done   = 0;
+            int error     = 0;
+            bool waited   = false;
+            bool underrun = false;
+            while (done < len) {
+                const size_t copied = copy_buffered(ptr + done, len - done);
+                if (copied > 0) {
+                    done += copied;
+                    continue;
+                }
+                if (fillError != 0) {
+                    error = fillError;
+                    stop_streaming();
+                    break;
+                }
+                if (eof && position >= eofOffset) {
+                    break;
+                }
+                if (fillIndex == -1 || position < fillStart || position >= fillStart + static_cast<int64_t>(capacity)) {
+                    // Nothing buffered or in flight for this offset, restart the readahead at the current position.
+                    underrun = true;
+                    cancel();
+                    schedule();
+                    if (fillIndex == -1) {
+                        const ssize_t res = read_direct(lock, ptr + done, len - done);
+                        if (res < 0) {
+                            error = static_cast<int>(res);
+                        } else {
+                            done += res;
+                        }
+                        break;
+                    }
+                } else {
+                    waited = true;
+                }
+                condition.wait(lock);
+            }
+            if (error == 0) {
+                auto event = CONTENT_REDIRECTION_READ_AHEAD_EVENT_HIT;
+                if (underrun) {
+                    event = CONTENT_REDIRECTION_READ_AHEAD_EVENT_UNDERRUN;
+                } else if (waited) {
+                    event = CONTENT_REDIRECTION_READ_AHEAD_EVENT_STALL;
+                }
+                ContentRedirection_CountReadAheadEvent(event, 0);
+            }
+            schedule();
+            if (done == 0 && error != 0) {
+                return error;
+            }
+            return static_cast<ssize_t>(done);
+        }
+
+        int64_t seek(int64_t pos, int dir) {
+            std::unique_lock lock(mutex);
+            if (!streaming) {
+                wait_idle(lock);
+                const int syncRes = sync_device_offset();
+                if (syncRes < 0) {
+                    return syncRes;
+                }
+                const int64_t res = Backend::seek(dev, fd, pos, dir);
+                if (res >= 0) {
+                    if (res != position) {
+                        sequentialReads = 0;
+                    }
+                    position     = res;
+                    deviceOffset = res;
+                }
+                return res;
+            }
+
+            int64_t base;
+            switch (dir) {
+                case SEEK_SET:
+                    base = 0;
+                    break;
+                case SEEK_CUR:
+                    base = position;
+                    break;
+                case SEEK_END: {
+                    wait_idle(lock);
+                    CR_Stat st{};
+                    const int res = Backend::fstat(dev, fd, &st);
+                    if (res < 0) {
+                        return res;
+                    }
+                    base = st.size;
+                    break;
+                }
+                default:
+                    return -EINVAL;
+            }
+            if (base + pos < 0) {
+                return -EINVAL;
+            }
+            position = base + pos;
+            for (const auto &buffer : buffers) {
+                if (buffer.valid && position >= buffer.start && position < buffer.end()) {
+                    schedule();
+                    return position;
+                }
+            }
+            if (fillIndex != -1 && position >= fillStart && position < fillStart + static_cast<int64_t>(capacity)) {
+                return position;
+            }
+            cancel();
+            if (!streamingHint) {
+                stop_streaming();
+            }
+            schedule();
+            return position;
+        }
+
+        int fstat(CR_Stat *st) {
+            std::unique_lock lock(mutex);
+            wait_idle(lock);
+            const int res = Backend::fstat(dev, fd, st);
+            schedule();
+            return res;
+        }
+
+        /**
+         * Leaves streaming mode and moves the offset of the device fd to the logical file offset.
+         * Has to be called before the device fd is used directly.
+         */
+        int sync() {
+            if (!enabled()) {
+                return 0;
+            }
+            std::unique_lock lock(mutex);
+            cancel();
+            stop_streaming();
+            wait_idle(lock);
+            return sync_device_offset();
+        }
+
+    private:
+        /**
+         * Waits until the readahead thread doesn't use the device fd. The caller has to hold the lock until it's done with the device.
+         */
+        void wait_idle(std::unique_lock<std::mutex> &lock) {
+            paused = true;
+            condition.wait(lock, [this] { return fillIndex == -1; });
+            paused = false;
+        }
+
+        int sync_device_offset() {
+            if (deviceOffset == position) {
+                return 0;
+            }
+            const int64_t res = Backend::seek(dev, fd, position, SEEK_SET);
+            deviceOffset      = res < 0 ? -1 : res;
+            return res < 0 ? static_cast<int>(res) : 0;
+        }
+
+        ssize_t read_direct(std::unique_lock<std::mutex> &lock, char *ptr, size_t len) {
+            wait_idle(lock);
+            const int res = sync_device_offset();
+            if (res < 0) {
+                return res;
+            }
+            const ssize_t read = Backend::read(dev, fd, ptr, len);
+            if (read < 0) {
+                deviceOffset = -1;
+                return read;
+            }
+            position += read;
+            deviceOffset = position;
+            return read;
+        }
+
+        size_t copy_buffered(char *ptr, size_t len) {
+            for (const auto &buffer : buffers) {
+                if (buffer.valid && position >= buffer.start && position < buffer.end()) {
+                    const size_t n = std::min(len, static_cast<size_t>(buffer.end() - position));
+                    memcpy(ptr, buffer.data + (position - buffer.start), n);
+                    position += static_cast<int64_t>(n);
+                    return n;
+                }
+            }
+            return 0;
+        }
+
+        void start_streaming() {
+            if (buffers[0].data == nullptr) {
+                // Without memory the file is read unbuffered.
+                if (!internal::ReserveLibraryMemory(2 * capacity)) {
+                    disable_streaming();
+                    return;
+                }
+                buffers[0].data = static_cast<char *>(malloc(capacity));
+                buffers[1].data = static_cast<char *>(malloc(capacity));
+                if (buffers[0].data == nullptr || buffers[1].data == nullptr) {
+                    free(buffers[0].data);
+                    free(buffers[1].data);
+                    buffers[0].data = nullptr;
+                    buffers[1].data = nullptr;
+                    internal::ReleaseLibraryMemory(2 * capacity);
+                    disable_streaming();
+                    return;
+                }
+            }
+            streaming = true;
+            fillError = 0;
+            ContentRedirection_CountReadAheadEvent(CONTENT_REDIRECTION_READ_AHEAD_EVENT_STREAM_START, 0);
+            schedule();
+        }
+
+        void stop_streaming() {
+            streaming       = false;
+            sequentialReads = 0;
+            fillError       = 0;
+        }
+
+        void disable_streaming() {
+            sequentialThreshold = UINT32_MAX;
+            streamingHint       = false;
+        }
+
+        void cancel() {
+            if (fillIndex != -1 || buffers[0].valid || buffers[1].valid) {
+                ContentRedirection_CountReadAheadEvent(CONTENT_REDIRECTION_READ_AHEAD_EVENT_CANCEL, 0);
+            }
+            generation++;
+            buffers[0].valid = false;
+            buffers[1].valid = false;
+            eof              = false;
+        }
+
+        /**
+         * Queues the fill of a buffer whose data is behind the current position, continuing where the buffered data ends.
+         */
+        void schedule() {
+            if (!streaming || paused || fillIndex != -1 || eof || fillError != 0) {
+                return;
+            }
+            int64_t next = position;
+            for (const auto &buffer : buffers) {
+                if (buffer.valid && buffer.end() > position) {
+                    next = std::max(next, buffer.end());
+                }
+            }
+            for (int i = 0; i < 2; i++) {
+                auto &buffer = buffers[i];
+                if (buffer.valid && buffer.end() > position) {
+                    continue;
+                }
+                buffer.valid = false;
+                fillIndex    = i;
+                fillStart    = next;
+                if (!ContentRedirection_QueueReadAhead(fill, this)) {
+                    fillIndex = -1;
+                    stop_streaming();
+                    disable_streaming();
+                }
+                return;
+            }
+        }
+
+        static void fill(void *context) {
+            auto *self = static_cast<ReadAheadBuffer *>(context);
+            std::unique_lock lock(self->mutex);
+            const int index         = self->fillIndex;
+            const int64_t start     = self->fillStart;
+            const uint32_t gen      = self->generation;
+            const int64_t devOffset = self->deviceOffset;
+            char *data              = self->buffers[index].data;
+            lock.unlock();
+
+            size_t total = 0;
+            int error    = 0;
+            {
+                // The data is going to be read by the game, so it's not throttled like other background requests of the lib.
+                ForegroundIO io;
+                if (devOffset != start) {
+                    const int64_t res = Backend::seek(self->dev, self->fd, start, SEEK_SET);
+                    error             = res < 0 ? static_cast<int>(res) : 0;
+                }
+                while (error == 0 && total < self->capacity) {
+                    const ssize_t res = Backend::read(self->dev, self->fd, data + total, self->capacity - total);
+                    if (res < 0) {
+                        error = static_cast<int>(res);
+                    } else if (res == 0) {
+                        break;
+                    } else {
+                        total += res;
+                    }
+                }
+                io.bytes = static_cast<uint32_t>(total);
+            }
+
+            lock.lock();
+            self->deviceOffset = error != 0 ? -1 : start + static_cast<int64_t>(total);
+            if (gen == self->generation) {
+                if (error != 0) {
+                    self->fillError = error;
+                } else {
+                    auto &buffer  = self->buffers[index];
+                    buffer.start  = start;
+                    buffer.length = total;
+                    buffer.valid  = true;
+                    if (total < self->capacity) {
+                        self->eof       = true;
+                        self->eofOffset = start + static_cast<int64_t>(total);
+                    }
+                    ContentRedirection_CountReadAheadEvent(CONTENT_REDIRECTION_READ_AHEAD_EVENT_FILL, static_cast<uint32_t>(total));
+                }
+            }
+            self->fillIndex = -1;
+            self->schedule();
+            self->condition.notify_all();
+        }
+    };
+} // namespace CR_DevoptabWrapper
+
+#endif // __cplusplus
@@ -0,0 +1,115 @@
+#pragma once
+
+#ifdef __cplusplus
+
+#include "devoptab_backend.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <limits.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace CR_DevoptabWrapper {
+    /**
+     * @brief stat_many for devices without native support.
+     *
+     * The paths are grouped by their parent directory. A directory that contains at least "dirScanThreshold" of the paths is read once
+     * via dirnext and the paths are resolved from its entries. All other paths, and paths that haven't been found in the directory
+     * (e.g. because the device compares names case-insensitively), are resolved via stat of the device.
+     */
+    struct StatManyFallback {
+        static int stat_many(const devoptab_t *dev, int deviceId, uint32_t dirScanThreshold, const char *const *paths, uint32_t count, CR_StatResult *results) {
+            if (count == 0) {
+                return 0;
+            }
+            if (paths == nullptr || results == nullptr) {
+                return -EINVAL;
+            }
+            std::vector<bool> done(count, false);
+            if (dirScanThreshold != 0 && count >= dirScanThreshold && dev->diropen_r && dev->dirnext_r && dev->dirclose_r) {
+                scan_directories(dev, deviceId, dirScanThreshold, paths, count, results, done);
+            }
+            for (uint32_t i = 0; i < count; i++) {
+                if (!done[i]) {
+                    results[i].result = paths[i] != nullptr ? Backend::stat(dev, paths[i], &results[i].st) : -EINVAL;
+                }
+            }
+            return 0;
+        }
+
+    private:
+        /**
+         * Splits a path into the directory that has to be opened and the name of the entry. Returns false for paths without a name.
+         */
+        static bool split_path(const char *path, std::string_view &dir, std::string_view &name) {
+            if (path == nullptr) {
+                return false;
+            }
+            const std::string_view view(path);
+            const size_t slash = view.find_last_of('/');
+            if (slash == std::string_view::npos || slash + 1 == view.size()) {
+                return false;
+            }
+            name = view.substr(slash + 1);
+            if (name == "." || name == "..") {
+                return false;
+            }
+            // Keep the slash of the root directory, e.g. "sd:/".
+            const bool isRoot = slash == 0 || view[slash - 1] == ':';
+            dir               = view.substr(0, isRoot ? slash + 1 : slash);
+            return true;
+        }
+
+        static void scan_directories(const devoptab_t *dev, int deviceId, uint32_t dirScanThreshold, const char *const *paths, uint32_t count,
+                                     CR_StatResult *results, std::vector<bool> &done) {
+            std::unordered_map<std::string_view, std::vector<uint32_t>> byDir;
+            std::vector<std::string_view> names(count);
+            for (uint32_t i = 0; i < count; i++) {
+                std::string_view dir;
+                if (split_path(paths[i], dir, names[i])) {
+                    byDir[dir].push_back(i);
+                }
+            }
+
+            void *dirStruct = nullptr;
+            for (const auto &[dir, indices] : byDir) {
+                if (indices.size() < dirScanThreshold) {
+                    continue;
+                }
+                if (dirStruct == nullptr) {
+                    dirStruct = malloc(std::max<size_t>(dev->dirStateSize, 1));
+                    if (dirStruct == nullptr) {
+                        return;
+                    }
+                }
+                if (Backend::diropen(dev, deviceId, dirStruct, std::string(dir).c_str()) < 0) {
+                    continue;
+                }
+                std::unordered_multimap<std::string_view, uint32_t> pending;
+                for (const uint32_t i : indices) {
+                    pending.emplace(names[i], i);
+                }
+                char name[NAME_MAX + 1];
+                CR_Stat st{};
+                while (!pending.empty() && Backend::dirnext(dev, deviceId, dirStruct, name, &st) == 0) {
+                    const auto range = pending.equal_range(std::string_view(name, strnlen(name, NAME_MAX)));
+                    for (auto it = range.first; it != range.second; ++it) {
+                        results[it->second].result = 0;
+                        results[it->second].st     = st;
+                        done[it->second]           = true;
+                    }
+                    pending.erase(range.first, range.second);
+                }
+                Backend::dirclose(dev, deviceId, dirStruct);
+            }
+            free(dirStruct);
+        }
+    };
+} // namespace CR_DevoptabWrapper
+
+#endif
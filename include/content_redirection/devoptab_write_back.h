@@ -0,0 +1,201 @@
+#pragma once
+
+#ifdef __cplusplus
+
+#include "devoptab_backend.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <stdio.h>
+
+namespace CR_DevoptabWrapper {
+    /**
+     * @brief Per-file write-back buffer.
+     *
+     * Holds one contiguous dirty range of the file. Sequential and overlapping writes which fit into the buffer are merged in memory,
+     * the range is written to the device with a single write once the buffer is full, or on fsync, ftruncate and close.
+     * If the device fails or writes less, the part that hasn't been written stays in the buffer until a later flush succeeds.
+     * While the buffer is active, the file offset is tracked here and the offset of the underlying device is only synced when needed.
+     */
+    struct WriteBackBuffer {
+        char *data       = nullptr;
+        size_t capacity  = 0;
+        int64_t start    = 0; /**< File offset of data[0] */
+        size_t length    = 0; /**< Number of valid bytes in data */
+        int64_t position = 0; /**< Logical file offset, only valid while active */
+        bool active      = false;
+
+        void init(size_t bufferSize) {
+            data     = nullptr;
+            capacity = bufferSize;
+            start    = 0;
+            length   = 0;
+            position = 0;
+            active   = false;
+        }
+
+        void release() {
+            if (data != nullptr) {
+                free(data);
+                internal::ReleaseLibraryMemory(capacity);
+            }
+            data     = nullptr;
+            capacity = 0;
+            active   = false;
+        }
+
+        [[nodiscard]] int64_t end() const {
+            return start + static_cast<int64_t>(length);
+        }
+
+        int flush(const devoptab_t *dev, void *fd) {
+            if (!active) {
+                return 0;
+            }
+            if (length > 0) {
+                const int64_t res = Backend::seek(dev, fd, start, SEEK_SET);
+                if (res < 0) {
+                    return static_cast<int>(res);
+                }
+                size_t written = 0;
+                while (written < length) {
+                    const ssize_t cur = Backend::write(dev, fd, data + written, length - written);
+                    if (cur <= 0) {
+                        // Keep the part that hasn't reached the device, reads still see it and the next flush retries it.
+                        memmove(data, data + written, length - written);
+                        start += static_cast<int64_t>(written);
+                        length -= written;
+                        return cur < 0 ? static_cast<int>(cur) : -EIO;
+                    }
+                    written += cur;
+                }
+                length = 0;
+            }
+            active = false;
+
+            const int64_t res = Backend::seek(dev, fd, position, SEEK_SET);
+            return res < 0 ? static_cast<int>(res) : 0;
+        }
+
+        ssize_t write(const devoptab_t *dev, void *fd, const char *ptr, size_t len) {
+            if (capacity == 0 || len >= capacity) {
+                const int res = flush(dev, fd);
+                if (res < 0) {
+                    return res;
+                }
+                return Backend::write(dev, fd, ptr, len);
+            }
+            if (data == nullptr) {
+                // Without memory the file is written unbuffered.
+                if (!internal::ReserveLibraryMemory(capacity)) {
+                    capacity = 0;
+                    return Backend::write(dev, fd, ptr, len);
+                }
+                data = static_cast<char *>(malloc(capacity));
+                if (data == nullptr) {
+                    internal::ReleaseLibraryMemory(capacity);
+                    capacity = 0;
+                    return Backend::write(dev, fd, ptr, len);
+                }
+            }
+
+            if (active && (position < start || position > end() || position + static_cast<int64_t>(len) > start + static_cast<int64_t>(capacity))) {
+                const int res = flush(dev, fd);
+                if (res < 0) {
+                    return res;
+                }
+            }
+            if (!active) {
+                const int64_t pos = Backend::seek(dev, fd, 0, SEEK_CUR);
+                if (pos < 0) {
+                    return static_cast<ssize_t>(pos);
+                }
+                start    = pos;
+                length   = 0;
+                position = pos;
+                active   = true;
+            }
+
+            memcpy(data + (position - start), ptr, len);
+            position += static_cast<int64_t>(len);
+            length = std::max(length, static_cast<size_t>(position - start));
+
+            if (length == capacity) {
+                // The data has been accepted either way. If the flush fails, it stays buffered and the next flush reports the error.
+                flush(dev, fd);
+            }
+            return static_cast<ssize_t>(len);
+        }
+
+        ssize_t read(const devoptab_t *dev, void *fd, char *ptr, size_t len) {
+            if (!active) {
+                return Backend::read(dev, fd, ptr, len);
+            }
+            const int64_t pos = Backend::seek(dev, fd, position, SEEK_SET);
+            if (pos < 0) {
+                return static_cast<ssize_t>(pos);
+            }
+            ssize_t res = Backend::read(dev, fd, ptr, len);
+            if (res < 0) {
+                return res;
+            }
+
+            // The buffered range may overlap or even extend the data that is on the device.
+            const int64_t overlapStart = std::max(position, start);
+            const int64_t overlapEnd   = std::min(position + static_cast<int64_t>(len), end());
+            if (overlapStart < overlapEnd) {
+                const int64_t deviceEnd = position + res;
+                if (deviceEnd < overlapStart) {
+                    memset(ptr + res, 0, overlapStart - deviceEnd);
+                }
+                memcpy(ptr + (overlapStart - position), data + (overlapStart - start), overlapEnd - overlapStart);
+                res = std::max<ssize_t>(res, overlapEnd - position);
+            }
+            position += res;
+            return res;
+        }
+
+        int64_t seek(const devoptab_t *dev, void *fd, int64_t pos, int dir) {
+            if (!active) {
+                return Backend::seek(dev, fd, pos, dir);
+            }
+            int64_t base;
+            switch (dir) {
+                case SEEK_SET:
+                    base = 0;
+                    break;
+                case SEEK_CUR:
+                    base = position;
+                    break;
+                case SEEK_END: {
+                    CR_Stat st{};
+                    const int res = fstat(dev, fd, &st);
+                    if (res < 0) {
+                        return res;
+                    }
+                    base = st.size;
+                    break;
+                }
+                default:
+                    return -EINVAL;
+            }
+            if (base + pos < 0) {
+                return -EINVAL;
+            }
+            position = base + pos;
+            return position;
+        }
+
+        int fstat(const devoptab_t *dev, void *fd, CR_Stat *st) {
+            const int res = Backend::fstat(dev, fd, st);
+            if (res >= 0 && active && st) {
+                st->size = std::max(st->size, end());
+            }
+            return res;
+        }
+    };
+} // namespace CR_DevoptabWrapper
+
+#endif // __cplusplus
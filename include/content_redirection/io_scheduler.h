@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum ContentRedirectionIOClass {
+    /* Requests of the game. Only requests to devices that have been added via the devoptab wrapper of this lib are seen,
+     * files the module serves from other devices or from the original filesystem don't count as foreground activity.
+     * The readahead of the devoptab wrapper is foreground as well, it only reads ahead of a stream the game is consuming. */
+    CONTENT_REDIRECTION_IO_CLASS_FOREGROUND,
+    /* Requests this lib issues on its own, e.g. tiered device promotion, change detection and mod scanning. */
+    CONTENT_REDIRECTION_IO_CLASS_BACKGROUND,
+} ContentRedirectionIOClass;
+
+typedef struct ContentRedirectionIOSchedulerConfig {
+    /**
+     * Share of the time in percent that background requests may keep the device busy while foreground requests are active.
+     * After a background request that took t, the next one waits t * (100 - share) / share. Only one background request runs at a time
+     * while foreground requests are active, no matter how many threads issue them. 0 pauses background requests entirely. Default: 10
+     */
+    uint32_t backgroundShare;
+    /**
+     * Foreground requests count as active until this many milliseconds after the last one has finished. Default: 50
+     */
+    uint32_t foregroundIdleMs;
+    /**
+     * Maximum throughput of background requests in bytes per second, regardless of foreground activity. 0 means unlimited. Default: 0
+     */
+    uint32_t backgroundMaxBytesPerSec;
+} ContentRedirectionIOSchedulerConfig;
+
+typedef struct ContentRedirectionIOClassStats {
+    uint32_t requests;
+    uint64_t bytes;
+    uint32_t p50Us;  /**< Latency percentiles, rounded up to the next power of two */
+    uint32_t p99Us;
+    uint32_t maxUs;
+    uint64_t waitUs; /**< Time requests have been held back by the scheduler before they started */
+} ContentRedirectionIOClassStats;
+
+/**
+ * Sets the configuration of the scheduler. Takes effect for the next background request.
+ */
+void ContentRedirection_SetIOSchedulerConfig(const ContentRedirectionIOSchedulerConfig *config);
+
+/**
+ * Retrieves the latency stats of foreground and background requests since the last reset.
+ * Comparing foreground p99 with and without background activity shows how well foreground requests are protected.
+ *
+ * @param foregroundOut     Stats of foreground requests, may be NULL.
+ * @param backgroundOut     Stats of background requests, may be NULL.
+ */
+void ContentRedirection_GetIOSchedulerStats(ContentRedirectionIOClassStats *foregroundOut, ContentRedirectionIOClassStats *backgroundOut);
+
+void ContentRedirection_ResetIOSchedulerStats(void);
+
+/**
+ * Has to be called before a request is issued to a device. <br>
+ * Foreground requests are never delayed. Background requests block until the scheduler allows them.
+ * Long background operations should be split into chunks, each with its own Begin/End, so they can be preempted.
+ *
+ * @param ioClass   Class of the request.
+ * @return Start time of the request, has to be passed to "ContentRedirection_IOEnd".
+ */
+uint64_t ContentRedirection_IOBegin(ContentRedirectionIOClass ioClass);
+
+/**
+ * Has to be called after a request which was started with "ContentRedirection_IOBegin" has finished.
+ *
+ * @param ioClass   Class of the request.
+ * @param start     Return value of "ContentRedirection_IOBegin".
+ * @param bytes     Number of bytes that have been transferred.
+ */
+void ContentRedirection_IOEnd(ContentRedirectionIOClass ioClass, uint64_t start, uint32_t bytes);
+
+#ifdef __cplusplus
+} // extern "C"
+
+namespace CR_DevoptabWrapper {
+    /**
+     * @brief Marks the lifetime of a request for the I/O scheduler.
+     */
+    template<ContentRedirectionIOClass IOClass>
+    struct ScopedIORequest {
+        uint64_t start = ContentRedirection_IOBegin(IOClass);
+        uint32_t bytes = 0;
+
+        ScopedIORequest()                        = default;
+        ScopedIORequest(const ScopedIORequest &) = delete;
+        ScopedIORequest &operator=(const ScopedIORequest &) = delete;
+
+        ~ScopedIORequest() {
+            ContentRedirection_IOEnd(IOClass, start, bytes);
+        }
+    };
+
+    using ForegroundIO = ScopedIORequest<CONTENT_REDIRECTION_IO_CLASS_FOREGROUND>;
+    using BackgroundIO = ScopedIORequest<CONTENT_REDIRECTION_IO_CLASS_BACKGROUND>;
+} // namespace CR_DevoptabWrapper
+#endif
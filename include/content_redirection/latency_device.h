@@ -0,0 +1,145 @@
+#pragma once
+
+#include "redirection.h"
+#include <stdint.h>
+#include <sys/iosupport.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum ContentRedirectionLatencyProfileType {
+    /**
+     * No latency is injected, the device behaves like its base device.
+     */
+    CONTENT_REDIRECTION_LATENCY_PROFILE_NONE = 0,
+    /**
+     * Rough model of the SD card slot of a Wii U, accessed via the FS API.
+     */
+    CONTENT_REDIRECTION_LATENCY_PROFILE_SD = 1,
+    /**
+     * Rough model of a USB hard drive attached to a Wii U.
+     */
+    CONTENT_REDIRECTION_LATENCY_PROFILE_USB = 2,
+} ContentRedirectionLatencyProfileType;
+
+typedef struct ContentRedirectionLatencyProfile {
+    /**
+     * Cost of opening a file or directory in microseconds.
+     */
+    uint32_t openUs;
+    /**
+     * Cost of a stat, lstat or fstat call and of every directory entry in microseconds.
+     */
+    uint32_t statUs;
+    /**
+     * Cost of a read or write that doesn't continue where the previous read or write of the same file has ended, in microseconds.
+     */
+    uint32_t seekUs;
+    /**
+     * Fixed cost of every read, write and any other call that isn't covered by the other values, in microseconds.
+     */
+    uint32_t perOpUs;
+    /**
+     * Additional cost of calls that modify metadata (unlink, rename, mkdir, rmdir, chmod, utimes, ftruncate) and of fsync, in microseconds.
+     */
+    uint32_t metadataWriteUs;
+    /**
+     * Bandwidth of reads and writes in bytes per second. 0 means unlimited.
+     */
+    uint32_t readBytesPerSec;
+    uint32_t writeBytesPerSec;
+    /**
+     * A uniformly distributed random delay of 0 to "jitterUs" microseconds is added to every call.
+     */
+    uint32_t jitterUs;
+} ContentRedirectionLatencyProfile;
+
+typedef struct ContentRedirectionLatencyDeviceConfig {
+    /**
+     * Name of the device, e.g. "slowsd". Paths of the device look like "slowsd:/content/file.bin".
+     */
+    const char *name;
+    /**
+     * Base path on an already registered newlib device which backs this device, e.g. "fs:/vol/external01/bench" or "host:/tmp/bench".
+     */
+    const char *basePath;
+    ContentRedirectionLatencyProfile profile;
+    /**
+     * Seed of the jitter generator. The same seed and the same sequence of calls always lead to the same delays.
+     */
+    uint32_t seed;
+    /**
+     * If true, the delays are only added to the simulated time of the device statistics and the calls return immediately.
+     * This makes benchmarks independent of the timer resolution and load of the machine that runs them.
+     */
+    bool simulateOnly;
+    /**
+     * If true, the delays of concurrent calls are served one after another, like a device that handles one request at a time.
+     * Calls from several threads then wait for each other, e.g. to measure how background requests of the lib delay the game.
+     * Ignored if "simulateOnly" is set.
+     */
+    bool serializeCalls;
+} ContentRedirectionLatencyDeviceConfig;
+
+typedef struct ContentRedirectionLatencyDeviceStats {
+    uint64_t ops;          /**< Number of calls to the device */
+    uint64_t seeks;        /**< Number of reads and writes that have been charged with "seekUs" */
+    uint64_t bytesRead;    /**< Number of bytes returned by reads */
+    uint64_t bytesWritten; /**< Number of bytes accepted by writes */
+    uint64_t simulatedUs;  /**< Sum of all injected delays in microseconds, including jitter */
+} ContentRedirectionLatencyDeviceStats;
+
+/**
+ * Fills "profileOut" with one of the built-in latency profiles. <br>
+ * The built-in values are rough approximations of typical hardware, tune them against measurements of your own SD card or drive
+ * if the absolute numbers matter.
+ *
+ * @param type          Profile that should be returned.
+ * @param profileOut    The profile is written to this pointer.
+ * @return CONTENT_REDIRECTION_RESULT_SUCCESS:          The profile has been written. <br>
+ *         CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT: "profileOut" is NULL or "type" is unknown.
+ */
+ContentRedirectionStatus ContentRedirection_GetLatencyProfile(ContentRedirectionLatencyProfileType type, ContentRedirectionLatencyProfile *profileOut);
+
+/**
+ * Creates a device that forwards all calls to a directory of another device and injects the latency of a slower device. <br>
+ * Every call is delayed according to the profile: a fixed cost per operation, a seek cost for non-sequential file access,
+ * a cost per byte read or written and a deterministic jitter. This allows benchmarking caching and scheduling changes
+ * against a reproducible model of an SD card or USB drive, even if the base device is a fast one. <br>
+ * <br>
+ * The returned device can be added via "ContentRedirection_AddDevice" like any other devoptab_t.
+ * It's not added to the newlib device list.
+ *
+ * @param config        Configuration of the device. All strings are copied.
+ * @param deviceOut     The created device is written to this pointer.
+ * @return CONTENT_REDIRECTION_RESULT_SUCCESS:          The device has been created. <br>
+ *         CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT: "config" or "deviceOut" is NULL or the base path doesn't belong to a registered device. <br>
+ *         CONTENT_REDIRECTION_RESULT_NO_MEMORY:        Not enough memory to create the device.
+ */
+ContentRedirectionStatus ContentRedirection_CreateLatencyDevice(const ContentRedirectionLatencyDeviceConfig *config, const devoptab_t **deviceOut);
+
+/**
+ * Returns the statistics of a device created by "ContentRedirection_CreateLatencyDevice".
+ *
+ * @param device    Device created by "ContentRedirection_CreateLatencyDevice".
+ * @param statsOut  The statistics are written to this pointer.
+ * @param reset     If true, the statistics are reset after reading them.
+ * @return CONTENT_REDIRECTION_RESULT_SUCCESS:          The statistics have been written. <br>
+ *         CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT: "device" or "statsOut" is NULL.
+ */
+ContentRedirectionStatus ContentRedirection_GetLatencyDeviceStats(const devoptab_t *device, ContentRedirectionLatencyDeviceStats *statsOut, bool reset);
+
+/**
+ * Destroys a device created by "ContentRedirection_CreateLatencyDevice". <br>
+ * Make sure to remove the device via "ContentRedirection_RemoveDevice" and to close all files before calling this function.
+ *
+ * @param device    Device that will be destroyed.
+ * @return CONTENT_REDIRECTION_RESULT_SUCCESS:          The device has been destroyed. <br>
+ *         CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT: "device" is NULL.
+ */
+ContentRedirectionStatus ContentRedirection_DestroyLatencyDevice(const devoptab_t *device);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "redirection.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CONTENT_REDIRECTION_LAYER_FILTER_VERSION    1
+#define CONTENT_REDIRECTION_LAYER_FILTER_BLOCK_BITS 256 /**< One block fills one 32 byte cache line */
+#define CONTENT_REDIRECTION_LAYER_FILTER_BLOCK_SIZE (CONTENT_REDIRECTION_LAYER_FILTER_BLOCK_BITS / 32)
+
+/**
+ * @brief Blocked bloom filter over all paths of a layer.
+ *
+ * Keys are the paths of all files and directories relative to the replacement dir, with a leading '/', without trailing '/' and
+ * lower-cased (ASCII only), e.g. "/audio/.deleted_track1.wav". <br>
+ * A key selects one block, all "numHashes" bits of the key are set in this block. See "ContentRedirection_LayerFilterMayContain".
+ */
+typedef struct ContentRedirectionLayerFilter {
+    uint32_t version;       /**< CONTENT_REDIRECTION_LAYER_FILTER_VERSION */
+    uint32_t numBlocks;     /**< Number of blocks, each block has CONTENT_REDIRECTION_LAYER_FILTER_BLOCK_SIZE words */
+    uint32_t numHashes;     /**< Number of bits set per key */
+    uint32_t numEntries;    /**< Number of keys in the filter */
+    const uint32_t *blocks; /**< numBlocks * CONTENT_REDIRECTION_LAYER_FILTER_BLOCK_SIZE words */
+} ContentRedirectionLayerFilter;
+
+typedef struct ContentRedirectionLayerFilterInfo {
+    uint32_t numEntries;     /**< Number of paths in the filter */
+    uint32_t sizeBytes;      /**< Memory used by the filter inside the module */
+    uint32_t numHashes;      /**< Number of bits set per key */
+    uint32_t lookups;        /**< Number of lookups that have been checked against the filter */
+    uint32_t definiteMisses; /**< Number of lookups that have been answered by the filter without accessing the device */
+} ContentRedirectionLayerFilterInfo;
+
+static inline uint64_t ContentRedirection_LayerFilterHash(const char *path) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (; *path; path++) {
+        char c = *path;
+        if (c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+        hash ^= (uint8_t) c;
+        hash *= 0x100000001B3ULL;
+    }
+    // FNV-1a has weak high bits for short keys, mix them before they select the block.
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static inline void ContentRedirection_LayerFilterAdd(uint32_t *blocks, uint32_t numBlocks, uint32_t numHashes, uint64_t hash) {
+    uint32_t *block = blocks + (uint32_t) (((hash >> 32) * numBlocks) >> 32) * CONTENT_REDIRECTION_LAYER_FILTER_BLOCK_SIZE;
+    uint32_t bits   = (uint32_t) hash;
+    for (uint32_t i = 0; i < numHashes; i++) {
+        const uint32_t bit = bits >> 24;
+        block[bit >> 5] |= 1u << (bit & 31);
+        bits = bits * 0x9E3779B1u + 0x7F4A7C15u;
+    }
+}
+
+/**
+ * Returns false if the path is definitely not part of the layer, true if it might be.
+ *
+ * @param filter    Filter of the layer.
+ * @param path      Key of the path, see ContentRedirectionLayerFilter.
+ */
+static inline bool ContentRedirection_LayerFilterMayContain(const ContentRedirectionLayerFilter *filter, const char *path) {
+    if (filter->numBlocks == 0) {
+        return false;
+    }
+    const uint64_t hash   = ContentRedirection_LayerFilterHash(path);
+    const uint32_t *block = filter->blocks + (uint32_t) (((hash >> 32) * filter->numBlocks) >> 32) * CONTENT_REDIRECTION_LAYER_FILTER_BLOCK_SIZE;
+    uint32_t bits         = (uint32_t) hash;
+    for (uint32_t i = 0; i < filter->numHashes; i++) {
+        const uint32_t bit = bits >> 24;
+        if ((block[bit >> 5] & (1u << (bit & 31))) == 0) {
+            return false;
+        }
+        bits = bits * 0x9E3779B1u + 0x7F4A7C15u;
+    }
+    return true;
+}
+
+/**
+ * Builds a filter over all files and directories in the replacement dir of a merge layer and passes it to the module. <br>
+ * Lookups that miss the filter are answered by the module without accessing the device of the layer. <br>
+ * This is useful for deep stacks of merge layers, where most lookups only hit one layer. <br>
+ * <br>
+ * The replacement dir has to be accessible via a registered newlib device. <br>
+ * The filter is rebuilt by "ContentRedirection_RefreshFSLayer" when the replacement dir has changed.
+ * Setting a filter also refreshes the layer in the module if the replacement dir has changed since the last refresh. <br>
+ * Files that are added to the replacement dir behind the back of this lib are invisible until the layer has been refreshed. <br>
+ * Only layers which have been added via this lib and whose type is FS_LAYER_TYPE_CONTENT_MERGE, FS_LAYER_TYPE_AOC_MERGE or
+ * FS_LAYER_TYPE_EX_MERGE_DIRECTORY can be filtered.
+ *
+ * **Requires API version 8 or higher**
+ *
+ * @param handle                Handle of the FSLayer.
+ * @param falsePositiveRate     Target rate of lookups that pass the filter even though the path isn't part of the layer, e.g. 0.01.
+ *                              A lower rate needs more memory, about 10 bits per path for 1%. 0 removes the filter.
+ * @return CONTENT_REDIRECTION_RESULT_SUCCESS:              The filter has been set or removed. <br>
+ *         CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED:    "ContentRedirection_InitLibrary()" was not called. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND:  This command is not supported by the currently loaded Module. <br>
+ *         CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT:     The layer is no merge layer, the rate is not in [0, 1) or the replacement dir can't be opened. <br>
+ *         CONTENT_REDIRECTION_RESULT_LAYER_NOT_FOUND:      Invalid FSLayer handle. <br>
+ *         CONTENT_REDIRECTION_RESULT_NO_MEMORY:            Not enough memory to create the filter. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNKNOWN_ERROR:        Unknown error.
+ */
+ContentRedirectionStatus ContentRedirection_SetLayerFilter(CRLayerHandle handle, float falsePositiveRate);
+
+/**
+ * Retrieves the size of the filter of a layer and how many lookups it has answered. <br>
+ * "definiteMisses" is the number of stat/open calls on the device of the layer that have been avoided.
+ *
+ * **Requires API version 8 or higher**
+ *
+ * @param handle    Handle of the FSLayer.
+ * @param infoOut   Information about the filter is written to this pointer. All values are 0 if the layer has no filter.
+ * @return CONTENT_REDIRECTION_RESULT_SUCCESS:              The information has been written to "infoOut". <br>
+ *         CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED:    "ContentRedirection_InitLibrary()" was not called. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND:  This command is not supported by the currently loaded Module. <br>
+ *         CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT:     "infoOut" is NULL. <br>
+ *         CONTENT_REDIRECTION_RESULT_LAYER_NOT_FOUND:      Invalid FSLayer handle. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNKNOWN_ERROR:        Unknown error.
+ */
+ContentRedirectionStatus ContentRedirection_GetLayerFilterInfo(CRLayerHandle handle, ContentRedirectionLayerFilterInfo *infoOut);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "redirection.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief I/O counters of one layer, counted by the module since the layer has been added or the counters have been reset.
+ *
+ * Every path the module resolves is checked against the layers from the top of the stack to the bottom, until one layer
+ * provides the file or hides it. Each checked layer counts one lookup, which ends as exactly one hit, miss or whiteout hit. <br>
+ * The counters are updated atomically and without locks, so they are cheap enough to stay enabled. Reading them isn't
+ * synchronized with the updates, the fields of one snapshot may be off by the calls that are in flight while it is taken.
+ * The 32 bit counters wrap around, compare the difference between two snapshots.
+ */
+typedef struct ContentRedirectionLayerStats {
+    CRLayerHandle handle;  /**< Handle of the layer */
+    uint32_t lookups;      /**< Paths that have been checked against the layer */
+    uint32_t hits;         /**< Lookups that have been served by the layer */
+    uint32_t misses;       /**< Lookups that have been passed on to the next layer or the original file */
+    uint32_t whiteoutHits; /**< Lookups of files that the layer hides via ".deleted_" files */
+    uint32_t opens;        /**< Files and directories that have been opened via the layer */
+    uint64_t bytesRead;    /**< Bytes read from files of the layer */
+    uint64_t bytesWritten; /**< Bytes written to files of the layer */
+    uint64_t timeUs;       /**< Time spent in the device calls of the layer in microseconds, including lookups */
+} ContentRedirectionLayerStats;
+
+/**
+ * Retrieves the I/O counters of a layer. Useful to find the mod that is responsible for slow loading times. <br>
+ * On modules without native layer priorities or refresh support, emulating them re-adds the layer, which resets its counters.
+ *
+ * **Requires API version 11 or higher**
+ *
+ * @param handle    Handle of the FSLayer.
+ * @param statsOut  The counters are written to this pointer.
+ * @return CONTENT_REDIRECTION_RESULT_SUCCESS:              The counters have been written to "statsOut". <br>
+ *         CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED:    "ContentRedirection_InitLibrary()" was not called. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND:  This command is not supported by the currently loaded Module. <br>
+ *         CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT:     "statsOut" is NULL. <br>
+ *         CONTENT_REDIRECTION_RESULT_LAYER_NOT_FOUND:      Invalid FSLayer handle. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNKNOWN_ERROR:        Unknown error.
+ */
+ContentRedirectionStatus ContentRedirection_GetLayerStats(CRLayerHandle handle, ContentRedirectionLayerStats *statsOut);
+
+/**
+ * Retrieves the I/O counters of all layers at once, including layers that haven't been added via this lib.
+ *
+ * **Requires API version 11 or higher**
+ *
+ * @param statsOut      The counters are written to this array, in the order the module checks the layers.
+ * @param maxLayers     Size of the "statsOut" array.
+ * @param numLayersOut  The total number of layers is written to this pointer, may be bigger than "maxLayers".
+ * @return CONTENT_REDIRECTION_RESULT_SUCCESS:              The counters have been written to "statsOut". <br>
+ *         CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED:    "ContentRedirection_InitLibrary()" was not called. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND:  This command is not supported by the currently loaded Module. <br>
+ *         CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT:     "numLayersOut" is NULL or "statsOut" is NULL while "maxLayers" isn't 0. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNKNOWN_ERROR:        Unknown error.
+ */
+ContentRedirectionStatus ContentRedirection_GetAllLayerStats(ContentRedirectionLayerStats *statsOut, uint32_t maxLayers, uint32_t *numLayersOut);
+
+/**
+ * Resets the I/O counters of all layers.
+ *
+ * **Requires API version 11 or higher**
+ *
+ * @return CONTENT_REDIRECTION_RESULT_SUCCESS:              The counters have been reset. <br>
+ *         CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED:    "ContentRedirection_InitLibrary()" was not called. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND:  This command is not supported by the currently loaded Module. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNKNOWN_ERROR:        Unknown error.
+ */
+ContentRedirectionStatus ContentRedirection_ResetLayerStats(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "defines.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Counters of the metadata cache, see "ContentRedirection_LoadMetadataCache".
+ */
+typedef struct ContentRedirectionMetadataCacheStats {
+    uint32_t dirs;            /**< Directories the cache knows */
+    uint32_t files;           /**< Cached stat results, including files that don't exist */
+    uint32_t listings;        /**< Cached directory listings */
+    uint32_t bytes;           /**< Memory used by the cache */
+    uint32_t hits;            /**< stat calls and directory listings that have been served from the cache */
+    uint32_t misses;          /**< stat calls and directory listings that had to go to the device */
+    uint32_t validations;     /**< Directories whose fingerprint has been checked against the device */
+    uint32_t invalidatedDirs; /**< Directories whose cached metadata has been dropped because they have changed */
+    uint32_t staleFiles;      /**< Files loaded from the cache file whose size or modification time has changed since */
+} ContentRedirectionMetadataCacheStats;
+
+/**
+ * Loads the metadata cache from a file that has been written via "ContentRedirection_SaveMetadataCache", replacing the current cache.
+ * The file is read with one sequential read. <br>
+ * Every directory in the file is checked lazily: the first time a path inside of it is accessed, the modification time of the directory
+ * is compared with the one in the file. If it differs, the cached metadata of that directory is dropped. <br>
+ * The file only contains the stat results of files that exist. FAT often keeps the modification time of a directory when an entry is added,
+ * so files that don't exist and directory listings are only cached until the title is closed, they can't be validated in the next session.
+ * Changing a file in place doesn't update the modification time of its directory either, so the stat result of a file from the cache file
+ * is only used after the first stat of the device has returned the same size and modification time. The stat results of directories are used right away.
+ * The cache is intended for trees that are replaced as a whole, like the replacement directories of layers.
+ *
+ * @param path  Path of the cache file, e.g. "fs:/vol/external01/wiiu/metadata/0005000010101C00.bin".
+ * @return false if the file doesn't exist or is no valid cache file, the cache is empty in this case.
+ */
+bool ContentRedirection_LoadMetadataCache(const char *path);
+
+/**
+ * Writes the stat results of existing files the cache has learned to a file, e.g. when the title is closed.
+ *
+ * @param path  Path of the cache file.
+ * @return false if the file can't be written.
+ */
+bool ContentRedirection_SaveMetadataCache(const char *path);
+
+/**
+ * Drops all cached metadata.
+ */
+void ContentRedirection_ClearMetadataCache(void);
+
+/**
+ * Retrieves the counters of the metadata cache. "hits", "misses", "validations" and "invalidatedDirs" count since the last reset.
+ */
+void ContentRedirection_GetMetadataCacheStats(ContentRedirectionMetadataCacheStats *statsOut);
+
+void ContentRedirection_ResetMetadataCacheStats(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
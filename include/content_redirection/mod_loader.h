@@ -0,0 +1,73 @@
+#pragma once
+
+#include "redirection.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ContentRedirectionModRule {
+    /**
+     * Directory inside of a mod folder, e.g. "content".
+     */
+    const char *subDir;
+    /**
+     * Path that will be replaced or merged with the subDir, e.g. "/vol/content".
+     */
+    const char *targetPath;
+    FSLayerTypeEx layerType;
+    /**
+     * Combination of ContentRedirectionLayerFlags for the layers of this rule, e.g. CONTENT_REDIRECTION_LAYER_FLAG_IMMUTABLE
+     * for mods that don't change while the title is running. See "ContentRedirection_AddFSLayerExWithFlags".
+     * The layers are added without flags if the loaded module doesn't support them.
+     */
+    uint32_t flags;
+} ContentRedirectionModRule;
+
+typedef struct ContentRedirectionModLoaderConfig {
+    /**
+     * Directory which contains one folder per mod, e.g. "fs:/vol/external01/wiiu/mods/0005000010101D00".
+     * Has to be accessible via a registered newlib device and via the ContentRedirection module.
+     */
+    const char *modsRoot;
+    const ContentRedirectionModRule *rules;
+    uint32_t numRules;
+    /**
+     * Optional path of a file which caches the scan results. Mods whose folders didn't change since the last scan are not walked again.
+     * NULL disables the cache.
+     */
+    const char *cachePath;
+    /**
+     * Number of threads used to scan the mods. 0 uses one thread per CPU core.
+     */
+    uint32_t numThreads;
+} ContentRedirectionModLoaderConfig;
+
+/**
+ * Scans all mods in the given root and adds one layer per mod and matching rule via "ContentRedirection_AddFSLayerExWithFlags". <br>
+ * A rule matches a mod if the mod contains the rule's subDir with at least one file in it. <br>
+ * The mod folders are scanned in parallel, the layers are added afterwards in alphabetical order of the mod folders,
+ * and in order of the rules for each mod. Following the processing order of layers, later mods take priority over earlier ones. <br>
+ * <br>
+ * If "cachePath" is set, the results are cached per mod, keyed by a fingerprint of the mod folder and rule subDirs (size and mtime).
+ * Mods with an unchanged fingerprint are not walked again on the next call.
+ *
+ * **Requires API version 2 or higher**
+ *
+ * @param config            Mods root and rule set.
+ * @param handlesOut        Handles of the added layers are written to this array.
+ * @param maxHandles        Size of the "handlesOut" array.
+ * @param numHandlesOut     Number of handles written to "handlesOut".
+ * @return CONTENT_REDIRECTION_RESULT_SUCCESS:               The layers have been added. <br>
+ *         CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED:     "ContentRedirection_InitLibrary()" was not called. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND:   This function requires API version 2 <br>
+ *         CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT:      An argument is NULL or the mods root can't be opened. <br>
+ *         CONTENT_REDIRECTION_RESULT_NO_MEMORY:             "handlesOut" is too small or not enough memory. No layers have been added. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNKNOWN_ERROR:         Unknown error. No layers have been added.
+ */
+ContentRedirectionStatus ContentRedirection_LoadMods(const ContentRedirectionModLoaderConfig *config, CRLayerHandle *handlesOut, uint32_t maxHandles, uint32_t *numHandlesOut);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
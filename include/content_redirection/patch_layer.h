@@ -0,0 +1,75 @@
+#pragma once
+
+#include "redirection.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CONTENT_REDIRECTION_PATCH_MAGIC       0x43525054 // "CRPT"
+#define CONTENT_REDIRECTION_PATCH_VERSION     1
+#define CONTENT_REDIRECTION_PATCH_MAX_EXTENTS 0x10000 // Keeps the extents of a loaded patch below 6 MiB, "tools/crpatch" has the same limit
+
+/**
+ * @brief Header at the start of a patch file.
+ *
+ * A patch file consists of the header, "numExtents" ContentRedirectionPatchExtent entries sorted by "offset" and the data of the extents.
+ * All values are stored big-endian, like on the console. Patch files are created via the host tool in "tools/crpatch".
+ */
+typedef struct ContentRedirectionPatchHeader {
+    uint32_t magic;       /**< CONTENT_REDIRECTION_PATCH_MAGIC */
+    uint32_t version;     /**< CONTENT_REDIRECTION_PATCH_VERSION */
+    uint64_t baseSize;    /**< Size of the original file, the patch is rejected if the original file has a different size */
+    uint64_t patchedSize; /**< Size of the patched file, may be bigger or smaller than the original file */
+    uint32_t numExtents;  /**< Number of extents, at most CONTENT_REDIRECTION_PATCH_MAX_EXTENTS */
+    uint32_t reserved;    /**< Has to be 0 */
+} ContentRedirectionPatchHeader;
+
+/**
+ * @brief Range of the patched file whose bytes are taken from the patch file.
+ *
+ * Extents must not overlap and must end before "patchedSize". Bytes that are not covered by an extent are read from the original file,
+ * bytes beyond the end of the original file that are not covered by an extent read as 0.
+ */
+typedef struct ContentRedirectionPatchExtent {
+    uint64_t offset;     /**< Offset of the range in the patched file */
+    uint64_t dataOffset; /**< Offset of the data of the range in the patch file */
+    uint32_t length;     /**< Length of the range in bytes, not 0 */
+    uint32_t reserved;   /**< Has to be 0 */
+} ContentRedirectionPatchExtent;
+
+/**
+ * Adds a layer that replaces a single file with the original file plus a byte-range patch. <br>
+ * Instead of a full copy of a modified file only the changed ranges have to be shipped, e.g. a few bytes of a big archive.
+ * Reads of the patched file are merged on the fly: ranges covered by an extent are read from the patch file, everything else from the
+ * original file. The extents are kept in memory, the data of the extents is read from the patch file when it's needed. <br>
+ * <br>
+ * The layer has the type FS_LAYER_TYPE_EX_PATCH_FILE. The patched file is provided by a read-only device of this lib ("crvirtual:"),
+ * which is added to the module with the first patch or archive layer. Opening the patched file for writing fails with EROFS. <br>
+ * "ContentRedirection_RefreshFSLayer" loads the patch file again, files that are already open keep using the old patch.
+ * The layer can't be watched via "ContentRedirection_WatchFSLayer".
+ *
+ * **Requires API version 3 or higher**
+ *
+ * @param handlePtr     The handle of the layer is written to this pointer.
+ * @param layerName     Name of the layer, used for debugging.
+ * @param targetPath    Path of the file that will be patched, e.g. "/vol/content/Pack/Dungeon.pack".
+ * @param basePath      Path of the original file on a registered newlib device, e.g. "fs:/vol/content/Pack/Dungeon.pack".
+ *                      It must not be redirected by another layer, otherwise the patch is applied to the redirected file.
+ * @param patchPath     Path of the patch file on a registered newlib device, e.g. "fs:/vol/external01/mods/A/Dungeon.pack.crpatch".
+ * @param priority      Priority of the layer, see "ContentRedirection_AddFSLayerExWithPriority".
+ * @return CONTENT_REDIRECTION_RESULT_SUCCESS:              The layer has been added. <br>
+ *         CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED:    "ContentRedirection_InitLibrary()" was not called. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND:  This command is not supported by the currently loaded Module. <br>
+ *         CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT:     A pointer is NULL, a path doesn't belong to a registered device, a file can't be opened,
+ *                                                          the patch file is malformed or doesn't match the size of the original file. <br>
+ *         CONTENT_REDIRECTION_RESULT_NO_MEMORY:            The extents don't fit into the memory budget. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNKNOWN_ERROR:        Unknown error.
+ */
+ContentRedirectionStatus ContentRedirection_AddFSLayerPatch(CRLayerHandle *handlePtr, const char *layerName, const char *targetPath,
+                                                            const char *basePath, const char *patchPath, int32_t priority);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
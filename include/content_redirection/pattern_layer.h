@@ -0,0 +1,156 @@
+#pragma once
+
+#include "redirection.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CONTENT_REDIRECTION_PATTERN_DFA_VERSION 1
+#define CONTENT_REDIRECTION_PATTERN_DEAD_STATE  0      /**< State without any way to reach an accepting state */
+#define CONTENT_REDIRECTION_PATTERN_START_STATE 1      /**< State before the first character of the path */
+#define CONTENT_REDIRECTION_PATTERN_NO_MATCH    0xFFFF /**< Value of "acceptRule" of states that don't accept */
+#define CONTENT_REDIRECTION_PATTERN_MAX_RULES   0xFFFE
+
+/**
+ * @brief One rule of a pattern layer, see "ContentRedirection_AddFSLayerPattern".
+ *
+ * "pattern" is a glob relative to the target path of the layer:
+ *  - "*" matches any number of characters except '/'
+ *  - "?" matches one character except '/'
+ *  - "**" matches any number of characters including '/', "**" followed by '/' matches zero or more complete directories
+ *  - "[abc]", "[a-z]" match one of the given characters, "[!abc]" or "[^abc]" one character that isn't given and isn't '/'
+ *  - "\" matches the next character literally
+ *
+ * Matching ignores the case (ASCII only), like the FS of the console, e.g. "**&#47;*.bfres" matches "Model/Link.BFRES". <br>
+ * "replacementTemplate" is the path the matching file is redirected to, the following placeholders are expanded:
+ *  - "{path}" the path of the file relative to the target path, e.g. "Model/Link.BFRES"
+ *  - "{name}" the name of the file, e.g. "Link.BFRES"
+ *
+ * e.g. pattern "**&#47;*.bfres" and template "fast:/bfres/{path}" redirect "/vol/content/Model/Link.BFRES" to "fast:/bfres/Model/Link.BFRES".
+ */
+typedef struct ContentRedirectionPatternRule {
+    const char *pattern;
+    const char *replacementTemplate;
+} ContentRedirectionPatternRule;
+
+/**
+ * @brief Deterministic automaton of all rules of a pattern layer.
+ *
+ * Bytes of the path are lower-cased (ASCII only) and mapped to a class via "byteClasses", bytes of the same class behave the same in
+ * every state. The next state is "transitions[state * numClasses + class]". After the last byte "acceptRule[state]" holds the
+ * index of the rule that matches the path. If several rules match, the one with the lowest index wins. <br>
+ * See "ContentRedirection_MatchPattern".
+ */
+typedef struct ContentRedirectionPatternDFA {
+    uint32_t version;                        /**< CONTENT_REDIRECTION_PATTERN_DFA_VERSION */
+    uint32_t numStates;                      /**< Number of states, including the dead and the start state */
+    uint32_t numClasses;                     /**< Number of byte classes */
+    uint32_t numRules;                       /**< Number of rules */
+    const uint8_t *byteClasses;              /**< 256 entries */
+    const uint16_t *transitions;             /**< numStates * numClasses entries */
+    const uint16_t *acceptRule;              /**< numStates entries, rule index or CONTENT_REDIRECTION_PATTERN_NO_MATCH */
+    const char *const *replacementTemplates; /**< numRules entries */
+} ContentRedirectionPatternDFA;
+
+/**
+ * Returns the index of the rule that matches the path, or CONTENT_REDIRECTION_PATTERN_NO_MATCH.
+ * The cost only depends on the length of the path, not on the number of rules.
+ *
+ * @param dfa       Automaton of the layer.
+ * @param path      Path relative to the target path of the layer, without a leading '/', e.g. "Model/Link.BFRES".
+ */
+static inline uint32_t ContentRedirection_MatchPattern(const ContentRedirectionPatternDFA *dfa, const char *path) {
+    uint32_t state = CONTENT_REDIRECTION_PATTERN_START_STATE;
+    for (; *path && state != CONTENT_REDIRECTION_PATTERN_DEAD_STATE; path++) {
+        uint8_t c = (uint8_t) *path;
+        if (c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+        state = dfa->transitions[state * dfa->numClasses + dfa->byteClasses[c]];
+    }
+    return dfa->acceptRule[state];
+}
+
+/**
+ * Expands the placeholders of a replacement template, see ContentRedirectionPatternRule.
+ *
+ * @param replacementTemplate   Template of the matching rule.
+ * @param path                  Path relative to the target path of the layer, without a leading '/'.
+ * @param out                   The expanded path is written to this buffer.
+ * @param outSize               Size of "out" in bytes.
+ * @return false if "out" is too small.
+ */
+static inline bool ContentRedirection_ExpandPatternTemplate(const char *replacementTemplate, const char *path, char *out, size_t outSize) {
+    const char *name = path;
+    for (const char *p = path; *p; p++) {
+        if (*p == '/') {
+            name = p + 1;
+        }
+    }
+    size_t len = 0;
+    for (const char *t = replacementTemplate; *t;) {
+        const char *insert = NULL;
+        if (t[0] == '{' && t[1] == 'p' && t[2] == 'a' && t[3] == 't' && t[4] == 'h' && t[5] == '}') {
+            insert = path;
+            t += 6;
+        } else if (t[0] == '{' && t[1] == 'n' && t[2] == 'a' && t[3] == 'm' && t[4] == 'e' && t[5] == '}') {
+            insert = name;
+            t += 6;
+        }
+        if (insert == NULL) {
+            if (len + 1 >= outSize) {
+                return false;
+            }
+            out[len++] = *t++;
+            continue;
+        }
+        for (; *insert; insert++) {
+            if (len + 1 >= outSize) {
+                return false;
+            }
+            out[len++] = *insert;
+        }
+    }
+    if (len >= outSize) {
+        return false;
+    }
+    out[len] = '\0';
+    return true;
+}
+
+/**
+ * Adds a layer that redirects every file below the target path which matches one of the glob patterns. <br>
+ * This replaces one FS_LAYER_TYPE_EX_REPLACE_FILE layer per file: the patterns are compiled once into a single automaton,
+ * matching a path costs O(length of the path) no matter how many rules or files are covered. <br>
+ * <br>
+ * Only files are redirected, directories and directory listings of the target path are not changed.
+ * If the expanded replacement path doesn't exist, the original file is used. <br>
+ * The layer has the type FS_LAYER_TYPE_EX_PATTERN. It can't be watched via "ContentRedirection_WatchFSLayer",
+ * "ContentRedirection_RefreshFSLayer" drops everything the module has cached about the replacement paths.
+ *
+ * **Requires API version 10 or higher**
+ *
+ * @param handlePtr     The handle of the layer is written to this pointer.
+ * @param layerName     Name of the layer, used for debugging.
+ * @param targetPath    Path whose files are redirected, e.g. "/vol/content".
+ * @param rules         Array of rules, see ContentRedirectionPatternRule. If several rules match a path, the first one wins.
+ *                      The rules are copied.
+ * @param numRules      Number of entries in "rules", at most CONTENT_REDIRECTION_PATTERN_MAX_RULES.
+ * @param priority      Priority of the layer, see "ContentRedirection_AddFSLayerExWithPriority".
+ * @return CONTENT_REDIRECTION_RESULT_SUCCESS:              The layer has been added. <br>
+ *         CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED:    "ContentRedirection_InitLibrary()" was not called. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND:  This command is not supported by the currently loaded Module. <br>
+ *         CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT:     A pointer is NULL, "numRules" is 0 or too big or a pattern is malformed, e.g. an unterminated "[". <br>
+ *         CONTENT_REDIRECTION_RESULT_NO_MEMORY:            The automaton is too big or doesn't fit into the memory budget. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNKNOWN_ERROR:        Unknown error.
+ */
+ContentRedirectionStatus ContentRedirection_AddFSLayerPattern(CRLayerHandle *handlePtr, const char *layerName, const char *targetPath,
+                                                              const ContentRedirectionPatternRule *rules, uint32_t numRules, int32_t priority);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
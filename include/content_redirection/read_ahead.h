@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum ContentRedirectionReadAheadEvent {
+    /* A file switched to streaming mode. */
+    CONTENT_REDIRECTION_READ_AHEAD_EVENT_STREAM_START,
+    /* A read has been served from the readahead buffers without waiting. */
+    CONTENT_REDIRECTION_READ_AHEAD_EVENT_HIT,
+    /* A read had to wait for a readahead that was still in flight. */
+    CONTENT_REDIRECTION_READ_AHEAD_EVENT_STALL,
+    /* A read of a streaming file found no buffered data and went to the device directly. */
+    CONTENT_REDIRECTION_READ_AHEAD_EVENT_UNDERRUN,
+    /* Buffered or in-flight readahead data has been discarded because of a seek. */
+    CONTENT_REDIRECTION_READ_AHEAD_EVENT_CANCEL,
+    /* A buffer has been filled in the background, "bytes" holds the number of bytes read. */
+    CONTENT_REDIRECTION_READ_AHEAD_EVENT_FILL,
+} ContentRedirectionReadAheadEvent;
+
+typedef struct ContentRedirectionReadAheadStats {
+    uint32_t streams;         /**< Number of files that switched to streaming mode */
+    uint32_t hits;            /**< Reads served from the buffers without waiting */
+    uint32_t stalls;          /**< Reads that waited for an in-flight readahead */
+    uint32_t underruns;       /**< Reads of streaming files that missed the buffers and went to the device */
+    uint32_t cancelled;       /**< Readaheads discarded because of a seek */
+    uint64_t bytesPrefetched; /**< Bytes read in the background */
+} ContentRedirectionReadAheadStats;
+
+/**
+ * Queues a job on the readahead thread of this lib. Jobs are executed one after another in the order they have been queued. <br>
+ * Used by the devoptab wrapper to fill the buffers of files in streaming mode, see ContentRedirectionDeviceOptions::readAheadBufferSize.
+ *
+ * @param job       Function that will be called on the readahead thread.
+ * @param context   Argument of "job".
+ * @return true if the job has been queued, false if the lib is currently being deinitialized.
+ */
+bool ContentRedirection_QueueReadAhead(void (*job)(void *context), void *context);
+
+/**
+ * Counts an event of the readahead of the devoptab wrapper, see "ContentRedirection_GetReadAheadStats".
+ *
+ * @param event     Event that happened.
+ * @param bytes     Number of bytes, only used by CONTENT_REDIRECTION_READ_AHEAD_EVENT_FILL.
+ */
+void ContentRedirection_CountReadAheadEvent(ContentRedirectionReadAheadEvent event, uint32_t bytes);
+
+/**
+ * Retrieves the readahead counters of all devices added with a readahead buffer since the last reset. <br>
+ * Stalls and underruns are the reads that still had to wait for the device. If they happen regularly, the buffers are too small
+ * for the bandwidth the stream needs.
+ *
+ * @param statsOut  The counters are written to this pointer.
+ */
+void ContentRedirection_GetReadAheadStats(ContentRedirectionReadAheadStats *statsOut);
+
+void ContentRedirection_ResetReadAheadStats(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "defines.h"
+#include "status.h"
+#include <stdbool.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -47,33 +49,117 @@ typedef enum FSLayerType {
      * Existing files in /vol/save/8XXXXXXX will be ignored, only files in the layer (provided via the replacementDir) will be used.
      */
     FS_LAYER_TYPE_SAVE_REPLACE_FOR_CURRENT_USER,
+
+    /* Redirects the /vol/save to a given path as copy-on-write overlay.
+     * The replacementDir doesn't need to be prepared, it may even be empty.
+     *
+     * Files are read from the original /vol/save until they are opened for writing for the first time.
+     * On the first write access the file is copied into the layer (provided via the replacementDir), from then on only the copy is used.
+     * New files and directories are only created in the layer.
+     *
+     * Deleting a file or directory which exists in the original /vol/save creates a whiteout in the layer,
+     * using the same ".deleted_" prefix as FS_LAYER_TYPE_CONTENT_MERGE.
+     * e.g. deleting "/vol/save/common/slot1.bin" creates "[replacementDir]/common/.deleted_slot1.bin"
+     *
+     * **Requires API version 4 or higher**
+     */
+    FS_LAYER_TYPE_SAVE_COPY_ON_WRITE,
+
+    /*
+     * Same as FS_LAYER_TYPE_SAVE_COPY_ON_WRITE, but for /vol/save/8XXXXXXX of the current user
+     *
+     * **Requires API version 4 or higher**
+     */
+    FS_LAYER_TYPE_SAVE_COPY_ON_WRITE_FOR_CURRENT_USER,
 } FSLayerType;
 
 typedef enum FSLayerTypeEx {
     FS_LAYER_TYPE_EX_REPLACE_DIRECTORY,
     FS_LAYER_TYPE_EX_MERGE_DIRECTORY,
     FS_LAYER_TYPE_EX_REPLACE_FILE,
+
+    /* Copy-on-write overlay for a directory, see FS_LAYER_TYPE_SAVE_COPY_ON_WRITE.
+     *
+     * **Requires API version 4 or higher**
+     */
+    FS_LAYER_TYPE_EX_COPY_ON_WRITE_DIRECTORY,
+
+    /* Redirects every file that matches one of a set of glob patterns, see "ContentRedirection_AddFSLayerPattern".
+     * Layers of this type can only be added via "ContentRedirection_AddFSLayerPattern".
+     *
+     * **Requires API version 10 or higher**
+     */
+    FS_LAYER_TYPE_EX_PATTERN,
+
+    /* Replaces a single file with the original file plus a byte-range patch, see "ContentRedirection_AddFSLayerPatch".
+     * Layers of this type can only be added via "ContentRedirection_AddFSLayerPatch".
+     *
+     * **Requires API version 3 or higher**
+     */
+    FS_LAYER_TYPE_EX_PATCH_FILE,
+
+    /* Replaces members of a SARC archive with files of a dir, see "ContentRedirection_AddFSLayerArchive".
+     * Layers of this type can only be added via "ContentRedirection_AddFSLayerArchive".
+     *
+     * **Requires API version 3 or higher**
+     */
+    FS_LAYER_TYPE_EX_ARCHIVE,
 } FSLayerTypeEx;
 
-typedef enum ContentRedirectionStatus {
-    CONTENT_REDIRECTION_RESULT_SUCCESS               = 0,
-    CONTENT_REDIRECTION_RESULT_MODULE_NOT_FOUND      = -0x1,
-    CONTENT_REDIRECTION_RESULT_MODULE_MISSING_EXPORT = -0x2,
-    CONTENT_REDIRECTION_RESULT_UNSUPPORTED_VERSION   = -0x3,
-    CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT      = -0x10,
-    CONTENT_REDIRECTION_RESULT_NO_MEMORY             = -0x11,
-    CONTENT_REDIRECTION_RESULT_UNKNOWN_FS_LAYER_TYPE = -0x12,
-    CONTENT_REDIRECTION_RESULT_LAYER_NOT_FOUND       = -0x13,
-    CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED     = -0x20,
-    CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND   = -0x21,
-    CONTENT_REDIRECTION_RESULT_UNKNOWN_ERROR         = -0x1000,
-} ContentRedirectionStatus;
+/**
+ * Flags of a layer, see "ContentRedirection_AddFSLayerExWithFlags". The flags can be combined.
+ */
+typedef enum ContentRedirectionLayerFlags {
+    CONTENT_REDIRECTION_LAYER_FLAG_NONE = 0,
+
+    /* The replacement dir doesn't change while the layer exists, e.g. mod content on the SD card.
+     * Positive and negative lookups and directory listings of the layer may be cached for the whole lifetime of the layer.
+     * Not allowed for copy-on-write layers.
+     */
+    CONTENT_REDIRECTION_LAYER_FLAG_IMMUTABLE = 1 << 0,
+
+    /* The replacement dir contains no ".deleted_" files, lookups don't probe for them.
+     * Not allowed for copy-on-write layers.
+     */
+    CONTENT_REDIRECTION_LAYER_FLAG_NO_WHITEOUTS = 1 << 1,
+} ContentRedirectionLayerFlags;
 
 typedef uint32_t CRLayerHandle;
 typedef uint32_t ContentRedirectionVersion;
 
 #define CONTENT_REDIRECTION_MODULE_VERSION_ERROR 0xFFFFFFFF
 
+typedef enum ContentRedirectionMemoryBudgetPolicy {
+    /* Caches are evicted when the budget is exceeded, new layers and devices can still be added. */
+    CONTENT_REDIRECTION_MEMORY_BUDGET_POLICY_EVICT_CACHES,
+    /* Caches are evicted when the budget is exceeded, adding new layers fails with CONTENT_REDIRECTION_RESULT_NO_MEMORY. */
+    CONTENT_REDIRECTION_MEMORY_BUDGET_POLICY_REFUSE_NEW_LAYERS,
+} ContentRedirectionMemoryBudgetPolicy;
+
+typedef struct ContentRedirectionLayerMemoryUsage {
+    CRLayerHandle handle;
+    uint32_t bytes; /**< Memory used by the layer itself and its caches */
+} ContentRedirectionLayerMemoryUsage;
+
+typedef struct ContentRedirectionDeviceMemoryUsage {
+    char name[32];
+    uint32_t bytes;            /**< Memory used by the device, including the open files and directories */
+    uint32_t openFiles;        /**< Number of currently allocated fileStructs (structSize bytes each) */
+    uint32_t openDirs;         /**< Number of currently allocated dirStates (dirStateSize bytes each) */
+    uint32_t handleStateBytes; /**< Memory used by the fileStructs and dirStates */
+} ContentRedirectionDeviceMemoryUsage;
+
+typedef struct ContentRedirectionMemoryUsage {
+    uint32_t totalBytes;   /**< Memory used by the module */
+    uint32_t layerBytes;   /**< Part of totalBytes used by layers */
+    uint32_t deviceBytes;  /**< Part of totalBytes used by devices */
+    uint32_t cacheBytes;   /**< Part of totalBytes used by caches */
+    uint32_t libraryBytes; /**< Memory used by caches and buffers of this lib, not part of totalBytes */
+    uint32_t budgetBytes;  /**< Current memory budget, 0 if there is none */
+    uint32_t numLayers;    /**< Total number of layers, may be bigger than the size of the layer array */
+    uint32_t numDevices;   /**< Total number of devices, may be bigger than the size of the device array */
+} ContentRedirectionMemoryUsage;
+
 typedef enum ContentRedirectionApiErrorType {
     CONTENT_REDIRECTION_API_ERROR_NONE                  = 0,
     CONTENT_REDIRECTION_API_ERROR_INVALID_ARG           = -1,
@@ -125,6 +211,7 @@ ContentRedirectionStatus ContentRedirection_GetVersion(ContentRedirectionVersion
 * @return CONTENT_REDIRECTION_RESULT_SUCCESS:               The layer had been added successfully. <br>
  *                                                          The layer has to be removed before the currently running application ends. <br>
 *         CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED:     "ContentRedirection_InitLibrary()" was not called. <br>
+*         CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND:   The layerType requires a newer API version than the loaded module provides. <br>
 *         CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT:      "handlePtr", "layerName" or "replacementDir" is NULL <br>
 *         CONTENT_REDIRECTION_API_ERROR_NO_MEMORY:          Not enough memory to create this layer. <br>
 *         CONTENT_REDIRECTION_API_ERROR_UNKNOWN_LAYER_TYPE: Unknown/invalid LayerType. See FSLayerType for all supported layers. <br>
@@ -150,7 +237,7 @@ ContentRedirectionStatus ContentRedirection_AddFSLayer(CRLayerHandle *handlePtr,
  *                          If set to false, errors of this layer will be returned to the OS.
 * @return CONTENT_REDIRECTION_RESULT_SUCCESS:               The layer had been added successfully. <br>
  *                                                          The layer has to be removed before the currently running application ends. <br>
-*         CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND:   This function requires API version 2 <br>
+*         CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND:   This function requires API version 2, FS_LAYER_TYPE_EX_COPY_ON_WRITE_DIRECTORY requires API version 4 <br>
 *         CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED:     "ContentRedirection_InitLibrary()" was not called. <br>
 *         CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT:      "handlePtr", "layerName" or "replacementDir" is NULL <br>
 *         CONTENT_REDIRECTION_API_ERROR_NO_MEMORY:          Not enough memory to create this layer. <br>
@@ -159,6 +246,85 @@ ContentRedirectionStatus ContentRedirection_AddFSLayer(CRLayerHandle *handlePtr,
  */
 ContentRedirectionStatus ContentRedirection_AddFSLayerEx(CRLayerHandle *handlePtr, const char *layerName, const char *targetPath, const char *replacementPath, FSLayerTypeEx layerType);
 
+/**
+ * Same as "ContentRedirection_AddFSLayer", but with an explicit priority.  <br>
+ * Layers with a higher priority are processed first. Layers with the same priority are processed in reverse adding order.  <br>
+ * Layers added via "ContentRedirection_AddFSLayer" and "ContentRedirection_AddFSLayerEx" have the priority 0.  <br>
+ * <br>
+ * If the loaded module doesn't support priorities (API version 5), they are emulated by removing and re-adding layers.
+ * The handles returned by this lib stay valid, but only layers added via this lib are taken into account.
+ *
+ * @param handlePtr         The handle of the layer is written to this pointer.
+ * @param layerName         Name of the layer, used for debugging.
+ * @param replacementDir    Path to the directory that will replace / merge into the original one.
+ * @param layerType         Type of the layer, see FSLayerType for more information.
+ * @param priority          Priority of the layer.
+ * @return See "ContentRedirection_AddFSLayer"
+ */
+ContentRedirectionStatus ContentRedirection_AddFSLayerWithPriority(CRLayerHandle *handlePtr, const char *layerName, const char *replacementDir, FSLayerType layerType, int32_t priority);
+
+/**
+ * Same as "ContentRedirection_AddFSLayerEx", but with an explicit priority. See "ContentRedirection_AddFSLayerWithPriority".
+ *
+ * **Requires API version 2 or higher**
+ *
+ * @param handlePtr         The handle of the layer is written to this pointer.
+ * @param layerName         Name of the layer, used for debugging.
+ * @param targetPath        Path to the directory/file that should be replaced or merged.
+ * @param replacementPath   Path to the directory/file that will replace / merge into the original one.
+ * @param layerType         Type of the layer, see FSLayerTypeEx for more information.
+ * @param priority          Priority of the layer.
+ * @return See "ContentRedirection_AddFSLayerEx"
+ */
+ContentRedirectionStatus ContentRedirection_AddFSLayerExWithPriority(CRLayerHandle *handlePtr, const char *layerName, const char *targetPath, const char *replacementPath, FSLayerTypeEx layerType, int32_t priority);
+
+/**
+ * Same as "ContentRedirection_AddFSLayerExWithPriority", but with flags that describe the content of the replacement dir,
+ * see ContentRedirectionLayerFlags. <br>
+ * The flags only allow the module to skip work, a layer behaves the same with and without them as long as the replacement dir
+ * matches the flags. Layer flags require API version 9, use CONTENT_REDIRECTION_LAYER_FLAG_NONE for older modules. <br>
+ * Immutable layers can't be watched via "ContentRedirection_WatchFSLayer", but can still be refreshed explicitly.
+ *
+ * **Requires API version 2 or higher**
+ *
+ * @param handlePtr         The handle of the layer is written to this pointer.
+ * @param layerName         Name of the layer, used for debugging.
+ * @param targetPath        Path to the directory/file that should be replaced or merged.
+ * @param replacementPath   Path to the directory/file that will replace / merge into the original one.
+ * @param layerType         Type of the layer, see FSLayerTypeEx for more information.
+ * @param priority          Priority of the layer.
+ * @param flags             Combination of ContentRedirectionLayerFlags.
+ * @return See "ContentRedirection_AddFSLayerEx". <br>
+ *         CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT is also returned for unknown flags and for flags on copy-on-write layers. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNSUPPORTED_VERSION is also returned for flags if the loaded module doesn't support layer flags (API version 9).
+ */
+ContentRedirectionStatus ContentRedirection_AddFSLayerExWithFlags(CRLayerHandle *handlePtr, const char *layerName, const char *targetPath, const char *replacementPath, FSLayerTypeEx layerType, int32_t priority, uint32_t flags);
+
+/**
+ * Changes the priority of an existing layer, see "ContentRedirection_AddFSLayerWithPriority". <br>
+ *
+ * @param handle    Handle of the FSLayer.
+ * @param priority  New priority of the layer.
+ * @return See "ContentRedirection_SetLayerPriorities"
+ */
+ContentRedirectionStatus ContentRedirection_SetLayerPriority(CRLayerHandle handle, int32_t priority);
+
+/**
+ * Changes the priorities of multiple layers at once. Use this function to re-order many layers, the layer stack is only updated once. <br>
+ * On modules without native support (API version 5) only layers which have been added via this lib can be re-ordered.
+ *
+ * @param handles       Array of FSLayer handles.
+ * @param priorities    Array of the new priorities, priorities[i] is applied to handles[i].
+ * @param count         Number of entries in "handles" and "priorities".
+ * @return CONTENT_REDIRECTION_RESULT_SUCCESS:              The priorities have been set successfully. <br>
+ *         CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED:    "ContentRedirection_InitLibrary()" was not called. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND:  This command is not supported by the currently loaded Module. <br>
+ *         CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT:     "handles" or "priorities" is NULL. <br>
+ *         CONTENT_REDIRECTION_RESULT_LAYER_NOT_FOUND:      Invalid FSLayer handle. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNKNOWN_ERROR:        Unknown error.
+ */
+ContentRedirectionStatus ContentRedirection_SetLayerPriorities(const CRLayerHandle *handles, const int32_t *priorities, uint32_t count);
+
 /**
  * Removes a previously added FS Layer.
  * @param handle    handle of the layer that will be removed
@@ -166,6 +332,80 @@ ContentRedirectionStatus ContentRedirection_AddFSLayerEx(CRLayerHandle *handlePt
  */
 ContentRedirectionStatus ContentRedirection_RemoveFSLayer(CRLayerHandle handle);
 
+/**
+ * Picks up changes of the replacement dir of a layer, e.g. files that have been added, modified or deleted while the layer is active. <br>
+ * The replacement dir is compared to the state of the last refresh by size and modification time of every entry,
+ * only the entries that have changed are refreshed in the module. The first refresh of a layer refreshes the whole layer,
+ * unless the layer is watched via "ContentRedirection_WatchFSLayer". <br>
+ * <br>
+ * The replacement dir has to be accessible via a registered newlib device. <br>
+ * If the loaded module doesn't support refreshing layers (API version 7), the layer is removed and re-added, this may change the order
+ * of layers with the same priority on modules with native priorities. The handle of the layer stays valid. <br>
+ * Layers of the type FS_LAYER_TYPE_EX_PATTERN have no replacement dir, they are always refreshed as a whole. <br>
+ * Layers of the type FS_LAYER_TYPE_EX_PATCH_FILE load their patch file again and are refreshed as a whole. <br>
+ * Layers of the type FS_LAYER_TYPE_EX_ARCHIVE rebuild the archive from the current member dir and are refreshed as a whole. <br>
+ * Only layers which have been added via this lib can be refreshed.
+ *
+ * @param handle    Handle of the FSLayer.
+ * @return CONTENT_REDIRECTION_RESULT_SUCCESS:              The layer is up to date. <br>
+ *         CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED:    "ContentRedirection_InitLibrary()" was not called. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND:  This command is not supported by the currently loaded Module. <br>
+ *         CONTENT_REDIRECTION_RESULT_LAYER_NOT_FOUND:      Invalid FSLayer handle. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNKNOWN_ERROR:        Unknown error.
+ */
+ContentRedirectionStatus ContentRedirection_RefreshFSLayer(CRLayerHandle handle);
+
+/**
+ * Polls the replacement dir of a layer for changes and refreshes the layer via "ContentRedirection_RefreshFSLayer" when something has changed. <br>
+ * The current state of the replacement dir is used as baseline, so the first poll doesn't refresh the whole layer. <br>
+ * All watched layers are polled by one background thread, which exits when no layer is watched anymore.
+ * Removed layers are unwatched automatically, "ContentRedirection_DeInitLibrary" unwatches all layers.
+ *
+ * @param handle        Handle of the FSLayer.
+ * @param intervalMs    Time between two polls in milliseconds, 0 stops watching the layer.
+ * @return CONTENT_REDIRECTION_RESULT_SUCCESS:              The layer is watched (or not watched anymore). <br>
+ *         CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT:     The layer has been added with CONTENT_REDIRECTION_LAYER_FLAG_IMMUTABLE or is a pattern, patch or archive layer. <br>
+ *         CONTENT_REDIRECTION_RESULT_LAYER_NOT_FOUND:      Invalid FSLayer handle or the layer hasn't been added via this lib.
+ */
+ContentRedirectionStatus ContentRedirection_WatchFSLayer(CRLayerHandle handle, uint32_t intervalMs);
+
+/**
+ * Retrieves the memory usage of the module, its layers and devices, and of the caches of this lib. <br>
+ *
+ * **Requires API version 6 or higher**
+ *
+ * @param usageOut      Total memory usage is written to this pointer.
+ * @param layersOut     Optional, per-layer breakdown is written to this array.
+ * @param maxLayers     Size of the "layersOut" array.
+ * @param devicesOut    Optional, per-device breakdown is written to this array.
+ * @param maxDevices    Size of the "devicesOut" array.
+ * @return CONTENT_REDIRECTION_RESULT_SUCCESS:              The memory usage has been written to the given pointers. <br>
+ *         CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED:    "ContentRedirection_InitLibrary()" was not called. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND:  This command is not supported by the currently loaded Module. <br>
+ *         CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT:     "usageOut" is NULL. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNKNOWN_ERROR:        Unknown error.
+ */
+ContentRedirectionStatus ContentRedirection_GetMemoryUsage(ContentRedirectionMemoryUsage *usageOut,
+                                                           ContentRedirectionLayerMemoryUsage *layersOut, uint32_t maxLayers,
+                                                           ContentRedirectionDeviceMemoryUsage *devicesOut, uint32_t maxDevices);
+
+/**
+ * Sets a memory budget for the module and the caches of this lib. <br>
+ * When the budget is exceeded, caches are evicted. Depending on the policy, new layers are refused. <br>
+ * Caches and buffers of this lib are bypassed when they don't fit into the budget. The budget is only changed if the module has accepted it. <br>
+ *
+ * **Requires API version 6 or higher**
+ *
+ * @param budgetBytes   Memory budget in bytes, 0 removes the budget.
+ * @param policy        What happens if the budget is exceeded, see ContentRedirectionMemoryBudgetPolicy.
+ * @return CONTENT_REDIRECTION_RESULT_SUCCESS:              The budget has been set. <br>
+ *         CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED:    "ContentRedirection_InitLibrary()" was not called. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND:  The currently loaded module doesn't support memory budgets. Nothing has been changed. <br>
+ *         CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT:     Invalid policy. <br>
+ *         CONTENT_REDIRECTION_RESULT_UNKNOWN_ERROR:        Unknown error.
+ */
+ContentRedirectionStatus ContentRedirection_SetMemoryBudget(uint32_t budgetBytes, ContentRedirectionMemoryBudgetPolicy policy);
+
 /**
  * Set the "active" flag for a given FSLayer. <br>
  *
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ContentRedirectionSlabClassStats {
+    uint32_t slotSize;            /**< Maximum allocation size of this class, 0 for allocations that are bigger than the biggest class */
+    uint32_t capacity;            /**< Number of slots in all chunks of this class */
+    uint32_t inUse;               /**< Number of slots that are currently allocated */
+    uint32_t peakInUse;           /**< Maximum of "inUse" so far */
+    uint32_t numChunks;           /**< Number of chunks the slots are allocated in */
+    uint32_t fallbackAllocations; /**< Number of allocations that have been served by malloc because the class couldn't grow */
+} ContentRedirectionSlabClassStats;
+
+/**
+ * Allocates memory from a size-classed slab pool. <br>
+ * Intended for the per-handle state of devices (fileStruct / dirStruct), which is allocated on every open and freed on every close. <br>
+ * Allocating and freeing is lock-free and doesn't touch the heap once the pool has grown to the working set.
+ * The pool grows in chunks, allocations that don't fit into a class are served by malloc. <br>
+ * The memory is aligned like malloc and is not cleared.
+ *
+ * @param size  Size in bytes.
+ * @return Pointer to the memory, NULL if there is not enough memory.
+ */
+void *ContentRedirection_SlabAlloc(uint32_t size);
+
+/**
+ * Frees memory which has been allocated via "ContentRedirection_SlabAlloc". NULL is ignored.
+ */
+void ContentRedirection_SlabFree(void *ptr);
+
+/**
+ * Grows the class for the given size until at least "count" slots are free, e.g. when a device is added.
+ *
+ * @param size  Size in bytes of the allocations.
+ * @param count Number of free slots.
+ * @return true if the slots are available, false if the size is too big for the pool or there is not enough memory.
+ */
+bool ContentRedirection_SlabReserve(uint32_t size, uint32_t count);
+
+/**
+ * Retrieves the occupancy of the slab pool, one entry per size class.
+ *
+ * @param statsOut      Array the stats are written to, may be NULL.
+ * @param maxClasses    Size of the "statsOut" array.
+ * @return The number of classes, which may be bigger than "maxClasses".
+ */
+uint32_t ContentRedirection_GetSlabPoolStats(ContentRedirectionSlabClassStats *statsOut, uint32_t maxClasses);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
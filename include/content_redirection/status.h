@@ -0,0 +1,23 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum ContentRedirectionStatus {
+    CONTENT_REDIRECTION_RESULT_SUCCESS               = 0,
+    CONTENT_REDIRECTION_RESULT_MODULE_NOT_FOUND      = -0x1,
+    CONTENT_REDIRECTION_RESULT_MODULE_MISSING_EXPORT = -0x2,
+    CONTENT_REDIRECTION_RESULT_UNSUPPORTED_VERSION   = -0x3,
+    CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT      = -0x10,
+    CONTENT_REDIRECTION_RESULT_NO_MEMORY             = -0x11,
+    CONTENT_REDIRECTION_RESULT_UNKNOWN_FS_LAYER_TYPE = -0x12,
+    CONTENT_REDIRECTION_RESULT_LAYER_NOT_FOUND       = -0x13,
+    CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED     = -0x20,
+    CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND   = -0x21,
+    CONTENT_REDIRECTION_RESULT_UNKNOWN_ERROR         = -0x1000,
+} ContentRedirectionStatus;
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
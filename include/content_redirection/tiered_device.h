@@ -0,0 +1,72 @@
+#pragma once
+
+#include "redirection.h"
+#include <stdint.h>
+#include <sys/iosupport.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ContentRedirectionTierConfig {
+    /**
+     * Base path of this tier on an already registered newlib device, e.g. "usb:/hot" or "fs:/vol/external01/bulk".
+     */
+    const char *path;
+    /**
+     * Number of bytes that may be filled with files promoted from slower tiers. 0 disables promotion into this tier.
+     */
+    uint64_t promotionBudget;
+} ContentRedirectionTierConfig;
+
+typedef struct ContentRedirectionTieredDeviceConfig {
+    /**
+     * Name of the device, e.g. "tiered". Paths of the device look like "tiered:/content/file.bin".
+     */
+    const char *name;
+    /**
+     * Tiers of this device, ordered from fastest to slowest.
+     */
+    const ContentRedirectionTierConfig *tiers;
+    uint32_t numTiers;
+    /**
+     * A file that has been opened for reading this many times is copied into the fastest tier that still has enough budget.
+     * Promotion happens on a background thread. 0 disables promotion.
+     */
+    uint32_t promoteAfterReads;
+} ContentRedirectionTieredDeviceConfig;
+
+/**
+ * Creates a device that stacks several devices in priority order. <br>
+ * Opening a file for reading and stat calls are served by the fastest tier that has the file. <br>
+ * Files opened for writing are modified in the fastest tier that has the file, new files and directories are created in the slowest tier.
+ * A promoted copy is dropped as soon as the original is opened for writing, renamed or deleted.
+ * Renaming a file drops copies with the old or the new name in the other tiers, renaming a directory renames it in every tier. <br>
+ * The directory "/.libcontentredirection" of each tier is reserved for the lib and hidden from the device.
+ * Promoted copies are stored in its "promoted" subdirectory, which is deleted when the device is created. Don't store anything else there. <br>
+ * Directory listings contain the entries of all tiers. <br>
+ * <br>
+ * The returned device can be added via "ContentRedirection_AddDevice" like any other devoptab_t.
+ * It's not added to the newlib device list.
+ *
+ * @param config        Configuration of the device. All strings are copied.
+ * @param deviceOut     The created device is written to this pointer.
+ * @return CONTENT_REDIRECTION_RESULT_SUCCESS:          The device has been created. <br>
+ *         CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT: "config" or "deviceOut" is NULL, there is no tier or a tier path doesn't belong to a registered device. <br>
+ *         CONTENT_REDIRECTION_RESULT_NO_MEMORY:        Not enough memory to create the device.
+ */
+ContentRedirectionStatus ContentRedirection_CreateTieredDevice(const ContentRedirectionTieredDeviceConfig *config, const devoptab_t **deviceOut);
+
+/**
+ * Destroys a device created by "ContentRedirection_CreateTieredDevice". <br>
+ * Make sure to remove the device via "ContentRedirection_RemoveDevice" and to close all files before calling this function.
+ *
+ * @param device    Device that will be destroyed.
+ * @return CONTENT_REDIRECTION_RESULT_SUCCESS:          The device has been destroyed. <br>
+ *         CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT: "device" is NULL.
+ */
+ContentRedirectionStatus ContentRedirection_DestroyTieredDevice(const devoptab_t *device);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,114 @@
+#include "change_detector.h"
+#include "content_redirection/io_scheduler.h"
+
+#include <cstring>
+#include <dirent.h>
+#include <set>
+#include <sys/stat.h>
+
+namespace {
+    void ScanEntries(const std::string &root, const std::string &relativePath, DirSnapshot &out, std::vector<std::string> &subDirs) {
+        const auto path = root + relativePath;
+        DIR *dir        = opendir(path.c_str());
+        if (!dir) {
+            return;
+        }
+        const struct dirent *entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+            auto entryPath = relativePath + "/" + entry->d_name;
+            struct stat st {};
+            if (stat((root + entryPath).c_str(), &st) != 0) {
+                continue;
+            }
+            FileFingerprint fingerprint;
+            fingerprint.isDir = S_ISDIR(st.st_mode);
+            fingerprint.mtime = st.st_mtime;
+            // The size of directories differs between devices and carries no information.
+            fingerprint.size = fingerprint.isDir ? 0 : st.st_size;
+            out[entryPath]   = fingerprint;
+            if (fingerprint.isDir) {
+                subDirs.push_back(std::move(entryPath));
+            }
+        }
+        closedir(dir);
+    }
+
+    void ScanDir(const std::string &root, const std::string &relativePath, DirSnapshot &out) {
+        std::vector<std::string> subDirs;
+        {
+            // Scanning runs in the background, every directory is one request for the I/O scheduler.
+            CR_DevoptabWrapper::BackgroundIO io;
+            ScanEntries(root, relativePath, out, subDirs);
+        }
+        for (const auto &subDir : subDirs) {
+            ScanDir(root, subDir, out);
+        }
+    }
+
+    bool HasParentIn(const std::string &path, const std::set<std::string> &dirs) {
+        for (auto pos = path.rfind('/'); pos != std::string::npos && pos > 0; pos = path.rfind('/', pos - 1)) {
+            if (dirs.count(path.substr(0, pos)) != 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+} // namespace
+
+namespace ChangeDetector {
+    bool Scan(const std::string &root, DirSnapshot &out) {
+        out.clear();
+        std::string rootPath = root;
+        while (!rootPath.empty() && rootPath.back() == '/') {
+            rootPath.pop_back();
+        }
+        struct stat st {};
+        if (stat(rootPath.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+            return false;
+        }
+        ScanDir(rootPath, "", out);
+        return true;
+    }
+
+    std::vector<std::string> Diff(const DirSnapshot &previous, const DirSnapshot &current) {
+        std::vector<std::string> result;
+        // Both snapshots are sorted by path, so they can be compared in one pass.
+        auto oldIt = previous.begin();
+        auto newIt = current.begin();
+        std::set<std::string> changedDirs;
+        while (oldIt != previous.end() || newIt != current.end()) {
+            int cmp;
+            if (oldIt == previous.end()) {
+                cmp = 1;
+            } else if (newIt == current.end()) {
+                cmp = -1;
+            } else {
+                cmp = oldIt->first.compare(newIt->first);
+            }
+            const auto &path = cmp < 0 ? oldIt->first : newIt->first;
+            if (HasParentIn(path, changedDirs)) {
+                // Already covered by an added or removed parent directory.
+            } else if (cmp != 0) {
+                if (cmp < 0 ? oldIt->second.isDir : newIt->second.isDir) {
+                    changedDirs.insert(path);
+                }
+                result.push_back(path);
+            } else if (oldIt->second.isDir != newIt->second.isDir) {
+                changedDirs.insert(path);
+                result.push_back(path);
+            } else if (!newIt->second.isDir && !(oldIt->second == newIt->second)) {
+                result.push_back(path);
+            }
+            if (cmp <= 0) {
+                ++oldIt;
+            }
+            if (cmp >= 0) {
+                ++newIt;
+            }
+        }
+        return result;
+    }
+} // namespace ChangeDetector
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Polling change detection for the replacement dirs of layers.
+ *
+ * A snapshot holds a size/mtime fingerprint of every file and directory below a root, keyed by the path relative to the root (e.g. "/data/file.bin").
+ */
+struct FileFingerprint {
+    int64_t size  = 0;
+    int64_t mtime = 0;
+    bool isDir    = false;
+
+    bool operator==(const FileFingerprint &other) const {
+        return size == other.size && mtime == other.mtime && isDir == other.isDir;
+    }
+};
+
+using DirSnapshot = std::map<std::string, FileFingerprint>;
+
+namespace ChangeDetector {
+    /**
+     * Walks the given root via newlib and fingerprints every entry.
+     * Returns false if the root can't be opened, "out" is empty in this case.
+     */
+    bool Scan(const std::string &root, DirSnapshot &out);
+
+    /**
+     * Returns the relative paths of all entries that have been added, removed or modified between the two snapshots.
+     * Entries inside of an added or removed directory are not listed separately.
+     * Directories whose fingerprint changed but still exist are not reported, changes of their content are reported instead.
+     */
+    std::vector<std::string> Diff(const DirSnapshot &previous, const DirSnapshot &current);
+} // namespace ChangeDetector
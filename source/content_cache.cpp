@@ -0,0 +1,333 @@
+#include "content_redirection/content_cache.h"
+#include "library_memory.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace {
+    constexpr uint32_t INDEX_MAGIC      = 0x43524348; // "CRCH"
+    constexpr uint32_t INDEX_VERSION    = 1;
+    constexpr uint32_t MAX_PATH_LEN     = 1024;
+    constexpr uint32_t DEFAULT_CAPACITY = 4 * 1024 * 1024;
+
+    struct IndexEntry {
+        int64_t size;
+        int64_t mtime;
+        uint64_t hash;
+    };
+
+    struct ContentEntry {
+        void *data    = nullptr;
+        uint32_t size = 0;
+        uint32_t refs = 0;
+        std::list<ContentEntry *>::iterator unusedIt; /**< Only valid while "refs" is 0 */
+    };
+
+    using ContentKey = std::pair<uint64_t, uint32_t>;
+
+    std::mutex sIndexMutex;
+    std::unordered_map<std::string, IndexEntry> sIndex;
+
+    std::mutex sMutex;
+    std::map<ContentKey, ContentEntry> sContents;
+    std::unordered_map<const void *, ContentKey> sContentByData;
+    std::list<ContentEntry *> sUnused; /**< Contents without references, least recently used first */
+    uint32_t sUnusedBytes = 0;
+    uint32_t sCapacity    = DEFAULT_CAPACITY;
+    ContentRedirectionContentCacheStats sStats{};
+
+    uint64_t ReadWord(const uint8_t *p) {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        return word;
+    }
+
+    // Must be called with sMutex held.
+    bool EvictOldestUnused() {
+        if (sUnused.empty()) {
+            return false;
+        }
+        ContentEntry *entry = sUnused.front();
+        sUnused.pop_front();
+        sUnusedBytes -= entry->size;
+        const uint32_t size = entry->size;
+        const auto keyIt    = sContentByData.find(entry->data);
+        free(entry->data);
+        sContents.erase(keyIt->second);
+        sContentByData.erase(keyIt);
+        ContentRedirection_ReleaseLibraryMemory(size);
+        return true;
+    }
+
+    // Must be called with sMutex held.
+    void TakeReference(ContentEntry &entry) {
+        if (entry.refs++ == 0) {
+            sUnused.erase(entry.unusedIt);
+            sUnusedBytes -= entry.size;
+        }
+    }
+
+    // Must be called with sMutex held.
+    void TrimUnused() {
+        while (sUnusedBytes > sCapacity && EvictOldestUnused()) {}
+    }
+} // namespace
+
+uint64_t ContentRedirection_HashContent(const void *data, size_t len) {
+    // MurmurHash64A
+    constexpr uint64_t m = 0xC6A4A7935BD1E995ULL;
+    constexpr int r      = 47;
+
+    const auto *bytes = static_cast<const uint8_t *>(data);
+    uint64_t h        = 0x8445D61A4E774912ULL ^ (len * m);
+
+    const size_t blocks = len / 8;
+    for (size_t i = 0; i < blocks; i++) {
+        uint64_t k = ReadWord(bytes + i * 8);
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    const uint8_t *tail = bytes + blocks * 8;
+    switch (len & 7) {
+        case 7:
+            h ^= uint64_t(tail[6]) << 48;
+            [[fallthrough]];
+        case 6:
+            h ^= uint64_t(tail[5]) << 40;
+            [[fallthrough]];
+        case 5:
+            h ^= uint64_t(tail[4]) << 32;
+            [[fallthrough]];
+        case 4:
+            h ^= uint64_t(tail[3]) << 24;
+            [[fallthrough]];
+        case 3:
+            h ^= uint64_t(tail[2]) << 16;
+            [[fallthrough]];
+        case 2:
+            h ^= uint64_t(tail[1]) << 8;
+            [[fallthrough]];
+        case 1:
+            h ^= uint64_t(tail[0]);
+            h *= m;
+            break;
+        default:
+            break;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+bool ContentRedirection_LookupContentHash(const char *path, int64_t size, int64_t mtime, uint64_t *hashOut) {
+    if (path == nullptr || hashOut == nullptr) {
+        return false;
+    }
+    std::lock_guard lock(sIndexMutex);
+    const auto it = sIndex.find(path);
+    if (it == sIndex.end() || it->second.size != size || it->second.mtime != mtime) {
+        return false;
+    }
+    *hashOut = it->second.hash;
+    return true;
+}
+
+void ContentRedirection_StoreContentHash(const char *path, int64_t size, int64_t mtime, uint64_t hash) {
+    if (path == nullptr) {
+        return;
+    }
+    {
+        std::lock_guard lock(sIndexMutex);
+        sIndex[path] = {size, mtime, hash};
+    }
+    std::lock_guard lock(sMutex);
+    sStats.hashesComputed++;
+}
+
+const void *ContentRedirection_AcquireCachedContent(uint64_t hash, uint32_t size) {
+    std::lock_guard lock(sMutex);
+    const auto it = sContents.find({hash, size});
+    if (it == sContents.end()) {
+        return nullptr;
+    }
+    TakeReference(it->second);
+    sStats.hits++;
+    sStats.bytesReadSaved += size;
+    return it->second.data;
+}
+
+void *ContentRedirection_AllocateCachedContent(uint32_t size) {
+    if (size == 0) {
+        return nullptr;
+    }
+    std::lock_guard lock(sMutex);
+    while (!ContentRedirection_ReserveLibraryMemory(size)) {
+        if (!EvictOldestUnused()) {
+            return nullptr;
+        }
+    }
+    void *data = malloc(size);
+    if (data == nullptr) {
+        ContentRedirection_ReleaseLibraryMemory(size);
+    }
+    return data;
+}
+
+void ContentRedirection_FreeCachedContent(void *data, uint32_t size) {
+    if (data == nullptr) {
+        return;
+    }
+    free(data);
+    ContentRedirection_ReleaseLibraryMemory(size);
+}
+
+const void *ContentRedirection_InsertCachedContent(uint64_t hash, void *data, uint32_t size) {
+    if (data == nullptr) {
+        return nullptr;
+    }
+    std::unique_lock lock(sMutex);
+    sStats.misses++;
+    const auto [it, inserted] = sContents.try_emplace({hash, size});
+    if (!inserted) {
+        TakeReference(it->second);
+        const void *existing = it->second.data;
+        lock.unlock();
+        ContentRedirection_FreeCachedContent(data, size);
+        return existing;
+    }
+    it->second.data = data;
+    it->second.size = size;
+    it->second.refs = 1;
+    sContentByData.emplace(data, it->first);
+    return data;
+}
+
+void ContentRedirection_ReleaseCachedContent(const void *data) {
+    if (data == nullptr) {
+        return;
+    }
+    std::lock_guard lock(sMutex);
+    const auto keyIt = sContentByData.find(data);
+    if (keyIt == sContentByData.end()) {
+        DEBUG_FUNCTION_LINE_WARN("Tried to release content %p which isn't cached", data);
+        return;
+    }
+    ContentEntry &entry = sContents[keyIt->second];
+    if (--entry.refs == 0) {
+        entry.unusedIt = sUnused.insert(sUnused.end(), &entry);
+        sUnusedBytes += entry.size;
+        TrimUnused();
+    }
+}
+
+void ContentRedirection_SetContentCacheCapacity(uint32_t bytes) {
+    std::lock_guard lock(sMutex);
+    sCapacity = bytes;
+    TrimUnused();
+}
+
+bool ContentRedirection_LoadContentHashes(const char *sidecarPath) {
+    std::lock_guard lock(sIndexMutex);
+    sIndex.clear();
+    if (sidecarPath == nullptr) {
+        return false;
+    }
+    FILE *f = fopen(sidecarPath, "rb");
+    if (!f) {
+        return false;
+    }
+    uint32_t header[3];
+    if (fread(header, sizeof(header), 1, f) != 1 || header[0] != INDEX_MAGIC || header[1] != INDEX_VERSION) {
+        fclose(f);
+        return false;
+    }
+    bool valid = true;
+    for (uint32_t i = 0; i < header[2]; i++) {
+        uint32_t pathLen;
+        IndexEntry entry{};
+        if (fread(&pathLen, sizeof(pathLen), 1, f) != 1 || pathLen > MAX_PATH_LEN) {
+            valid = false;
+            break;
+        }
+        std::string path(pathLen, '\0');
+        if (fread(path.data(), 1, pathLen, f) != pathLen ||
+            fread(&entry.size, sizeof(entry.size), 1, f) != 1 ||
+            fread(&entry.mtime, sizeof(entry.mtime), 1, f) != 1 ||
+            fread(&entry.hash, sizeof(entry.hash), 1, f) != 1) {
+            valid = false;
+            break;
+        }
+        sIndex[std::move(path)] = entry;
+    }
+    fclose(f);
+    if (!valid) {
+        DEBUG_FUNCTION_LINE_WARN("Content hash index \"%s\" is truncated", sidecarPath);
+        sIndex.clear();
+    }
+    return valid;
+}
+
+bool ContentRedirection_SaveContentHashes(const char *sidecarPath) {
+    if (sidecarPath == nullptr) {
+        return false;
+    }
+    FILE *f = fopen(sidecarPath, "wb");
+    if (!f) {
+        DEBUG_FUNCTION_LINE_WARN("Failed to open \"%s\" for writing", sidecarPath);
+        return false;
+    }
+    std::lock_guard lock(sIndexMutex);
+    const uint32_t header[3] = {INDEX_MAGIC, INDEX_VERSION, static_cast<uint32_t>(sIndex.size())};
+    bool success             = fwrite(header, sizeof(header), 1, f) == 1;
+    for (const auto &[path, entry] : sIndex) {
+        if (!success) {
+            break;
+        }
+        const uint32_t pathLen = path.size();
+        success                = fwrite(&pathLen, sizeof(pathLen), 1, f) == 1 &&
+                  fwrite(path.data(), 1, pathLen, f) == pathLen &&
+                  fwrite(&entry.size, sizeof(entry.size), 1, f) == 1 &&
+                  fwrite(&entry.mtime, sizeof(entry.mtime), 1, f) == 1 &&
+                  fwrite(&entry.hash, sizeof(entry.hash), 1, f) == 1;
+    }
+    if (fclose(f) != 0) {
+        success = false;
+    }
+    return success;
+}
+
+void ContentRedirection_GetContentCacheStats(ContentRedirectionContentCacheStats *statsOut) {
+    if (statsOut == nullptr) {
+        return;
+    }
+    std::lock_guard lock(sMutex);
+    *statsOut                   = sStats;
+    statsOut->entries           = sContents.size();
+    statsOut->bytesCached       = 0;
+    statsOut->bytesDeduplicated = 0;
+    for (const auto &[key, entry] : sContents) {
+        statsOut->bytesCached += entry.size;
+        if (entry.refs > 1) {
+            statsOut->bytesDeduplicated += (entry.refs - 1) * entry.size;
+        }
+    }
+}
+
+void ContentRedirection_ResetContentCacheStats() {
+    std::lock_guard lock(sMutex);
+    sStats = {};
+}
@@ -0,0 +1,784 @@
+#include "content_redirection/device_test_kit.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+    constexpr uint32_t TEST_FILE_SIZE             = 64 * 1024;
+    constexpr uint32_t DEFAULT_LARGE_DIR_ENTRIES  = 512;
+    constexpr uint32_t DEFAULT_READ_FILE_SIZE     = 4 * 1024 * 1024;
+    constexpr uint32_t DEFAULT_CONCURRENT_READERS = 4;
+    constexpr uint32_t LATENCY_ITERATIONS         = 100;
+    constexpr uint32_t READ_SIZES[3]              = {4 * 1024, 64 * 1024, 1024 * 1024};
+    constexpr int MAX_ERRNO                       = 4095;
+
+    using Clock = std::chrono::steady_clock;
+
+    uint64_t ElapsedNs(Clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    }
+
+    uint8_t PatternByte(uint32_t offset) {
+        return static_cast<uint8_t>((offset * 131) ^ (offset >> 8));
+    }
+
+    /**
+     * Memory for one file or dir struct of the device, allocated via the device if it provides an allocator.
+     */
+    class DeviceStruct {
+    public:
+        DeviceStruct(const ContentRedirectionDeviceABI *device, bool dir) : mDevice(device), mDir(dir) {
+            const bool hasAllocator = device->version >= 4 && (dir ? device->alloc_dir_struct != nullptr : device->alloc_file_struct != nullptr);
+            if (hasAllocator) {
+                mPtr = dir ? device->alloc_dir_struct(device->deviceData) : device->alloc_file_struct(device->deviceData);
+            } else {
+                const size_t size = std::max(dir ? device->dirStateSize : device->structSize, 1);
+                mFallback         = std::make_unique<std::max_align_t[]>((size + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t));
+                mPtr              = mFallback.get();
+            }
+        }
+
+        ~DeviceStruct() {
+            if (mPtr != nullptr && !mFallback) {
+                if (mDir) {
+                    mDevice->free_dir_struct(mDevice->deviceData, mPtr);
+                } else {
+                    mDevice->free_file_struct(mDevice->deviceData, mPtr);
+                }
+            }
+        }
+
+        DeviceStruct(const DeviceStruct &)            = delete;
+        DeviceStruct &operator=(const DeviceStruct &) = delete;
+
+        [[nodiscard]] void *get() const {
+            return mPtr;
+        }
+
+    private:
+        const ContentRedirectionDeviceABI *mDevice;
+        bool mDir;
+        void *mPtr = nullptr;
+        std::unique_ptr<std::max_align_t[]> mFallback;
+    };
+
+    class Report {
+    public:
+        explicit Report(const ContentRedirectionDeviceTestConfig &config) : mConfig(config) {}
+
+        void printf(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+            if (mConfig.print == nullptr) {
+                return;
+            }
+            char line[256];
+            va_list args;
+            va_start(args, fmt);
+            vsnprintf(line, sizeof(line), fmt, args);
+            va_end(args);
+            mConfig.print(mConfig.printContext, line);
+        }
+
+    private:
+        const ContentRedirectionDeviceTestConfig &mConfig;
+    };
+
+    class ConformanceSuite {
+    public:
+        ConformanceSuite(const ContentRedirectionDeviceABI *device, const ContentRedirectionDeviceTestConfig &config)
+            : mDev(device), mData(device->deviceData), mReport(config), mDir(config.scratchDir) {}
+
+        ContentRedirectionDeviceConformanceResult run() {
+            mReport.printf("conformance %s (device version %u)", mDev->name ? mDev->name : "(null)", mDev->version);
+            checkHeader();
+            if (!checkSetup()) {
+                mReport.printf("scratch directory \"%s\" can't be used, skipping the remaining checks", mDir.c_str());
+            } else {
+                checkFiles();
+                checkFileOperations();
+                checkDirectories();
+                checkRelative();
+                checkStatMany();
+                checkRemove();
+            }
+            mReport.printf("conformance result: %u passed, %u failed, %u skipped", mResult.passed, mResult.failed, mResult.skipped);
+            return mResult;
+        }
+
+    private:
+        [[nodiscard]] bool has(uint32_t version) const {
+            return mDev->version >= version;
+        }
+
+        std::string path(const char *name) const {
+            return mDir + "/" + name;
+        }
+
+        bool check(const char *entry, bool ok, const char *what, int64_t got) {
+            if (ok) {
+                mResult.passed++;
+            } else {
+                mResult.failed++;
+                mReport.printf("[FAIL] %s: %s (got %lld)", entry, what, static_cast<long long>(got));
+            }
+            return ok;
+        }
+
+        bool expect(const char *entry, int64_t got, int64_t expected, const char *what) {
+            if (got == expected) {
+                mResult.passed++;
+                return true;
+            }
+            mResult.failed++;
+            mReport.printf("[FAIL] %s: %s, expected %lld (got %lld)", entry, what, static_cast<long long>(expected), static_cast<long long>(got));
+            return false;
+        }
+
+        /**
+         * For entries whose support depends on the underlying filesystem: the call has to succeed or fail with a negative errno.
+         */
+        bool expectZeroOrErrno(const char *entry, int64_t got, const char *what) {
+            return check(entry, got == 0 || (got < 0 && got >= -MAX_ERRNO), what, got);
+        }
+
+        bool expectErrno(const char *entry, int64_t got, const char *what) {
+            return check(entry, got < 0 && got >= -MAX_ERRNO, what, got);
+        }
+
+        void skip(const char *entry) {
+            mResult.skipped++;
+            mReport.printf("[SKIP] %s: not implemented", entry);
+        }
+
+        void checkHeader() {
+            check("header", mDev->magic == CONTENT_REDIRECTION_DEVICE_MAGIC, "magic is CONTENT_REDIRECTION_DEVICE_MAGIC", mDev->magic);
+            check("header", mDev->version >= 1 && mDev->version <= CONTENT_REDIRECTION_DEVICE_VERSION, "version is known", mDev->version);
+            check("header", mDev->name != nullptr && mDev->name[0] != '\0' && strchr(mDev->name, ':') == nullptr, "name is set and has no ':'", 0);
+            check("header", mDev->structSize > 0, "structSize is positive", mDev->structSize);
+            check("header", mDev->dirStateSize >= 0, "dirStateSize isn't negative", mDev->dirStateSize);
+            if (has(2)) {
+                check("map", (mDev->map == nullptr) == (mDev->unmap == nullptr), "map and unmap are set together", 0);
+            }
+            if (has(4)) {
+                check("alloc_file_struct", (mDev->alloc_file_struct == nullptr) == (mDev->free_file_struct == nullptr), "alloc and free are set together", 0);
+                check("alloc_dir_struct", (mDev->alloc_dir_struct == nullptr) == (mDev->free_dir_struct == nullptr), "alloc and free are set together", 0);
+            }
+        }
+
+        bool checkSetup() {
+            if (!mDev->mkdir || !mDev->stat) {
+                mReport.printf("[FAIL] mkdir/stat: required to set up the scratch directory");
+                mResult.failed++;
+                return false;
+            }
+            if (!expect("mkdir", mDev->mkdir(mData, mDir.c_str(), 0777), 0, "creating the scratch directory returns 0")) {
+                return false;
+            }
+            expect("mkdir", mDev->mkdir(mData, mDir.c_str(), 0777), -EEXIST, "creating an existing directory fails");
+            CR_Stat st{};
+            if (expect("stat", mDev->stat(mData, mDir.c_str(), &st), 0, "stat of a directory returns 0")) {
+                check("stat", S_ISDIR(st.mode), "mode of a directory is S_IFDIR", st.mode);
+            }
+            expect("stat", mDev->stat(mData, path("missing").c_str(), &st), -ENOENT, "stat of a missing file fails");
+            expect("stat", mDev->stat(mData, path("missing/child").c_str(), &st), -ENOENT, "stat below a missing directory fails");
+            if (mDev->lstat) {
+                expect("lstat", mDev->lstat(mData, path("missing").c_str(), &st), -ENOENT, "lstat of a missing file fails");
+            } else {
+                skip("lstat");
+            }
+            return true;
+        }
+
+        bool writeTestFile(const char *name, uint32_t size) {
+            if (!mDev->open || !mDev->write || !mDev->close) {
+                return false;
+            }
+            DeviceStruct fd(mDev, false);
+            const int openRes = mDev->open(mData, fd.get(), path(name).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+            if (!check("open", openRes >= 0, "creating a file succeeds", openRes)) {
+                return false;
+            }
+            std::vector<char> data(size);
+            for (uint32_t i = 0; i < size; i++) {
+                data[i] = static_cast<char>(PatternByte(i));
+            }
+            uint32_t done = 0;
+            while (done < size) {
+                const ssize_t res = mDev->write(mData, fd.get(), data.data() + done, size - done);
+                if (!check("write", res > 0, "write makes progress", res)) {
+                    break;
+                }
+                done += static_cast<uint32_t>(res);
+            }
+            if (mDev->fsync) {
+                expect("fsync", mDev->fsync(mData, fd.get()), 0, "fsync of a written file returns 0");
+            } else {
+                skip("fsync");
+            }
+            if (mDev->fstat) {
+                CR_Stat st{};
+                if (expect("fstat", mDev->fstat(mData, fd.get(), &st), 0, "fstat of a file opened for writing returns 0")) {
+                    expect("fstat", st.size, size, "size includes all written bytes");
+                }
+            }
+            expect("close", mDev->close(mData, fd.get()), 0, "close returns 0");
+            return done == size;
+        }
+
+        void checkFiles() {
+            if (!mDev->open || !mDev->close) {
+                skip("open");
+                return;
+            }
+            {
+                DeviceStruct fd(mDev, false);
+                expect("open", mDev->open(mData, fd.get(), path("missing").c_str(), O_RDONLY, 0), -ENOENT, "opening a missing file fails");
+            }
+            if (!mDev->write) {
+                skip("write");
+                return;
+            }
+            if (!writeTestFile("a.bin", TEST_FILE_SIZE)) {
+                return;
+            }
+
+            DeviceStruct fd(mDev, false);
+            if (!check("open", mDev->open(mData, fd.get(), path("a.bin").c_str(), O_RDONLY, 0) >= 0, "opening an existing file succeeds", 0)) {
+                return;
+            }
+            if (mDev->read) {
+                std::vector<char> buf(TEST_FILE_SIZE);
+                bool matches = expect("read", mDev->read(mData, fd.get(), buf.data(), 1000), 1000, "read returns the requested length");
+                for (uint32_t i = 0; matches && i < 1000; i++) {
+                    matches = static_cast<uint8_t>(buf[i]) == PatternByte(i);
+                }
+                check("read", matches, "read returns the written data", 0);
+                if (mDev->seek) {
+                    expect("seek", mDev->seek(mData, fd.get(), 0, SEEK_CUR), 1000, "the offset advances by the bytes read");
+                    expect("seek", mDev->seek(mData, fd.get(), TEST_FILE_SIZE - 100, SEEK_SET), TEST_FILE_SIZE - 100, "SEEK_SET returns the new offset");
+                    expect("read", mDev->read(mData, fd.get(), buf.data(), 1000), 100, "a read at the end of the file is short");
+                    expect("read", mDev->read(mData, fd.get(), buf.data(), 1000), 0, "a read at the end of the file returns 0");
+                    expect("seek", mDev->seek(mData, fd.get(), -10, SEEK_END), TEST_FILE_SIZE - 10, "SEEK_END is relative to the size");
+                    expectErrno("seek", mDev->seek(mData, fd.get(), -1, SEEK_SET), "seeking before the start fails with a negative errno");
+                    expect("seek", mDev->seek(mData, fd.get(), 0, SEEK_CUR), TEST_FILE_SIZE - 10, "a failed seek doesn't move the offset");
+                } else {
+                    skip("seek");
+                }
+            } else {
+                skip("read");
+            }
+            if (mDev->fstat) {
+                CR_Stat st{};
+                if (expect("fstat", mDev->fstat(mData, fd.get(), &st), 0, "fstat returns 0")) {
+                    expect("fstat", st.size, TEST_FILE_SIZE, "size matches the file");
+                    check("fstat", S_ISREG(st.mode), "mode of a file is S_IFREG", st.mode);
+                }
+            } else {
+                skip("fstat");
+            }
+            if (has(2) && mDev->map) {
+                const void *ptr = nullptr;
+                const int res   = mDev->map(mData, fd.get(), 4096, 4096, &ptr);
+                if (res == -ENOTSUP) {
+                    mResult.passed++;
+                } else if (expect("map", res, 0, "map returns 0 or -ENOTSUP")) {
+                    check("map", ptr != nullptr && static_cast<const uint8_t *>(ptr)[0] == PatternByte(4096), "the mapping contains the file data", 0);
+                    expect("unmap", mDev->unmap(mData, fd.get(), ptr, 4096), 0, "unmap returns 0");
+                }
+            } else {
+                skip("map");
+            }
+            if (mDev->fpathconf) {
+                const int64_t res = mDev->fpathconf(mData, fd.get(), _PC_NAME_MAX);
+                check("fpathconf", res >= -MAX_ERRNO, "returns a value or a negative errno", res);
+            } else {
+                skip("fpathconf");
+            }
+            if (mDev->write) {
+                expectErrno("write", mDev->write(mData, fd.get(), "x", 1), "writing to a file opened read-only fails with a negative errno");
+            }
+            expect("close", mDev->close(mData, fd.get()), 0, "close returns 0");
+        }
+
+        void checkFileOperations() {
+            if (!mDev->open || !mDev->close) {
+                return;
+            }
+            if (has(3) && mDev->copy_range) {
+                DeviceStruct src(mDev, false), dst(mDev, false);
+                if (mDev->open(mData, src.get(), path("a.bin").c_str(), O_RDONLY, 0) >= 0) {
+                    if (mDev->open(mData, dst.get(), path("copy.bin").c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666) >= 0) {
+                        const int64_t res = mDev->copy_range(mData, src.get(), 0, dst.get(), 0, TEST_FILE_SIZE + 100);
+                        if (res != -ENOTSUP && res != -ENOMEM) {
+                            expect("copy_range", res, TEST_FILE_SIZE, "copying past the end of the source stops at its end");
+                        } else {
+                            mResult.passed++;
+                        }
+                        if (mDev->seek) {
+                            expect("copy_range", mDev->seek(mData, src.get(), 0, SEEK_CUR), 0, "the file offsets aren't changed");
+                        }
+                        mDev->close(mData, dst.get());
+                    }
+                    mDev->close(mData, src.get());
+                }
+            } else {
+                skip("copy_range");
+            }
+            if (mDev->ftruncate) {
+                DeviceStruct fd(mDev, false);
+                if (mDev->open(mData, fd.get(), path("a.bin").c_str(), O_RDWR, 0) >= 0) {
+                    expect("ftruncate", mDev->ftruncate(mData, fd.get(), 100), 0, "ftruncate returns 0");
+                    CR_Stat st{};
+                    if (mDev->fstat && mDev->fstat(mData, fd.get(), &st) == 0) {
+                        expect("ftruncate", st.size, 100, "the file has the new size");
+                    }
+                    expectErrno("ftruncate", mDev->ftruncate(mData, fd.get(), -1), "a negative length fails with a negative errno");
+                    mDev->close(mData, fd.get());
+                }
+            } else {
+                skip("ftruncate");
+            }
+            if (mDev->fchmod) {
+                DeviceStruct fd(mDev, false);
+                if (mDev->open(mData, fd.get(), path("a.bin").c_str(), O_RDONLY, 0) >= 0) {
+                    expectZeroOrErrno("fchmod", mDev->fchmod(mData, fd.get(), 0666), "returns 0 or a negative errno");
+                    mDev->close(mData, fd.get());
+                }
+            } else {
+                skip("fchmod");
+            }
+            if (mDev->chmod) {
+                expectZeroOrErrno("chmod", mDev->chmod(mData, path("a.bin").c_str(), 0666), "returns 0 or a negative errno");
+                expectErrno("chmod", mDev->chmod(mData, path("missing").c_str(), 0666), "chmod of a missing file fails with a negative errno");
+            } else {
+                skip("chmod");
+            }
+            if (mDev->utimes) {
+                const CR_Timeval times[2] = {};
+                expectZeroOrErrno("utimes", mDev->utimes(mData, path("a.bin").c_str(), times), "returns 0 or a negative errno");
+            } else {
+                skip("utimes");
+            }
+            if (mDev->statvfs) {
+                CR_Statvfs buf{};
+                expectZeroOrErrno("statvfs", mDev->statvfs(mData, mDir.c_str(), &buf), "returns 0 or a negative errno");
+            } else {
+                skip("statvfs");
+            }
+            if (mDev->pathconf) {
+                const int64_t res = mDev->pathconf(mData, mDir.c_str(), _PC_NAME_MAX);
+                check("pathconf", res >= -MAX_ERRNO, "returns a value or a negative errno", res);
+            } else {
+                skip("pathconf");
+            }
+            if (mDev->chdir) {
+                expectErrno("chdir", mDev->chdir(mData, path("missing").c_str()), "chdir to a missing directory fails with a negative errno");
+            } else {
+                skip("chdir");
+            }
+            if (mDev->rename) {
+                expect("rename", mDev->rename(mData, path("a.bin").c_str(), path("b.bin").c_str()), 0, "rename returns 0");
+                CR_Stat st{};
+                expect("rename", mDev->stat(mData, path("a.bin").c_str(), &st), -ENOENT, "the old name is gone");
+                expect("rename", mDev->stat(mData, path("b.bin").c_str(), &st), 0, "the new name exists");
+                expect("rename", mDev->rename(mData, path("missing").c_str(), path("c.bin").c_str()), -ENOENT, "renaming a missing file fails");
+            } else {
+                skip("rename");
+                writeTestFile("b.bin", 100);
+            }
+            if (mDev->link) {
+                if (expectZeroOrErrno("link", mDev->link(mData, path("b.bin").c_str(), path("hardlink.bin").c_str()), "returns 0 or a negative errno") && mDev->unlink) {
+                    mDev->unlink(mData, path("hardlink.bin").c_str());
+                }
+            } else {
+                skip("link");
+            }
+            if (mDev->symlink) {
+                const int res = mDev->symlink(mData, "b.bin", path("symlink").c_str());
+                expectZeroOrErrno("symlink", res, "returns 0 or a negative errno");
+                if (res == 0 && mDev->readlink) {
+                    char buf[64];
+                    expect("readlink", mDev->readlink(mData, path("symlink").c_str(), buf, sizeof(buf)), 5, "returns the length of the target");
+                }
+                if (res == 0 && mDev->unlink) {
+                    mDev->unlink(mData, path("symlink").c_str());
+                }
+            } else {
+                skip("symlink");
+            }
+        }
+
+        /**
+         * Lists a directory, returns the number of entries or -1. "expectedName" has to be listed with "expectedSize".
+         */
+        int listDir(void *dirStruct, const char *expectedName, int64_t expectedSize) {
+            char name[NAME_MAX + 1];
+            CR_Stat st{};
+            int count  = 0;
+            bool found = false;
+            int res    = 0;
+            while ((res = mDev->dirnext(mData, dirStruct, name, &st)) == 0 && count < 100000) {
+                count++;
+                if (strcmp(name, expectedName) == 0) {
+                    found = true;
+                    expect("dirnext", st.size, expectedSize, "the stat of an entry has its size");
+                }
+            }
+            expect("dirnext", res, -ENOENT, "the end of the directory is signalled with -ENOENT");
+            check("dirnext", found, "lists the files of the directory", count);
+            return count;
+        }
+
+        void checkDirectories() {
+            if (!mDev->diropen || !mDev->dirnext || !mDev->dirclose) {
+                skip("diropen");
+                return;
+            }
+            expect("mkdir", mDev->mkdir(mData, path("sub").c_str(), 0777), 0, "creating a sub directory returns 0");
+            {
+                DeviceStruct dir(mDev, true);
+                expect("diropen", mDev->diropen(mData, dir.get(), path("missing").c_str()), -ENOENT, "opening a missing directory fails");
+            }
+            DeviceStruct dir(mDev, true);
+            if (!expect("diropen", mDev->diropen(mData, dir.get(), mDir.c_str()), 0, "opening a directory returns 0")) {
+                return;
+            }
+            const int count = listDir(dir.get(), "b.bin", 100);
+            char name[NAME_MAX + 1];
+            CR_Stat st{};
+            expect("dirnext", mDev->dirnext(mData, dir.get(), name, &st), -ENOENT, "dirnext keeps returning -ENOENT at the end");
+            if (mDev->dirreset) {
+                expect("dirreset", mDev->dirreset(mData, dir.get()), 0, "dirreset returns 0");
+                int again = 0;
+                while (mDev->dirnext(mData, dir.get(), name, &st) == 0 && again < 100000) {
+                    again++;
+                }
+                expect("dirreset", again, count, "the directory is listed again from the start");
+            } else {
+                skip("dirreset");
+            }
+            expect("dirclose", mDev->dirclose(mData, dir.get()), 0, "dirclose returns 0");
+        }
+
+        void checkRelative() {
+            if (!has(5) || (!mDev->openat && !mDev->fstatat && !mDev->diropenat)) {
+                skip("openat/fstatat/diropenat");
+                return;
+            }
+            DeviceStruct dir(mDev, true);
+            if (!mDev->diropen || mDev->diropen(mData, dir.get(), mDir.c_str()) != 0) {
+                return;
+            }
+            if (mDev->fstatat) {
+                CR_Stat st{};
+                if (expect("fstatat", mDev->fstatat(mData, dir.get(), "b.bin", &st), 0, "fstatat of a file in the directory returns 0")) {
+                    expect("fstatat", st.size, 100, "fstatat returns the size of the file");
+                }
+                expect("fstatat", mDev->fstatat(mData, dir.get(), "missing", &st), -ENOENT, "fstatat of a missing file fails");
+            } else {
+                skip("fstatat");
+            }
+            if (mDev->openat) {
+                DeviceStruct fd(mDev, false);
+                if (check("openat", mDev->openat(mData, dir.get(), fd.get(), "b.bin", O_RDONLY, 0) >= 0, "openat of a file in the directory succeeds", 0)) {
+                    char buf[16];
+                    if (mDev->read) {
+                        expect("openat", mDev->read(mData, fd.get(), buf, sizeof(buf)), sizeof(buf), "the opened file can be read");
+                    }
+                    mDev->close(mData, fd.get());
+                }
+                DeviceStruct missing(mDev, false);
+                expect("openat", mDev->openat(mData, dir.get(), missing.get(), "missing", O_RDONLY, 0), -ENOENT, "openat of a missing file fails");
+            } else {
+                skip("openat");
+            }
+            if (mDev->diropenat) {
+                DeviceStruct sub(mDev, true);
+                if (expect("diropenat", mDev->diropenat(mData, dir.get(), sub.get(), "sub"), 0, "diropenat of a sub directory returns 0")) {
+                    char name[NAME_MAX + 1];
+                    CR_Stat st{};
+                    int res;
+                    int count = 0;
+                    while ((res = mDev->dirnext(mData, sub.get(), name, &st)) == 0 && count < 100000) {
+                        count++;
+                    }
+                    expect("diropenat", res, -ENOENT, "the sub directory can be listed independently");
+                    mDev->dirclose(mData, sub.get());
+                }
+            } else {
+                skip("diropenat");
+            }
+            mDev->dirclose(mData, dir.get());
+        }
+
+        void checkStatMany() {
+            if (!has(6) || !mDev->stat_many) {
+                skip("stat_many");
+                return;
+            }
+            const std::string existing = path("b.bin");
+            const std::string missing  = path("missing");
+            const char *paths[3]       = {existing.c_str(), missing.c_str(), mDir.c_str()};
+            CR_StatResult results[3]   = {};
+            if (!expect("stat_many", mDev->stat_many(mData, paths, 3, results), 0, "stat_many returns 0 even if a path is missing")) {
+                return;
+            }
+            if (expect("stat_many", results[0].result, 0, "an existing file succeeds")) {
+                expect("stat_many", results[0].st.size, 100, "the result has the size of the file");
+            }
+            expect("stat_many", results[1].result, -ENOENT, "a missing file is reported in its result");
+            if (expect("stat_many", results[2].result, 0, "a directory succeeds")) {
+                check("stat_many", S_ISDIR(results[2].st.mode), "mode of a directory is S_IFDIR", results[2].st.mode);
+            }
+            expect("stat_many", mDev->stat_many(mData, paths, 0, results), 0, "an empty request returns 0");
+        }
+
+        void checkRemove() {
+            CR_Stat st{};
+            if (mDev->rmdir) {
+                expectErrno("rmdir", mDev->rmdir(mData, mDir.c_str()), "removing a non-empty directory fails with a negative errno");
+                expect("rmdir", mDev->rmdir(mData, path("sub").c_str()), 0, "removing an empty directory returns 0");
+                expect("rmdir", mDev->rmdir(mData, path("sub").c_str()), -ENOENT, "removing a missing directory fails");
+            } else {
+                skip("rmdir");
+            }
+            if (mDev->unlink) {
+                expect("unlink", mDev->unlink(mData, path("b.bin").c_str()), 0, "unlink returns 0");
+                expect("unlink", mDev->stat(mData, path("b.bin").c_str(), &st), -ENOENT, "the file is gone");
+                expect("unlink", mDev->unlink(mData, path("b.bin").c_str()), -ENOENT, "unlinking a missing file fails");
+                mDev->unlink(mData, path("copy.bin").c_str());
+            } else {
+                skip("unlink");
+            }
+            if (mDev->rmdir) {
+                expect("rmdir", mDev->rmdir(mData, mDir.c_str()), 0, "the scratch directory can be removed");
+            }
+        }
+
+        const ContentRedirectionDeviceABI *mDev;
+        void *mData;
+        Report mReport;
+        std::string mDir;
+        ContentRedirectionDeviceConformanceResult mResult{};
+    };
+
+    class PerformanceProfile {
+    public:
+        PerformanceProfile(const ContentRedirectionDeviceABI *device, const ContentRedirectionDeviceTestConfig &config)
+            : mDev(device), mData(device->deviceData), mReport(config), mDir(config.scratchDir),
+              mDirEntries(config.largeDirEntries != 0 ? config.largeDirEntries : DEFAULT_LARGE_DIR_ENTRIES),
+              mFileSize(config.readFileSize != 0 ? config.readFileSize : DEFAULT_READ_FILE_SIZE),
+              mReaders(config.concurrentReaders != 0 ? config.concurrentReaders : DEFAULT_CONCURRENT_READERS) {}
+
+        ContentRedirectionStatus run(ContentRedirectionDevicePerfResult &result) {
+            if (!mDev->open || !mDev->close || !mDev->read || !mDev->write || !mDev->stat || !mDev->mkdir || !mDev->unlink || !mDev->rmdir ||
+                !mDev->diropen || !mDev->dirnext || !mDev->dirclose) {
+                mReport.printf("perf %s: the device lacks entries the profile needs", mDev->name);
+                return CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND;
+            }
+            std::unique_ptr<char[]> buffer(new (std::nothrow) char[READ_SIZES[2]]);
+            if (!buffer) {
+                return CONTENT_REDIRECTION_RESULT_NO_MEMORY;
+            }
+            ContentRedirectionStatus res = CONTENT_REDIRECTION_RESULT_UNKNOWN_ERROR;
+            if (setup(buffer.get())) {
+                mReport.printf("perf %s: file %u bytes, directory %u entries, %u readers", mDev->name, mFileSize, mDirEntries, mReaders);
+                measureLatency(result);
+                measureReads(result, buffer.get());
+                measureDirnext(result);
+                measureConcurrentReads(result);
+                res = CONTENT_REDIRECTION_RESULT_SUCCESS;
+            } else {
+                mReport.printf("perf %s: failed to create the test files in \"%s\"", mDev->name, mDir.c_str());
+            }
+            cleanup();
+            return res;
+        }
+
+    private:
+        std::string path(const std::string &name) const {
+            return mDir + "/" + name;
+        }
+
+        std::string entryPath(uint32_t i) const {
+            return mDir + "/dir/f" + std::to_string(i);
+        }
+
+        bool writeFile(const std::string &filePath, const char *data, uint32_t size) {
+            DeviceStruct fd(mDev, false);
+            if (mDev->open(mData, fd.get(), filePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666) < 0) {
+                return false;
+            }
+            uint32_t done = 0;
+            while (done < size) {
+                const ssize_t res = mDev->write(mData, fd.get(), data + (done % READ_SIZES[2]), std::min(size - done, READ_SIZES[2] - done % READ_SIZES[2]));
+                if (res <= 0) {
+                    break;
+                }
+                done += static_cast<uint32_t>(res);
+            }
+            return mDev->close(mData, fd.get()) == 0 && done == size;
+        }
+
+        bool setup(char *buffer) {
+            for (uint32_t i = 0; i < READ_SIZES[2]; i++) {
+                buffer[i] = static_cast<char>(PatternByte(i));
+            }
+            if (mDev->mkdir(mData, mDir.c_str(), 0777) != 0 || mDev->mkdir(mData, path("dir").c_str(), 0777) != 0) {
+                return false;
+            }
+            if (!writeFile(path("read.bin"), buffer, mFileSize)) {
+                return false;
+            }
+            for (uint32_t i = 0; i < mDirEntries; i++) {
+                if (!writeFile(entryPath(i), buffer, 16)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void cleanup() {
+            for (uint32_t i = 0; i < mDirEntries; i++) {
+                mDev->unlink(mData, entryPath(i).c_str());
+            }
+            mDev->unlink(mData, path("read.bin").c_str());
+            mDev->rmdir(mData, path("dir").c_str());
+            mDev->rmdir(mData, mDir.c_str());
+        }
+
+        void measureLatency(ContentRedirectionDevicePerfResult &result) {
+            const std::string file    = path("read.bin");
+            const std::string missing = path("missing.bin");
+            CR_Stat st{};
+
+            auto start = Clock::now();
+            for (uint32_t i = 0; i < LATENCY_ITERATIONS; i++) {
+                DeviceStruct fd(mDev, false);
+                if (mDev->open(mData, fd.get(), file.c_str(), O_RDONLY, 0) >= 0) {
+                    mDev->close(mData, fd.get());
+                }
+            }
+            result.openCloseNs = ElapsedNs(start) / LATENCY_ITERATIONS;
+
+            start = Clock::now();
+            for (uint32_t i = 0; i < LATENCY_ITERATIONS; i++) {
+                mDev->stat(mData, file.c_str(), &st);
+            }
+            result.statHitNs = ElapsedNs(start) / LATENCY_ITERATIONS;
+
+            start = Clock::now();
+            for (uint32_t i = 0; i < LATENCY_ITERATIONS; i++) {
+                mDev->stat(mData, missing.c_str(), &st);
+            }
+            result.statMissNs = ElapsedNs(start) / LATENCY_ITERATIONS;
+
+            mReport.printf("perf open+close          %10.2f us/op", result.openCloseNs / 1000.0);
+            mReport.printf("perf stat (hit)          %10.2f us/op", result.statHitNs / 1000.0);
+            mReport.printf("perf stat (miss)         %10.2f us/op", result.statMissNs / 1000.0);
+        }
+
+        uint64_t readWholeFile(char *buffer, uint32_t readSize) {
+            DeviceStruct fd(mDev, false);
+            if (mDev->open(mData, fd.get(), path("read.bin").c_str(), O_RDONLY, 0) < 0) {
+                return 0;
+            }
+            uint64_t total = 0;
+            ssize_t res;
+            while ((res = mDev->read(mData, fd.get(), buffer, readSize)) > 0) {
+                total += static_cast<uint64_t>(res);
+            }
+            mDev->close(mData, fd.get());
+            return total;
+        }
+
+        static uint64_t BytesPerSec(uint64_t bytes, uint64_t ns) {
+            return ns != 0 ? bytes * 1000000000ULL / ns : 0;
+        }
+
+        void measureReads(ContentRedirectionDevicePerfResult &result, char *buffer) {
+            for (size_t i = 0; i < 3; i++) {
+                const auto start          = Clock::now();
+                const uint64_t bytes      = readWholeFile(buffer, READ_SIZES[i]);
+                result.readBytesPerSec[i] = BytesPerSec(bytes, ElapsedNs(start));
+                mReport.printf("perf read %4u KiB        %10.2f MiB/s", READ_SIZES[i] / 1024, result.readBytesPerSec[i] / (1024.0 * 1024.0));
+            }
+        }
+
+        void measureDirnext(ContentRedirectionDevicePerfResult &result) {
+            DeviceStruct dir(mDev, true);
+            char name[NAME_MAX + 1];
+            CR_Stat st{};
+            uint32_t count   = 0;
+            const auto start = Clock::now();
+            if (mDev->diropen(mData, dir.get(), path("dir").c_str()) == 0) {
+                while (mDev->dirnext(mData, dir.get(), name, &st) == 0) {
+                    count++;
+                }
+                mDev->dirclose(mData, dir.get());
+            }
+            result.dirnextNsPerEntry = count != 0 ? ElapsedNs(start) / count : 0;
+            mReport.printf("perf dirnext             %10.2f us/entry", result.dirnextNsPerEntry / 1000.0);
+        }
+
+        void measureConcurrentReads(ContentRedirectionDevicePerfResult &result) {
+            std::atomic<uint64_t> total{0};
+            std::vector<std::thread> threads;
+            const auto start = Clock::now();
+            for (uint32_t i = 0; i < mReaders; i++) {
+                threads.emplace_back([this, &total] {
+                    std::unique_ptr<char[]> buffer(new (std::nothrow) char[READ_SIZES[1]]);
+                    if (buffer) {
+                        total += readWholeFile(buffer.get(), READ_SIZES[1]);
+                    }
+                });
+            }
+            for (auto &thread : threads) {
+                thread.join();
+            }
+            result.concurrentReadBytesPerSec = BytesPerSec(total, ElapsedNs(start));
+            mReport.printf("perf concurrent read     %10.2f MiB/s", result.concurrentReadBytesPerSec / (1024.0 * 1024.0));
+        }
+
+        const ContentRedirectionDeviceABI *mDev;
+        void *mData;
+        Report mReport;
+        std::string mDir;
+        uint32_t mDirEntries;
+        uint32_t mFileSize;
+        uint32_t mReaders;
+    };
+} // namespace
+
+ContentRedirectionStatus ContentRedirection_RunDeviceConformanceTests(const ContentRedirectionDeviceABI *device, const ContentRedirectionDeviceTestConfig *config,
+                                                                      ContentRedirectionDeviceConformanceResult *resultOut) {
+    if (device == nullptr || config == nullptr || config->scratchDir == nullptr || resultOut == nullptr || device->magic != CONTENT_REDIRECTION_DEVICE_MAGIC) {
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
+    ConformanceSuite suite(device, *config);
+    *resultOut = suite.run();
+    return CONTENT_REDIRECTION_RESULT_SUCCESS;
+}
+
+ContentRedirectionStatus ContentRedirection_RunDevicePerformanceProfile(const ContentRedirectionDeviceABI *device, const ContentRedirectionDeviceTestConfig *config,
+                                                                        ContentRedirectionDevicePerfResult *resultOut) {
+    if (device == nullptr || config == nullptr || config->scratchDir == nullptr || resultOut == nullptr || device->magic != CONTENT_REDIRECTION_DEVICE_MAGIC) {
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
+    *resultOut = {};
+    PerformanceProfile profile(device, *config);
+    return profile.run(*resultOut);
+}
@@ -0,0 +1,181 @@
+#include "content_redirection/io_scheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+namespace {
+    constexpr uint32_t NUM_LATENCY_BUCKETS = 32; // Bucket n counts latencies < 2^n us
+    constexpr uint64_t MAX_SLEEP_US        = 5000;
+
+    struct ClassStats {
+        std::mutex mutex;
+        uint32_t requests = 0;
+        uint64_t bytes    = 0;
+        uint32_t maxUs    = 0;
+        uint64_t waitUs   = 0;
+        uint32_t buckets[NUM_LATENCY_BUCKETS]{};
+    };
+
+    std::mutex sConfigMutex;
+    ContentRedirectionIOSchedulerConfig sConfig = {10, 50, 0};
+
+    std::atomic<uint32_t> sForegroundPending = 0;
+    std::atomic<uint32_t> sLastForegroundEnd = 0; /**< Lower 32 bit of the time in ms */
+
+    std::mutex sBackgroundMutex;
+    uint64_t sBackgroundNextShareUs = 0; /**< Earliest start of the next background request while foreground is active */
+    uint64_t sBackgroundNextRateUs  = 0; /**< Earliest start of the next background request due to the throughput limit */
+    uint32_t sBackgroundInFlight    = 0; /**< Background requests that have started but not ended yet */
+
+    ClassStats sStats[2];
+
+    uint64_t NowUs() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    bool IsForegroundActive(uint64_t nowUs, uint32_t idleMs) {
+        if (sForegroundPending.load() > 0) {
+            return true;
+        }
+        return static_cast<uint32_t>(nowUs / 1000) - sLastForegroundEnd.load() < idleMs;
+    }
+
+    uint32_t Percentile(const ClassStats &stats, uint32_t percent) {
+        const uint64_t target = (static_cast<uint64_t>(stats.requests) * percent + 99) / 100;
+        uint64_t count        = 0;
+        for (uint32_t i = 0; i < NUM_LATENCY_BUCKETS; i++) {
+            count += stats.buckets[i];
+            if (count >= target && count > 0) {
+                return std::min(1u << i, stats.maxUs);
+            }
+        }
+        return stats.maxUs;
+    }
+
+    void FillStats(ClassStats &stats, ContentRedirectionIOClassStats *out) {
+        if (out == nullptr) {
+            return;
+        }
+        std::lock_guard lock(stats.mutex);
+        out->requests = stats.requests;
+        out->bytes    = stats.bytes;
+        out->p50Us    = Percentile(stats, 50);
+        out->p99Us    = Percentile(stats, 99);
+        out->maxUs    = stats.maxUs;
+        out->waitUs   = stats.waitUs;
+    }
+
+    /**
+     * Blocks until a background request may start, returns the time it has waited.
+     */
+    uint64_t WaitForBackgroundSlot() {
+        ContentRedirectionIOSchedulerConfig config;
+        {
+            std::lock_guard lock(sConfigMutex);
+            config = sConfig;
+        }
+        const uint64_t begin = NowUs();
+        while (true) {
+            const uint64_t now = NowUs();
+            uint64_t notBefore;
+            {
+                std::lock_guard lock(sBackgroundMutex);
+                notBefore = sBackgroundNextRateUs;
+                if (IsForegroundActive(now, config.foregroundIdleMs)) {
+                    if (config.backgroundShare == 0 || sBackgroundInFlight > 0) {
+                        // Background requests are paused entirely, or another thread is using the share right now.
+                        // The share is granted to one request at a time, otherwise N threads would get N times the share.
+                        notBefore = std::max(notBefore, now + MAX_SLEEP_US);
+                    } else {
+                        notBefore = std::max(notBefore, sBackgroundNextShareUs);
+                    }
+                }
+                if (notBefore <= now) {
+                    sBackgroundInFlight++;
+                    return now - begin;
+                }
+            }
+            // Sleep in small steps, the foreground state may change in the meantime.
+            std::this_thread::sleep_for(std::chrono::microseconds(std::min(notBefore - now, MAX_SLEEP_US)));
+        }
+    }
+} // namespace
+
+void ContentRedirection_SetIOSchedulerConfig(const ContentRedirectionIOSchedulerConfig *config) {
+    if (config == nullptr) {
+        return;
+    }
+    std::lock_guard lock(sConfigMutex);
+    sConfig                 = *config;
+    sConfig.backgroundShare = std::min<uint32_t>(sConfig.backgroundShare, 100);
+}
+
+void ContentRedirection_GetIOSchedulerStats(ContentRedirectionIOClassStats *foregroundOut, ContentRedirectionIOClassStats *backgroundOut) {
+    FillStats(sStats[CONTENT_REDIRECTION_IO_CLASS_FOREGROUND], foregroundOut);
+    FillStats(sStats[CONTENT_REDIRECTION_IO_CLASS_BACKGROUND], backgroundOut);
+}
+
+void ContentRedirection_ResetIOSchedulerStats() {
+    for (auto &stats : sStats) {
+        std::lock_guard lock(stats.mutex);
+        stats.requests = 0;
+        stats.bytes    = 0;
+        stats.maxUs    = 0;
+        stats.waitUs   = 0;
+        std::fill(std::begin(stats.buckets), std::end(stats.buckets), 0);
+    }
+}
+
+uint64_t ContentRedirection_IOBegin(ContentRedirectionIOClass ioClass) {
+    if (ioClass == CONTENT_REDIRECTION_IO_CLASS_FOREGROUND) {
+        sForegroundPending++;
+        return NowUs();
+    }
+    const uint64_t waited = WaitForBackgroundSlot();
+    if (waited > 0) {
+        auto &stats = sStats[CONTENT_REDIRECTION_IO_CLASS_BACKGROUND];
+        std::lock_guard lock(stats.mutex);
+        stats.waitUs += waited;
+    }
+    return NowUs();
+}
+
+void ContentRedirection_IOEnd(ContentRedirectionIOClass ioClass, uint64_t start, uint32_t bytes) {
+    const uint64_t now = NowUs();
+    const auto latency = static_cast<uint32_t>(std::min<uint64_t>(now - start, UINT32_MAX));
+
+    if (ioClass == CONTENT_REDIRECTION_IO_CLASS_FOREGROUND) {
+        sLastForegroundEnd = static_cast<uint32_t>(now / 1000);
+        sForegroundPending--;
+    } else {
+        ContentRedirectionIOSchedulerConfig config;
+        {
+            std::lock_guard lock(sConfigMutex);
+            config = sConfig;
+        }
+        std::lock_guard lock(sBackgroundMutex);
+        sBackgroundInFlight--;
+        if (config.backgroundShare > 0) {
+            // Requests that started before the foreground became active may end at the same time, the longest pause wins.
+            sBackgroundNextShareUs = std::max(sBackgroundNextShareUs, now + static_cast<uint64_t>(latency) * (100 - config.backgroundShare) / config.backgroundShare);
+        }
+        if (config.backgroundMaxBytesPerSec > 0) {
+            sBackgroundNextRateUs = std::max(sBackgroundNextRateUs, start) + static_cast<uint64_t>(bytes) * 1000000 / config.backgroundMaxBytesPerSec;
+        }
+    }
+
+    auto &stats = sStats[ioClass];
+    std::lock_guard lock(stats.mutex);
+    stats.requests++;
+    stats.bytes += bytes;
+    stats.maxUs = std::max(stats.maxUs, latency);
+
+    uint32_t bucket = 0;
+    while (bucket + 1 < NUM_LATENCY_BUCKETS && (1u << bucket) <= latency) {
+        bucket++;
+    }
+    stats.buckets[bucket]++;
+}
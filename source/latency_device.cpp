@@ -0,0 +1,492 @@
+#include "content_redirection/latency_device.h"
+#include "content_redirection/devoptab_backend.h"
+#include "logger.h"
+
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+
+using CR_DevoptabWrapper::Backend;
+
+namespace {
+    constexpr size_t FILE_HEADER_SIZE = 32;
+
+    struct LatencyDevice {
+        devoptab_t devoptab{};
+        std::string name;
+        std::string basePath;
+        const devoptab_t *base = nullptr;
+        int baseDeviceId       = -1;
+        ContentRedirectionLatencyProfile profile{};
+        bool simulateOnly   = false;
+        bool serializeCalls = false;
+
+        std::mutex mutex;
+        std::mutex queueMutex; /**< Held while sleeping if "serializeCalls" is set */
+        uint32_t randomState = 0;
+        ContentRedirectionLatencyDeviceStats stats{};
+    };
+
+    struct LatencyFile {
+        int64_t position; /**< Current file offset, as far as it's known to this device */
+        int64_t lastEnd;  /**< File offset at which the last read or write has ended */
+        bool append;
+    };
+    static_assert(sizeof(LatencyFile) <= FILE_HEADER_SIZE);
+
+    struct Charge {
+        uint64_t us           = 0;
+        bool seek             = false;
+        uint64_t bytesRead    = 0;
+        uint64_t bytesWritten = 0;
+    };
+
+    int SetError(struct _reent *r, int res) {
+        r->_errno = -res;
+        return -1;
+    }
+
+    LatencyDevice *GetDevice(struct _reent *r) {
+        return static_cast<LatencyDevice *>(r->deviceData);
+    }
+
+    std::string GetBasePath(const LatencyDevice *device, const char *path) {
+        const char *separator = strchr(path, ':');
+        const char *rel       = separator ? separator + 1 : path;
+        if (rel[0] != '/') {
+            return device->basePath + "/" + rel;
+        }
+        return device->basePath + rel;
+    }
+
+    void *GetBaseFd(void *fd) {
+        return static_cast<char *>(fd) + FILE_HEADER_SIZE;
+    }
+
+    uint32_t NextRandom(LatencyDevice *device) {
+        // xorshift32, cheap and reproducible for a given seed.
+        uint32_t x = device->randomState;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        device->randomState = x;
+        return x;
+    }
+
+    uint64_t TransferUs(uint64_t bytes, uint32_t bytesPerSec) {
+        return bytesPerSec != 0 ? bytes * 1000000 / bytesPerSec : 0;
+    }
+
+    /**
+     * Adds the jitter, accounts the call and sleeps for the resulting time unless the device only simulates the latency.
+     */
+    void Delay(LatencyDevice *device, Charge charge) {
+        {
+            std::lock_guard lock(device->mutex);
+            if (device->profile.jitterUs != 0) {
+                charge.us += NextRandom(device) % (device->profile.jitterUs + 1);
+            }
+            device->stats.ops++;
+            device->stats.seeks += charge.seek ? 1 : 0;
+            device->stats.bytesRead += charge.bytesRead;
+            device->stats.bytesWritten += charge.bytesWritten;
+            device->stats.simulatedUs += charge.us;
+        }
+        if (!device->simulateOnly && charge.us != 0) {
+            if (device->serializeCalls) {
+                std::lock_guard lock(device->queueMutex);
+                std::this_thread::sleep_for(std::chrono::microseconds(charge.us));
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(charge.us));
+            }
+        }
+    }
+
+    void Delay(LatencyDevice *device, uint64_t us) {
+        Charge charge;
+        charge.us = us;
+        Delay(device, charge);
+    }
+
+    void CRStatToStat(const CR_Stat &src, struct stat *dst) {
+        memset(dst, 0, sizeof(*dst));
+        dst->st_dev     = src.dev;
+        dst->st_ino     = src.ino;
+        dst->st_mode    = src.mode;
+        dst->st_nlink   = src.nlink;
+        dst->st_uid     = src.uid;
+        dst->st_gid     = src.gid;
+        dst->st_rdev    = src.rdev;
+        dst->st_size    = src.size;
+        dst->st_atime   = src.atime;
+        dst->st_mtime   = src.mtime;
+        dst->st_ctime   = src.ctime;
+        dst->st_blksize = src.blksize;
+        dst->st_blocks  = src.blocks;
+    }
+
+    int latency_open(struct _reent *r, void *fileStruct, const char *path, int flags, int mode) {
+        auto *device  = GetDevice(r);
+        auto *file    = static_cast<LatencyFile *>(fileStruct);
+        file->append  = (flags & O_APPEND) != 0;
+        const int res = Backend::open(device->base, GetBaseFd(fileStruct), GetBasePath(device, path).c_str(), flags, mode);
+        Delay(device, device->profile.openUs);
+        if (res < 0) {
+            return SetError(r, res);
+        }
+        file->position = 0;
+        file->lastEnd  = 0;
+        return 0;
+    }
+
+    int latency_close(struct _reent *r, void *fd) {
+        auto *device  = GetDevice(r);
+        const int res = Backend::close(device->base, GetBaseFd(fd));
+        Delay(device, device->profile.perOpUs);
+        return res < 0 ? SetError(r, res) : res;
+    }
+
+    ssize_t latency_write(struct _reent *r, void *fd, const char *ptr, size_t len) {
+        auto *device = GetDevice(r);
+        auto *file   = static_cast<LatencyFile *>(fd);
+        if (file->append) {
+            const int64_t end = Backend::seek(device->base, GetBaseFd(fd), 0, SEEK_END);
+            if (end >= 0) {
+                file->position = end;
+            }
+        }
+        const ssize_t res = Backend::write(device->base, GetBaseFd(fd), ptr, len);
+
+        Charge charge;
+        charge.seek = file->position != file->lastEnd;
+        charge.us   = device->profile.perOpUs + (charge.seek ? device->profile.seekUs : 0);
+        if (res > 0) {
+            charge.us += TransferUs(res, device->profile.writeBytesPerSec);
+            charge.bytesWritten = res;
+            file->position += res;
+            file->lastEnd = file->position;
+        }
+        Delay(device, charge);
+        return res < 0 ? SetError(r, static_cast<int>(res)) : res;
+    }
+
+    ssize_t latency_read(struct _reent *r, void *fd, char *ptr, size_t len) {
+        auto *device      = GetDevice(r);
+        auto *file        = static_cast<LatencyFile *>(fd);
+        const ssize_t res = Backend::read(device->base, GetBaseFd(fd), ptr, len);
+
+        Charge charge;
+        charge.seek = file->position != file->lastEnd;
+        charge.us   = device->profile.perOpUs + (charge.seek ? device->profile.seekUs : 0);
+        if (res > 0) {
+            charge.us += TransferUs(res, device->profile.readBytesPerSec);
+            charge.bytesRead = res;
+            file->position += res;
+            file->lastEnd = file->position;
+        }
+        Delay(device, charge);
+        return res < 0 ? SetError(r, static_cast<int>(res)) : res;
+    }
+
+    off_t latency_seek(struct _reent *r, void *fd, off_t pos, int dir) {
+        // Seeking only moves the offset, the cost is charged to the next read or write that doesn't continue sequentially.
+        auto *device      = GetDevice(r);
+        const int64_t res = Backend::seek(device->base, GetBaseFd(fd), pos, dir);
+        if (res < 0) {
+            return SetError(r, static_cast<int>(res));
+        }
+        static_cast<LatencyFile *>(fd)->position = res;
+        return static_cast<off_t>(res);
+    }
+
+    int latency_fstat(struct _reent *r, void *fd, struct stat *st) {
+        auto *device = GetDevice(r);
+        CR_Stat crStat{};
+        const int res = Backend::fstat(device->base, GetBaseFd(fd), &crStat);
+        Delay(device, device->profile.statUs);
+        if (res < 0) {
+            return SetError(r, res);
+        }
+        CRStatToStat(crStat, st);
+        return 0;
+    }
+
+    int latency_stat(struct _reent *r, const char *file, struct stat *st) {
+        auto *device = GetDevice(r);
+        CR_Stat crStat{};
+        const int res = Backend::stat(device->base, GetBasePath(device, file).c_str(), &crStat);
+        Delay(device, device->profile.statUs);
+        if (res < 0) {
+            return SetError(r, res);
+        }
+        CRStatToStat(crStat, st);
+        return 0;
+    }
+
+    int latency_lstat(struct _reent *r, const char *file, struct stat *st) {
+        auto *device = GetDevice(r);
+        CR_Stat crStat{};
+        const int res = Backend::lstat(device->base, GetBasePath(device, file).c_str(), &crStat);
+        Delay(device, device->profile.statUs);
+        if (res < 0) {
+            return SetError(r, res);
+        }
+        CRStatToStat(crStat, st);
+        return 0;
+    }
+
+    uint64_t MetadataWriteUs(const LatencyDevice *device) {
+        return device->profile.perOpUs + device->profile.metadataWriteUs;
+    }
+
+    int latency_unlink(struct _reent *r, const char *name) {
+        auto *device  = GetDevice(r);
+        const int res = Backend::unlink(device->base, GetBasePath(device, name).c_str());
+        Delay(device, MetadataWriteUs(device));
+        return res < 0 ? SetError(r, res) : 0;
+    }
+
+    int latency_rename(struct _reent *r, const char *oldName, const char *newName) {
+        auto *device  = GetDevice(r);
+        const int res = Backend::rename(device->base, GetBasePath(device, oldName).c_str(), GetBasePath(device, newName).c_str());
+        Delay(device, MetadataWriteUs(device));
+        return res < 0 ? SetError(r, res) : 0;
+    }
+
+    int latency_mkdir(struct _reent *r, const char *path, int mode) {
+        auto *device  = GetDevice(r);
+        const int res = Backend::mkdir(device->base, GetBasePath(device, path).c_str(), mode);
+        Delay(device, MetadataWriteUs(device));
+        return res < 0 ? SetError(r, res) : 0;
+    }
+
+    int latency_rmdir(struct _reent *r, const char *name) {
+        auto *device  = GetDevice(r);
+        const int res = Backend::rmdir(device->base, GetBasePath(device, name).c_str());
+        Delay(device, MetadataWriteUs(device));
+        return res < 0 ? SetError(r, res) : 0;
+    }
+
+    DIR_ITER *latency_diropen(struct _reent *r, DIR_ITER *dirState, const char *path) {
+        auto *device  = GetDevice(r);
+        const int res = Backend::diropen(device->base, device->baseDeviceId, dirState->dirStruct, GetBasePath(device, path).c_str());
+        Delay(device, device->profile.openUs);
+        if (res < 0) {
+            SetError(r, res);
+            return nullptr;
+        }
+        return dirState;
+    }
+
+    int latency_dirreset(struct _reent *r, DIR_ITER *dirState) {
+        auto *device  = GetDevice(r);
+        const int res = Backend::dirreset(device->base, device->baseDeviceId, dirState->dirStruct);
+        Delay(device, device->profile.perOpUs);
+        return res < 0 ? SetError(r, res) : 0;
+    }
+
+    int latency_dirnext(struct _reent *r, DIR_ITER *dirState, char *filename, struct stat *filestat) {
+        auto *device = GetDevice(r);
+        CR_Stat crStat{};
+        const int res = Backend::dirnext(device->base, device->baseDeviceId, dirState->dirStruct, filename, &crStat);
+        Delay(device, device->profile.statUs);
+        if (res < 0) {
+            return SetError(r, res);
+        }
+        CRStatToStat(crStat, filestat);
+        return 0;
+    }
+
+    int latency_dirclose(struct _reent *r, DIR_ITER *dirState) {
+        auto *device  = GetDevice(r);
+        const int res = Backend::dirclose(device->base, device->baseDeviceId, dirState->dirStruct);
+        Delay(device, device->profile.perOpUs);
+        return res < 0 ? SetError(r, res) : 0;
+    }
+
+    int latency_statvfs(struct _reent *r, const char *path, struct statvfs *buf) {
+        auto *device = GetDevice(r);
+        CR_Statvfs crStatvfs{};
+        const int res = Backend::statvfs(device->base, GetBasePath(device, path).c_str(), &crStatvfs);
+        Delay(device, device->profile.statUs);
+        if (res < 0) {
+            return SetError(r, res);
+        }
+        memset(buf, 0, sizeof(*buf));
+        buf->f_bsize   = crStatvfs.bsize;
+        buf->f_frsize  = crStatvfs.frsize;
+        buf->f_blocks  = crStatvfs.blocks;
+        buf->f_bfree   = crStatvfs.bfree;
+        buf->f_bavail  = crStatvfs.bavail;
+        buf->f_files   = crStatvfs.files;
+        buf->f_ffree   = crStatvfs.ffree;
+        buf->f_favail  = crStatvfs.favail;
+        buf->f_fsid    = crStatvfs.fsid;
+        buf->f_flag    = crStatvfs.flag;
+        buf->f_namemax = crStatvfs.namemax;
+        return 0;
+    }
+
+    int latency_ftruncate(struct _reent *r, void *fd, off_t len) {
+        auto *device  = GetDevice(r);
+        const int res = Backend::ftruncate(device->base, GetBaseFd(fd), len);
+        Delay(device, MetadataWriteUs(device));
+        return res < 0 ? SetError(r, res) : 0;
+    }
+
+    int latency_fsync(struct _reent *r, void *fd) {
+        auto *device  = GetDevice(r);
+        const int res = Backend::fsync(device->base, GetBaseFd(fd));
+        Delay(device, MetadataWriteUs(device));
+        return res < 0 ? SetError(r, res) : 0;
+    }
+
+    int latency_chmod(struct _reent *r, const char *path, mode_t mode) {
+        auto *device  = GetDevice(r);
+        const int res = Backend::chmod(device->base, GetBasePath(device, path).c_str(), mode);
+        Delay(device, MetadataWriteUs(device));
+        return res < 0 ? SetError(r, res) : 0;
+    }
+
+    int latency_fchmod(struct _reent *r, void *fd, mode_t mode) {
+        auto *device  = GetDevice(r);
+        const int res = Backend::fchmod(device->base, GetBaseFd(fd), mode);
+        Delay(device, MetadataWriteUs(device));
+        return res < 0 ? SetError(r, res) : 0;
+    }
+
+    int latency_utimes(struct _reent *r, const char *filename, const struct timeval times[2]) {
+        auto *device = GetDevice(r);
+        CR_Timeval crTimes[2];
+        if (times) {
+            for (int i = 0; i < 2; i++) {
+                crTimes[i].tv_sec  = times[i].tv_sec;
+                crTimes[i].tv_usec = times[i].tv_usec;
+            }
+        }
+        const int res = Backend::utimes(device->base, GetBasePath(device, filename).c_str(), times ? crTimes : nullptr);
+        Delay(device, MetadataWriteUs(device));
+        return res < 0 ? SetError(r, res) : 0;
+    }
+} // namespace
+
+ContentRedirectionStatus ContentRedirection_GetLatencyProfile(ContentRedirectionLatencyProfileType type, ContentRedirectionLatencyProfile *profileOut) {
+    if (profileOut == nullptr) {
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
+    ContentRedirectionLatencyProfile profile{};
+    switch (type) {
+        case CONTENT_REDIRECTION_LATENCY_PROFILE_NONE:
+            break;
+        case CONTENT_REDIRECTION_LATENCY_PROFILE_SD:
+            // Flash has no mechanical seek, but the FS API round trip and FAT lookups make opens and stats expensive.
+            profile.openUs           = 3000;
+            profile.statUs           = 1500;
+            profile.seekUs           = 500;
+            profile.perOpUs          = 200;
+            profile.metadataWriteUs  = 5000;
+            profile.readBytesPerSec  = 12 * 1024 * 1024;
+            profile.writeBytesPerSec = 6 * 1024 * 1024;
+            profile.jitterUs         = 500;
+            break;
+        case CONTENT_REDIRECTION_LATENCY_PROFILE_USB:
+            // Spinning drive: cheap sequential access, every non-sequential access pays for the head movement.
+            profile.openUs           = 2000;
+            profile.statUs           = 1000;
+            profile.seekUs           = 8000;
+            profile.perOpUs          = 150;
+            profile.metadataWriteUs  = 10000;
+            profile.readBytesPerSec  = 28 * 1024 * 1024;
+            profile.writeBytesPerSec = 24 * 1024 * 1024;
+            profile.jitterUs         = 2000;
+            break;
+        default:
+            return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
+    *profileOut = profile;
+    return CONTENT_REDIRECTION_RESULT_SUCCESS;
+}
+
+ContentRedirectionStatus ContentRedirection_CreateLatencyDevice(const ContentRedirectionLatencyDeviceConfig *config, const devoptab_t **deviceOut) {
+    if (config == nullptr || deviceOut == nullptr || config->name == nullptr || config->basePath == nullptr) {
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
+    const devoptab_t *base = GetDeviceOpTab(config->basePath);
+    if (base == nullptr || strchr(config->basePath, ':') == nullptr) {
+        DEBUG_FUNCTION_LINE_ERR("No device found for base path \"%s\"", config->basePath);
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
+
+    std::unique_ptr<LatencyDevice> device(new (std::nothrow) LatencyDevice());
+    if (!device) {
+        return CONTENT_REDIRECTION_RESULT_NO_MEMORY;
+    }
+    device->name           = config->name;
+    device->basePath       = config->basePath;
+    device->base           = base;
+    device->baseDeviceId   = FindDevice(config->basePath);
+    device->profile        = config->profile;
+    device->simulateOnly   = config->simulateOnly;
+    device->serializeCalls = config->serializeCalls;
+    device->randomState    = config->seed != 0 ? config->seed : 0x9E3779B9;
+    while (!device->basePath.empty() && device->basePath.back() == '/') {
+        device->basePath.pop_back();
+    }
+
+    auto &dt        = device->devoptab;
+    dt.name         = device->name.c_str();
+    dt.structSize   = FILE_HEADER_SIZE + base->structSize;
+    dt.open_r       = latency_open;
+    dt.close_r      = latency_close;
+    dt.write_r      = latency_write;
+    dt.read_r       = latency_read;
+    dt.seek_r       = latency_seek;
+    dt.fstat_r      = latency_fstat;
+    dt.stat_r       = latency_stat;
+    dt.unlink_r     = latency_unlink;
+    dt.rename_r     = latency_rename;
+    dt.mkdir_r      = latency_mkdir;
+    dt.dirStateSize = base->dirStateSize;
+    dt.diropen_r    = latency_diropen;
+    dt.dirreset_r   = latency_dirreset;
+    dt.dirnext_r    = latency_dirnext;
+    dt.dirclose_r   = latency_dirclose;
+    dt.statvfs_r    = latency_statvfs;
+    dt.ftruncate_r  = latency_ftruncate;
+    dt.fsync_r      = latency_fsync;
+    dt.deviceData   = device.get();
+    dt.chmod_r      = latency_chmod;
+    dt.fchmod_r     = latency_fchmod;
+    dt.rmdir_r      = latency_rmdir;
+    dt.lstat_r      = latency_lstat;
+    dt.utimes_r     = latency_utimes;
+
+    *deviceOut = &device.release()->devoptab;
+    return CONTENT_REDIRECTION_RESULT_SUCCESS;
+}
+
+ContentRedirectionStatus ContentRedirection_GetLatencyDeviceStats(const devoptab_t *device, ContentRedirectionLatencyDeviceStats *statsOut, bool reset) {
+    if (device == nullptr || statsOut == nullptr) {
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
+    auto *latencyDevice = static_cast<LatencyDevice *>(device->deviceData);
+    std::lock_guard lock(latencyDevice->mutex);
+    *statsOut = latencyDevice->stats;
+    if (reset) {
+        latencyDevice->stats = {};
+    }
+    return CONTENT_REDIRECTION_RESULT_SUCCESS;
+}
+
+ContentRedirectionStatus ContentRedirection_DestroyLatencyDevice(const devoptab_t *device) {
+    if (device == nullptr) {
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
+    delete static_cast<LatencyDevice *>(device->deviceData);
+    return CONTENT_REDIRECTION_RESULT_SUCCESS;
+}
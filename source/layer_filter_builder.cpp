@@ -0,0 +1,26 @@
+#include "layer_filter_builder.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace LayerFilterBuilder {
+    void Build(const DirSnapshot &snapshot, float falsePositiveRate, std::vector<uint32_t> &blocksOut, ContentRedirectionLayerFilter &filterOut) {
+        const double ln2 = std::log(2.0);
+        // Optimal bits per key of a classic bloom filter, plus some headroom for the uneven load of the blocks.
+        const double bitsPerEntry = -std::log(falsePositiveRate) / (ln2 * ln2) * 1.1;
+        const auto numHashes      = static_cast<uint32_t>(std::clamp(std::lround(-std::log2(falsePositiveRate)), 1L, 16L));
+        const auto numBits        = static_cast<uint64_t>(std::ceil(bitsPerEntry * snapshot.size()));
+        const auto numBlocks      = static_cast<uint32_t>(std::max<uint64_t>(1, (numBits + CONTENT_REDIRECTION_LAYER_FILTER_BLOCK_BITS - 1) / CONTENT_REDIRECTION_LAYER_FILTER_BLOCK_BITS));
+
+        blocksOut.assign(static_cast<size_t>(numBlocks) * CONTENT_REDIRECTION_LAYER_FILTER_BLOCK_SIZE, 0);
+        for (const auto &[path, fingerprint] : snapshot) {
+            ContentRedirection_LayerFilterAdd(blocksOut.data(), numBlocks, numHashes, ContentRedirection_LayerFilterHash(path.c_str()));
+        }
+
+        filterOut.version    = CONTENT_REDIRECTION_LAYER_FILTER_VERSION;
+        filterOut.numBlocks  = numBlocks;
+        filterOut.numHashes  = numHashes;
+        filterOut.numEntries = snapshot.size();
+        filterOut.blocks     = blocksOut.data();
+    }
+} // namespace LayerFilterBuilder
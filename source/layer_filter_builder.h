@@ -0,0 +1,14 @@
+#pragma once
+
+#include "change_detector.h"
+#include "content_redirection/layer_filter.h"
+
+#include <vector>
+
+namespace LayerFilterBuilder {
+    /**
+     * Builds a filter over all entries of the snapshot, sized for the given false positive rate.
+     * "filterOut.blocks" points into "blocksOut", which has to outlive the filter.
+     */
+    void Build(const DirSnapshot &snapshot, float falsePositiveRate, std::vector<uint32_t> &blocksOut, ContentRedirectionLayerFilter &filterOut);
+} // namespace LayerFilterBuilder
@@ -0,0 +1,70 @@
+#include "layer_registry.h"
+
+#include <map>
+
+namespace {
+    std::recursive_mutex sMutex;
+    std::map<CRLayerHandle, LayerInfo> sLayers;
+    uint32_t sSequence                  = 0;
+    CRLayerHandle sNextSubstituteHandle = 0xFFFF0000;
+} // namespace
+
+namespace LayerRegistry {
+    std::recursive_mutex &GetMutex() {
+        return sMutex;
+    }
+
+    uint32_t NextSequence() {
+        std::lock_guard lock(sMutex);
+        return ++sSequence;
+    }
+
+    LayerInfo *Add(LayerInfo layer) {
+        std::lock_guard lock(sMutex);
+        if (layer.handle == 0 || sLayers.count(layer.handle) != 0) {
+            // The module may reuse handles of layers which have been re-added, make sure every caller handle is unique.
+            do {
+                layer.handle = sNextSubstituteHandle++;
+            } while (layer.handle == 0 || sLayers.count(layer.handle) != 0);
+        }
+        auto [it, inserted] = sLayers.emplace(layer.handle, std::move(layer));
+        return &it->second;
+    }
+
+    void Remove(CRLayerHandle handle) {
+        std::lock_guard lock(sMutex);
+        sLayers.erase(handle);
+    }
+
+    LayerInfo *Find(CRLayerHandle handle) {
+        std::lock_guard lock(sMutex);
+        auto it = sLayers.find(handle);
+        return it != sLayers.end() ? &it->second : nullptr;
+    }
+
+    CRLayerHandle ToModuleHandle(CRLayerHandle handle) {
+        std::lock_guard lock(sMutex);
+        auto it = sLayers.find(handle);
+        return it != sLayers.end() ? it->second.moduleHandle : handle;
+    }
+
+    CRLayerHandle FromModuleHandle(CRLayerHandle moduleHandle) {
+        std::lock_guard lock(sMutex);
+        for (auto &[handle, layer] : sLayers) {
+            if (layer.moduleHandle == moduleHandle) {
+                return handle;
+            }
+        }
+        return moduleHandle;
+    }
+
+    std::vector<LayerInfo *> GetAll() {
+        std::lock_guard lock(sMutex);
+        std::vector<LayerInfo *> result;
+        result.reserve(sLayers.size());
+        for (auto &[handle, layer] : sLayers) {
+            result.push_back(&layer);
+        }
+        return result;
+    }
+} // namespace LayerRegistry
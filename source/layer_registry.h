@@ -0,0 +1,68 @@
+#pragma once
+
+#include "change_detector.h"
+#include "content_redirection/redirection.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct PatternAutomaton;
+
+/**
+ * Book-keeping of the layers added via this lib.
+ *
+ * Layers might have to be removed and re-added to emulate features on older modules, which changes their module handle.
+ * The handle that has been returned to the caller stays the same, "ToModuleHandle" translates it to the current module handle.
+ */
+struct LayerInfo {
+    CRLayerHandle handle       = 0; /**< Handle that has been returned to the caller */
+    CRLayerHandle moduleHandle = 0; /**< Current handle of the layer inside the module, 0 if the layer is not added to the module */
+    bool isEx                  = false;
+    std::string name;
+    std::string targetPath;
+    std::string replacementPath;
+    int layerType                 = 0;
+    int32_t priority              = 0;
+    bool active                   = true;
+    uint32_t sequence             = 0; /**< Order in which the layers have been added by the caller */
+    uint32_t moduleSequence       = 0; /**< Order in which the layers have been added to the module */
+    float filterFalsePositiveRate = 0; /**< False positive rate of the filter passed to the module, 0 if the layer has no filter */
+    uint32_t flags                = 0; /**< ContentRedirectionLayerFlags, only passed to the module if it supports them */
+    std::shared_ptr<const DirSnapshot> snapshot;       /**< State of the replacement dir at the last refresh, nullptr if the layer has never been refreshed */
+    std::shared_ptr<const PatternAutomaton> automaton; /**< Compiled rules of a FS_LAYER_TYPE_EX_PATTERN layer */
+    uint32_t virtualFileId = 0;                        /**< Id of the file of a FS_LAYER_TYPE_EX_PATCH_FILE or FS_LAYER_TYPE_EX_ARCHIVE layer on the virtual file device, 0 for other layers */
+};
+
+namespace LayerRegistry {
+    std::recursive_mutex &GetMutex();
+
+    /**
+     * Returns the next value for LayerInfo::sequence / LayerInfo::moduleSequence
+     */
+    uint32_t NextSequence();
+
+    /**
+     * Adds a layer, "layer.handle" is set to a handle that is not used by any other layer. Usually that's the module handle.
+     */
+    LayerInfo *Add(LayerInfo layer);
+
+    void Remove(CRLayerHandle handle);
+
+    LayerInfo *Find(CRLayerHandle handle);
+
+    /**
+     * Translates the handle returned to the caller into the current handle inside the module.
+     * Handles of unknown layers are returned unchanged.
+     */
+    CRLayerHandle ToModuleHandle(CRLayerHandle handle);
+
+    /**
+     * Translates a handle of the module into the handle which has been returned to the caller.
+     * Handles of unknown layers are returned unchanged.
+     */
+    CRLayerHandle FromModuleHandle(CRLayerHandle moduleHandle);
+
+    std::vector<LayerInfo *> GetAll();
+} // namespace LayerRegistry
@@ -0,0 +1,144 @@
+#include "layer_watcher.h"
+#include "change_detector.h"
+#include "layer_registry.h"
+#include "logger.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <thread>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct WatchedLayer {
+        std::chrono::milliseconds interval;
+        Clock::time_point nextPoll;
+    };
+
+    std::mutex sMutex;
+    std::condition_variable sCondition;
+    std::map<CRLayerHandle, WatchedLayer> sWatchedLayers;
+    std::thread sThread;
+    bool sThreadRunning = false;
+    bool sStopRequested = false;
+
+    void WatcherThread() {
+        std::unique_lock lock(sMutex);
+        while (!sStopRequested && !sWatchedLayers.empty()) {
+            auto next = sWatchedLayers.begin();
+            for (auto it = sWatchedLayers.begin(); it != sWatchedLayers.end(); ++it) {
+                if (it->second.nextPoll < next->second.nextPoll) {
+                    next = it;
+                }
+            }
+            const auto now = Clock::now();
+            if (next->second.nextPoll > now) {
+                sCondition.wait_until(lock, next->second.nextPoll);
+                continue;
+            }
+            const CRLayerHandle handle = next->first;
+            next->second.nextPoll      = now + next->second.interval;
+
+            lock.unlock();
+            const auto res = ContentRedirection_RefreshFSLayer(handle);
+            lock.lock();
+
+            if (res == CONTENT_REDIRECTION_RESULT_LAYER_NOT_FOUND) {
+                // The layer has been removed.
+                sWatchedLayers.erase(handle);
+            } else if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+                DEBUG_FUNCTION_LINE_WARN("Failed to refresh layer %08X: %s", handle, ContentRedirection_GetStatusStr(res));
+            }
+        }
+        sThreadRunning = false;
+    }
+
+    /**
+     * Takes the snapshot the first poll is compared against, unless the layer already has one.
+     */
+    bool TakeBaseline(CRLayerHandle handle) {
+        std::string replacementPath;
+        {
+            std::lock_guard lock(LayerRegistry::GetMutex());
+            auto *layer = LayerRegistry::Find(handle);
+            if (layer == nullptr) {
+                return false;
+            }
+            if (layer->snapshot != nullptr) {
+                return true;
+            }
+            replacementPath = layer->replacementPath;
+        }
+
+        auto snapshot = std::make_shared<DirSnapshot>();
+        if (!ChangeDetector::Scan(replacementPath, *snapshot)) {
+            DEBUG_FUNCTION_LINE_WARN("Failed to scan \"%s\"", replacementPath.c_str());
+        }
+
+        std::lock_guard lock(LayerRegistry::GetMutex());
+        auto *layer = LayerRegistry::Find(handle);
+        if (layer == nullptr) {
+            return false;
+        }
+        if (layer->snapshot == nullptr) {
+            layer->snapshot = std::move(snapshot);
+        }
+        return true;
+    }
+} // namespace
+
+namespace LayerWatcher {
+    void Stop() {
+        std::unique_lock lock(sMutex);
+        sStopRequested = true;
+        sWatchedLayers.clear();
+        sCondition.notify_all();
+        lock.unlock();
+        if (sThread.joinable()) {
+            sThread.join();
+        }
+        lock.lock();
+        sStopRequested = false;
+    }
+} // namespace LayerWatcher
+
+ContentRedirectionStatus ContentRedirection_WatchFSLayer(CRLayerHandle handle, uint32_t intervalMs) {
+    if (intervalMs == 0) {
+        std::lock_guard lock(sMutex);
+        sWatchedLayers.erase(handle);
+        sCondition.notify_all();
+        return CONTENT_REDIRECTION_RESULT_SUCCESS;
+    }
+
+    {
+        std::lock_guard lock(LayerRegistry::GetMutex());
+        auto *layer = LayerRegistry::Find(handle);
+        if (layer != nullptr && (layer->flags & CONTENT_REDIRECTION_LAYER_FLAG_IMMUTABLE) != 0) {
+            // Polling a layer that can't change would only cost I/O.
+            return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+        }
+        if (layer != nullptr && (layer->automaton != nullptr || layer->virtualFileId != 0)) {
+            // Pattern and patch layers have no replacement dir to poll, archive layers are only rebuilt on an explicit refresh.
+            return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+        }
+    }
+    if (!TakeBaseline(handle)) {
+        return CONTENT_REDIRECTION_RESULT_LAYER_NOT_FOUND;
+    }
+
+    std::lock_guard lock(sMutex);
+    const auto interval    = std::chrono::milliseconds(intervalMs);
+    sWatchedLayers[handle] = {interval, Clock::now() + interval};
+    if (!sThreadRunning) {
+        if (sThread.joinable()) {
+            // The previous thread exited after the last layer was unwatched.
+            sThread.join();
+        }
+        sThreadRunning = true;
+        sThread        = std::thread(WatcherThread);
+    } else {
+        sCondition.notify_all();
+    }
+    return CONTENT_REDIRECTION_RESULT_SUCCESS;
+}
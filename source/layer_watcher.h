@@ -0,0 +1,8 @@
+#pragma once
+
+namespace LayerWatcher {
+    /**
+     * Stops watching all layers and waits until the watcher thread has exited.
+     */
+    void Stop();
+} // namespace LayerWatcher
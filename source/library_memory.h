@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Reserves memory for a cache or buffer of this lib, see "ContentRedirection_SetMemoryBudget". <br>
+ * The devoptab wrapper uses the same accounting via "CR_DevoptabWrapper::internal::ReserveLibraryMemory". <br>
+ * Callers have to handle a failed reservation gracefully, e.g. by bypassing the cache. <br>
+ * The usage of the module is cached, it's refreshed by "ContentRedirection_GetMemoryUsage", "ContentRedirection_SetMemoryBudget"
+ * and by a reservation that doesn't fit with the cached value.
+ *
+ * @param size  Number of bytes that will be allocated.
+ * @return true if the allocation fits into the memory budget, false otherwise.
+ */
+bool ContentRedirection_ReserveLibraryMemory(uint32_t size);
+
+/**
+ * Releases memory which has been reserved via "ContentRedirection_ReserveLibraryMemory".
+ *
+ * @param size  Number of bytes that have been freed.
+ */
+void ContentRedirection_ReleaseLibraryMemory(uint32_t size);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,436 @@
+#include "content_redirection/devoptab_metadata_cache.h"
+#include "content_redirection/metadata_cache.h"
+#include "library_memory.h"
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <utility>
+
+using CR_DevoptabWrapper::internal::MetadataDirState;
+
+namespace {
+    constexpr uint32_t CACHE_MAGIC   = 0x43524D44; // "CRMD"
+    constexpr uint32_t CACHE_VERSION = 2;
+    constexpr size_t MAX_FILE_SIZE   = 16 * 1024 * 1024;
+    constexpr size_t ENTRY_OVERHEAD  = 32; // Rough per-node overhead of the hash maps
+
+    struct FileEntry {
+        int32_t result;
+        CR_Stat st;
+        bool verified = true; /**< false for files loaded from the cache file until a stat of the device has returned the same size and mtime */
+    };
+
+    struct DirEntry {
+        int64_t mtime   = 0;
+        bool valid      = false;
+        bool hasListing = false;
+        std::string listing;
+        std::unordered_map<std::string, FileEntry> files; /**< Keyed by the name inside of the directory */
+    };
+
+    std::mutex sMutex;
+    std::unordered_map<std::string, DirEntry> sDirs;
+    uint32_t sReservedBytes = 0;
+    ContentRedirectionMetadataCacheStats sStats{};
+
+    size_t DirCost(const std::string &path) {
+        return sizeof(DirEntry) + path.size() + ENTRY_OVERHEAD;
+    }
+
+    size_t FileCost(const std::string &name) {
+        return sizeof(FileEntry) + name.size() + ENTRY_OVERHEAD;
+    }
+
+    // Must be called with sMutex held.
+    bool Reserve(size_t size) {
+        if (!ContentRedirection_ReserveLibraryMemory(size)) {
+            return false;
+        }
+        sReservedBytes += size;
+        return true;
+    }
+
+    // Must be called with sMutex held.
+    void Release(size_t size) {
+        ContentRedirection_ReleaseLibraryMemory(size);
+        sReservedBytes -= size;
+    }
+
+    /**
+     * Splits a full path into its parent directory and the name inside of it, keeping the slash of the root directory (e.g. "sd:/").
+     */
+    bool SplitPath(std::string_view path, std::string &dir, std::string &name) {
+        const size_t slash = path.find_last_of('/');
+        if (slash == std::string_view::npos || slash + 1 == path.size()) {
+            return false;
+        }
+        const bool isRoot = slash == 0 || path[slash - 1] == ':';
+        dir               = path.substr(0, isRoot ? slash + 1 : slash);
+        name              = path.substr(slash + 1);
+        return true;
+    }
+
+    // Must be called with sMutex held.
+    void DropListing(DirEntry &dir) {
+        if (dir.hasListing) {
+            Release(dir.listing.size());
+            dir.listing.clear();
+            dir.listing.shrink_to_fit();
+            dir.hasListing = false;
+        }
+    }
+
+    // Must be called with sMutex held.
+    void DropContents(DirEntry &dir) {
+        DropListing(dir);
+        for (const auto &[name, file] : dir.files) {
+            Release(FileCost(name));
+        }
+        dir.files.clear();
+    }
+
+    // Must be called with sMutex held.
+    void DropAll() {
+        for (auto &[path, dir] : sDirs) {
+            DropContents(dir);
+            Release(DirCost(path));
+        }
+        sDirs.clear();
+    }
+
+    // Must be called with sMutex held.
+    DirEntry *FindValidDir(const std::string &path) {
+        const auto it = sDirs.find(path);
+        return it != sDirs.end() && it->second.valid ? &it->second : nullptr;
+    }
+
+    template<typename T>
+    void Append(std::string &out, const T &value) {
+        out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    struct Reader {
+        const char *cur;
+        const char *end;
+
+        template<typename T>
+        bool read(T &value) {
+            if (static_cast<size_t>(end - cur) < sizeof(T)) {
+                return false;
+            }
+            memcpy(&value, cur, sizeof(T));
+            cur += sizeof(T);
+            return true;
+        }
+
+        bool read(std::string &value, size_t len) {
+            if (static_cast<size_t>(end - cur) < len) {
+                return false;
+            }
+            value.assign(cur, len);
+            cur += len;
+            return true;
+        }
+    };
+
+    // Must be called with sMutex held.
+    bool Parse(Reader &reader) {
+        uint32_t header[3];
+        if (!reader.read(header) || header[0] != CACHE_MAGIC || header[1] != CACHE_VERSION) {
+            return false;
+        }
+        for (uint32_t i = 0; i < header[2]; i++) {
+            uint16_t pathLen;
+            std::string path;
+            int64_t mtime;
+            uint32_t numFiles;
+            if (!reader.read(pathLen) || !reader.read(path, pathLen) || !reader.read(mtime) || !reader.read(numFiles)) {
+                return false;
+            }
+            if (!Reserve(DirCost(path))) {
+                return true; // Keep what fits into the memory budget.
+            }
+            auto &dir = sDirs[path];
+            dir.mtime = mtime;
+            for (uint32_t j = 0; j < numFiles; j++) {
+                uint16_t nameLen;
+                std::string name;
+                FileEntry file{};
+                if (!reader.read(nameLen) || !reader.read(name, nameLen) || !reader.read(file.st)) {
+                    return false;
+                }
+                // Changing a file in place keeps the mtime of its directory, only the size of a directory doesn't matter.
+                file.verified = S_ISDIR(file.st.mode);
+                if (Reserve(FileCost(name))) {
+                    dir.files.emplace(std::move(name), file);
+                }
+            }
+        }
+        return reader.cur == reader.end;
+    }
+} // namespace
+
+bool ContentRedirection_LoadMetadataCache(const char *path) {
+    // Read the file before taking the lock, the device it's on may use the cache itself.
+    std::string buffer;
+    FILE *f = path ? fopen(path, "rb") : nullptr;
+    if (f) {
+        long size = -1;
+        if (fseek(f, 0, SEEK_END) == 0) {
+            size = ftell(f);
+        }
+        if (size > 0 && static_cast<size_t>(size) <= MAX_FILE_SIZE && fseek(f, 0, SEEK_SET) == 0) {
+            buffer.resize(size);
+            if (fread(buffer.data(), 1, buffer.size(), f) != buffer.size()) {
+                buffer.clear();
+            }
+        }
+        fclose(f);
+    }
+
+    std::lock_guard lock(sMutex);
+    DropAll();
+    if (buffer.empty()) {
+        return false;
+    }
+    Reader reader{buffer.data(), buffer.data() + buffer.size()};
+    if (!Parse(reader)) {
+        DEBUG_FUNCTION_LINE_WARN("Metadata cache \"%s\" is invalid", path);
+        DropAll();
+        return false;
+    }
+    return true;
+}
+
+bool ContentRedirection_SaveMetadataCache(const char *path) {
+    if (path == nullptr) {
+        return false;
+    }
+    // Only existing files are written. The modification time of a directory on FAT often stays the same when an entry is added,
+    // so listings and files that don't exist can't be validated in the next session and are only cached while the title runs.
+    std::string out;
+    {
+        std::lock_guard lock(sMutex);
+        uint32_t header[3] = {CACHE_MAGIC, CACHE_VERSION, 0};
+        Append(out, header);
+        for (const auto &[dirPath, dir] : sDirs) {
+            uint32_t numFiles = 0;
+            for (const auto &[name, file] : dir.files) {
+                numFiles += file.result == 0 ? 1 : 0;
+            }
+            if (numFiles == 0) {
+                continue;
+            }
+            header[2]++;
+            Append(out, static_cast<uint16_t>(dirPath.size()));
+            out += dirPath;
+            Append(out, dir.mtime);
+            Append(out, numFiles);
+            for (const auto &[name, file] : dir.files) {
+                if (file.result == 0) {
+                    Append(out, static_cast<uint16_t>(name.size()));
+                    out += name;
+                    Append(out, file.st);
+                }
+            }
+        }
+        memcpy(out.data(), header, sizeof(header));
+    }
+
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        DEBUG_FUNCTION_LINE_WARN("Failed to open \"%s\" for writing", path);
+        return false;
+    }
+    bool success = fwrite(out.data(), 1, out.size(), f) == out.size();
+    if (fclose(f) != 0) {
+        success = false;
+    }
+    return success;
+}
+
+void ContentRedirection_ClearMetadataCache() {
+    std::lock_guard lock(sMutex);
+    DropAll();
+}
+
+MetadataDirState CR_DevoptabWrapper::internal::GetMetadataDirState(const char *dirPath) {
+    if (dirPath == nullptr) {
+        return MetadataDirState::Unknown;
+    }
+    std::lock_guard lock(sMutex);
+    const auto it = sDirs.find(dirPath);
+    if (it == sDirs.end()) {
+        return MetadataDirState::Unknown;
+    }
+    return it->second.valid ? MetadataDirState::Valid : MetadataDirState::NeedsValidation;
+}
+
+void CR_DevoptabWrapper::internal::ValidateMetadataDir(const char *dirPath, int64_t mtime) {
+    if (dirPath == nullptr) {
+        return;
+    }
+    std::lock_guard lock(sMutex);
+    auto it = sDirs.find(dirPath);
+    if (it == sDirs.end()) {
+        const std::string path = dirPath;
+        if (!Reserve(DirCost(path))) {
+            return;
+        }
+        it = sDirs.emplace(path, DirEntry{}).first;
+    } else if (it->second.mtime != mtime) {
+        DropContents(it->second);
+        sStats.invalidatedDirs++;
+    }
+    it->second.mtime = mtime;
+    it->second.valid = true;
+    sStats.validations++;
+}
+
+bool CR_DevoptabWrapper::internal::LookupCachedStat(const char *path, int32_t *resultOut, CR_Stat *statOut) {
+    std::string dirPath, name;
+    if (path == nullptr || resultOut == nullptr || !SplitPath(path, dirPath, name)) {
+        return false;
+    }
+    std::lock_guard lock(sMutex);
+    if (const auto *dir = FindValidDir(dirPath)) {
+        const auto it = dir->files.find(name);
+        if (it != dir->files.end() && it->second.verified) {
+            *resultOut = it->second.result;
+            if (it->second.result == 0 && statOut != nullptr) {
+                *statOut = it->second.st;
+            }
+            sStats.hits++;
+            return true;
+        }
+    }
+    sStats.misses++;
+    return false;
+}
+
+void CR_DevoptabWrapper::internal::StoreCachedStat(const char *path, int32_t result, const CR_Stat *st) {
+    std::string dirPath, name;
+    if (path == nullptr || (result == 0 && st == nullptr) || !SplitPath(path, dirPath, name)) {
+        return;
+    }
+    std::lock_guard lock(sMutex);
+    auto *dir = FindValidDir(dirPath);
+    if (dir == nullptr) {
+        return;
+    }
+    auto it = dir->files.find(name);
+    if (it == dir->files.end()) {
+        if (!Reserve(FileCost(name))) {
+            return;
+        }
+        it = dir->files.emplace(std::move(name), FileEntry{}).first;
+    } else if (!it->second.verified) {
+        if (result != 0 || st->size != it->second.st.size || st->mtime != it->second.st.mtime) {
+            sStats.staleFiles++;
+        }
+        it->second.verified = true;
+    }
+    it->second.result = result;
+    it->second.st     = result == 0 ? *st : CR_Stat{};
+}
+
+bool CR_DevoptabWrapper::internal::CopyCachedListing(const char *dirPath, void *buffer, size_t bufferSize, size_t *sizeOut) {
+    if (dirPath == nullptr || sizeOut == nullptr) {
+        return false;
+    }
+    std::lock_guard lock(sMutex);
+    const auto *dir = FindValidDir(dirPath);
+    if (dir == nullptr || !dir->hasListing) {
+        sStats.misses++;
+        return false;
+    }
+    *sizeOut = dir->listing.size();
+    if (buffer == nullptr) {
+        return true;
+    }
+    if (bufferSize < dir->listing.size()) {
+        return false;
+    }
+    memcpy(buffer, dir->listing.data(), dir->listing.size());
+    sStats.hits++;
+    return true;
+}
+
+void CR_DevoptabWrapper::internal::StoreCachedListing(const char *dirPath, const void *data, size_t size) {
+    if (dirPath == nullptr || (data == nullptr && size > 0)) {
+        return;
+    }
+    std::lock_guard lock(sMutex);
+    auto *dir = FindValidDir(dirPath);
+    if (dir == nullptr) {
+        return;
+    }
+    DropListing(*dir);
+    if (!Reserve(size)) {
+        return;
+    }
+    dir->listing.assign(static_cast<const char *>(data), size);
+    dir->hasListing = true;
+}
+
+void CR_DevoptabWrapper::internal::InvalidateCachedMetadata(const char *path) {
+    if (path == nullptr) {
+        return;
+    }
+    std::string pathStr = path;
+    while (pathStr.size() > 1 && pathStr.back() == '/' && pathStr[pathStr.size() - 2] != ':') {
+        pathStr.pop_back();
+    }
+    std::lock_guard lock(sMutex);
+    std::string dirPath, name;
+    if (SplitPath(pathStr, dirPath, name)) {
+        const auto it = sDirs.find(dirPath);
+        if (it != sDirs.end()) {
+            const auto fileIt = it->second.files.find(name);
+            if (fileIt != it->second.files.end()) {
+                Release(FileCost(fileIt->first));
+                it->second.files.erase(fileIt);
+            }
+            // The directory has changed, its other entries are kept if its fingerprint turns out to be unchanged.
+            DropListing(it->second);
+            it->second.valid = false;
+        }
+    }
+    const std::string prefix = pathStr.back() == '/' ? pathStr : pathStr + "/";
+    for (auto it = sDirs.begin(); it != sDirs.end();) {
+        if (it->first == pathStr || it->first.compare(0, prefix.size(), prefix) == 0) {
+            DropContents(it->second);
+            Release(DirCost(it->first));
+            it = sDirs.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void ContentRedirection_GetMetadataCacheStats(ContentRedirectionMetadataCacheStats *statsOut) {
+    if (statsOut == nullptr) {
+        return;
+    }
+    std::lock_guard lock(sMutex);
+    *statsOut          = sStats;
+    statsOut->dirs     = sDirs.size();
+    statsOut->files    = 0;
+    statsOut->listings = 0;
+    statsOut->bytes    = sReservedBytes;
+    for (const auto &[path, dir] : sDirs) {
+        statsOut->files += dir.files.size();
+        statsOut->listings += dir.hasListing ? 1 : 0;
+    }
+}
+
+void ContentRedirection_ResetMetadataCacheStats() {
+    std::lock_guard lock(sMutex);
+    sStats = {};
+}
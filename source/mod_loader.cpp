@@ -0,0 +1,309 @@
+#include "content_redirection/io_scheduler.h"
+#include "content_redirection/mod_loader.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+    constexpr uint32_t CACHE_MAGIC   = 0x43524D43; // "CRMC"
+    constexpr uint32_t CACHE_VERSION = 1;
+
+    struct ModScanResult {
+        std::string name;
+        uint64_t fingerprint = 0;
+        uint32_t ruleMask    = 0; /**< Bit n is set if rule n matches this mod */
+    };
+
+    uint64_t HashBytes(uint64_t hash, const void *data, size_t len) {
+        const auto *bytes = static_cast<const uint8_t *>(data);
+        for (size_t i = 0; i < len; i++) {
+            hash ^= bytes[i];
+            hash *= 0x100000001B3ULL;
+        }
+        return hash;
+    }
+
+    uint64_t HashString(uint64_t hash, const char *str) {
+        return HashBytes(hash, str, strlen(str) + 1);
+    }
+
+    uint64_t HashStat(uint64_t hash, const struct stat &st) {
+        const int64_t values[] = {static_cast<int64_t>(st.st_size), static_cast<int64_t>(st.st_mtime), static_cast<int64_t>(st.st_mode & S_IFMT)};
+        return HashBytes(hash, values, sizeof(values));
+    }
+
+    uint64_t HashRules(const ContentRedirectionModLoaderConfig *config) {
+        uint64_t hash = 0xCBF29CE484222325ULL;
+        for (uint32_t i = 0; i < config->numRules; i++) {
+            const auto &rule      = config->rules[i];
+            const int32_t typeVal = rule.layerType;
+            hash                  = HashString(hash, rule.subDir);
+            hash                  = HashString(hash, rule.targetPath);
+            hash                  = HashBytes(hash, &typeVal, sizeof(typeVal));
+        }
+        return hash;
+    }
+
+    /**
+     * Cheap fingerprint of a mod, only the mod folder and the direct rule subDirs are checked.
+     */
+    uint64_t GetModFingerprint(const std::string &modPath, const ContentRedirectionModLoaderConfig *config) {
+        uint64_t hash = 0xCBF29CE484222325ULL;
+        struct stat st {};
+        if (stat(modPath.c_str(), &st) == 0) {
+            hash = HashStat(hash, st);
+        }
+        for (uint32_t i = 0; i < config->numRules; i++) {
+            const auto path = modPath + "/" + config->rules[i].subDir;
+            if (stat(path.c_str(), &st) == 0) {
+                hash = HashStat(HashString(hash, config->rules[i].subDir), st);
+            }
+        }
+        return hash;
+    }
+
+    bool IsDirectory(const std::string &parent, const struct dirent *entry) {
+#ifdef DT_DIR
+        if (entry->d_type == DT_DIR) {
+            return true;
+        }
+        if (entry->d_type != DT_UNKNOWN) {
+            return false;
+        }
+#endif
+        struct stat st {};
+        return stat((parent + "/" + entry->d_name).c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    }
+
+    /**
+     * Returns true if the directory contains at least one file, recursively.
+     */
+    bool ContainsFiles(const std::string &path) {
+        bool found = false;
+        std::vector<std::string> subDirs;
+        {
+            // Mods are scanned while the game may already be loading, every directory is one background request.
+            CR_DevoptabWrapper::BackgroundIO io;
+            DIR *dir = opendir(path.c_str());
+            if (!dir) {
+                return false;
+            }
+            while (!found) {
+                const struct dirent *entry = readdir(dir);
+                if (entry == nullptr) {
+                    break;
+                }
+                if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+                    continue;
+                }
+                if (IsDirectory(path, entry)) {
+                    subDirs.emplace_back(path + "/" + entry->d_name);
+                } else {
+                    found = true;
+                }
+            }
+            closedir(dir);
+        }
+        for (const auto &subDir : subDirs) {
+            if (found) {
+                break;
+            }
+            found = ContainsFiles(subDir);
+        }
+        return found;
+    }
+
+    void ScanMod(const std::string &modsRoot, const ContentRedirectionModLoaderConfig *config, ModScanResult &mod) {
+        const auto modPath = modsRoot + "/" + mod.name;
+        for (uint32_t i = 0; i < config->numRules; i++) {
+            if (ContainsFiles(modPath + "/" + config->rules[i].subDir)) {
+                mod.ruleMask |= 1u << i;
+            }
+        }
+    }
+
+    bool ListMods(const std::string &modsRoot, std::vector<ModScanResult> &mods) {
+        DIR *dir = opendir(modsRoot.c_str());
+        if (!dir) {
+            return false;
+        }
+        const struct dirent *entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            if (entry->d_name[0] == '.' || !IsDirectory(modsRoot, entry)) {
+                continue;
+            }
+            ModScanResult mod;
+            mod.name = entry->d_name;
+            mods.push_back(std::move(mod));
+        }
+        closedir(dir);
+        std::sort(mods.begin(), mods.end(), [](const ModScanResult &a, const ModScanResult &b) { return a.name < b.name; });
+        return true;
+    }
+
+    struct CachedMod {
+        uint64_t fingerprint;
+        uint32_t ruleMask;
+    };
+
+    void LoadCache(const char *cachePath, uint64_t rulesHash, std::unordered_map<std::string, CachedMod> &cache) {
+        FILE *f = fopen(cachePath, "rb");
+        if (!f) {
+            return;
+        }
+        uint32_t header[3];
+        uint64_t fileRulesHash;
+        if (fread(header, sizeof(header), 1, f) != 1 || fread(&fileRulesHash, sizeof(fileRulesHash), 1, f) != 1 ||
+            header[0] != CACHE_MAGIC || header[1] != CACHE_VERSION || fileRulesHash != rulesHash) {
+            fclose(f);
+            return;
+        }
+        for (uint32_t i = 0; i < header[2]; i++) {
+            uint32_t nameLen;
+            CachedMod entry{};
+            if (fread(&nameLen, sizeof(nameLen), 1, f) != 1 || nameLen > 1024) {
+                break;
+            }
+            std::string name(nameLen, '\0');
+            if (fread(name.data(), 1, nameLen, f) != nameLen ||
+                fread(&entry.fingerprint, sizeof(entry.fingerprint), 1, f) != 1 ||
+                fread(&entry.ruleMask, sizeof(entry.ruleMask), 1, f) != 1) {
+                break;
+            }
+            cache[name] = entry;
+        }
+        fclose(f);
+    }
+
+    void SaveCache(const char *cachePath, uint64_t rulesHash, const std::vector<ModScanResult> &mods) {
+        FILE *f = fopen(cachePath, "wb");
+        if (!f) {
+            DEBUG_FUNCTION_LINE_WARN("Failed to open \"%s\" for writing", cachePath);
+            return;
+        }
+        const uint32_t header[3] = {CACHE_MAGIC, CACHE_VERSION, static_cast<uint32_t>(mods.size())};
+        fwrite(header, sizeof(header), 1, f);
+        fwrite(&rulesHash, sizeof(rulesHash), 1, f);
+        for (const auto &mod : mods) {
+            const uint32_t nameLen = mod.name.size();
+            fwrite(&nameLen, sizeof(nameLen), 1, f);
+            fwrite(mod.name.data(), 1, nameLen, f);
+            fwrite(&mod.fingerprint, sizeof(mod.fingerprint), 1, f);
+            fwrite(&mod.ruleMask, sizeof(mod.ruleMask), 1, f);
+        }
+        fclose(f);
+    }
+} // namespace
+
+ContentRedirectionStatus ContentRedirection_LoadMods(const ContentRedirectionModLoaderConfig *config, CRLayerHandle *handlesOut, uint32_t maxHandles, uint32_t *numHandlesOut) {
+    if (config == nullptr || config->modsRoot == nullptr || (config->rules == nullptr && config->numRules > 0) || handlesOut == nullptr || numHandlesOut == nullptr) {
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
+    if (config->numRules > 32) {
+        DEBUG_FUNCTION_LINE_ERR("Only up to 32 rules are supported");
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
+    *numHandlesOut = 0;
+
+    ContentRedirectionVersion version;
+    auto res = ContentRedirection_GetVersion(&version);
+    if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+        return res;
+    }
+    if (version < 2) {
+        return CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND;
+    }
+
+    std::string modsRoot = config->modsRoot;
+    while (!modsRoot.empty() && modsRoot.back() == '/') {
+        modsRoot.pop_back();
+    }
+
+    std::vector<ModScanResult> mods;
+    if (!ListMods(modsRoot, mods)) {
+        DEBUG_FUNCTION_LINE_ERR("Failed to open mods root \"%s\"", modsRoot.c_str());
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
+
+    const uint64_t rulesHash = HashRules(config);
+    std::unordered_map<std::string, CachedMod> cache;
+    if (config->cachePath) {
+        LoadCache(config->cachePath, rulesHash, cache);
+    }
+
+    uint32_t numThreads = config->numThreads != 0 ? config->numThreads : std::thread::hardware_concurrency();
+    numThreads          = std::max<uint32_t>(1, std::min<uint32_t>(numThreads, mods.size()));
+
+    // Every worker picks the next mod until all are scanned. The results are stored by index, so the order stays deterministic.
+    std::atomic<size_t> nextMod = 0;
+
+    auto worker = [&]() {
+        size_t i;
+        while ((i = nextMod.fetch_add(1)) < mods.size()) {
+            auto &mod       = mods[i];
+            mod.fingerprint = GetModFingerprint(modsRoot + "/" + mod.name, config);
+            auto it         = cache.find(mod.name);
+            if (it != cache.end() && it->second.fingerprint == mod.fingerprint) {
+                mod.ruleMask = it->second.ruleMask;
+                continue;
+            }
+            ScanMod(modsRoot, config, mod);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < numThreads; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    if (config->cachePath) {
+        SaveCache(config->cachePath, rulesHash, mods);
+    }
+
+    uint32_t numLayers = 0;
+    for (const auto &mod : mods) {
+        numLayers += __builtin_popcount(mod.ruleMask);
+    }
+    if (numLayers > maxHandles) {
+        DEBUG_FUNCTION_LINE_ERR("handlesOut is too small, %d layers would be added", numLayers);
+        return CONTENT_REDIRECTION_RESULT_NO_MEMORY;
+    }
+
+    for (const auto &mod : mods) {
+        for (uint32_t i = 0; i < config->numRules; i++) {
+            if ((mod.ruleMask & (1u << i)) == 0) {
+                continue;
+            }
+            const auto &rule           = config->rules[i];
+            const auto replacementPath = modsRoot + "/" + mod.name + "/" + rule.subDir;
+            CRLayerHandle handle;
+            res = ContentRedirection_AddFSLayerExWithFlags(&handle, mod.name.c_str(), rule.targetPath, replacementPath.c_str(), rule.layerType, 0, rule.flags);
+            if (res == CONTENT_REDIRECTION_RESULT_UNSUPPORTED_VERSION && rule.flags != CONTENT_REDIRECTION_LAYER_FLAG_NONE) {
+                // The flags only let the module skip work, modules without layer flags still get the layer.
+                res = ContentRedirection_AddFSLayerExWithFlags(&handle, mod.name.c_str(), rule.targetPath, replacementPath.c_str(), rule.layerType, 0, CONTENT_REDIRECTION_LAYER_FLAG_NONE);
+            }
+            if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+                DEBUG_FUNCTION_LINE_ERR("Failed to add layer for mod \"%s\": %s", mod.name.c_str(), ContentRedirection_GetStatusStr(res));
+                for (uint32_t j = 0; j < *numHandlesOut; j++) {
+                    ContentRedirection_RemoveFSLayer(handlesOut[j]);
+                }
+                *numHandlesOut = 0;
+                return res;
+            }
+            handlesOut[(*numHandlesOut)++] = handle;
+        }
+    }
+    return CONTENT_REDIRECTION_RESULT_SUCCESS;
+}
@@ -0,0 +1,102 @@
+#include "patch_loader.h"
+#include "content_redirection/devoptab_backend.h"
+#include "content_redirection/patch_layer.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <memory>
+#include <new>
+
+using CR_DevoptabWrapper::Backend;
+
+namespace {
+    constexpr size_t HEADER_SIZE = 32;
+    constexpr size_t EXTENT_SIZE = 24;
+
+    uint32_t ReadU32(const uint8_t *p) {
+        return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | (uint32_t) p[3];
+    }
+
+    uint64_t ReadU64(const uint8_t *p) {
+        return (uint64_t) ReadU32(p) << 32 | ReadU32(p + 4);
+    }
+} // namespace
+
+namespace PatchLoader {
+    ContentRedirectionStatus Load(const std::string &basePath, const std::string &patchPath, VirtualFile &out) {
+        const uint32_t base  = out.AddSource(basePath);
+        const uint32_t patch = out.AddSource(patchPath);
+        if (base == VIRTUAL_FILE_SOURCE_ZERO || patch == VIRTUAL_FILE_SOURCE_ZERO) {
+            return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+        }
+        CR_Stat patchStat{};
+        if (Backend::stat(out.sourceDevs[base], basePath.c_str(), &out.stat) < 0 || Backend::stat(out.sourceDevs[patch], patchPath.c_str(), &patchStat) < 0) {
+            DEBUG_FUNCTION_LINE_ERR("Failed to stat \"%s\" or \"%s\"", basePath.c_str(), patchPath.c_str());
+            return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+        }
+        const uint64_t baseSize  = out.stat.size;
+        const uint64_t patchSize = patchStat.size;
+
+        uint8_t header[HEADER_SIZE];
+        if (patchSize < HEADER_SIZE || VirtualFileDevice::ReadRange(patchPath, 0, header, sizeof(header)) < 0) {
+            DEBUG_FUNCTION_LINE_ERR("Failed to read header of \"%s\"", patchPath.c_str());
+            return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+        }
+        const uint32_t numExtents = ReadU32(header + 24);
+        if (ReadU32(header) != CONTENT_REDIRECTION_PATCH_MAGIC || ReadU32(header + 4) != CONTENT_REDIRECTION_PATCH_VERSION || ReadU32(header + 28) != 0 ||
+            numExtents > CONTENT_REDIRECTION_PATCH_MAX_EXTENTS || HEADER_SIZE + (uint64_t) numExtents * EXTENT_SIZE > patchSize) {
+            DEBUG_FUNCTION_LINE_ERR("\"%s\" is no valid patch file", patchPath.c_str());
+            return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+        }
+        if (ReadU64(header + 8) != baseSize) {
+            DEBUG_FUNCTION_LINE_ERR("\"%s\" has been created for a file of %llu bytes, \"%s\" has %llu bytes", patchPath.c_str(),
+                                    static_cast<unsigned long long>(ReadU64(header + 8)), basePath.c_str(), static_cast<unsigned long long>(baseSize));
+            return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+        }
+        const uint64_t patchedSize = ReadU64(header + 16);
+
+        // The table and the segments are charged to the memory budget before they are allocated.
+        const size_t tableSize   = numExtents * EXTENT_SIZE;
+        const size_t numSegments = numExtents * 2 + 1;
+        if (!out.Reserve(tableSize + numSegments * sizeof(VirtualFileSegment))) {
+            DEBUG_FUNCTION_LINE_ERR("The %d extents of \"%s\" don't fit into the memory budget", numExtents, patchPath.c_str());
+            return CONTENT_REDIRECTION_RESULT_NO_MEMORY;
+        }
+
+        // The whole table is read with one request.
+        std::unique_ptr<uint8_t[]> table(new (std::nothrow) uint8_t[tableSize + 1]);
+        if (!table) {
+            return CONTENT_REDIRECTION_RESULT_NO_MEMORY;
+        }
+        if (tableSize > 0 && VirtualFileDevice::ReadRange(patchPath, HEADER_SIZE, table.get(), tableSize) < 0) {
+            DEBUG_FUNCTION_LINE_ERR("Failed to read extents of \"%s\"", patchPath.c_str());
+            return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+        }
+
+        // Bytes between the extents come from the original file, bytes beyond its end read as 0.
+        auto appendBase = [&](uint64_t from, uint64_t to) {
+            const uint64_t baseEnd = std::max(from, std::min(to, baseSize));
+            out.Append(base, from, baseEnd - from);
+            out.Append(VIRTUAL_FILE_SOURCE_ZERO, 0, to - baseEnd);
+        };
+        const uint64_t dataStart = HEADER_SIZE + tableSize;
+        uint64_t pos             = 0;
+        out.segments.reserve(numSegments);
+        for (uint32_t i = 0; i < numExtents; i++) {
+            const uint8_t *entry      = table.get() + i * EXTENT_SIZE;
+            const uint64_t offset     = ReadU64(entry);
+            const uint64_t dataOffset = ReadU64(entry + 8);
+            const uint32_t length     = ReadU32(entry + 16);
+            if (length == 0 || ReadU32(entry + 20) != 0 || offset < pos || offset > patchedSize || length > patchedSize - offset ||
+                dataOffset < dataStart || dataOffset > patchSize || length > patchSize - dataOffset) {
+                DEBUG_FUNCTION_LINE_ERR("Extent %d of \"%s\" is invalid", i, patchPath.c_str());
+                return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+            }
+            appendBase(pos, offset);
+            out.Append(patch, dataOffset, length);
+            pos = offset + length;
+        }
+        appendBase(pos, patchedSize);
+        return CONTENT_REDIRECTION_RESULT_SUCCESS;
+    }
+} // namespace PatchLoader
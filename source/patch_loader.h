@@ -0,0 +1,14 @@
+#pragma once
+
+#include "virtual_file_device.h"
+
+#include <string>
+
+namespace PatchLoader {
+    /**
+     * Describes the patched file of a FS_LAYER_TYPE_EX_PATCH_FILE layer: ranges covered by an extent are taken from the patch file,
+     * everything else from the original file.
+     * Returns CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT if a file can't be read or the patch doesn't match the original file.
+     */
+    ContentRedirectionStatus Load(const std::string &basePath, const std::string &patchPath, VirtualFile &out);
+} // namespace PatchLoader
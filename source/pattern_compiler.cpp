@@ -0,0 +1,492 @@
+#include "pattern_compiler.h"
+#include "library_memory.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <array>
+#include <map>
+
+namespace {
+    /**
+     * Set of (lower-cased) bytes, bit b of word b / 64 is set if byte b is part of the set.
+     */
+    using CharSet = std::array<uint64_t, 4>;
+
+    /**
+     * Upper bound of the states of the automaton before and after minimization, state ids have to fit into uint16_t.
+     */
+    constexpr uint32_t MAX_STATES = 0xFFFF;
+
+    constexpr uint32_t NO_STATE = UINT32_MAX;
+
+    /**
+     * Bookkeeping of a std::map node or a std::vector, used to estimate the working memory of the compiler.
+     */
+    constexpr uint32_t CONTAINER_OVERHEAD = 48;
+
+    /**
+     * Working memory of the compiler. It's reserved via "ContentRedirection_ReserveLibraryMemory" before it's allocated,
+     * in steps of RESERVE_STEP to keep the number of reservations low, and released when the compiler is done.
+     */
+    struct ScratchMemory {
+        static constexpr uint32_t RESERVE_STEP = 64 * 1024;
+
+        uint64_t usedBytes     = 0;
+        uint32_t reservedBytes = 0;
+
+        ScratchMemory() = default;
+
+        ScratchMemory(const ScratchMemory &)            = delete;
+        ScratchMemory &operator=(const ScratchMemory &) = delete;
+
+        ~ScratchMemory() {
+            if (reservedBytes != 0) {
+                ContentRedirection_ReleaseLibraryMemory(reservedBytes);
+            }
+        }
+
+        bool Grow(uint64_t bytes) {
+            usedBytes += bytes;
+            if (usedBytes <= reservedBytes) {
+                return true;
+            }
+            const uint64_t step = std::max<uint64_t>(usedBytes - reservedBytes, RESERVE_STEP);
+            if (reservedBytes + step > UINT32_MAX || !ContentRedirection_ReserveLibraryMemory(step)) {
+                return false;
+            }
+            reservedBytes += step;
+            return true;
+        }
+    };
+
+    void AddChar(CharSet &set, uint8_t c) {
+        if (c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+        set[c >> 6] |= 1ULL << (c & 63);
+    }
+
+    bool HasChar(const CharSet &set, uint8_t c) {
+        return (set[c >> 6] & (1ULL << (c & 63))) != 0;
+    }
+
+    void RemoveChar(CharSet &set, uint8_t c) {
+        set[c >> 6] &= ~(1ULL << (c & 63));
+    }
+
+    CharSet AllChars(bool includeSlash) {
+        CharSet set;
+        set.fill(~0ULL);
+        // Paths are lower-cased before they are matched, upper-case bytes never reach the automaton.
+        for (uint8_t c = 'A'; c <= 'Z'; c++) {
+            RemoveChar(set, c);
+        }
+        if (!includeSlash) {
+            RemoveChar(set, '/');
+        }
+        return set;
+    }
+
+    struct NfaEdge {
+        uint32_t charSet; /**< Index into Nfa::charSets */
+        uint32_t target;
+    };
+
+    struct NfaState {
+        std::vector<NfaEdge> edges;
+        std::vector<uint32_t> epsilon;
+        uint16_t acceptRule = CONTENT_REDIRECTION_PATTERN_NO_MATCH;
+    };
+
+    /**
+     * Thompson-style automaton of all patterns, every rule adds its own chain of states.
+     */
+    struct Nfa {
+        std::vector<NfaState> states;
+        std::vector<CharSet> charSets;
+        std::map<CharSet, uint32_t> charSetIds;
+        std::vector<uint32_t> starts;
+
+        uint32_t AddState() {
+            states.emplace_back();
+            return states.size() - 1;
+        }
+
+        void AddEdge(uint32_t from, const CharSet &set, uint32_t to) {
+            auto [it, inserted] = charSetIds.emplace(set, charSets.size());
+            if (inserted) {
+                charSets.push_back(set);
+            }
+            states[from].edges.push_back({it->second, to});
+        }
+    };
+
+    /**
+     * Parses a bracket expression, "p" points to the character after the '['.
+     */
+    bool ParseBracket(const char *&p, CharSet &out) {
+        out.fill(0);
+        bool negate = false;
+        if (*p == '!' || *p == '^') {
+            negate = true;
+            p++;
+        }
+        bool first = true;
+        while (*p != ']' || first) {
+            first = false;
+            if (*p == '\0') {
+                return false;
+            }
+            if (*p == '\\' && p[1] != '\0') {
+                p++;
+            }
+            const auto lo = static_cast<uint8_t>(*p++);
+            auto hi       = lo;
+            if (*p == '-' && p[1] != ']' && p[1] != '\0') {
+                p++;
+                if (*p == '\\' && p[1] != '\0') {
+                    p++;
+                }
+                hi = static_cast<uint8_t>(*p++);
+                if (hi < lo) {
+                    return false;
+                }
+            }
+            for (uint32_t c = lo; c <= hi; c++) {
+                AddChar(out, c);
+            }
+        }
+        p++;
+        if (negate) {
+            const auto all = AllChars(false);
+            for (size_t i = 0; i < out.size(); i++) {
+                out[i] = all[i] & ~out[i];
+            }
+        } else {
+            // '/' separates directories, a bracket never matches it.
+            RemoveChar(out, '/');
+        }
+        return true;
+    }
+
+    bool AddPattern(Nfa &nfa, const char *pattern, uint16_t rule) {
+        while (*pattern == '/') {
+            pattern++;
+        }
+        if (*pattern == '\0') {
+            return false;
+        }
+        const auto any      = AllChars(true);
+        const auto anyInDir = AllChars(false);
+
+        uint32_t cur = nfa.AddState();
+        nfa.starts.push_back(cur);
+        for (const char *p = pattern; *p;) {
+            if (p[0] == '*' && p[1] == '*') {
+                p += 2;
+                while (*p == '*') {
+                    p++;
+                }
+                const uint32_t next = nfa.AddState();
+                nfa.states[cur].epsilon.push_back(next);
+                if (*p == '/') {
+                    // "**/" matches nothing or anything that ends with a '/'.
+                    p++;
+                    CharSet slash{};
+                    AddChar(slash, '/');
+                    const uint32_t inDirs = nfa.AddState();
+                    nfa.AddEdge(cur, any, inDirs);
+                    nfa.AddEdge(inDirs, any, inDirs);
+                    nfa.AddEdge(inDirs, slash, next);
+                    nfa.AddEdge(cur, slash, next);
+                } else {
+                    nfa.AddEdge(cur, any, cur);
+                }
+                cur = next;
+                continue;
+            }
+            if (*p == '*') {
+                p++;
+                const uint32_t next = nfa.AddState();
+                nfa.AddEdge(cur, anyInDir, cur);
+                nfa.states[cur].epsilon.push_back(next);
+                cur = next;
+                continue;
+            }
+
+            CharSet set{};
+            if (*p == '?') {
+                set = anyInDir;
+                p++;
+            } else if (*p == '[') {
+                p++;
+                if (!ParseBracket(p, set)) {
+                    return false;
+                }
+            } else {
+                if (*p == '\\') {
+                    p++;
+                    if (*p == '\0') {
+                        return false;
+                    }
+                }
+                AddChar(set, *p++);
+            }
+            const uint32_t next = nfa.AddState();
+            nfa.AddEdge(cur, set, next);
+            cur = next;
+        }
+        nfa.states[cur].acceptRule = rule;
+        return true;
+    }
+
+    void AddClosure(const Nfa &nfa, std::vector<uint32_t> &set, std::vector<uint8_t> &inSet) {
+        std::vector<uint32_t> stack = set;
+        while (!stack.empty()) {
+            const uint32_t state = stack.back();
+            stack.pop_back();
+            for (const uint32_t next : nfa.states[state].epsilon) {
+                if (!inSet[next]) {
+                    inSet[next] = 1;
+                    set.push_back(next);
+                    stack.push_back(next);
+                }
+            }
+        }
+        std::sort(set.begin(), set.end());
+    }
+
+    /**
+     * Partitions all bytes into classes, two bytes are in the same class if every char set of the NFA either contains both or none of them.
+     */
+    uint32_t BuildByteClasses(const Nfa &nfa, std::vector<uint8_t> &classes) {
+        classes.assign(256, 0);
+        uint32_t numClasses = 1;
+        for (const auto &set : nfa.charSets) {
+            std::map<std::pair<uint8_t, bool>, uint8_t> split;
+            for (uint32_t c = 0; c < 256; c++) {
+                auto [it, inserted] = split.emplace(std::make_pair(classes[c], HasChar(set, c)), split.size());
+                classes[c]          = it->second;
+            }
+            numClasses = split.size();
+        }
+        return numClasses;
+    }
+
+    /**
+     * Subset construction. State 0 is the empty set (dead state), state 1 the closure of all start states.
+     * Every new state is charged to "scratch" before it's added, so a pattern set that blows up fails early instead of exhausting the heap.
+     */
+    bool Determinize(const Nfa &nfa, const std::vector<uint8_t> &byteClasses, uint32_t numClasses, ScratchMemory &scratch,
+                     std::vector<uint32_t> &transitions, std::vector<uint16_t> &acceptRule) {
+        std::vector<uint8_t> representative(numClasses);
+        for (uint32_t c = 256; c-- > 0;) {
+            representative[byteClasses[c]] = c;
+        }
+
+        std::map<std::vector<uint32_t>, uint32_t> ids;
+        std::vector<std::vector<uint32_t>> sets;
+        std::vector<uint8_t> inSet(nfa.states.size(), 0);
+
+        auto intern = [&](std::vector<uint32_t> &&set) -> uint32_t {
+            auto it = ids.find(set);
+            if (it != ids.end()) {
+                return it->second;
+            }
+            if (sets.size() >= MAX_STATES) {
+                DEBUG_FUNCTION_LINE_ERR("Patterns need more than %d states", MAX_STATES);
+                return NO_STATE;
+            }
+            // The set is stored twice (key of "ids" and "sets"), the transitions of the state may take twice their size while the vector grows.
+            const uint64_t cost = 2 * (set.size() * sizeof(uint32_t) + CONTAINER_OVERHEAD) + 2 * numClasses * sizeof(uint32_t) + sizeof(uint16_t);
+            if (!scratch.Grow(cost)) {
+                DEBUG_FUNCTION_LINE_ERR("Not enough memory to compile the patterns, gave up after %d states", static_cast<int>(sets.size()));
+                return NO_STATE;
+            }
+            ids.emplace(set, sets.size());
+            sets.push_back(std::move(set));
+            return sets.size() - 1;
+        };
+
+        if (intern({}) == NO_STATE) {
+            return false;
+        }
+        std::vector<uint32_t> start = nfa.starts;
+        for (const uint32_t s : start) {
+            inSet[s] = 1;
+        }
+        AddClosure(nfa, start, inSet);
+        for (const uint32_t s : start) {
+            inSet[s] = 0;
+        }
+        if (intern(std::move(start)) == NO_STATE) {
+            return false;
+        }
+
+        for (uint32_t state = 0; state < sets.size(); state++) {
+            uint16_t accept = CONTENT_REDIRECTION_PATTERN_NO_MATCH;
+            for (const uint32_t s : sets[state]) {
+                accept = std::min(accept, nfa.states[s].acceptRule);
+            }
+            acceptRule.push_back(accept);
+
+            for (uint32_t cls = 0; cls < numClasses; cls++) {
+                std::vector<uint32_t> next;
+                for (const uint32_t s : sets[state]) {
+                    for (const auto &edge : nfa.states[s].edges) {
+                        if (!inSet[edge.target] && HasChar(nfa.charSets[edge.charSet], representative[cls])) {
+                            inSet[edge.target] = 1;
+                            next.push_back(edge.target);
+                        }
+                    }
+                }
+                AddClosure(nfa, next, inSet);
+                for (const uint32_t s : next) {
+                    inSet[s] = 0;
+                }
+                // "sets" may grow, don't keep references into it across this call.
+                const uint32_t target = intern(std::move(next));
+                if (target == NO_STATE) {
+                    return false;
+                }
+                transitions.push_back(target);
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Upper bound of the memory "Minimize" allocates: the signature of every state, the partition and the minimized automaton.
+     */
+    uint64_t MinimizeCost(uint32_t numStates, uint32_t numClasses) {
+        const uint64_t signatures = static_cast<uint64_t>(numStates) * ((numClasses + 1) * sizeof(uint32_t) + 2 * CONTAINER_OVERHEAD);
+        const uint64_t partition  = static_cast<uint64_t>(numStates) * 4 * sizeof(uint32_t);
+        const uint64_t automaton  = static_cast<uint64_t>(numStates) * (numClasses + 1) * sizeof(uint16_t);
+        return signatures + partition + automaton;
+    }
+
+    /**
+     * Moore's partition refinement, merges all states that accept the same rule for every suffix.
+     * The dead state stays state 0 and the start state stays state 1.
+     */
+    void Minimize(uint32_t numClasses, const std::vector<uint32_t> &transitions, const std::vector<uint16_t> &acceptRule, PatternAutomaton &out) {
+        const uint32_t numStates = acceptRule.size();
+        std::vector<uint32_t> block(numStates);
+        uint32_t numBlocks = 0;
+        {
+            std::map<uint16_t, uint32_t> initial;
+            for (uint32_t s = 0; s < numStates; s++) {
+                block[s] = initial.emplace(acceptRule[s], initial.size()).first->second;
+            }
+            numBlocks = initial.size();
+        }
+        while (true) {
+            std::map<std::vector<uint32_t>, uint32_t> signatures;
+            std::vector<uint32_t> next(numStates);
+            std::vector<uint32_t> signature(numClasses + 1);
+            for (uint32_t s = 0; s < numStates; s++) {
+                signature[0] = block[s];
+                for (uint32_t cls = 0; cls < numClasses; cls++) {
+                    signature[cls + 1] = block[transitions[s * numClasses + cls]];
+                }
+                next[s] = signatures.emplace(signature, signatures.size()).first->second;
+            }
+            block.swap(next);
+            if (signatures.size() == numBlocks) {
+                break;
+            }
+            numBlocks = signatures.size();
+        }
+
+        // Renumber the blocks, dead state first, start state second. If nothing can match both are the same block,
+        // the start state is kept as a copy of the dead state.
+        const bool startIsDead = block[CONTENT_REDIRECTION_PATTERN_START_STATE] == block[CONTENT_REDIRECTION_PATTERN_DEAD_STATE];
+        std::vector<uint32_t> newId(numBlocks, UINT32_MAX);
+        std::vector<uint32_t> representative;
+        newId[block[CONTENT_REDIRECTION_PATTERN_DEAD_STATE]] = CONTENT_REDIRECTION_PATTERN_DEAD_STATE;
+        representative.push_back(CONTENT_REDIRECTION_PATTERN_DEAD_STATE);
+        if (startIsDead) {
+            representative.push_back(CONTENT_REDIRECTION_PATTERN_DEAD_STATE);
+        } else {
+            newId[block[CONTENT_REDIRECTION_PATTERN_START_STATE]] = CONTENT_REDIRECTION_PATTERN_START_STATE;
+            representative.push_back(CONTENT_REDIRECTION_PATTERN_START_STATE);
+        }
+        for (uint32_t s = 0; s < numStates; s++) {
+            if (newId[block[s]] == UINT32_MAX) {
+                newId[block[s]] = representative.size();
+                representative.push_back(s);
+            }
+        }
+
+        out.transitions.resize(representative.size() * numClasses);
+        out.acceptRule.resize(representative.size());
+        for (uint32_t state = 0; state < representative.size(); state++) {
+            const uint32_t s      = representative[state];
+            out.acceptRule[state] = acceptRule[s];
+            for (uint32_t cls = 0; cls < numClasses; cls++) {
+                out.transitions[state * numClasses + cls] = newId[block[transitions[s * numClasses + cls]]];
+            }
+        }
+    }
+} // namespace
+
+PatternAutomaton::~PatternAutomaton() {
+    if (reservedBytes != 0) {
+        ContentRedirection_ReleaseLibraryMemory(reservedBytes);
+    }
+}
+
+namespace PatternCompiler {
+    ContentRedirectionStatus Compile(const ContentRedirectionPatternRule *rules, uint32_t numRules, PatternAutomaton &out) {
+        if (rules == nullptr || numRules == 0 || numRules > CONTENT_REDIRECTION_PATTERN_MAX_RULES) {
+            return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+        }
+        Nfa nfa;
+        for (uint32_t i = 0; i < numRules; i++) {
+            if (rules[i].pattern == nullptr || rules[i].replacementTemplate == nullptr) {
+                return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+            }
+            if (!AddPattern(nfa, rules[i].pattern, i)) {
+                DEBUG_FUNCTION_LINE_ERR("Malformed pattern \"%s\"", rules[i].pattern);
+                return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+            }
+        }
+
+        const uint32_t numClasses = BuildByteClasses(nfa, out.byteClasses);
+        ScratchMemory scratch;
+        std::vector<uint32_t> transitions;
+        std::vector<uint16_t> acceptRule;
+        if (!Determinize(nfa, out.byteClasses, numClasses, scratch, transitions, acceptRule)) {
+            return CONTENT_REDIRECTION_RESULT_NO_MEMORY;
+        }
+        if (!scratch.Grow(MinimizeCost(acceptRule.size(), numClasses))) {
+            DEBUG_FUNCTION_LINE_ERR("Not enough memory to minimize %d states", static_cast<int>(acceptRule.size()));
+            return CONTENT_REDIRECTION_RESULT_NO_MEMORY;
+        }
+        Minimize(numClasses, transitions, acceptRule, out);
+
+        uint32_t size = out.byteClasses.size() + out.transitions.size() * sizeof(uint16_t) + out.acceptRule.size() * sizeof(uint16_t);
+        out.templates.reserve(numRules);
+        for (uint32_t i = 0; i < numRules; i++) {
+            out.templates.emplace_back(rules[i].replacementTemplate);
+            size += out.templates.back().size() + 1;
+        }
+        for (const auto &replacementTemplate : out.templates) {
+            out.templatePtrs.push_back(replacementTemplate.c_str());
+        }
+        if (!ContentRedirection_ReserveLibraryMemory(size)) {
+            return CONTENT_REDIRECTION_RESULT_NO_MEMORY;
+        }
+        out.reservedBytes = size;
+
+        out.dfa.version              = CONTENT_REDIRECTION_PATTERN_DFA_VERSION;
+        out.dfa.numStates            = out.acceptRule.size();
+        out.dfa.numClasses           = numClasses;
+        out.dfa.numRules             = numRules;
+        out.dfa.byteClasses          = out.byteClasses.data();
+        out.dfa.transitions          = out.transitions.data();
+        out.dfa.acceptRule           = out.acceptRule.data();
+        out.dfa.replacementTemplates = out.templatePtrs.data();
+        return CONTENT_REDIRECTION_RESULT_SUCCESS;
+    }
+} // namespace PatternCompiler
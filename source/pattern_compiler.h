@@ -0,0 +1,35 @@
+#pragma once
+
+#include "content_redirection/pattern_layer.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * Automaton of a pattern layer, owns all arrays "dfa" points to.
+ * The size of the arrays is reserved via "ContentRedirection_ReserveLibraryMemory" for the lifetime of the object.
+ */
+struct PatternAutomaton {
+    PatternAutomaton() = default;
+    ~PatternAutomaton();
+
+    PatternAutomaton(const PatternAutomaton &)            = delete;
+    PatternAutomaton &operator=(const PatternAutomaton &) = delete;
+
+    std::vector<uint8_t> byteClasses;
+    std::vector<uint16_t> transitions;
+    std::vector<uint16_t> acceptRule;
+    std::vector<std::string> templates;
+    std::vector<const char *> templatePtrs;
+    uint32_t reservedBytes = 0;
+    ContentRedirectionPatternDFA dfa{};
+};
+
+namespace PatternCompiler {
+    /**
+     * Compiles the glob patterns of all rules into one minimal DFA.
+     * Returns CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT for malformed patterns and CONTENT_REDIRECTION_RESULT_NO_MEMORY if the
+     * automaton has too many states or doesn't fit into the memory budget.
+     */
+    ContentRedirectionStatus Compile(const ContentRedirectionPatternRule *rules, uint32_t numRules, PatternAutomaton &out);
+} // namespace PatternCompiler
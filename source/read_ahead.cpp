@@ -0,0 +1,106 @@
+#include "content_redirection/read_ahead.h"
+#include "read_ahead_worker.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace {
+    using Job = std::pair<void (*)(void *), void *>;
+
+    std::mutex sMutex;
+    std::condition_variable sCondition;
+    std::deque<Job> sQueue;
+    std::thread sThread;
+    bool sStopRequested = false;
+
+    std::mutex sStatsMutex;
+    ContentRedirectionReadAheadStats sStats{};
+
+    void WorkerThread() {
+        std::unique_lock lock(sMutex);
+        while (true) {
+            if (sQueue.empty()) {
+                if (sStopRequested) {
+                    break;
+                }
+                sCondition.wait(lock);
+                continue;
+            }
+            const Job job = sQueue.front();
+            sQueue.pop_front();
+            lock.unlock();
+            job.first(job.second);
+            lock.lock();
+        }
+    }
+} // namespace
+
+namespace ReadAheadWorker {
+    void Stop() {
+        std::unique_lock lock(sMutex);
+        sStopRequested = true;
+        sCondition.notify_all();
+        lock.unlock();
+        if (sThread.joinable()) {
+            sThread.join();
+        }
+        lock.lock();
+        sStopRequested = false;
+    }
+} // namespace ReadAheadWorker
+
+bool ContentRedirection_QueueReadAhead(void (*job)(void *context), void *context) {
+    if (job == nullptr) {
+        return false;
+    }
+    std::lock_guard lock(sMutex);
+    if (sStopRequested) {
+        return false;
+    }
+    if (!sThread.joinable()) {
+        sThread = std::thread(WorkerThread);
+    }
+    sQueue.emplace_back(job, context);
+    sCondition.notify_one();
+    return true;
+}
+
+void ContentRedirection_CountReadAheadEvent(ContentRedirectionReadAheadEvent event, uint32_t bytes) {
+    std::lock_guard lock(sStatsMutex);
+    switch (event) {
+        case CONTENT_REDIRECTION_READ_AHEAD_EVENT_STREAM_START:
+            sStats.streams++;
+            break;
+        case CONTENT_REDIRECTION_READ_AHEAD_EVENT_HIT:
+            sStats.hits++;
+            break;
+        case CONTENT_REDIRECTION_READ_AHEAD_EVENT_STALL:
+            sStats.stalls++;
+            break;
+        case CONTENT_REDIRECTION_READ_AHEAD_EVENT_UNDERRUN:
+            sStats.underruns++;
+            break;
+        case CONTENT_REDIRECTION_READ_AHEAD_EVENT_CANCEL:
+            sStats.cancelled++;
+            break;
+        case CONTENT_REDIRECTION_READ_AHEAD_EVENT_FILL:
+            sStats.bytesPrefetched += bytes;
+            break;
+    }
+}
+
+void ContentRedirection_GetReadAheadStats(ContentRedirectionReadAheadStats *statsOut) {
+    if (statsOut == nullptr) {
+        return;
+    }
+    std::lock_guard lock(sStatsMutex);
+    *statsOut = sStats;
+}
+
+void ContentRedirection_ResetReadAheadStats() {
+    std::lock_guard lock(sStatsMutex);
+    sStats = {};
+}
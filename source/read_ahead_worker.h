@@ -0,0 +1,9 @@
+#pragma once
+
+namespace ReadAheadWorker {
+    /**
+     * Runs the queued readahead jobs and waits until the readahead thread has exited.
+     * The thread is started again by the next "ContentRedirection_QueueReadAhead".
+     */
+    void Stop();
+} // namespace ReadAheadWorker
@@ -0,0 +1,213 @@
+#include "sarc_loader.h"
+#include "change_detector.h"
+#include "content_redirection/devoptab_backend.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cstring>
+
+using CR_DevoptabWrapper::Backend;
+
+namespace {
+    constexpr uint32_t SARC_MAGIC       = 0x53415243; // "SARC"
+    constexpr uint32_t SFAT_MAGIC       = 0x53464154; // "SFAT"
+    constexpr uint32_t SFNT_MAGIC       = 0x53464E54; // "SFNT"
+    constexpr uint32_t YAZ0_MAGIC       = 0x59617A30; // "Yaz0"
+    constexpr uint32_t SARC_HEADER_SIZE = 0x14;
+    constexpr uint32_t SFAT_HEADER_SIZE = 0x0C;
+    constexpr uint32_t SFAT_NODE_SIZE   = 0x10;
+    constexpr uint32_t SFNT_HEADER_SIZE = 0x08;
+    /**
+     * Upper bound of the header and file table of an archive, they are kept in memory while the layer exists.
+     */
+    constexpr uint32_t MAX_HEADER_SIZE = 4 * 1024 * 1024;
+    /**
+     * Members are placed at the alignment of their original offset, up to this value.
+     */
+    constexpr uint64_t MAX_ALIGNMENT = 0x2000;
+
+    /**
+     * Values of a SARC archive are stored in the byte order given by the byte order mark of the header, magics are always big-endian.
+     */
+    struct ByteOrder {
+        bool bigEndian = true;
+
+        uint16_t U16(const uint8_t *p) const {
+            return bigEndian ? (p[0] << 8 | p[1]) : (p[1] << 8 | p[0]);
+        }
+
+        uint32_t U32(const uint8_t *p) const {
+            return bigEndian ? Magic(p) : ((uint32_t) p[3] << 24 | (uint32_t) p[2] << 16 | (uint32_t) p[1] << 8 | (uint32_t) p[0]);
+        }
+
+        void PutU32(uint8_t *p, uint32_t value) const {
+            for (int i = 0; i < 4; i++) {
+                p[bigEndian ? 3 - i : i] = static_cast<uint8_t>(value >> (i * 8));
+            }
+        }
+
+        static uint32_t Magic(const uint8_t *p) {
+            return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | (uint32_t) p[3];
+        }
+    };
+
+    struct Member {
+        uint32_t node;
+        uint32_t begin; /**< Relative to the data offset of the archive */
+        uint32_t end;
+        const char *name; /**< nullptr if the member has no name */
+    };
+
+    bool ParseMembers(const ByteOrder &order, const uint8_t *header, uint32_t dataOffset, uint64_t baseSize, std::vector<Member> &out) {
+        if (ByteOrder::Magic(header + SARC_HEADER_SIZE) != SFAT_MAGIC || order.U16(header + SARC_HEADER_SIZE + 4) != SFAT_HEADER_SIZE) {
+            return false;
+        }
+        const uint32_t numNodes   = order.U16(header + SARC_HEADER_SIZE + 6);
+        const uint32_t nodesStart = SARC_HEADER_SIZE + SFAT_HEADER_SIZE;
+        const uint32_t sfntStart  = nodesStart + numNodes * SFAT_NODE_SIZE;
+        if (sfntStart + SFNT_HEADER_SIZE > dataOffset || ByteOrder::Magic(header + sfntStart) != SFNT_MAGIC) {
+            return false;
+        }
+        const uint32_t namesStart = sfntStart + SFNT_HEADER_SIZE;
+
+        out.reserve(numNodes);
+        for (uint32_t i = 0; i < numNodes; i++) {
+            const uint8_t *node  = header + nodesStart + i * SFAT_NODE_SIZE;
+            const uint32_t attrs = order.U32(node + 4);
+            Member member        = {i, order.U32(node + 8), order.U32(node + 12), nullptr};
+            if (member.begin > member.end || dataOffset + (uint64_t) member.end > baseSize) {
+                return false;
+            }
+            // The upper byte of the attributes is set if the member has a name, the lower bits hold the offset of the name in words.
+            if ((attrs >> 24) != 0) {
+                const uint64_t nameOffset = namesStart + (uint64_t) (attrs & 0xFFFF) * 4;
+                if (nameOffset >= dataOffset || memchr(header + nameOffset, '\0', dataOffset - nameOffset) == nullptr) {
+                    return false;
+                }
+                member.name = reinterpret_cast<const char *>(header + nameOffset);
+            }
+            out.push_back(member);
+        }
+
+        // The data is laid out in the order of the original archive, which doesn't have to be the order of the file table.
+        std::sort(out.begin(), out.end(), [](const Member &a, const Member &b) { return a.begin < b.begin; });
+        for (size_t i = 1; i < out.size(); i++) {
+            if (out[i].begin < out[i - 1].end) {
+                return false;
+            }
+        }
+        return true;
+    }
+} // namespace
+
+namespace SarcLoader {
+    ContentRedirectionStatus Load(const std::string &basePath, const std::string &memberDir, VirtualFile &out) {
+        const uint32_t base = out.AddSource(basePath);
+        if (base == VIRTUAL_FILE_SOURCE_ZERO) {
+            return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+        }
+        if (Backend::stat(out.sourceDevs[base], basePath.c_str(), &out.stat) < 0) {
+            DEBUG_FUNCTION_LINE_ERR("Failed to stat \"%s\"", basePath.c_str());
+            return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+        }
+        const uint64_t baseSize = out.stat.size;
+
+        uint8_t start[SARC_HEADER_SIZE];
+        if (baseSize < sizeof(start) || VirtualFileDevice::ReadRange(basePath, 0, start, sizeof(start)) < 0) {
+            DEBUG_FUNCTION_LINE_ERR("Failed to read header of \"%s\"", basePath.c_str());
+            return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+        }
+        if (ByteOrder::Magic(start) == YAZ0_MAGIC) {
+            DEBUG_FUNCTION_LINE_ERR("\"%s\" is compressed, only uncompressed archives are supported", basePath.c_str());
+            return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+        }
+        ByteOrder order;
+        order.bigEndian           = start[6] == 0xFE && start[7] == 0xFF;
+        const bool validOrder     = order.bigEndian || (start[6] == 0xFF && start[7] == 0xFE);
+        const uint32_t dataOffset = order.U32(start + 0x0C);
+        if (ByteOrder::Magic(start) != SARC_MAGIC || !validOrder || order.U16(start + 4) != SARC_HEADER_SIZE ||
+            dataOffset < SARC_HEADER_SIZE + SFAT_HEADER_SIZE + SFNT_HEADER_SIZE || dataOffset > baseSize || dataOffset > MAX_HEADER_SIZE) {
+            DEBUG_FUNCTION_LINE_ERR("\"%s\" is no valid SARC archive", basePath.c_str());
+            return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+        }
+
+        // Header and file table are rebuilt in memory, the data of the members is read from the files.
+        if (!out.Reserve(dataOffset)) {
+            DEBUG_FUNCTION_LINE_ERR("The file table of \"%s\" doesn't fit into the memory budget", basePath.c_str());
+            return CONTENT_REDIRECTION_RESULT_NO_MEMORY;
+        }
+        out.memory.resize(dataOffset);
+        uint8_t *header = out.memory.data();
+        std::vector<Member> members;
+        if (VirtualFileDevice::ReadRange(basePath, 0, header, dataOffset) < 0 || !ParseMembers(order, header, dataOffset, baseSize, members)) {
+            DEBUG_FUNCTION_LINE_ERR("Failed to read the file table of \"%s\"", basePath.c_str());
+            return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+        }
+
+        std::string dir = memberDir;
+        while (!dir.empty() && dir.back() == '/') {
+            dir.pop_back();
+        }
+        DirSnapshot replacements;
+        if (!ChangeDetector::Scan(dir, replacements)) {
+            DEBUG_FUNCTION_LINE_ERR("Failed to scan \"%s\"", dir.c_str());
+            return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+        }
+
+        out.Append(VIRTUAL_FILE_SOURCE_MEMORY, 0, dataOffset);
+        uint64_t cursor   = dataOffset;
+        int64_t baseDelta = 0;
+        bool lastFromBase = false;
+        uint32_t replaced = 0;
+        const size_t numSegments = members.size() * 2 + 1;
+        if (!out.Reserve(numSegments * sizeof(VirtualFileSegment))) {
+            DEBUG_FUNCTION_LINE_ERR("The %d members of \"%s\" don't fit into the memory budget", static_cast<int>(members.size()), basePath.c_str());
+            return CONTENT_REDIRECTION_RESULT_NO_MEMORY;
+        }
+        out.segments.reserve(numSegments);
+        for (const auto &member : members) {
+            const uint64_t originalOffset = dataOffset + member.begin;
+            const uint64_t alignment      = std::min(originalOffset & (~originalOffset + 1), MAX_ALIGNMENT);
+            const uint64_t offset         = (cursor + alignment - 1) & ~(alignment - 1);
+            const int64_t delta           = static_cast<int64_t>(offset - originalOffset);
+
+            auto replacement      = member.name != nullptr ? replacements.find(std::string("/") + member.name) : replacements.end();
+            const bool isReplaced = replacement != replacements.end() && !replacement->second.isDir;
+            const uint64_t length = isReplaced ? replacement->second.size : member.end - member.begin;
+            if (offset + length - dataOffset > UINT32_MAX) {
+                DEBUG_FUNCTION_LINE_ERR("\"%s\" would be bigger than 4 GiB", basePath.c_str());
+                return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+            }
+
+            if (!isReplaced && lastFromBase && delta == baseDelta) {
+                // Unchanged members that keep their distance are one continuous range of the original archive, including the padding.
+                out.Append(base, cursor - baseDelta, offset - cursor);
+            } else {
+                out.Append(VIRTUAL_FILE_SOURCE_ZERO, 0, offset - cursor);
+            }
+            if (isReplaced) {
+                const uint32_t source = out.AddSource(dir + replacement->first);
+                if (source == VIRTUAL_FILE_SOURCE_ZERO) {
+                    return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+                }
+                out.Append(source, 0, length);
+                replaced++;
+            } else {
+                out.Append(base, originalOffset, length);
+            }
+
+            uint8_t *node = header + SARC_HEADER_SIZE + SFAT_HEADER_SIZE + member.node * SFAT_NODE_SIZE;
+            order.PutU32(node + 8, static_cast<uint32_t>(offset - dataOffset));
+            order.PutU32(node + 12, static_cast<uint32_t>(offset + length - dataOffset));
+            cursor       = offset + length;
+            baseDelta    = delta;
+            lastFromBase = !isReplaced;
+        }
+        order.PutU32(header + 0x08, static_cast<uint32_t>(cursor));
+
+        if (replaced == 0) {
+            DEBUG_FUNCTION_LINE_WARN("\"%s\" doesn't replace any member of \"%s\"", dir.c_str(), basePath.c_str());
+        }
+        return CONTENT_REDIRECTION_RESULT_SUCCESS;
+    }
+} // namespace SarcLoader
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "virtual_file_device.h"
+
+#include <string>
+
+namespace SarcLoader {
+    /**
+     * Describes the virtual archive of a FS_LAYER_TYPE_EX_ARCHIVE layer: the header and file table of the original SARC archive with
+     * recomputed member offsets, followed by the data of every member, taken from "memberDir" if it has a replacement and from the
+     * original archive otherwise.
+     * Returns CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT if the original file is no valid SARC archive or "memberDir" can't be read.
+     */
+    ContentRedirectionStatus Load(const std::string &basePath, const std::string &memberDir, VirtualFile &out);
+} // namespace SarcLoader
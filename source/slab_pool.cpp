@@ -0,0 +1,238 @@
+#include "content_redirection/slab_pool.h"
+#include "library_memory.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+
+namespace {
+    constexpr uint32_t MIN_SLOT_SIZE   = 16;
+    constexpr uint32_t NUM_CLASSES     = 9; // 16 ... 4096 bytes
+    constexpr uint32_t CHUNK_SIZE      = 4096;
+    constexpr uint32_t MIN_CHUNK_SLOTS = 8;
+    constexpr uint32_t MAX_CHUNKS      = 256;
+    constexpr uint32_t MAX_SLOTS       = 0xFFFF; // Slot index + 1 has to fit into the lower half of the free list head
+
+    /**
+     * Stored in front of every allocation. "next" links free slots, it's only accessed while the slot is free.
+     */
+    struct SlotHeader {
+        uint16_t classIndex; /**< NUM_CLASSES for allocations that are bigger than the biggest class */
+        uint16_t isMalloc;   /**< Allocated via malloc instead of a chunk */
+        uint32_t index;
+        std::atomic<uint32_t> next;
+        uint32_t reserved;
+    };
+    static_assert(sizeof(SlotHeader) % alignof(std::max_align_t) == 0, "allocations have to be aligned like malloc");
+
+    /**
+     * One size class. Free slots form a lock-free stack, its head is "tag << 16 | (index + 1)".
+     * The tag is incremented on every change, so a head that has been popped and pushed again in between doesn't match (ABA).
+     * Slots are never returned to the heap, so reading "next" of a slot that has just been popped by another thread is safe.
+     */
+    struct SlabClass {
+        uint16_t index      = 0;
+        uint32_t slotSize   = 0;
+        uint32_t stride     = 0;
+        uint32_t chunkSlots = 0;
+        std::atomic<uint32_t> freeHead{0};
+        std::array<std::atomic<char *>, MAX_CHUNKS> chunks{};
+        std::atomic<uint32_t> numChunks{0};
+        std::atomic<uint32_t> inUse{0};
+        std::atomic<uint32_t> freeSlots{0};
+        std::atomic<uint32_t> peakInUse{0};
+        std::atomic<uint32_t> fallbackAllocations{0};
+        std::mutex growMutex;
+
+        SlotHeader *slot(uint32_t index) {
+            return reinterpret_cast<SlotHeader *>(chunks[index / chunkSlots].load(std::memory_order_acquire) + (index % chunkSlots) * stride);
+        }
+
+        void push(SlotHeader *first, SlotHeader *last, uint32_t count) {
+            uint32_t head = freeHead.load(std::memory_order_relaxed);
+            uint32_t newHead;
+            do {
+                last->next.store(head & 0xFFFF, std::memory_order_relaxed);
+                newHead = ((head + 0x10000) & 0xFFFF0000) | (first->index + 1);
+            } while (!freeHead.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
+            freeSlots += count;
+        }
+
+        SlotHeader *pop() {
+            uint32_t head = freeHead.load(std::memory_order_acquire);
+            while (true) {
+                if ((head & 0xFFFF) == 0) {
+                    return nullptr;
+                }
+                auto *cur              = slot((head & 0xFFFF) - 1);
+                const uint32_t next    = cur->next.load(std::memory_order_relaxed);
+                const uint32_t newHead = ((head + 0x10000) & 0xFFFF0000) | next;
+                if (freeHead.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire)) {
+                    freeSlots--;
+                    return cur;
+                }
+            }
+        }
+
+        bool grow() {
+            std::lock_guard lock(growMutex);
+            const uint32_t chunk = numChunks.load(std::memory_order_relaxed);
+            if (chunk >= MAX_CHUNKS || (chunk + 1) * chunkSlots > MAX_SLOTS) {
+                return false;
+            }
+            const uint32_t size = chunkSlots * stride;
+            if (!ContentRedirection_ReserveLibraryMemory(size)) {
+                return false;
+            }
+            auto *memory = static_cast<char *>(malloc(size));
+            if (memory == nullptr) {
+                ContentRedirection_ReleaseLibraryMemory(size);
+                return false;
+            }
+            for (uint32_t i = 0; i < chunkSlots; i++) {
+                auto *header       = new (memory + i * stride) SlotHeader();
+                header->classIndex = index;
+                header->index      = chunk * chunkSlots + i;
+                if (i + 1 < chunkSlots) {
+                    header->next.store(chunk * chunkSlots + i + 2, std::memory_order_relaxed);
+                }
+            }
+            chunks[chunk].store(memory, std::memory_order_release);
+            numChunks.store(chunk + 1, std::memory_order_release);
+            push(reinterpret_cast<SlotHeader *>(memory), reinterpret_cast<SlotHeader *>(memory + (chunkSlots - 1) * stride), chunkSlots);
+            return true;
+        }
+    };
+
+    SlabClass sClasses[NUM_CLASSES];
+    std::atomic<uint32_t> sOversizedInUse{0};
+    std::atomic<uint32_t> sOversizedPeak{0};
+    std::atomic<uint32_t> sOversizedAllocations{0};
+    std::once_flag sInitFlag;
+
+    void UpdatePeak(std::atomic<uint32_t> &peak, uint32_t value) {
+        uint32_t cur = peak.load(std::memory_order_relaxed);
+        while (value > cur && !peak.compare_exchange_weak(cur, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    void InitClasses() {
+        std::call_once(sInitFlag, [] {
+            for (uint32_t i = 0; i < NUM_CLASSES; i++) {
+                auto &cls      = sClasses[i];
+                cls.index      = static_cast<uint16_t>(i);
+                cls.slotSize   = MIN_SLOT_SIZE << i;
+                cls.stride     = sizeof(SlotHeader) + cls.slotSize;
+                cls.chunkSlots = std::max(MIN_CHUNK_SLOTS, CHUNK_SIZE / cls.stride);
+            }
+        });
+    }
+
+    SlabClass *GetClass(uint32_t size) {
+        InitClasses();
+        for (auto &cls : sClasses) {
+            if (size <= cls.slotSize) {
+                return &cls;
+            }
+        }
+        return nullptr;
+    }
+
+    void *MallocWithHeader(uint32_t size, uint16_t classIndex) {
+        void *memory = malloc(sizeof(SlotHeader) + size);
+        if (memory == nullptr) {
+            return nullptr;
+        }
+        auto *header       = new (memory) SlotHeader();
+        header->classIndex = classIndex;
+        header->isMalloc   = 1;
+        return header + 1;
+    }
+} // namespace
+
+void *ContentRedirection_SlabAlloc(uint32_t size) {
+    auto *cls = GetClass(size);
+    if (cls == nullptr) {
+        void *result = MallocWithHeader(size, NUM_CLASSES);
+        if (result != nullptr) {
+            sOversizedAllocations++;
+            UpdatePeak(sOversizedPeak, ++sOversizedInUse);
+        }
+        return result;
+    }
+
+    SlotHeader *slot;
+    while ((slot = cls->pop()) == nullptr) {
+        if (!cls->grow()) {
+            void *result = MallocWithHeader(size, cls->index);
+            if (result != nullptr) {
+                cls->fallbackAllocations++;
+                UpdatePeak(cls->peakInUse, ++cls->inUse);
+            }
+            return result;
+        }
+    }
+    UpdatePeak(cls->peakInUse, ++cls->inUse);
+    return slot + 1;
+}
+
+void ContentRedirection_SlabFree(void *ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+    auto *header = static_cast<SlotHeader *>(ptr) - 1;
+    if (header->classIndex == NUM_CLASSES) {
+        sOversizedInUse--;
+    } else {
+        sClasses[header->classIndex].inUse--;
+    }
+    if (header->isMalloc) {
+        header->~SlotHeader();
+        free(header);
+        return;
+    }
+    sClasses[header->classIndex].push(header, header, 1);
+}
+
+bool ContentRedirection_SlabReserve(uint32_t size, uint32_t count) {
+    auto *cls = GetClass(size);
+    if (cls == nullptr) {
+        return false;
+    }
+    while (cls->freeSlots.load() < count) {
+        if (!cls->grow()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t ContentRedirection_GetSlabPoolStats(ContentRedirectionSlabClassStats *statsOut, uint32_t maxClasses) {
+    InitClasses();
+    if (statsOut == nullptr) {
+        maxClasses = 0;
+    }
+    for (uint32_t i = 0; i < std::min(maxClasses, NUM_CLASSES); i++) {
+        auto &cls                       = sClasses[i];
+        statsOut[i].slotSize            = cls.slotSize;
+        statsOut[i].numChunks           = cls.numChunks.load();
+        statsOut[i].capacity            = statsOut[i].numChunks * cls.chunkSlots;
+        statsOut[i].inUse               = cls.inUse.load();
+        statsOut[i].peakInUse           = cls.peakInUse.load();
+        statsOut[i].fallbackAllocations = cls.fallbackAllocations.load();
+    }
+    if (maxClasses > NUM_CLASSES) {
+        auto &stats               = statsOut[NUM_CLASSES];
+        stats.slotSize            = 0;
+        stats.capacity            = 0;
+        stats.inUse               = sOversizedInUse.load();
+        stats.peakInUse           = sOversizedPeak.load();
+        stats.numChunks           = 0;
+        stats.fallbackAllocations = sOversizedAllocations.load();
+    }
+    return NUM_CLASSES + 1;
+}
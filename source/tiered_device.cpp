@@ -0,0 +1,850 @@
+#include "content_redirection/tiered_device.h"
+#include "content_redirection/devoptab_backend.h"
+#include "content_redirection/io_scheduler.h"
+#include "library_memory.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <climits>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <strings.h>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using CR_DevoptabWrapper::Backend;
+using CR_DevoptabWrapper::BackgroundIO;
+
+namespace {
+    constexpr size_t FILE_HEADER_SIZE  = 16;
+    constexpr size_t COPY_BUFFER_SIZE  = 128 * 1024;
+    constexpr const char *TEMP_SUFFIX  = ".crpromote";
+    constexpr const char *RESERVED_DIR = "/.libcontentredirection";
+    constexpr const char *PROMOTED_DIR = "/.libcontentredirection/promoted";
+    constexpr uint32_t NOT_PROMOTED    = 0xFFFFFFFF;
+    constexpr int WRITE_ACCESS_FLAGS   = O_WRONLY | O_RDWR | O_CREAT | O_TRUNC | O_APPEND;
+
+    struct Tier {
+        std::string path;
+        const devoptab_t *dev;
+        int deviceId;
+        uint64_t promotionBudget;
+        uint64_t promotedBytes;
+    };
+
+    struct PromotedFile {
+        uint32_t tier;
+        uint64_t size;
+    };
+
+    struct TieredDevice {
+        devoptab_t devoptab{};
+        std::string name;
+        std::vector<Tier> tiers;
+        uint32_t promoteAfterReads = 0;
+
+        std::mutex mutex;
+        std::unordered_map<std::string, uint32_t> readCounts;
+        std::unordered_map<std::string, PromotedFile> promoted;
+        std::unordered_set<std::string> queued;
+        std::unordered_set<std::string> invalidated;
+        std::deque<std::pair<std::string, uint32_t>> queue;
+        std::condition_variable queueCondition;
+        std::thread worker;
+        bool stopWorker = false;
+    };
+
+    struct TieredFile {
+        uint32_t tier;
+    };
+    static_assert(sizeof(TieredFile) <= FILE_HEADER_SIZE);
+
+    struct TieredDirIterator {
+        std::string path;
+        std::unordered_set<std::string> seen;
+        std::vector<char> tierDirState;
+        uint32_t tier;
+        bool tierOpen;
+    };
+
+    struct TieredDir {
+        TieredDirIterator *iter;
+    };
+
+    int SetError(struct _reent *r, int res) {
+        r->_errno = -res;
+        return -1;
+    }
+
+    TieredDevice *GetDevice(struct _reent *r) {
+        return static_cast<TieredDevice *>(r->deviceData);
+    }
+
+    std::string GetRelativePath(const char *path) {
+        const char *separator = strchr(path, ':');
+        const char *rel       = separator ? separator + 1 : path;
+        if (rel[0] != '/') {
+            return std::string("/") + rel;
+        }
+        return rel;
+    }
+
+    std::string GetTierPath(const TieredDevice *device, uint32_t tier, const std::string &rel) {
+        return device->tiers[tier].path + rel;
+    }
+
+    /**
+     * Promoted copies are kept below PROMOTED_DIR of the tier, so a copy left over from an earlier session can never shadow the original.
+     */
+    std::string GetPromotedPath(const TieredDevice *device, uint32_t tier, const std::string &rel) {
+        return device->tiers[tier].path + PROMOTED_DIR + rel;
+    }
+
+    /**
+     * Returns true if the given path points into RESERVED_DIR. Such paths are never resolved for the user.
+     */
+    bool IsReservedPath(const std::string &rel) {
+        const size_t start = rel.find_first_not_of('/');
+        if (start == std::string::npos || start == 0) {
+            return false;
+        }
+        const char *name     = RESERVED_DIR + 1;
+        const size_t nameLen = strlen(name);
+        // Tiers are usually FAT formatted, which ignores the case.
+        return strncasecmp(rel.c_str() + start, name, nameLen) == 0 && (rel.size() == start + nameLen || rel[start + nameLen] == '/');
+    }
+
+    void *GetTierFd(void *fd) {
+        return static_cast<char *>(fd) + FILE_HEADER_SIZE;
+    }
+
+    const devoptab_t *GetFileTier(const TieredDevice *device, void *fd) {
+        return device->tiers[static_cast<TieredFile *>(fd)->tier].dev;
+    }
+
+    /**
+     * Returns the index of the fastest tier which has the given path, or a negative errno.
+     */
+    int FindTier(TieredDevice *device, const std::string &rel, CR_Stat *st) {
+        if (IsReservedPath(rel)) {
+            return -ENOENT;
+        }
+        int firstError = -ENOENT;
+        for (uint32_t i = 0; i < device->tiers.size(); i++) {
+            const int res = Backend::stat(device->tiers[i].dev, GetTierPath(device, i, rel).c_str(), st);
+            if (res >= 0) {
+                return static_cast<int>(i);
+            }
+            if (res != -ENOENT && firstError == -ENOENT) {
+                firstError = res;
+            }
+        }
+        return firstError;
+    }
+
+    /**
+     * Drops a promoted copy of the given path. Has to be called before the original is modified.
+     */
+    void DropPromoted(TieredDevice *device, const std::string &rel) {
+        const devoptab_t *dev = nullptr;
+        std::string promotedPath;
+        {
+            std::lock_guard lock(device->mutex);
+            device->readCounts.erase(rel);
+            if (device->queued.count(rel) != 0) {
+                // Let the worker discard the copy it's currently creating.
+                device->invalidated.insert(rel);
+            }
+            auto it = device->promoted.find(rel);
+            if (it == device->promoted.end()) {
+                return;
+            }
+            auto &tier = device->tiers[it->second.tier];
+            tier.promotedBytes -= it->second.size;
+            dev          = tier.dev;
+            promotedPath = GetPromotedPath(device, it->second.tier, rel);
+            device->promoted.erase(it);
+        }
+        // Don't block lookups of other files while the (possibly slow) tier deletes the copy.
+        Backend::unlink(dev, promotedPath.c_str());
+    }
+
+    uint32_t GetPromotedTier(TieredDevice *device, const std::string &rel) {
+        std::lock_guard lock(device->mutex);
+        auto it = device->promoted.find(rel);
+        return it != device->promoted.end() ? it->second.tier : NOT_PROMOTED;
+    }
+
+    void CountRead(TieredDevice *device, const std::string &rel, uint32_t servedByTier) {
+        if (device->promoteAfterReads == 0 || servedByTier == 0) {
+            return;
+        }
+        std::lock_guard lock(device->mutex);
+        if (device->promoted.count(rel) != 0 || device->queued.count(rel) != 0) {
+            return;
+        }
+        if (++device->readCounts[rel] < device->promoteAfterReads) {
+            return;
+        }
+        device->readCounts.erase(rel);
+        device->queued.insert(rel);
+        device->queue.emplace_back(rel, servedByTier);
+        device->queueCondition.notify_one();
+    }
+
+    int CopyFileWithBuffer(const devoptab_t *srcDev, void *srcFile, const char *srcPath, const devoptab_t *dstDev, void *dstFile, const char *dstPath, char *buffer, uint64_t *sizeOut) {
+        int res = Backend::open(srcDev, srcFile, srcPath, O_RDONLY, 0);
+        if (res < 0) {
+            return res;
+        }
+        res = Backend::open(dstDev, dstFile, dstPath, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (res < 0) {
+            Backend::close(srcDev, srcFile);
+            return res;
+        }
+
+        uint64_t total = 0;
+        while (true) {
+            // One request per chunk, so the copy can be throttled while the game is loading.
+            BackgroundIO io;
+            const ssize_t read = Backend::read(srcDev, srcFile, buffer, COPY_BUFFER_SIZE);
+            if (read <= 0) {
+                res = static_cast<int>(read);
+                break;
+            }
+            ssize_t written = 0;
+            while (written < read) {
+                const ssize_t cur = Backend::write(dstDev, dstFile, buffer + written, read - written);
+                if (cur <= 0) {
+                    res = cur < 0 ? static_cast<int>(cur) : -EIO;
+                    break;
+                }
+                written += cur;
+            }
+            if (res < 0) {
+                break;
+            }
+            total += read;
+            io.bytes = static_cast<uint32_t>(read);
+        }
+
+        Backend::close(srcDev, srcFile);
+        const int closeRes = Backend::close(dstDev, dstFile);
+        if (res == 0 && closeRes < 0) {
+            res = closeRes;
+        }
+        if (res < 0) {
+            Backend::unlink(dstDev, dstPath);
+            return res;
+        }
+        *sizeOut = total;
+        return 0;
+    }
+
+    int CopyFile(const devoptab_t *srcDev, const char *srcPath, const devoptab_t *dstDev, const char *dstPath, uint64_t *sizeOut) {
+        if (!ContentRedirection_ReserveLibraryMemory(COPY_BUFFER_SIZE)) {
+            return -ENOMEM;
+        }
+        std::unique_ptr<char[]> buffer(new (std::nothrow) char[COPY_BUFFER_SIZE]);
+        std::unique_ptr<char[]> srcFile(new (std::nothrow) char[srcDev->structSize + 1]);
+        std::unique_ptr<char[]> dstFile(new (std::nothrow) char[dstDev->structSize + 1]);
+        if (!srcFile || !dstFile || !buffer) {
+            ContentRedirection_ReleaseLibraryMemory(COPY_BUFFER_SIZE);
+            return -ENOMEM;
+        }
+        const int res = CopyFileWithBuffer(srcDev, srcFile.get(), srcPath, dstDev, dstFile.get(), dstPath, buffer.get(), sizeOut);
+        ContentRedirection_ReleaseLibraryMemory(COPY_BUFFER_SIZE);
+        return res;
+    }
+
+    /**
+     * Creates RESERVED_DIR, PROMOTED_DIR and all parent directories of the given path inside it.
+     */
+    int CreatePromotedParents(const Tier &tier, const std::string &rel) {
+        const int res = Backend::mkdir(tier.dev, (tier.path + RESERVED_DIR).c_str(), 0777);
+        if (res < 0 && res != -EEXIST) {
+            return res;
+        }
+        const std::string root = tier.path + PROMOTED_DIR;
+        for (size_t pos = 0; pos != std::string::npos; pos = rel.find('/', pos + 1)) {
+            const int res = Backend::mkdir(tier.dev, (root + rel.substr(0, pos)).c_str(), 0777);
+            if (res < 0 && res != -EEXIST) {
+                return res;
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * Deletes the given directory and everything inside it. A missing directory is not an error.
+     */
+    int RemoveTree(const devoptab_t *dev, int deviceId, const std::string &path) {
+        std::vector<char> dirState(dev->dirStateSize + 1);
+        int res = Backend::diropen(dev, deviceId, dirState.data(), path.c_str());
+        if (res < 0) {
+            return res == -ENOENT ? 0 : res;
+        }
+        // Collect the entries first, deleting while iterating isn't supported by every device.
+        std::vector<std::pair<std::string, bool>> entries;
+        char name[NAME_MAX + 1];
+        CR_Stat st{};
+        while (Backend::dirnext(dev, deviceId, dirState.data(), name, &st) >= 0) {
+            if (strcmp(name, ".") != 0 && strcmp(name, "..") != 0) {
+                entries.emplace_back(name, S_ISDIR(st.mode));
+            }
+        }
+        Backend::dirclose(dev, deviceId, dirState.data());
+
+        for (const auto &[entry, isDir] : entries) {
+            const std::string entryPath = path + "/" + entry;
+            res                         = isDir ? RemoveTree(dev, deviceId, entryPath) : Backend::unlink(dev, entryPath.c_str());
+            if (res < 0) {
+                return res;
+            }
+        }
+        return Backend::rmdir(dev, path.c_str());
+    }
+
+    void Promote(TieredDevice *device, const std::string &rel, uint32_t srcTier) {
+        CR_Stat st{};
+        if (Backend::stat(device->tiers[srcTier].dev, GetTierPath(device, srcTier, rel).c_str(), &st) < 0) {
+            return;
+        }
+
+        uint32_t dstTier = NOT_PROMOTED;
+        {
+            std::lock_guard lock(device->mutex);
+            for (uint32_t i = 0; i < srcTier; i++) {
+                auto &tier = device->tiers[i];
+                if (tier.promotedBytes + st.size <= tier.promotionBudget) {
+                    // Reserve the space now, so concurrent promotions can't exceed the budget.
+                    tier.promotedBytes += st.size;
+                    dstTier = i;
+                    break;
+                }
+            }
+        }
+        if (dstTier == NOT_PROMOTED) {
+            return;
+        }
+
+        auto &tier             = device->tiers[dstTier];
+        const auto srcPath     = GetTierPath(device, srcTier, rel);
+        const auto dstPath     = GetPromotedPath(device, dstTier, rel);
+        const auto dstTempPath = dstPath + TEMP_SUFFIX;
+
+        uint64_t size = 0;
+        int res       = CreatePromotedParents(tier, rel);
+        if (res == 0) {
+            res = CopyFile(device->tiers[srcTier].dev, srcPath.c_str(), tier.dev, dstTempPath.c_str(), &size);
+        }
+        if (res == 0) {
+            res = Backend::rename(tier.dev, dstTempPath.c_str(), dstPath.c_str());
+            if (res < 0) {
+                Backend::unlink(tier.dev, dstTempPath.c_str());
+            }
+        }
+
+        bool discard = false;
+        {
+            std::lock_guard lock(device->mutex);
+            tier.promotedBytes -= st.size;
+            if (res < 0) {
+                DEBUG_FUNCTION_LINE_WARN("Failed to promote \"%s\" into tier %d: %d", rel.c_str(), dstTier, res);
+                return;
+            }
+            // The worker erases the entry once this function returns, whatever the outcome.
+            discard = device->invalidated.count(rel) != 0;
+            if (!discard) {
+                tier.promotedBytes += size;
+                device->promoted[rel] = {dstTier, size};
+            }
+        }
+        if (discard) {
+            Backend::unlink(tier.dev, dstPath.c_str());
+        }
+    }
+
+    void PromotionWorker(TieredDevice *device) {
+        std::unique_lock lock(device->mutex);
+        while (true) {
+            device->queueCondition.wait(lock, [device] { return device->stopWorker || !device->queue.empty(); });
+            if (device->stopWorker) {
+                return;
+            }
+            auto [rel, srcTier] = device->queue.front();
+            device->queue.pop_front();
+
+            lock.unlock();
+            Promote(device, rel, srcTier);
+            lock.lock();
+
+            device->queued.erase(rel);
+            device->invalidated.erase(rel);
+        }
+    }
+
+    int tiered_open(struct _reent *r, void *fileStruct, const char *path, int flags, int mode) {
+        auto *device    = GetDevice(r);
+        auto *file      = static_cast<TieredFile *>(fileStruct);
+        const auto rel  = GetRelativePath(path);
+        const bool read = (flags & WRITE_ACCESS_FLAGS) == 0;
+
+        CR_Stat st{};
+        int tier = FindTier(device, rel, &st);
+        if (tier < 0 && tier != -ENOENT) {
+            return SetError(r, tier);
+        }
+        if (!read) {
+            if (IsReservedPath(rel)) {
+                return SetError(r, -EACCES);
+            }
+            DropPromoted(device, rel);
+            if (tier < 0) {
+                // New files are always created in the slowest tier.
+                tier = static_cast<int>(device->tiers.size() - 1);
+            }
+        } else if (tier < 0) {
+            return SetError(r, tier);
+        } else {
+            const uint32_t promotedTier = GetPromotedTier(device, rel);
+            if (promotedTier < static_cast<uint32_t>(tier)) {
+                file->tier = promotedTier;
+                if (Backend::open(device->tiers[promotedTier].dev, GetTierFd(fileStruct), GetPromotedPath(device, promotedTier, rel).c_str(), flags, mode) >= 0) {
+                    return 0;
+                }
+                // The copy may have been deleted behind our back, the original is still there.
+            }
+        }
+
+        file->tier    = tier;
+        const int res = Backend::open(device->tiers[tier].dev, GetTierFd(fileStruct), GetTierPath(device, tier, rel).c_str(), flags, mode);
+        if (res < 0) {
+            return SetError(r, res);
+        }
+        if (read) {
+            CountRead(device, rel, tier);
+        }
+        return 0;
+    }
+
+    int tiered_close(struct _reent *r, void *fd) {
+        const int res = Backend::close(GetFileTier(GetDevice(r), fd), GetTierFd(fd));
+        return res < 0 ? SetError(r, res) : res;
+    }
+
+    ssize_t tiered_write(struct _reent *r, void *fd, const char *ptr, size_t len) {
+        const ssize_t res = Backend::write(GetFileTier(GetDevice(r), fd), GetTierFd(fd), ptr, len);
+        return res < 0 ? SetError(r, static_cast<int>(res)) : res;
+    }
+
+    ssize_t tiered_read(struct _reent *r, void *fd, char *ptr, size_t len) {
+        const ssize_t res = Backend::read(GetFileTier(GetDevice(r), fd), GetTierFd(fd), ptr, len);
+        return res < 0 ? SetError(r, static_cast<int>(res)) : res;
+    }
+
+    off_t tiered_seek(struct _reent *r, void *fd, off_t pos, int dir) {
+        const int64_t res = Backend::seek(GetFileTier(GetDevice(r), fd), GetTierFd(fd), pos, dir);
+        return res < 0 ? SetError(r, static_cast<int>(res)) : static_cast<off_t>(res);
+    }
+
+    void CRStatToStat(const CR_Stat &src, struct stat *dst) {
+        memset(dst, 0, sizeof(*dst));
+        dst->st_dev     = src.dev;
+        dst->st_ino     = src.ino;
+        dst->st_mode    = src.mode;
+        dst->st_nlink   = src.nlink;
+        dst->st_uid     = src.uid;
+        dst->st_gid     = src.gid;
+        dst->st_rdev    = src.rdev;
+        dst->st_size    = src.size;
+        dst->st_atime   = src.atime;
+        dst->st_mtime   = src.mtime;
+        dst->st_ctime   = src.ctime;
+        dst->st_blksize = src.blksize;
+        dst->st_blocks  = src.blocks;
+    }
+
+    int tiered_fstat(struct _reent *r, void *fd, struct stat *st) {
+        CR_Stat crStat{};
+        const int res = Backend::fstat(GetFileTier(GetDevice(r), fd), GetTierFd(fd), &crStat);
+        if (res < 0) {
+            return SetError(r, res);
+        }
+        CRStatToStat(crStat, st);
+        return 0;
+    }
+
+    int tiered_stat(struct _reent *r, const char *file, struct stat *st) {
+        CR_Stat crStat{};
+        const int tier = FindTier(GetDevice(r), GetRelativePath(file), &crStat);
+        if (tier < 0) {
+            return SetError(r, tier);
+        }
+        CRStatToStat(crStat, st);
+        return 0;
+    }
+
+    int tiered_unlink(struct _reent *r, const char *name) {
+        auto *device   = GetDevice(r);
+        const auto rel = GetRelativePath(name);
+        if (IsReservedPath(rel)) {
+            return SetError(r, -ENOENT);
+        }
+        DropPromoted(device, rel);
+
+        int res = -ENOENT;
+        for (uint32_t i = 0; i < device->tiers.size(); i++) {
+            const int cur = Backend::unlink(device->tiers[i].dev, GetTierPath(device, i, rel).c_str());
+            if (cur >= 0 || res == -ENOENT) {
+                res = cur;
+            }
+        }
+        return res < 0 ? SetError(r, res) : 0;
+    }
+
+    int tiered_rename(struct _reent *r, const char *oldName, const char *newName) {
+        auto *device      = GetDevice(r);
+        const auto oldRel = GetRelativePath(oldName);
+        const auto newRel = GetRelativePath(newName);
+        if (IsReservedPath(newRel)) {
+            return SetError(r, -EACCES);
+        }
+        DropPromoted(device, oldRel);
+        DropPromoted(device, newRel);
+
+        CR_Stat st{};
+        const int tier = FindTier(device, oldRel, &st);
+        if (tier < 0) {
+            return SetError(r, tier);
+        }
+        if (S_ISDIR(st.mode)) {
+            // Listings merge the directories of all tiers, so each tier has to move its part.
+            int res = -ENOENT;
+            for (uint32_t i = tier; i < device->tiers.size(); i++) {
+                const int cur = Backend::rename(device->tiers[i].dev, GetTierPath(device, i, oldRel).c_str(), GetTierPath(device, i, newRel).c_str());
+                if (cur >= 0 || res == -ENOENT) {
+                    res = cur;
+                }
+            }
+            return res < 0 ? SetError(r, res) : 0;
+        }
+
+        const int res = Backend::rename(device->tiers[tier].dev, GetTierPath(device, tier, oldRel).c_str(), GetTierPath(device, tier, newRel).c_str());
+        if (res < 0) {
+            return SetError(r, res);
+        }
+        // Copies of the same name in slower tiers were shadowed by the renamed file and would show up under the old name again.
+        // Other files with the new name are replaced by the rename, a faster one would shadow the renamed file otherwise.
+        for (uint32_t i = 0; i < device->tiers.size(); i++) {
+            if (i == static_cast<uint32_t>(tier)) {
+                continue;
+            }
+            if (i > static_cast<uint32_t>(tier)) {
+                Backend::unlink(device->tiers[i].dev, GetTierPath(device, i, oldRel).c_str());
+            }
+            Backend::unlink(device->tiers[i].dev, GetTierPath(device, i, newRel).c_str());
+        }
+        return 0;
+    }
+
+    int tiered_mkdir(struct _reent *r, const char *path, int mode) {
+        auto *device        = GetDevice(r);
+        const uint32_t tier = device->tiers.size() - 1;
+        const auto rel      = GetRelativePath(path);
+        if (IsReservedPath(rel)) {
+            return SetError(r, -EACCES);
+        }
+        const int res = Backend::mkdir(device->tiers[tier].dev, GetTierPath(device, tier, rel).c_str(), mode);
+        return res < 0 ? SetError(r, res) : 0;
+    }
+
+    int tiered_rmdir(struct _reent *r, const char *name) {
+        auto *device   = GetDevice(r);
+        const auto rel = GetRelativePath(name);
+        if (IsReservedPath(rel)) {
+            return SetError(r, -ENOENT);
+        }
+
+        int res = -ENOENT;
+        for (uint32_t i = 0; i < device->tiers.size(); i++) {
+            const int cur = Backend::rmdir(device->tiers[i].dev, GetTierPath(device, i, rel).c_str());
+            if (cur >= 0 || res == -ENOENT) {
+                res = cur;
+            }
+        }
+        return res < 0 ? SetError(r, res) : 0;
+    }
+
+    int OpenTierDir(TieredDevice *device, TieredDirIterator *iter) {
+        const auto &tier = device->tiers[iter->tier];
+        iter->tierDirState.assign(tier.dev->dirStateSize + 1, 0);
+        const int res  = Backend::diropen(tier.dev, tier.deviceId, iter->tierDirState.data(), GetTierPath(device, iter->tier, iter->path).c_str());
+        iter->tierOpen = res >= 0;
+        return res;
+    }
+
+    void CloseTierDir(TieredDevice *device, TieredDirIterator *iter) {
+        if (iter->tierOpen) {
+            Backend::dirclose(device->tiers[iter->tier].dev, device->tiers[iter->tier].deviceId, iter->tierDirState.data());
+            iter->tierOpen = false;
+        }
+    }
+
+    int OpenFirstTierDir(TieredDevice *device, TieredDirIterator *iter) {
+        int firstError = -ENOENT;
+        for (iter->tier = 0; iter->tier < device->tiers.size(); iter->tier++) {
+            const int res = OpenTierDir(device, iter);
+            if (res >= 0) {
+                return 0;
+            }
+            if (res != -ENOENT && firstError == -ENOENT) {
+                firstError = res;
+            }
+        }
+        return firstError;
+    }
+
+    DIR_ITER *tiered_diropen(struct _reent *r, DIR_ITER *dirState, const char *path) {
+        auto *device = GetDevice(r);
+        auto *dir    = static_cast<TieredDir *>(dirState->dirStruct);
+        auto *iter   = new (std::nothrow) TieredDirIterator();
+        if (!iter) {
+            SetError(r, -ENOMEM);
+            return nullptr;
+        }
+        iter->path     = GetRelativePath(path);
+        iter->tierOpen = false;
+        if (IsReservedPath(iter->path)) {
+            delete iter;
+            SetError(r, -ENOENT);
+            return nullptr;
+        }
+
+        const int res = OpenFirstTierDir(device, iter);
+        if (res < 0) {
+            delete iter;
+            SetError(r, res);
+            return nullptr;
+        }
+        dir->iter = iter;
+        return dirState;
+    }
+
+    int tiered_dirreset(struct _reent *r, DIR_ITER *dirState) {
+        auto *device = GetDevice(r);
+        auto *iter   = static_cast<TieredDir *>(dirState->dirStruct)->iter;
+        CloseTierDir(device, iter);
+        iter->seen.clear();
+        const int res = OpenFirstTierDir(device, iter);
+        return res < 0 ? SetError(r, res) : 0;
+    }
+
+    int tiered_dirnext(struct _reent *r, DIR_ITER *dirState, char *filename, struct stat *filestat) {
+        auto *device = GetDevice(r);
+        auto *iter   = static_cast<TieredDir *>(dirState->dirStruct)->iter;
+
+        while (iter->tier < device->tiers.size()) {
+            if (!iter->tierOpen) {
+                const int res = OpenTierDir(device, iter);
+                if (res < 0) {
+                    iter->tier++;
+                    continue;
+                }
+            }
+            CR_Stat crStat{};
+            const int res = Backend::dirnext(device->tiers[iter->tier].dev, device->tiers[iter->tier].deviceId, iter->tierDirState.data(), filename, &crStat);
+            if (res < 0) {
+                CloseTierDir(device, iter);
+                iter->tier++;
+                continue;
+            }
+            if (IsReservedPath(iter->path + "/" + filename)) {
+                continue;
+            }
+            if (!iter->seen.insert(filename).second) {
+                continue;
+            }
+            CRStatToStat(crStat, filestat);
+            return 0;
+        }
+        return SetError(r, -ENOENT);
+    }
+
+    int tiered_dirclose(struct _reent *r, DIR_ITER *dirState) {
+        auto *dir = static_cast<TieredDir *>(dirState->dirStruct);
+        CloseTierDir(GetDevice(r), dir->iter);
+        delete dir->iter;
+        dir->iter = nullptr;
+        return 0;
+    }
+
+    int tiered_statvfs(struct _reent *r, const char *path, struct statvfs *buf) {
+        auto *device        = GetDevice(r);
+        const uint32_t tier = device->tiers.size() - 1;
+        CR_Statvfs crStatvfs{};
+        const int res = Backend::statvfs(device->tiers[tier].dev, GetTierPath(device, tier, GetRelativePath(path)).c_str(), &crStatvfs);
+        if (res < 0) {
+            return SetError(r, res);
+        }
+        memset(buf, 0, sizeof(*buf));
+        buf->f_bsize   = crStatvfs.bsize;
+        buf->f_frsize  = crStatvfs.frsize;
+        buf->f_blocks  = crStatvfs.blocks;
+        buf->f_bfree   = crStatvfs.bfree;
+        buf->f_bavail  = crStatvfs.bavail;
+        buf->f_files   = crStatvfs.files;
+        buf->f_ffree   = crStatvfs.ffree;
+        buf->f_favail  = crStatvfs.favail;
+        buf->f_fsid    = crStatvfs.fsid;
+        buf->f_flag    = crStatvfs.flag;
+        buf->f_namemax = crStatvfs.namemax;
+        return 0;
+    }
+
+    int tiered_ftruncate(struct _reent *r, void *fd, off_t len) {
+        const int res = Backend::ftruncate(GetFileTier(GetDevice(r), fd), GetTierFd(fd), len);
+        return res < 0 ? SetError(r, res) : 0;
+    }
+
+    int tiered_fsync(struct _reent *r, void *fd) {
+        const int res = Backend::fsync(GetFileTier(GetDevice(r), fd), GetTierFd(fd));
+        return res < 0 ? SetError(r, res) : 0;
+    }
+
+    int tiered_chmod(struct _reent *r, const char *path, mode_t mode) {
+        auto *device   = GetDevice(r);
+        const auto rel = GetRelativePath(path);
+        CR_Stat st{};
+        const int tier = FindTier(device, rel, &st);
+        if (tier < 0) {
+            return SetError(r, tier);
+        }
+        const int res = Backend::chmod(device->tiers[tier].dev, GetTierPath(device, tier, rel).c_str(), mode);
+        return res < 0 ? SetError(r, res) : 0;
+    }
+
+    int tiered_fchmod(struct _reent *r, void *fd, mode_t mode) {
+        const int res = Backend::fchmod(GetFileTier(GetDevice(r), fd), GetTierFd(fd), mode);
+        return res < 0 ? SetError(r, res) : 0;
+    }
+
+    int tiered_utimes(struct _reent *r, const char *filename, const struct timeval times[2]) {
+        auto *device   = GetDevice(r);
+        const auto rel = GetRelativePath(filename);
+        CR_Stat st{};
+        const int tier = FindTier(device, rel, &st);
+        if (tier < 0) {
+            return SetError(r, tier);
+        }
+        CR_Timeval crTimes[2];
+        if (times) {
+            for (int i = 0; i < 2; i++) {
+                crTimes[i].tv_sec  = times[i].tv_sec;
+                crTimes[i].tv_usec = times[i].tv_usec;
+            }
+        }
+        const int res = Backend::utimes(device->tiers[tier].dev, GetTierPath(device, tier, rel).c_str(), times ? crTimes : nullptr);
+        return res < 0 ? SetError(r, res) : 0;
+    }
+} // namespace
+
+ContentRedirectionStatus ContentRedirection_CreateTieredDevice(const ContentRedirectionTieredDeviceConfig *config, const devoptab_t **deviceOut) {
+    if (config == nullptr || deviceOut == nullptr || config->name == nullptr || config->tiers == nullptr || config->numTiers == 0) {
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
+
+    std::unique_ptr<TieredDevice> device(new (std::nothrow) TieredDevice());
+    if (!device) {
+        return CONTENT_REDIRECTION_RESULT_NO_MEMORY;
+    }
+    device->name              = config->name;
+    device->promoteAfterReads = config->promoteAfterReads;
+
+    size_t maxStructSize = 0;
+    for (uint32_t i = 0; i < config->numTiers; i++) {
+        const auto &tierConfig = config->tiers[i];
+        if (tierConfig.path == nullptr) {
+            return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+        }
+        const devoptab_t *dev = GetDeviceOpTab(tierConfig.path);
+        if (dev == nullptr || strchr(tierConfig.path, ':') == nullptr) {
+            DEBUG_FUNCTION_LINE_ERR("No device found for tier path \"%s\"", tierConfig.path);
+            return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+        }
+        std::string path = tierConfig.path;
+        while (!path.empty() && path.back() == '/') {
+            path.pop_back();
+        }
+        device->tiers.push_back({path, dev, FindDevice(tierConfig.path), tierConfig.promotionBudget, 0});
+        maxStructSize = std::max(maxStructSize, dev->structSize);
+    }
+
+    // Which files were promoted is only known in memory, so copies of an earlier session may be outdated.
+    for (const auto &tier : device->tiers) {
+        const int res = RemoveTree(tier.dev, tier.deviceId, tier.path + PROMOTED_DIR);
+        if (res < 0) {
+            DEBUG_FUNCTION_LINE_WARN("Failed to clear promoted files of tier \"%s\": %d", tier.path.c_str(), res);
+        }
+    }
+
+    auto &dt        = device->devoptab;
+    dt.name         = device->name.c_str();
+    dt.structSize   = FILE_HEADER_SIZE + maxStructSize;
+    dt.open_r       = tiered_open;
+    dt.close_r      = tiered_close;
+    dt.write_r      = tiered_write;
+    dt.read_r       = tiered_read;
+    dt.seek_r       = tiered_seek;
+    dt.fstat_r      = tiered_fstat;
+    dt.stat_r       = tiered_stat;
+    dt.unlink_r     = tiered_unlink;
+    dt.rename_r     = tiered_rename;
+    dt.mkdir_r      = tiered_mkdir;
+    dt.dirStateSize = sizeof(TieredDir);
+    dt.diropen_r    = tiered_diropen;
+    dt.dirreset_r   = tiered_dirreset;
+    dt.dirnext_r    = tiered_dirnext;
+    dt.dirclose_r   = tiered_dirclose;
+    dt.statvfs_r    = tiered_statvfs;
+    dt.ftruncate_r  = tiered_ftruncate;
+    dt.fsync_r      = tiered_fsync;
+    dt.deviceData   = device.get();
+    dt.chmod_r      = tiered_chmod;
+    dt.fchmod_r     = tiered_fchmod;
+    dt.rmdir_r      = tiered_rmdir;
+    dt.lstat_r      = tiered_stat;
+    dt.utimes_r     = tiered_utimes;
+
+    if (device->promoteAfterReads != 0 && device->tiers.size() > 1) {
+        device->worker = std::thread(PromotionWorker, device.get());
+    }
+
+    *deviceOut = &device.release()->devoptab;
+    return CONTENT_REDIRECTION_RESULT_SUCCESS;
+}
+
+ContentRedirectionStatus ContentRedirection_DestroyTieredDevice(const devoptab_t *device) {
+    if (device == nullptr) {
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
+    auto *tieredDevice = static_cast<TieredDevice *>(device->deviceData);
+    {
+        std::lock_guard lock(tieredDevice->mutex);
+        tieredDevice->stopWorker = true;
+        tieredDevice->queueCondition.notify_all();
+    }
+    if (tieredDevice->worker.joinable()) {
+        tieredDevice->worker.join();
+    }
+    delete tieredDevice;
+    return CONTENT_REDIRECTION_RESULT_SUCCESS;
+}
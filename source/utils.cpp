@@ -1,20 +1,55 @@
+#include "content_redirection/archive_layer.h"
+#include "content_redirection/layer_filter.h"
+#include "content_redirection/layer_stats.h"
+#include "content_redirection/patch_layer.h"
+#include "content_redirection/pattern_layer.h"
 #include "content_redirection/redirection.h"
+#include "layer_filter_builder.h"
+#include "layer_registry.h"
+#include "layer_watcher.h"
+#include "library_memory.h"
 #include "logger.h"
+#include "patch_loader.h"
+#include "pattern_compiler.h"
+#include "read_ahead_worker.h"
+#include "sarc_loader.h"
+#include "virtual_file_device.h"
+#include <algorithm>
+#include <atomic>
 #include <coreinit/debug.h>
 #include <coreinit/dynload.h>
+#include <memory>
+#include <vector>
 
 static OSDynLoad_Module sModuleHandle = nullptr;
 
-static ContentRedirectionApiErrorType (*sCRAddFSLayerEx)(CRLayerHandle *, const char *, const char *, const char *, FSLayerTypeEx) = nullptr;
-static ContentRedirectionApiErrorType (*sCRAddFSLayer)(CRLayerHandle *, const char *, const char *, FSLayerType)                   = nullptr;
-static ContentRedirectionApiErrorType (*sCRRemoveFSLayer)(CRLayerHandle)                                                           = nullptr;
-static ContentRedirectionApiErrorType (*sCRSetActive)(CRLayerHandle, bool)                                                         = nullptr;
-static ContentRedirectionApiErrorType (*sCRGetVersion)(ContentRedirectionVersion *)                                                = nullptr;
-static ContentRedirectionApiErrorType (*sCRAddDeviceABI)(const ContentRedirectionDeviceABI *, int *)                               = nullptr;
-static ContentRedirectionApiErrorType (*sCRRemoveDeviceABI)(const char *, int *)                                                   = nullptr;
+static ContentRedirectionApiErrorType (*sCRAddFSLayerEx)(CRLayerHandle *, const char *, const char *, const char *, FSLayerTypeEx)                                                           = nullptr;
+static ContentRedirectionApiErrorType (*sCRAddFSLayer)(CRLayerHandle *, const char *, const char *, FSLayerType)                                                                             = nullptr;
+static ContentRedirectionApiErrorType (*sCRRemoveFSLayer)(CRLayerHandle)                                                                                                                     = nullptr;
+static ContentRedirectionApiErrorType (*sCRSetActive)(CRLayerHandle, bool)                                                                                                                   = nullptr;
+static ContentRedirectionApiErrorType (*sCRGetVersion)(ContentRedirectionVersion *)                                                                                                          = nullptr;
+static ContentRedirectionApiErrorType (*sCRAddDeviceABI)(const ContentRedirectionDeviceABI *, int *)                                                                                         = nullptr;
+static ContentRedirectionApiErrorType (*sCRRemoveDeviceABI)(const char *, int *)                                                                                                             = nullptr;
+static ContentRedirectionApiErrorType (*sCRAddFSLayerWithPriority)(CRLayerHandle *, const char *, const char *, FSLayerType, int32_t)                                                        = nullptr;
+static ContentRedirectionApiErrorType (*sCRAddFSLayerExWithPriority)(CRLayerHandle *, const char *, const char *, const char *, FSLayerTypeEx, int32_t)                                      = nullptr;
+static ContentRedirectionApiErrorType (*sCRSetLayerPriorities)(const CRLayerHandle *, const int32_t *, uint32_t)                                                                             = nullptr;
+static ContentRedirectionApiErrorType (*sCRGetMemoryUsage)(ContentRedirectionMemoryUsage *, ContentRedirectionLayerMemoryUsage *, uint32_t, ContentRedirectionDeviceMemoryUsage *, uint32_t) = nullptr;
+static ContentRedirectionApiErrorType (*sCRSetMemoryBudget)(uint32_t, ContentRedirectionMemoryBudgetPolicy)                                                                                  = nullptr;
+static ContentRedirectionApiErrorType (*sCRRefreshFSLayer)(CRLayerHandle, const char *const *, uint32_t)                                                                                     = nullptr;
+static ContentRedirectionApiErrorType (*sCRSetLayerFilter)(CRLayerHandle, const ContentRedirectionLayerFilter *)                                                                             = nullptr;
+static ContentRedirectionApiErrorType (*sCRGetLayerFilterInfo)(CRLayerHandle, ContentRedirectionLayerFilterInfo *)                                                                           = nullptr;
+static ContentRedirectionApiErrorType (*sCRAddFSLayerExWithFlags)(CRLayerHandle *, const char *, const char *, const char *, FSLayerTypeEx, int32_t, uint32_t)                               = nullptr;
+static ContentRedirectionApiErrorType (*sCRAddFSLayerPattern)(CRLayerHandle *, const char *, const char *, const ContentRedirectionPatternDFA *, int32_t)                                    = nullptr;
+static ContentRedirectionApiErrorType (*sCRGetLayerStats)(CRLayerHandle, ContentRedirectionLayerStats *)                                                                                     = nullptr;
+static ContentRedirectionApiErrorType (*sCRGetAllLayerStats)(ContentRedirectionLayerStats *, uint32_t, uint32_t *)                                                                           = nullptr;
+static ContentRedirectionApiErrorType (*sCRResetLayerStats)()                                                                                                                                = nullptr;
 
 static ContentRedirectionVersion sContentRedirectionVersion = CONTENT_REDIRECTION_MODULE_VERSION_ERROR;
 
+static std::atomic<uint32_t> sLibraryMemoryBytes  = 0;
+static std::atomic<uint32_t> sLibraryMemoryBudget = 0;
+static std::atomic<uint32_t> sModuleMemoryBytes   = 0; /**< Last known usage of the module, see RefreshModuleMemoryBytes */
+
 static ContentRedirectionStatus ConvertApiError(ContentRedirectionApiErrorType apiError) {
     switch (apiError) {
         case CONTENT_REDIRECTION_API_ERROR_NONE:
@@ -104,10 +139,77 @@ ContentRedirectionStatus ContentRedirection_InitLibrary() {
         sCRRemoveDeviceABI = nullptr;
     }
 
+    if (OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "CRAddFSLayerWithPriority", (void **) &sCRAddFSLayerWithPriority) != OS_DYNLOAD_OK) {
+        DEBUG_FUNCTION_LINE_WARN("FindExport CRAddFSLayerWithPriority failed, layer priorities will be emulated.");
+        sCRAddFSLayerWithPriority = nullptr;
+    }
+
+    if (OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "CRAddFSLayerExWithPriority", (void **) &sCRAddFSLayerExWithPriority) != OS_DYNLOAD_OK) {
+        DEBUG_FUNCTION_LINE_WARN("FindExport CRAddFSLayerExWithPriority failed, layer priorities will be emulated.");
+        sCRAddFSLayerExWithPriority = nullptr;
+    }
+
+    if (OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "CRSetLayerPriorities", (void **) &sCRSetLayerPriorities) != OS_DYNLOAD_OK) {
+        DEBUG_FUNCTION_LINE_WARN("FindExport CRSetLayerPriorities failed, layer priorities will be emulated.");
+        sCRSetLayerPriorities = nullptr;
+    }
+
+    if (OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "CRGetMemoryUsage", (void **) &sCRGetMemoryUsage) != OS_DYNLOAD_OK) {
+        DEBUG_FUNCTION_LINE_WARN("FindExport CRGetMemoryUsage failed.");
+        sCRGetMemoryUsage = nullptr;
+    }
+
+    if (OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "CRSetMemoryBudget", (void **) &sCRSetMemoryBudget) != OS_DYNLOAD_OK) {
+        DEBUG_FUNCTION_LINE_WARN("FindExport CRSetMemoryBudget failed.");
+        sCRSetMemoryBudget = nullptr;
+    }
+
+    if (OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "CRRefreshFSLayer", (void **) &sCRRefreshFSLayer) != OS_DYNLOAD_OK) {
+        DEBUG_FUNCTION_LINE_WARN("FindExport CRRefreshFSLayer failed, refreshing layers will be emulated.");
+        sCRRefreshFSLayer = nullptr;
+    }
+
+    if (OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "CRSetLayerFilter", (void **) &sCRSetLayerFilter) != OS_DYNLOAD_OK) {
+        DEBUG_FUNCTION_LINE_WARN("FindExport CRSetLayerFilter failed.");
+        sCRSetLayerFilter = nullptr;
+    }
+
+    if (OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "CRGetLayerFilterInfo", (void **) &sCRGetLayerFilterInfo) != OS_DYNLOAD_OK) {
+        DEBUG_FUNCTION_LINE_WARN("FindExport CRGetLayerFilterInfo failed.");
+        sCRGetLayerFilterInfo = nullptr;
+    }
+
+    if (OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "CRAddFSLayerExWithFlags", (void **) &sCRAddFSLayerExWithFlags) != OS_DYNLOAD_OK) {
+        DEBUG_FUNCTION_LINE_WARN("FindExport CRAddFSLayerExWithFlags failed.");
+        sCRAddFSLayerExWithFlags = nullptr;
+    }
+
+    if (OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "CRAddFSLayerPattern", (void **) &sCRAddFSLayerPattern) != OS_DYNLOAD_OK) {
+        DEBUG_FUNCTION_LINE_WARN("FindExport CRAddFSLayerPattern failed.");
+        sCRAddFSLayerPattern = nullptr;
+    }
+
+    if (OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "CRGetLayerStats", (void **) &sCRGetLayerStats) != OS_DYNLOAD_OK) {
+        DEBUG_FUNCTION_LINE_WARN("FindExport CRGetLayerStats failed.");
+        sCRGetLayerStats = nullptr;
+    }
+
+    if (OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "CRGetAllLayerStats", (void **) &sCRGetAllLayerStats) != OS_DYNLOAD_OK) {
+        DEBUG_FUNCTION_LINE_WARN("FindExport CRGetAllLayerStats failed.");
+        sCRGetAllLayerStats = nullptr;
+    }
+
+    if (OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "CRResetLayerStats", (void **) &sCRResetLayerStats) != OS_DYNLOAD_OK) {
+        DEBUG_FUNCTION_LINE_WARN("FindExport CRResetLayerStats failed.");
+        sCRResetLayerStats = nullptr;
+    }
+
     return CONTENT_REDIRECTION_RESULT_SUCCESS;
 }
 
 ContentRedirectionStatus ContentRedirection_DeInitLibrary() {
+    LayerWatcher::Stop();
+    ReadAheadWorker::Stop();
     return CONTENT_REDIRECTION_RESULT_SUCCESS;
 }
 
@@ -127,27 +229,350 @@ ContentRedirectionStatus ContentRedirection_GetVersion(ContentRedirectionVersion
     return ConvertApiError(sCRGetVersion(outVersion));
 }
 
+static bool HasNativeLayerPriorities() {
+    return sCRAddFSLayerWithPriority != nullptr && sCRAddFSLayerExWithPriority != nullptr && sCRSetLayerPriorities != nullptr && sContentRedirectionVersion >= 5;
+}
 
-ContentRedirectionStatus ContentRedirection_AddFSLayer(CRLayerHandle *handlePtr, const char *layerName, const char *replacementDir, const FSLayerType layerType) {
+static bool HasNativeLayerFlags() {
+    return sCRAddFSLayerExWithFlags != nullptr && sContentRedirectionVersion >= 9;
+}
+
+static ContentRedirectionStatus CheckAddFSLayer(const FSLayerType layerType) {
     if (sContentRedirectionVersion == CONTENT_REDIRECTION_MODULE_VERSION_ERROR) {
         return CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED;
     }
     if (sCRAddFSLayer == nullptr || sContentRedirectionVersion < 1) {
         return CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND;
     }
+    if ((layerType == FS_LAYER_TYPE_SAVE_COPY_ON_WRITE || layerType == FS_LAYER_TYPE_SAVE_COPY_ON_WRITE_FOR_CURRENT_USER) && sContentRedirectionVersion < 4) {
+        return CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND;
+    }
+    return CONTENT_REDIRECTION_RESULT_SUCCESS;
+}
+
+static ContentRedirectionStatus CheckAddFSLayerEx(const FSLayerTypeEx layerType) {
+    if (sContentRedirectionVersion == CONTENT_REDIRECTION_MODULE_VERSION_ERROR) {
+        return CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED;
+    }
+    if (sCRAddFSLayerEx == nullptr || sContentRedirectionVersion < 2) {
+        return CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND;
+    }
+    if (layerType == FS_LAYER_TYPE_EX_COPY_ON_WRITE_DIRECTORY && sContentRedirectionVersion < 4) {
+        return CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND;
+    }
+    return CONTENT_REDIRECTION_RESULT_SUCCESS;
+}
+
+static ContentRedirectionStatus AddLayerToModule(LayerInfo &layer) {
+    CRLayerHandle moduleHandle = 0;
+    ContentRedirectionStatus res;
+    // Patch and archive layers replace the file with their file on the virtual file device.
+    const auto layerTypeEx = layer.virtualFileId != 0 ? FS_LAYER_TYPE_EX_REPLACE_FILE : static_cast<FSLayerTypeEx>(layer.layerType);
+    if (layer.automaton != nullptr) {
+        // The module copies the automaton.
+        res = ConvertApiError(sCRAddFSLayerPattern(&moduleHandle, layer.name.c_str(), layer.targetPath.c_str(), &layer.automaton->dfa, layer.priority));
+    } else if (HasNativeLayerFlags() && layer.isEx && layer.flags != CONTENT_REDIRECTION_LAYER_FLAG_NONE) {
+        res = ConvertApiError(sCRAddFSLayerExWithFlags(&moduleHandle, layer.name.c_str(), layer.targetPath.c_str(), layer.replacementPath.c_str(), layerTypeEx, layer.priority, layer.flags));
+    } else if (HasNativeLayerPriorities() && layer.priority != 0) {
+        if (layer.isEx) {
+            res = ConvertApiError(sCRAddFSLayerExWithPriority(&moduleHandle, layer.name.c_str(), layer.targetPath.c_str(), layer.replacementPath.c_str(), layerTypeEx, layer.priority));
+        } else {
+            res = ConvertApiError(sCRAddFSLayerWithPriority(&moduleHandle, layer.name.c_str(), layer.replacementPath.c_str(), static_cast<FSLayerType>(layer.layerType), layer.priority));
+        }
+    } else if (layer.isEx) {
+        res = ConvertApiError(sCRAddFSLayerEx(&moduleHandle, layer.name.c_str(), layer.targetPath.c_str(), layer.replacementPath.c_str(), layerTypeEx));
+    } else {
+        res = ConvertApiError(sCRAddFSLayer(&moduleHandle, layer.name.c_str(), layer.replacementPath.c_str(), static_cast<FSLayerType>(layer.layerType)));
+    }
+    if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+        return res;
+    }
+    layer.moduleHandle   = moduleHandle;
+    layer.moduleSequence = LayerRegistry::NextSequence();
+    if (!layer.active && sCRSetActive != nullptr) {
+        sCRSetActive(moduleHandle, false);
+    }
+    return CONTENT_REDIRECTION_RESULT_SUCCESS;
+}
+
+/**
+ * Emulates layer priorities on modules without native support.
+ * The module processes the layers in reverse adding order, so every layer starting with the first one that is out of order
+ * is removed and re-added in priority order. If a re-add fails, the removed layers are re-added in their previous order.
+ */
+static ContentRedirectionStatus ApplyLayerOrder() {
+    std::lock_guard lock(LayerRegistry::GetMutex());
+    auto current = LayerRegistry::GetAll();
+    std::sort(current.begin(), current.end(), [](const LayerInfo *a, const LayerInfo *b) {
+        // Layers which are not part of the module (e.g. failed re-adds) are sorted to the end.
+        if ((a->moduleHandle == 0) != (b->moduleHandle == 0)) {
+            return b->moduleHandle == 0;
+        }
+        return a->moduleSequence < b->moduleSequence;
+    });
+    auto desired = current;
+    std::sort(desired.begin(), desired.end(), [](const LayerInfo *a, const LayerInfo *b) {
+        if (a->priority != b->priority) {
+            return a->priority < b->priority;
+        }
+        return a->sequence < b->sequence;
+    });
+
+    size_t first = 0;
+    while (first < current.size() && current[first] == desired[first] && current[first]->moduleHandle != 0) {
+        first++;
+    }
+    std::vector<LayerInfo *> removed;
+    for (size_t i = first; i < current.size(); i++) {
+        if (current[i]->moduleHandle != 0) {
+            sCRRemoveFSLayer(current[i]->moduleHandle);
+            current[i]->moduleHandle = 0;
+            removed.push_back(current[i]);
+        }
+    }
+
+    for (size_t i = first; i < desired.size(); i++) {
+        auto res = AddLayerToModule(*desired[i]);
+        if (res == CONTENT_REDIRECTION_RESULT_SUCCESS) {
+            continue;
+        }
+        DEBUG_FUNCTION_LINE_ERR("Failed to re-add layer \"%s\": %s", desired[i]->name.c_str(), ContentRedirection_GetStatusStr(res));
+        // Restores the previous order instead of leaving the module with only a part of the layers.
+        for (size_t j = first; j < i; j++) {
+            sCRRemoveFSLayer(desired[j]->moduleHandle);
+            desired[j]->moduleHandle = 0;
+        }
+        for (auto *layer : removed) {
+            if (AddLayerToModule(*layer) != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+                DEBUG_FUNCTION_LINE_ERR("Failed to restore layer \"%s\"", layer->name.c_str());
+            }
+        }
+        return res;
+    }
+    return CONTENT_REDIRECTION_RESULT_SUCCESS;
+}
+
+static ContentRedirectionStatus AddLayer(LayerInfo layer, CRLayerHandle *handlePtr) {
+    std::lock_guard lock(LayerRegistry::GetMutex());
+    layer.sequence = LayerRegistry::NextSequence();
+
+    auto res = AddLayerToModule(layer);
+    if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+        return res;
+    }
+
+    layer.handle = layer.moduleHandle;
+    *handlePtr   = LayerRegistry::Add(std::move(layer))->handle;
+
+    if (!HasNativeLayerPriorities()) {
+        return ApplyLayerOrder();
+    }
+    return CONTENT_REDIRECTION_RESULT_SUCCESS;
+}
+
+ContentRedirectionStatus ContentRedirection_AddFSLayer(CRLayerHandle *handlePtr, const char *layerName, const char *replacementDir, const FSLayerType layerType) {
+    return ContentRedirection_AddFSLayerWithPriority(handlePtr, layerName, replacementDir, layerType, 0);
+}
+
+ContentRedirectionStatus ContentRedirection_AddFSLayerWithPriority(CRLayerHandle *handlePtr, const char *layerName, const char *replacementDir, const FSLayerType layerType, int32_t priority) {
+    auto res = CheckAddFSLayer(layerType);
+    if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+        return res;
+    }
+    if (handlePtr == nullptr || layerName == nullptr || replacementDir == nullptr) {
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
 
-    return ConvertApiError(sCRAddFSLayer(handlePtr, layerName, replacementDir, layerType));
+    LayerInfo layer;
+    layer.isEx            = false;
+    layer.name            = layerName;
+    layer.replacementPath = replacementDir;
+    layer.layerType       = layerType;
+    layer.priority        = priority;
+    return AddLayer(std::move(layer), handlePtr);
 }
 
 ContentRedirectionStatus ContentRedirection_AddFSLayerEx(CRLayerHandle *handlePtr, const char *layerName, const char *targetPath, const char *replacementDir, const FSLayerTypeEx layerType) {
+    return ContentRedirection_AddFSLayerExWithPriority(handlePtr, layerName, targetPath, replacementDir, layerType, 0);
+}
+
+ContentRedirectionStatus ContentRedirection_AddFSLayerExWithPriority(CRLayerHandle *handlePtr, const char *layerName, const char *targetPath, const char *replacementDir, const FSLayerTypeEx layerType, int32_t priority) {
+    return ContentRedirection_AddFSLayerExWithFlags(handlePtr, layerName, targetPath, replacementDir, layerType, priority, CONTENT_REDIRECTION_LAYER_FLAG_NONE);
+}
+
+ContentRedirectionStatus ContentRedirection_AddFSLayerExWithFlags(CRLayerHandle *handlePtr, const char *layerName, const char *targetPath, const char *replacementDir, const FSLayerTypeEx layerType, int32_t priority, uint32_t flags) {
+    auto res = CheckAddFSLayerEx(layerType);
+    if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+        return res;
+    }
+    if (handlePtr == nullptr || layerName == nullptr || targetPath == nullptr || replacementDir == nullptr) {
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
+    constexpr uint32_t knownFlags = CONTENT_REDIRECTION_LAYER_FLAG_IMMUTABLE | CONTENT_REDIRECTION_LAYER_FLAG_NO_WHITEOUTS;
+    if ((flags & ~knownFlags) != 0 || (flags != CONTENT_REDIRECTION_LAYER_FLAG_NONE && layerType == FS_LAYER_TYPE_EX_COPY_ON_WRITE_DIRECTORY)) {
+        // Copy-on-write layers write into the replacement dir, including whiteouts.
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
+    if (layerType == FS_LAYER_TYPE_EX_PATTERN || layerType == FS_LAYER_TYPE_EX_PATCH_FILE || layerType == FS_LAYER_TYPE_EX_ARCHIVE) {
+        // These layers have no replacement dir, see ContentRedirection_AddFSLayerPattern, ContentRedirection_AddFSLayerPatch and ContentRedirection_AddFSLayerArchive.
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
+    if (flags != CONTENT_REDIRECTION_LAYER_FLAG_NONE && !HasNativeLayerFlags()) {
+        return CONTENT_REDIRECTION_RESULT_UNSUPPORTED_VERSION;
+    }
+
+    LayerInfo layer;
+    layer.isEx            = true;
+    layer.name            = layerName;
+    layer.targetPath      = targetPath;
+    layer.replacementPath = replacementDir;
+    layer.layerType       = layerType;
+    layer.priority        = priority;
+    layer.flags           = flags;
+    return AddLayer(std::move(layer), handlePtr);
+}
+
+ContentRedirectionStatus ContentRedirection_AddFSLayerPattern(CRLayerHandle *handlePtr, const char *layerName, const char *targetPath,
+                                                              const ContentRedirectionPatternRule *rules, uint32_t numRules, int32_t priority) {
     if (sContentRedirectionVersion == CONTENT_REDIRECTION_MODULE_VERSION_ERROR) {
         return CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED;
     }
-    if (sCRAddFSLayerEx == nullptr || sContentRedirectionVersion < 2) {
+    if (sCRAddFSLayerPattern == nullptr || sContentRedirectionVersion < 10) {
+        return CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND;
+    }
+    if (handlePtr == nullptr || layerName == nullptr || targetPath == nullptr) {
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
+
+    auto automaton = std::make_shared<PatternAutomaton>();
+    auto res       = PatternCompiler::Compile(rules, numRules, *automaton);
+    if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+        return res;
+    }
+
+    LayerInfo layer;
+    layer.isEx       = true;
+    layer.name       = layerName;
+    layer.targetPath = targetPath;
+    layer.layerType  = FS_LAYER_TYPE_EX_PATTERN;
+    layer.priority   = priority;
+    layer.automaton  = std::move(automaton);
+    return AddLayer(std::move(layer), handlePtr);
+}
+
+/**
+ * Adds a layer whose replacement is a file on the virtual file device, the file is removed again if the layer can't be added.
+ */
+static ContentRedirectionStatus AddVirtualFileLayer(LayerInfo layer, CRLayerHandle *handlePtr) {
+    const uint32_t virtualFileId = layer.virtualFileId;
+    CRLayerHandle handle         = 0;
+    auto res                     = AddLayer(std::move(layer), &handle);
+    if (handle == 0) {
+        // The layer hasn't been added, nothing refers to the file.
+        VirtualFileDevice::Remove(virtualFileId);
+        return res;
+    }
+    *handlePtr = handle;
+    return res;
+}
+
+ContentRedirectionStatus ContentRedirection_AddFSLayerPatch(CRLayerHandle *handlePtr, const char *layerName, const char *targetPath,
+                                                            const char *basePath, const char *patchPath, int32_t priority) {
+    auto res = CheckAddFSLayerEx(FS_LAYER_TYPE_EX_REPLACE_FILE);
+    if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+        return res;
+    }
+    if (sCRAddDeviceABI == nullptr || sContentRedirectionVersion < 3) {
+        return CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND;
+    }
+    if (handlePtr == nullptr || layerName == nullptr || targetPath == nullptr || basePath == nullptr || patchPath == nullptr) {
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
+
+    LayerInfo layer;
+    res = VirtualFileDevice::Add([base = std::string(basePath), patch = std::string(patchPath)](VirtualFile &out) { return PatchLoader::Load(base, patch, out); },
+                                 layer.virtualFileId, layer.replacementPath);
+    if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+        return res;
+    }
+    layer.isEx       = true;
+    layer.name       = layerName;
+    layer.targetPath = targetPath;
+    layer.layerType  = FS_LAYER_TYPE_EX_PATCH_FILE;
+    layer.priority   = priority;
+    return AddVirtualFileLayer(std::move(layer), handlePtr);
+}
+
+ContentRedirectionStatus ContentRedirection_AddFSLayerArchive(CRLayerHandle *handlePtr, const char *layerName, const char *targetPath,
+                                                              const char *basePath, const char *memberDir, int32_t priority) {
+    auto res = CheckAddFSLayerEx(FS_LAYER_TYPE_EX_REPLACE_FILE);
+    if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+        return res;
+    }
+    if (sCRAddDeviceABI == nullptr || sContentRedirectionVersion < 3) {
         return CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND;
     }
+    if (handlePtr == nullptr || layerName == nullptr || targetPath == nullptr || basePath == nullptr || memberDir == nullptr) {
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
 
-    return ConvertApiError(sCRAddFSLayerEx(handlePtr, layerName, targetPath, replacementDir, layerType));
+    LayerInfo layer;
+    res = VirtualFileDevice::Add([base = std::string(basePath), dir = std::string(memberDir)](VirtualFile &out) { return SarcLoader::Load(base, dir, out); },
+                                 layer.virtualFileId, layer.replacementPath);
+    if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+        return res;
+    }
+    layer.isEx       = true;
+    layer.name       = layerName;
+    layer.targetPath = targetPath;
+    layer.layerType  = FS_LAYER_TYPE_EX_ARCHIVE;
+    layer.priority   = priority;
+    return AddVirtualFileLayer(std::move(layer), handlePtr);
+}
+
+ContentRedirectionStatus ContentRedirection_SetLayerPriority(CRLayerHandle handle, int32_t priority) {
+    return ContentRedirection_SetLayerPriorities(&handle, &priority, 1);
+}
+
+ContentRedirectionStatus ContentRedirection_SetLayerPriorities(const CRLayerHandle *handles, const int32_t *priorities, uint32_t count) {
+    if (sContentRedirectionVersion == CONTENT_REDIRECTION_MODULE_VERSION_ERROR) {
+        return CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED;
+    }
+    if (!HasNativeLayerPriorities() && (sCRAddFSLayer == nullptr || sCRRemoveFSLayer == nullptr || sContentRedirectionVersion < 1)) {
+        return CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND;
+    }
+    if (count > 0 && (handles == nullptr || priorities == nullptr)) {
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
+
+    std::lock_guard lock(LayerRegistry::GetMutex());
+    if (HasNativeLayerPriorities()) {
+        std::vector<CRLayerHandle> moduleHandles(count);
+        for (uint32_t i = 0; i < count; i++) {
+            moduleHandles[i] = LayerRegistry::ToModuleHandle(handles[i]);
+        }
+        auto res = ConvertApiError(sCRSetLayerPriorities(moduleHandles.data(), priorities, count));
+        if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+            return res;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            if (auto *layer = LayerRegistry::Find(handles[i])) {
+                layer->priority = priorities[i];
+            }
+        }
+        return CONTENT_REDIRECTION_RESULT_SUCCESS;
+    }
+
+    // Only layers added via this lib can be re-ordered on older modules.
+    for (uint32_t i = 0; i < count; i++) {
+        if (LayerRegistry::Find(handles[i]) == nullptr) {
+            return CONTENT_REDIRECTION_RESULT_LAYER_NOT_FOUND;
+        }
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        LayerRegistry::Find(handles[i])->priority = priorities[i];
+    }
+    return ApplyLayerOrder();
 }
 
 ContentRedirectionStatus ContentRedirection_RemoveFSLayer(CRLayerHandle handlePtr) {
@@ -158,7 +583,289 @@ ContentRedirectionStatus ContentRedirection_RemoveFSLayer(CRLayerHandle handlePt
         return CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND;
     }
 
-    return ConvertApiError(sCRRemoveFSLayer(handlePtr));
+    std::lock_guard lock(LayerRegistry::GetMutex());
+    auto *layer                  = LayerRegistry::Find(handlePtr);
+    const uint32_t virtualFileId = layer != nullptr ? layer->virtualFileId : 0;
+    if (layer != nullptr && layer->moduleHandle == 0) {
+        // Re-adding this layer has failed, it's only known to the lib.
+        LayerRegistry::Remove(handlePtr);
+        VirtualFileDevice::Remove(virtualFileId);
+        return CONTENT_REDIRECTION_RESULT_SUCCESS;
+    }
+
+    auto res = ConvertApiError(sCRRemoveFSLayer(LayerRegistry::ToModuleHandle(handlePtr)));
+    if (res == CONTENT_REDIRECTION_RESULT_SUCCESS || res == CONTENT_REDIRECTION_RESULT_LAYER_NOT_FOUND) {
+        LayerRegistry::Remove(handlePtr);
+        // Files that are still open keep the virtual file alive until they are closed.
+        VirtualFileDevice::Remove(virtualFileId);
+    }
+    return res;
+}
+
+static bool IsMergeLayer(const LayerInfo &layer) {
+    if (layer.isEx) {
+        return layer.layerType == FS_LAYER_TYPE_EX_MERGE_DIRECTORY;
+    }
+    return layer.layerType == FS_LAYER_TYPE_CONTENT_MERGE || layer.layerType == FS_LAYER_TYPE_AOC_MERGE;
+}
+
+/**
+ * Passes a filter over the given snapshot to the module, or removes the filter of the layer if "snapshot" is nullptr.
+ */
+static ContentRedirectionStatus SetLayerFilterInModule(LayerInfo &layer, const DirSnapshot *snapshot) {
+    if (snapshot == nullptr) {
+        // An empty filter would hide every file of the layer.
+        DEBUG_FUNCTION_LINE_WARN("Removing filter of layer \"%s\"", layer.name.c_str());
+        layer.filterFalsePositiveRate = 0;
+        return ConvertApiError(sCRSetLayerFilter(layer.moduleHandle, nullptr));
+    }
+
+    std::vector<uint32_t> blocks;
+    ContentRedirectionLayerFilter filter{};
+    LayerFilterBuilder::Build(*snapshot, layer.filterFalsePositiveRate, blocks, filter);
+    // The module copies the filter.
+    return ConvertApiError(sCRSetLayerFilter(layer.moduleHandle, &filter));
+}
+
+/**
+ * If more entries than this have changed, the whole layer is refreshed, which is cheaper than refreshing every single path.
+ */
+static constexpr uint32_t MAX_REFRESH_PATHS = 256;
+
+static ContentRedirectionStatus RefreshLayerInModule(LayerInfo &layer, const std::vector<std::string> *changedPaths) {
+    if (sCRRefreshFSLayer != nullptr && sContentRedirectionVersion >= 7) {
+        if (changedPaths == nullptr || changedPaths->size() > MAX_REFRESH_PATHS) {
+            return ConvertApiError(sCRRefreshFSLayer(layer.moduleHandle, nullptr, 0));
+        }
+        std::vector<const char *> paths;
+        paths.reserve(changedPaths->size());
+        for (const auto &path : *changedPaths) {
+            paths.push_back(path.c_str());
+        }
+        return ConvertApiError(sCRRefreshFSLayer(layer.moduleHandle, paths.data(), paths.size()));
+    }
+
+    // Older modules build their index when a layer is added, the only way to refresh it is to re-add the layer.
+    if (sCRRemoveFSLayer == nullptr) {
+        return CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND;
+    }
+    if (layer.moduleHandle != 0) {
+        auto res = ConvertApiError(sCRRemoveFSLayer(layer.moduleHandle));
+        if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+            return res;
+        }
+        layer.moduleHandle = 0;
+    }
+    auto res = AddLayerToModule(layer);
+    if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+        return res;
+    }
+    if (!HasNativeLayerPriorities()) {
+        return ApplyLayerOrder();
+    }
+    return CONTENT_REDIRECTION_RESULT_SUCCESS;
+}
+
+ContentRedirectionStatus ContentRedirection_RefreshFSLayer(CRLayerHandle handle) {
+    if (sContentRedirectionVersion == CONTENT_REDIRECTION_MODULE_VERSION_ERROR) {
+        return CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED;
+    }
+    if (sContentRedirectionVersion < 1) {
+        return CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND;
+    }
+
+    std::string replacementPath;
+    uint32_t virtualFileId;
+    {
+        std::lock_guard lock(LayerRegistry::GetMutex());
+        auto *layer = LayerRegistry::Find(handle);
+        if (layer == nullptr) {
+            return CONTENT_REDIRECTION_RESULT_LAYER_NOT_FOUND;
+        }
+        if (layer->automaton != nullptr) {
+            // The replacement paths of a pattern layer may be spread over several devices, there is nothing to compare.
+            return RefreshLayerInModule(*layer, nullptr);
+        }
+        replacementPath = layer->replacementPath;
+        virtualFileId   = layer->virtualFileId;
+    }
+
+    if (virtualFileId != 0) {
+        // The patched file or rebuilt archive is a single file on the virtual file device, the module has to drop what it knows about it.
+        auto res = VirtualFileDevice::Reload(virtualFileId);
+        if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+            return res;
+        }
+        std::lock_guard lock(LayerRegistry::GetMutex());
+        auto *layer = LayerRegistry::Find(handle);
+        if (layer == nullptr) {
+            return CONTENT_REDIRECTION_RESULT_LAYER_NOT_FOUND;
+        }
+        return RefreshLayerInModule(*layer, nullptr);
+    }
+
+    // Scan without holding the lock, walking a big replacement dir may take a while.
+    auto current       = std::make_shared<DirSnapshot>();
+    const bool scanned = ChangeDetector::Scan(replacementPath, *current);
+    if (!scanned) {
+        DEBUG_FUNCTION_LINE_WARN("Failed to scan \"%s\"", replacementPath.c_str());
+    }
+
+    std::lock_guard lock(LayerRegistry::GetMutex());
+    auto *layer = LayerRegistry::Find(handle);
+    if (layer == nullptr) {
+        return CONTENT_REDIRECTION_RESULT_LAYER_NOT_FOUND;
+    }
+
+    // Without a snapshot nothing is known about the state of the dir when the layer was added.
+    const bool fullRefresh = layer->snapshot == nullptr;
+    std::vector<std::string> changedPaths;
+    if (!fullRefresh) {
+        changedPaths = ChangeDetector::Diff(*layer->snapshot, *current);
+        if (changedPaths.empty()) {
+            return CONTENT_REDIRECTION_RESULT_SUCCESS;
+        }
+    }
+
+    if (layer->filterFalsePositiveRate > 0) {
+        // The filter has to contain new paths before the module looks for them.
+        auto res = SetLayerFilterInModule(*layer, scanned ? current.get() : nullptr);
+        if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+            return res;
+        }
+    }
+
+    auto res = RefreshLayerInModule(*layer, fullRefresh ? nullptr : &changedPaths);
+    if (res == CONTENT_REDIRECTION_RESULT_SUCCESS) {
+        layer->snapshot = std::move(current);
+    }
+    return res;
+}
+
+ContentRedirectionStatus ContentRedirection_SetLayerFilter(CRLayerHandle handle, float falsePositiveRate) {
+    if (sContentRedirectionVersion == CONTENT_REDIRECTION_MODULE_VERSION_ERROR) {
+        return CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED;
+    }
+    if (sCRSetLayerFilter == nullptr || sContentRedirectionVersion < 8) {
+        return CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND;
+    }
+    if (!(falsePositiveRate >= 0 && falsePositiveRate < 1)) {
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
+
+    std::string replacementPath;
+    {
+        std::lock_guard lock(LayerRegistry::GetMutex());
+        auto *layer = LayerRegistry::Find(handle);
+        if (layer == nullptr) {
+            return CONTENT_REDIRECTION_RESULT_LAYER_NOT_FOUND;
+        }
+        if (!IsMergeLayer(*layer)) {
+            return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+        }
+        if (falsePositiveRate == 0) {
+            if (layer->filterFalsePositiveRate == 0) {
+                return CONTENT_REDIRECTION_RESULT_SUCCESS;
+            }
+            return SetLayerFilterInModule(*layer, nullptr);
+        }
+        replacementPath = layer->replacementPath;
+    }
+
+    auto snapshot = std::make_shared<DirSnapshot>();
+    if (!ChangeDetector::Scan(replacementPath, *snapshot)) {
+        DEBUG_FUNCTION_LINE_ERR("Failed to scan \"%s\"", replacementPath.c_str());
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
+
+    std::lock_guard lock(LayerRegistry::GetMutex());
+    auto *layer = LayerRegistry::Find(handle);
+    if (layer == nullptr) {
+        return CONTENT_REDIRECTION_RESULT_LAYER_NOT_FOUND;
+    }
+    const float previousRate       = layer->filterFalsePositiveRate;
+    layer->filterFalsePositiveRate = falsePositiveRate;
+    auto res                       = SetLayerFilterInModule(*layer, snapshot.get());
+    if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+        layer->filterFalsePositiveRate = previousRate;
+        return res;
+    }
+
+    // Later refreshes compare against the new snapshot, so the index of the module has to catch up with it now.
+    // Otherwise changes between the last refresh and this scan would never reach the index.
+    const bool fullRefresh = layer->snapshot == nullptr;
+    std::vector<std::string> changedPaths;
+    if (!fullRefresh) {
+        changedPaths = ChangeDetector::Diff(*layer->snapshot, *snapshot);
+    }
+    if (fullRefresh || !changedPaths.empty()) {
+        res = RefreshLayerInModule(*layer, fullRefresh ? nullptr : &changedPaths);
+        if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+            return res;
+        }
+    }
+    layer->snapshot = std::move(snapshot);
+    return CONTENT_REDIRECTION_RESULT_SUCCESS;
+}
+
+ContentRedirectionStatus ContentRedirection_GetLayerFilterInfo(CRLayerHandle handle, ContentRedirectionLayerFilterInfo *infoOut) {
+    if (sContentRedirectionVersion == CONTENT_REDIRECTION_MODULE_VERSION_ERROR) {
+        return CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED;
+    }
+    if (sCRGetLayerFilterInfo == nullptr || sContentRedirectionVersion < 8) {
+        return CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND;
+    }
+    if (infoOut == nullptr) {
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
+    return ConvertApiError(sCRGetLayerFilterInfo(LayerRegistry::ToModuleHandle(handle), infoOut));
+}
+
+ContentRedirectionStatus ContentRedirection_GetLayerStats(CRLayerHandle handle, ContentRedirectionLayerStats *statsOut) {
+    if (sContentRedirectionVersion == CONTENT_REDIRECTION_MODULE_VERSION_ERROR) {
+        return CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED;
+    }
+    if (sCRGetLayerStats == nullptr || sContentRedirectionVersion < 11) {
+        return CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND;
+    }
+    if (statsOut == nullptr) {
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
+    auto res = ConvertApiError(sCRGetLayerStats(LayerRegistry::ToModuleHandle(handle), statsOut));
+    if (res == CONTENT_REDIRECTION_RESULT_SUCCESS) {
+        statsOut->handle = handle;
+    }
+    return res;
+}
+
+ContentRedirectionStatus ContentRedirection_GetAllLayerStats(ContentRedirectionLayerStats *statsOut, uint32_t maxLayers, uint32_t *numLayersOut) {
+    if (sContentRedirectionVersion == CONTENT_REDIRECTION_MODULE_VERSION_ERROR) {
+        return CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED;
+    }
+    if (sCRGetAllLayerStats == nullptr || sContentRedirectionVersion < 11) {
+        return CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND;
+    }
+    if (numLayersOut == nullptr || (statsOut == nullptr && maxLayers != 0)) {
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
+    auto res = ConvertApiError(sCRGetAllLayerStats(statsOut, maxLayers, numLayersOut));
+    if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+        return res;
+    }
+    for (uint32_t i = 0; i < std::min(maxLayers, *numLayersOut); i++) {
+        statsOut[i].handle = LayerRegistry::FromModuleHandle(statsOut[i].handle);
+    }
+    return CONTENT_REDIRECTION_RESULT_SUCCESS;
+}
+
+ContentRedirectionStatus ContentRedirection_ResetLayerStats() {
+    if (sContentRedirectionVersion == CONTENT_REDIRECTION_MODULE_VERSION_ERROR) {
+        return CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED;
+    }
+    if (sCRResetLayerStats == nullptr || sContentRedirectionVersion < 11) {
+        return CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND;
+    }
+    return ConvertApiError(sCRResetLayerStats());
 }
 
 ContentRedirectionStatus ContentRedirection_SetActive(CRLayerHandle handle, bool active) {
@@ -169,7 +876,14 @@ ContentRedirectionStatus ContentRedirection_SetActive(CRLayerHandle handle, bool
         return CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND;
     }
 
-    return ConvertApiError(sCRSetActive(handle, active));
+    std::lock_guard lock(LayerRegistry::GetMutex());
+    auto res = ConvertApiError(sCRSetActive(LayerRegistry::ToModuleHandle(handle), active));
+    if (res == CONTENT_REDIRECTION_RESULT_SUCCESS) {
+        if (auto *layer = LayerRegistry::Find(handle)) {
+            layer->active = active;
+        }
+    }
+    return res;
 }
 
 ContentRedirectionStatus ContentRedirection_AddDeviceABI(const ContentRedirectionDeviceABI *device, int *resultOut) {
@@ -199,4 +913,106 @@ ContentRedirectionStatus ContentRedirection_RemoveDeviceABI(const char *device_n
     }
 
     return ConvertApiError(sCRRemoveDeviceABI(device_name, resultOut));
-}
\ No newline at end of file
+}
+
+static bool HasModuleMemoryBudget() {
+    return sCRGetMemoryUsage != nullptr && sCRSetMemoryBudget != nullptr && sContentRedirectionVersion >= 6 && sContentRedirectionVersion != CONTENT_REDIRECTION_MODULE_VERSION_ERROR;
+}
+
+/**
+ * Asks the module for its current memory usage. The result is cached, reserving memory for the caches of this lib only
+ * calls this if a reservation doesn't fit with the cached value.
+ */
+static void RefreshModuleMemoryBytes() {
+    ContentRedirectionMemoryUsage usage{};
+    if (HasModuleMemoryBudget() && sCRGetMemoryUsage(&usage, nullptr, 0, nullptr, 0) == CONTENT_REDIRECTION_API_ERROR_NONE) {
+        sModuleMemoryBytes = usage.totalBytes;
+    }
+}
+
+ContentRedirectionStatus ContentRedirection_GetMemoryUsage(ContentRedirectionMemoryUsage *usageOut,
+                                                           ContentRedirectionLayerMemoryUsage *layersOut, uint32_t maxLayers,
+                                                           ContentRedirectionDeviceMemoryUsage *devicesOut, uint32_t maxDevices) {
+    if (sContentRedirectionVersion == CONTENT_REDIRECTION_MODULE_VERSION_ERROR) {
+        return CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED;
+    }
+    if (sCRGetMemoryUsage == nullptr || sContentRedirectionVersion < 6) {
+        return CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND;
+    }
+    if (usageOut == nullptr) {
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
+    if (layersOut == nullptr) {
+        maxLayers = 0;
+    }
+    if (devicesOut == nullptr) {
+        maxDevices = 0;
+    }
+
+    auto res = ConvertApiError(sCRGetMemoryUsage(usageOut, layersOut, maxLayers, devicesOut, maxDevices));
+    if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+        return res;
+    }
+    sModuleMemoryBytes     = usageOut->totalBytes;
+    usageOut->libraryBytes = sLibraryMemoryBytes;
+    for (uint32_t i = 0; i < std::min(maxLayers, usageOut->numLayers); i++) {
+        layersOut[i].handle = LayerRegistry::FromModuleHandle(layersOut[i].handle);
+    }
+    return CONTENT_REDIRECTION_RESULT_SUCCESS;
+}
+
+ContentRedirectionStatus ContentRedirection_SetMemoryBudget(uint32_t budgetBytes, ContentRedirectionMemoryBudgetPolicy policy) {
+    if (sContentRedirectionVersion == CONTENT_REDIRECTION_MODULE_VERSION_ERROR) {
+        return CONTENT_REDIRECTION_RESULT_LIB_UNINITIALIZED;
+    }
+    if (policy != CONTENT_REDIRECTION_MEMORY_BUDGET_POLICY_EVICT_CACHES && policy != CONTENT_REDIRECTION_MEMORY_BUDGET_POLICY_REFUSE_NEW_LAYERS) {
+        return CONTENT_REDIRECTION_RESULT_INVALID_ARGUMENT;
+    }
+
+    if (!HasModuleMemoryBudget()) {
+        return CONTENT_REDIRECTION_RESULT_UNSUPPORTED_COMMAND;
+    }
+    const auto res = ConvertApiError(sCRSetMemoryBudget(budgetBytes, policy));
+    if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+        return res;
+    }
+    // The module may have evicted caches to fit into the new budget.
+    RefreshModuleMemoryBytes();
+    sLibraryMemoryBudget = budgetBytes;
+    return CONTENT_REDIRECTION_RESULT_SUCCESS;
+}
+
+bool ContentRedirection_ReserveLibraryMemory(uint32_t size) {
+    const uint32_t budget = sLibraryMemoryBudget;
+    if (budget == 0) {
+        sLibraryMemoryBytes += size;
+        return true;
+    }
+
+    // The module is only asked again if the reservation doesn't fit, its caches may have been evicted in the meantime.
+    for (bool refreshed = false;; refreshed = true) {
+        const uint32_t moduleBytes = sModuleMemoryBytes;
+        uint32_t current           = sLibraryMemoryBytes;
+        while (static_cast<uint64_t>(moduleBytes) + current + size <= budget) {
+            if (sLibraryMemoryBytes.compare_exchange_weak(current, current + size)) {
+                return true;
+            }
+        }
+        if (refreshed) {
+            return false;
+        }
+        RefreshModuleMemoryBytes();
+    }
+}
+
+void ContentRedirection_ReleaseLibraryMemory(uint32_t size) {
+    sLibraryMemoryBytes -= size;
+}
+
+bool CR_DevoptabWrapper::internal::ReserveLibraryMemory(uint32_t size) {
+    return ContentRedirection_ReserveLibraryMemory(size);
+}
+
+void CR_DevoptabWrapper::internal::ReleaseLibraryMemory(uint32_t size) {
+    ContentRedirection_ReleaseLibraryMemory(size);
+}
@@ -0,0 +1,391 @@
+#include "virtual_file_device.h"
+#include "content_redirection/devoptab_backend.h"
+#include "content_redirection/io_scheduler.h"
+#include "library_memory.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+
+using CR_DevoptabWrapper::Backend;
+using CR_DevoptabWrapper::ForegroundIO;
+
+namespace {
+    constexpr const char *DEVICE_NAME = "crvirtual";
+    constexpr int WRITE_ACCESS_FLAGS  = O_WRONLY | O_RDWR | O_CREAT | O_TRUNC | O_APPEND;
+
+    struct Entry {
+        VirtualFileDevice::Loader loader;
+        std::shared_ptr<const VirtualFile> file;
+    };
+
+    /**
+     * Source file of an open virtual file. Opened on the first read. "pos" is the current offset of the file, -1 if it's unknown,
+     * so sequential reads don't need a seek per call.
+     */
+    struct SourceFile {
+        std::unique_ptr<char[]> fileStruct;
+        int64_t pos = -1;
+        bool open   = false;
+    };
+
+    struct OpenFile {
+        std::shared_ptr<const VirtualFile> file;
+        std::vector<SourceFile> sources;
+        uint64_t pos = 0;
+    };
+
+    struct OpenFileHandle {
+        OpenFile *file;
+    };
+
+    std::mutex sMutex;
+    std::unordered_map<uint32_t, Entry> sFiles;
+    uint32_t sNextId  = 1;
+    bool sDeviceAdded = false;
+    ContentRedirectionDeviceABI sDevice{};
+
+    std::shared_ptr<const VirtualFile> FindFile(const char *path) {
+        const char *separator = strchr(path, ':');
+        const char *rel       = separator ? separator + 1 : path;
+        while (*rel == '/') {
+            rel++;
+        }
+        char *end         = nullptr;
+        const uint32_t id = strtoul(rel, &end, 10);
+        if (end == rel || *end != '\0') {
+            return nullptr;
+        }
+        std::lock_guard lock(sMutex);
+        auto it = sFiles.find(id);
+        return it != sFiles.end() ? it->second.file : nullptr;
+    }
+
+    int OpenSource(const VirtualFile &file, uint32_t index, SourceFile &source) {
+        const devoptab_t *dev = file.sourceDevs[index];
+        source.fileStruct.reset(new (std::nothrow) char[dev->structSize + 1]);
+        if (!source.fileStruct) {
+            return -ENOMEM;
+        }
+        const int res = Backend::open(dev, source.fileStruct.get(), file.sources[index].c_str(), O_RDONLY, 0);
+        if (res < 0) {
+            return res;
+        }
+        source.pos  = 0;
+        source.open = true;
+        return 0;
+    }
+
+    /**
+     * Reads exactly "len" bytes at "offset" of a source, a file that is shorter than expected is reported as -EIO.
+     */
+    int ReadSourceAt(const VirtualFile &file, uint32_t index, SourceFile &source, uint64_t offset, char *ptr, size_t len) {
+        if (!source.open) {
+            const int res = OpenSource(file, index, source);
+            if (res < 0) {
+                return res;
+            }
+        }
+        const devoptab_t *dev = file.sourceDevs[index];
+        if (source.pos != static_cast<int64_t>(offset)) {
+            const int64_t res = Backend::seek(dev, source.fileStruct.get(), static_cast<int64_t>(offset), SEEK_SET);
+            if (res < 0) {
+                source.pos = -1;
+                return static_cast<int>(res);
+            }
+            source.pos = static_cast<int64_t>(offset);
+        }
+        while (len > 0) {
+            const ssize_t res = Backend::read(dev, source.fileStruct.get(), ptr, len);
+            if (res <= 0) {
+                source.pos = -1;
+                return res < 0 ? static_cast<int>(res) : -EIO;
+            }
+            source.pos += res;
+            ptr += res;
+            len -= res;
+        }
+        return 0;
+    }
+
+    ContentRedirectionStatus Load(const VirtualFileDevice::Loader &loader, std::shared_ptr<const VirtualFile> &out) {
+        auto file = std::make_shared<VirtualFile>();
+        auto res  = loader(*file);
+        if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+            return res;
+        }
+
+        uint32_t size = file->segments.size() * sizeof(VirtualFileSegment) + file->memory.size();
+        for (const auto &source : file->sources) {
+            size += source.size() + 1;
+        }
+        // The loader reserves its big buffers up front, some of them are only needed while loading, e.g. the extent table of a patch.
+        if (size > file->reservedBytes) {
+            if (!file->Reserve(size - file->reservedBytes)) {
+                return CONTENT_REDIRECTION_RESULT_NO_MEMORY;
+            }
+        } else {
+            ContentRedirection_ReleaseLibraryMemory(file->reservedBytes - size);
+            file->reservedBytes = size;
+        }
+
+        // Virtual files are read-only.
+        file->stat.mode   = file->stat.mode & ~0222;
+        file->stat.size   = static_cast<int64_t>(file->size());
+        file->stat.blocks = (file->stat.size + 511) / 512;
+        out               = std::move(file);
+        return CONTENT_REDIRECTION_RESULT_SUCCESS;
+    }
+
+    OpenFile *GetFile(void *fd) {
+        return static_cast<OpenFileHandle *>(fd)->file;
+    }
+
+    int virtual_open(void *, void *fileStruct, const char *path, int flags, uint32_t) {
+        if ((flags & WRITE_ACCESS_FLAGS) != 0) {
+            return -EROFS;
+        }
+        auto file = FindFile(path);
+        if (file == nullptr) {
+            return -ENOENT;
+        }
+        auto *openFile = new (std::nothrow) OpenFile();
+        if (openFile == nullptr) {
+            return -ENOMEM;
+        }
+        openFile->sources.resize(file->sources.size());
+        openFile->file                                  = std::move(file);
+        static_cast<OpenFileHandle *>(fileStruct)->file = openFile;
+        return 0;
+    }
+
+    int virtual_close(void *, void *fd) {
+        auto *file = GetFile(fd);
+        for (uint32_t i = 0; i < file->sources.size(); i++) {
+            if (file->sources[i].open) {
+                Backend::close(file->file->sourceDevs[i], file->sources[i].fileStruct.get());
+            }
+        }
+        delete file;
+        return 0;
+    }
+
+    ssize_t virtual_read(void *, void *fd, char *ptr, size_t len) {
+        auto *file              = GetFile(fd);
+        const auto &virtualFile = *file->file;
+        const uint64_t size     = virtualFile.size();
+        if (file->pos >= size) {
+            return 0;
+        }
+        len = std::min<uint64_t>(len, size - file->pos);
+
+        ForegroundIO io;
+        size_t done  = 0;
+        auto segment = std::upper_bound(virtualFile.segments.begin(), virtualFile.segments.end(), file->pos,
+                                        [](uint64_t value, const VirtualFileSegment &cur) { return value < cur.end(); });
+        for (; done < len; ++segment) {
+            const uint64_t pos          = file->pos + done;
+            const uint64_t sourceOffset = segment->sourceOffset + (pos - segment->offset);
+            const size_t chunk          = std::min<uint64_t>(len - done, segment->end() - pos);
+            int res                     = 0;
+            if (segment->source == VIRTUAL_FILE_SOURCE_ZERO) {
+                memset(ptr + done, 0, chunk);
+            } else if (segment->source == VIRTUAL_FILE_SOURCE_MEMORY) {
+                memcpy(ptr + done, virtualFile.memory.data() + sourceOffset, chunk);
+            } else {
+                res = ReadSourceAt(virtualFile, segment->source, file->sources[segment->source], sourceOffset, ptr + done, chunk);
+            }
+            if (res < 0) {
+                if (done > 0) {
+                    break;
+                }
+                return res;
+            }
+            done += chunk;
+        }
+        file->pos += done;
+        io.bytes = static_cast<uint32_t>(done);
+        return static_cast<ssize_t>(done);
+    }
+
+    int64_t virtual_seek(void *, void *fd, int64_t pos, int dir) {
+        auto *file = GetFile(fd);
+        int64_t base;
+        switch (dir) {
+            case SEEK_SET:
+                base = 0;
+                break;
+            case SEEK_CUR:
+                base = static_cast<int64_t>(file->pos);
+                break;
+            case SEEK_END:
+                base = static_cast<int64_t>(file->file->size());
+                break;
+            default:
+                return -EINVAL;
+        }
+        if (base + pos < 0) {
+            return -EINVAL;
+        }
+        file->pos = static_cast<uint64_t>(base + pos);
+        return base + pos;
+    }
+
+    int virtual_fstat(void *, void *fd, CR_Stat *st) {
+        *st = GetFile(fd)->file->stat;
+        return 0;
+    }
+
+    int virtual_stat(void *, const char *path, CR_Stat *st) {
+        auto file = FindFile(path);
+        if (file == nullptr) {
+            return -ENOENT;
+        }
+        *st = file->stat;
+        return 0;
+    }
+
+    ContentRedirectionStatus AddDeviceToModule() {
+        if (sDeviceAdded) {
+            return CONTENT_REDIRECTION_RESULT_SUCCESS;
+        }
+        sDevice.magic      = CONTENT_REDIRECTION_DEVICE_MAGIC;
+        sDevice.version    = 1; // Only uses entries of version 1
+        sDevice.name       = DEVICE_NAME;
+        sDevice.structSize = sizeof(OpenFileHandle);
+        sDevice.open       = virtual_open;
+        sDevice.close      = virtual_close;
+        sDevice.read       = virtual_read;
+        sDevice.seek       = virtual_seek;
+        sDevice.fstat      = virtual_fstat;
+        sDevice.stat       = virtual_stat;
+        sDevice.lstat      = virtual_stat;
+
+        int result = 0;
+        auto res   = ContentRedirection_AddDeviceABI(&sDevice, &result);
+        if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+            return res;
+        }
+        if (result < 0) {
+            DEBUG_FUNCTION_LINE_ERR("Failed to add device \"%s\": %d", DEVICE_NAME, result);
+            return CONTENT_REDIRECTION_RESULT_UNKNOWN_ERROR;
+        }
+        sDeviceAdded = true;
+        return CONTENT_REDIRECTION_RESULT_SUCCESS;
+    }
+} // namespace
+
+VirtualFile::~VirtualFile() {
+    if (reservedBytes != 0) {
+        ContentRedirection_ReleaseLibraryMemory(reservedBytes);
+    }
+}
+
+bool VirtualFile::Reserve(uint32_t size) {
+    if (!ContentRedirection_ReserveLibraryMemory(size)) {
+        return false;
+    }
+    reservedBytes += size;
+    return true;
+}
+
+uint32_t VirtualFile::AddSource(const std::string &path) {
+    const devoptab_t *dev = GetDeviceOpTab(path.c_str());
+    if (dev == nullptr || path.find(':') == std::string::npos) {
+        DEBUG_FUNCTION_LINE_ERR("No device found for \"%s\"", path.c_str());
+        return VIRTUAL_FILE_SOURCE_ZERO;
+    }
+    for (uint32_t i = 0; i < sources.size(); i++) {
+        if (sources[i] == path) {
+            return i;
+        }
+    }
+    sources.push_back(path);
+    sourceDevs.push_back(dev);
+    return sources.size() - 1;
+}
+
+void VirtualFile::Append(uint32_t source, uint64_t sourceOffset, uint64_t length) {
+    if (length == 0) {
+        return;
+    }
+    if (!segments.empty()) {
+        auto &last = segments.back();
+        if (last.source == source && (source == VIRTUAL_FILE_SOURCE_ZERO || last.sourceOffset + last.length == sourceOffset)) {
+            last.length += length;
+            return;
+        }
+    }
+    segments.push_back({size(), length, sourceOffset, source});
+}
+
+namespace VirtualFileDevice {
+    ContentRedirectionStatus Add(Loader loader, uint32_t &idOut, std::string &pathOut) {
+        std::shared_ptr<const VirtualFile> file;
+        auto res = Load(loader, file);
+        if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+            return res;
+        }
+
+        std::lock_guard lock(sMutex);
+        res = AddDeviceToModule();
+        if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+            return res;
+        }
+        const uint32_t id = sNextId++;
+        sFiles[id]        = {std::move(loader), std::move(file)};
+        idOut             = id;
+        pathOut           = std::string(DEVICE_NAME) + ":/" + std::to_string(id);
+        return CONTENT_REDIRECTION_RESULT_SUCCESS;
+    }
+
+    ContentRedirectionStatus Reload(uint32_t id) {
+        Loader loader;
+        {
+            std::lock_guard lock(sMutex);
+            auto it = sFiles.find(id);
+            if (it == sFiles.end()) {
+                return CONTENT_REDIRECTION_RESULT_LAYER_NOT_FOUND;
+            }
+            loader = it->second.loader;
+        }
+
+        std::shared_ptr<const VirtualFile> file;
+        auto res = Load(loader, file);
+        if (res != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+            return res;
+        }
+
+        std::lock_guard lock(sMutex);
+        auto it = sFiles.find(id);
+        if (it == sFiles.end()) {
+            return CONTENT_REDIRECTION_RESULT_LAYER_NOT_FOUND;
+        }
+        it->second.file = std::move(file);
+        return CONTENT_REDIRECTION_RESULT_SUCCESS;
+    }
+
+    void Remove(uint32_t id) {
+        std::lock_guard lock(sMutex);
+        sFiles.erase(id);
+    }
+
+    int ReadRange(const std::string &path, uint64_t offset, void *buffer, size_t len) {
+        VirtualFile file;
+        if (file.AddSource(path) != 0) {
+            return -ENODEV;
+        }
+        SourceFile source;
+        const int res = ReadSourceAt(file, 0, source, offset, static_cast<char *>(buffer), len);
+        if (source.open) {
+            Backend::close(file.sourceDevs[0], source.fileStruct.get());
+        }
+        return res;
+    }
+} // namespace VirtualFileDevice
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "content_redirection/redirection.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <sys/iosupport.h>
+#include <vector>
+
+constexpr uint32_t VIRTUAL_FILE_SOURCE_MEMORY = 0xFFFFFFFE; /**< The segment is read from "VirtualFile::memory" */
+constexpr uint32_t VIRTUAL_FILE_SOURCE_ZERO   = 0xFFFFFFFF; /**< The segment reads as 0 */
+
+/**
+ * Range of a virtual file whose bytes are taken from one source.
+ */
+struct VirtualFileSegment {
+    uint64_t offset;       /**< Offset in the virtual file */
+    uint64_t length;       /**< Length in bytes */
+    uint64_t sourceOffset; /**< Offset in the source, or in "VirtualFile::memory" */
+    uint32_t source;       /**< Index into "VirtualFile::sources", VIRTUAL_FILE_SOURCE_MEMORY or VIRTUAL_FILE_SOURCE_ZERO */
+
+    uint64_t end() const {
+        return offset + length;
+    }
+};
+
+/**
+ * Read-only file that is stitched together from ranges of other files, e.g. an original file plus a patch.
+ * The segments are sorted by offset and cover the whole file without gaps, so the segment which contains an offset is found via binary search.
+ */
+struct VirtualFile {
+    VirtualFile() = default;
+    ~VirtualFile();
+
+    VirtualFile(const VirtualFile &)            = delete;
+    VirtualFile &operator=(const VirtualFile &) = delete;
+
+    std::vector<std::string> sources;           /**< Paths of the source files on registered newlib devices */
+    std::vector<const devoptab_t *> sourceDevs; /**< Device of every source */
+    std::vector<uint8_t> memory;                /**< Bytes of segments that don't come from a file, e.g. a rebuilt header */
+    std::vector<VirtualFileSegment> segments;   /**< Sorted by offset, without gaps */
+    CR_Stat stat{};                             /**< Returned by stat and fstat, "size" is the size of the virtual file */
+    uint32_t reservedBytes = 0;                 /**< Memory reserved via "ContentRedirection_ReserveLibraryMemory" */
+
+    /**
+     * Adds a source file and returns its index, or VIRTUAL_FILE_SOURCE_ZERO if the path doesn't belong to a registered device.
+     */
+    uint32_t AddSource(const std::string &path);
+
+    /**
+     * Reserves memory of the budget before the loader allocates it, e.g. for the segments. Released when the file is destroyed.
+     * Returns false if it doesn't fit into the budget.
+     */
+    bool Reserve(uint32_t size);
+
+    /**
+     * Appends a range to the end of the file. Merged with the last segment if it continues the same range of the same source.
+     */
+    void Append(uint32_t source, uint64_t sourceOffset, uint64_t length);
+
+    uint64_t size() const {
+        return segments.empty() ? 0 : segments.back().end();
+    }
+};
+
+/**
+ * Read-only device ("crvirtual:") that provides the virtual files of FS_LAYER_TYPE_EX_PATCH_FILE and FS_LAYER_TYPE_EX_ARCHIVE layers.
+ * Every file gets an id, the file is "crvirtual:/<id>" and is used as replacement of a FS_LAYER_TYPE_EX_REPLACE_FILE layer.
+ */
+namespace VirtualFileDevice {
+    /**
+     * Fills a virtual file, e.g. from the original file and a patch. Called again by "Reload".
+     */
+    using Loader = std::function<ContentRedirectionStatus(VirtualFile &out)>;
+
+    /**
+     * Loads a file and adds the device to the module if this is the first file.
+     */
+    ContentRedirectionStatus Add(Loader loader, uint32_t &idOut, std::string &pathOut);
+
+    /**
+     * Loads a file again. Files that are already open keep using the old version.
+     */
+    ContentRedirectionStatus Reload(uint32_t id);
+
+    void Remove(uint32_t id);
+
+    /**
+     * Reads exactly "len" bytes at "offset" of a file on a registered newlib device, e.g. the header of an original file.
+     * Returns 0 or a negative errno, a file that is too short is reported as -EIO.
+     */
+    int ReadRange(const std::string &path, uint64_t offset, void *buffer, size_t len);
+} // namespace VirtualFileDevice
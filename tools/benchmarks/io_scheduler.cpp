@@ -0,0 +1,170 @@
+/**
+ * Host benchmark for the I/O scheduler, see "ContentRedirection_SetIOSchedulerConfig".
+ * A latency device with the SD card profile serves one call at a time. The "game" reads random chunks of a file through the
+ * devoptab wrapper, which issues them as foreground requests. Meanwhile a second thread reads another file in large chunks as
+ * background requests, like the promotion of the tiered device or the change detection. The foreground latency reported by
+ * "ContentRedirection_GetIOSchedulerStats" is compared without background work, with an unthrottled background thread and with
+ * the default share of the scheduler. The delays are real, so the numbers depend on the timer resolution of the host.
+ *
+ * Build: g++ -std=gnu++17 -O2 -Itools/host/include -Itools/host -Isource -Iinclude -o crschedulerbench tools/benchmarks/io_scheduler.cpp \
+ *            tools/host/host_support.cpp tools/host/posix_devoptab.cpp source/[a-z]*.cpp -lpthread
+ *
+ * Usage:
+ *   crschedulerbench <hostDir>
+ */
+#include "posix_devoptab.h"
+
+#include <atomic>
+#include <chrono>
+#include <content_redirection/devoptab_backend.h>
+#include <content_redirection/io_scheduler.h>
+#include <content_redirection/latency_device.h>
+#include <content_redirection/redirection.h>
+#include <cstddef>
+#include <cstdio>
+#include <fcntl.h>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using CR_DevoptabWrapper::Backend;
+
+namespace {
+    constexpr uint32_t GAME_FILE_SIZE  = 4 * 1024 * 1024;
+    constexpr uint32_t BULK_FILE_SIZE  = 8 * 1024 * 1024;
+    constexpr uint32_t GAME_READ_SIZE  = 16 * 1024;
+    constexpr uint32_t BULK_READ_SIZE  = 128 * 1024;
+    constexpr uint32_t GAME_READS      = 300;
+    constexpr uint32_t GAME_THINK_US   = 2000;
+    constexpr const char *GAME_FILE    = "crscheduler-game.bin";
+    constexpr const char *BULK_FILE    = "crscheduler-bulk.bin";
+    constexpr const char *DEVICE_NAME  = "slow";
+    constexpr const char *GAME_PATH    = "slow:/crscheduler-game.bin";
+    constexpr const char *BULK_PATH    = "slow:/crscheduler-bulk.bin";
+    constexpr uint32_t DEFAULT_SHARE   = 10;
+    constexpr uint32_t DEFAULT_IDLE_MS = 50;
+
+    bool CreateFile(const std::string &path, uint32_t size) {
+        FILE *file = fopen(path.c_str(), "wb");
+        if (file == nullptr) {
+            return false;
+        }
+        std::vector<char> data(size, 0x5A);
+        const bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+        return fclose(file) == 0 && ok;
+    }
+
+    /**
+     * Reads random chunks of the game file through the wrapper, with a short pause after each read like a game processing the data.
+     */
+    bool RunGame(const ContentRedirectionDeviceABI *abi) {
+        // The wrapper only exports alloc_file_struct with useSlabPool, the module allocates "structSize" bytes otherwise.
+        std::vector<std::max_align_t> fileStruct((abi->structSize + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t) + 1);
+        void *fd = fileStruct.data();
+        if (abi->open(abi->deviceData, fd, GAME_PATH, O_RDONLY, 0) < 0) {
+            return false;
+        }
+        std::mt19937 rng(1);
+        std::vector<char> buffer(GAME_READ_SIZE);
+        bool ok = true;
+        for (uint32_t i = 0; ok && i < GAME_READS; i++) {
+            const int64_t offset = (rng() % (GAME_FILE_SIZE / GAME_READ_SIZE)) * GAME_READ_SIZE;
+            ok                   = abi->seek(abi->deviceData, fd, offset, SEEK_SET) == offset &&
+                 abi->read(abi->deviceData, fd, buffer.data(), buffer.size()) == static_cast<ssize_t>(buffer.size());
+            std::this_thread::sleep_for(std::chrono::microseconds(GAME_THINK_US));
+        }
+        return abi->close(abi->deviceData, fd) >= 0 && ok;
+    }
+
+    /**
+     * Reads the bulk file over and over in large chunks as background requests until "stop" is set.
+     */
+    void RunBackground(const devoptab_t *device, const std::atomic<bool> *stop) {
+        std::vector<std::max_align_t> fileStruct(device->structSize / sizeof(std::max_align_t) + 1);
+        void *fd = fileStruct.data();
+        if (Backend::open(device, fd, BULK_PATH, O_RDONLY, 0) < 0) {
+            return;
+        }
+        std::vector<char> buffer(BULK_READ_SIZE);
+        while (!stop->load()) {
+            CR_DevoptabWrapper::BackgroundIO io;
+            ssize_t res = Backend::read(device, fd, buffer.data(), buffer.size());
+            if (res == 0) {
+                Backend::seek(device, fd, 0, SEEK_SET);
+            } else if (res < 0) {
+                break;
+            }
+            io.bytes = res > 0 ? static_cast<uint32_t>(res) : 0;
+        }
+        Backend::close(device, fd);
+    }
+
+    bool Run(const char *name, const ContentRedirectionDeviceABI *abi, const devoptab_t *device, bool background, uint32_t share) {
+        ContentRedirectionIOSchedulerConfig config{};
+        config.backgroundShare  = share;
+        config.foregroundIdleMs = DEFAULT_IDLE_MS;
+        ContentRedirection_SetIOSchedulerConfig(&config);
+        ContentRedirection_ResetIOSchedulerStats();
+
+        std::atomic<bool> stop = false;
+        std::thread backgroundThread;
+        if (background) {
+            backgroundThread = std::thread(RunBackground, device, &stop);
+        }
+        const bool ok = RunGame(abi);
+        stop          = true;
+        if (backgroundThread.joinable()) {
+            backgroundThread.join();
+        }
+
+        ContentRedirectionIOClassStats foreground{};
+        ContentRedirectionIOClassStats backgroundStats{};
+        ContentRedirection_GetIOSchedulerStats(&foreground, &backgroundStats);
+        printf("%-36s foreground p50 %6u us, p99 %6u us, max %6u us | background %5.1f MiB, waited %6.0f ms\n", name,
+               foreground.p50Us, foreground.p99Us, foreground.maxUs, backgroundStats.bytes / (1024.0 * 1024.0), backgroundStats.waitUs / 1000.0);
+        return ok;
+    }
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage:\n"
+                        "  %s <hostDir>\n"
+                        "      Creates <hostDir>/%s and <hostDir>/%s and reads them through a latency device.\n",
+                argv[0], GAME_FILE, BULK_FILE);
+        return 1;
+    }
+    const std::string hostDir = argv[1];
+    if (CreatePosixDevoptab("host", argv[1]) == nullptr || !CreateFile(hostDir + "/" + GAME_FILE, GAME_FILE_SIZE) ||
+        !CreateFile(hostDir + "/" + BULK_FILE, BULK_FILE_SIZE)) {
+        return 1;
+    }
+
+    ContentRedirectionLatencyDeviceConfig config{};
+    config.name           = DEVICE_NAME;
+    config.basePath       = "host:/";
+    config.seed           = 1;
+    config.serializeCalls = true;
+    const devoptab_t *device;
+    if (ContentRedirection_GetLatencyProfile(CONTENT_REDIRECTION_LATENCY_PROFILE_SD, &config.profile) != CONTENT_REDIRECTION_RESULT_SUCCESS ||
+        ContentRedirection_CreateLatencyDevice(&config, &device) != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+        return 1;
+    }
+    const auto *abi = CR_DevoptabWrapper::RuntimeSlot<0>::bind(device, {});
+
+    printf("%u random %u KiB reads with %u us pauses, background reads of %u KiB, SD card profile\n", GAME_READS, GAME_READ_SIZE / 1024,
+           GAME_THINK_US, BULK_READ_SIZE / 1024);
+    bool ok = Run("background off", abi, device, false, DEFAULT_SHARE);
+    ok      = Run("background on, share 100%", abi, device, true, 100) && ok;
+    ok      = Run("background on, share 10% (default)", abi, device, true, DEFAULT_SHARE) && ok;
+
+    ContentRedirectionIOSchedulerConfig defaults{};
+    defaults.backgroundShare  = DEFAULT_SHARE;
+    defaults.foregroundIdleMs = DEFAULT_IDLE_MS;
+    ContentRedirection_SetIOSchedulerConfig(&defaults);
+    ContentRedirection_DestroyLatencyDevice(device);
+    // Stops the readahead thread of the lib.
+    ContentRedirection_DeInitLibrary();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+/**
+ * Host runner for the latency-injecting device of "ContentRedirection_CreateLatencyDevice".
+ * A latency device with each built-in profile is stacked on a POSIX devoptab of a host directory and wrapped via the devoptab wrapper.
+ * The conformance suite of the device test kit checks that every call is forwarded correctly, the performance profile adds a
+ * typical workload. The delays are only simulated, the reported time is the sum of the injected delays.
+ *
+ * Build: g++ -std=gnu++17 -O2 -Itools/host/include -Itools/host -Isource -Iinclude -o crlatencybench tools/benchmarks/latency_device.cpp \
+ *            tools/host/host_support.cpp tools/host/posix_devoptab.cpp source/[a-z]*.cpp -lpthread
+ *
+ * Usage:
+ *   crlatencybench <hostDir>
+ */
+#include "posix_devoptab.h"
+
+#include <content_redirection/device_test_kit.h>
+#include <content_redirection/latency_device.h>
+#include <content_redirection/redirection.h>
+#include <cstdio>
+#include <string>
+
+namespace {
+    struct Profile {
+        const char *name;
+        ContentRedirectionLatencyProfileType type;
+    };
+
+    void PrintLine(void *, const char *line) {
+        // Only the summary lines matter here, the details are printed by the device test kit runners.
+        if (std::string(line).find("result") != std::string::npos) {
+            printf("  %s\n", line);
+        }
+    }
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage:\n"
+                        "  %s <hostDir>\n"
+                        "      Runs the device test kit against latency devices on <hostDir>, the scratch directories <hostDir>/crlatency-* must not exist.\n",
+                argv[0]);
+        return 1;
+    }
+    if (CreatePosixDevoptab("host", argv[1]) == nullptr) {
+        return 1;
+    }
+
+    const Profile profiles[] = {
+            {"none", CONTENT_REDIRECTION_LATENCY_PROFILE_NONE},
+            {"sd", CONTENT_REDIRECTION_LATENCY_PROFILE_SD},
+            {"usb", CONTENT_REDIRECTION_LATENCY_PROFILE_USB},
+    };
+    uint32_t failed = 0;
+    for (const auto &profile : profiles) {
+        ContentRedirectionLatencyDeviceConfig config{};
+        config.name         = "slow";
+        config.basePath     = "host:/";
+        config.seed         = 1;
+        config.simulateOnly = true;
+        if (ContentRedirection_GetLatencyProfile(profile.type, &config.profile) != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+            return 1;
+        }
+        const devoptab_t *device = nullptr;
+        if (ContentRedirection_CreateLatencyDevice(&config, &device) != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+            return 1;
+        }
+
+        printf("%s\n", profile.name);
+        const std::string scratchDir = std::string("slow:/crlatency-") + profile.name;
+
+        ContentRedirectionDeviceTestConfig testConfig{};
+        testConfig.scratchDir = scratchDir.c_str();
+        testConfig.print      = PrintLine;
+
+        const auto *abi = CR_DevoptabWrapper::RuntimeSlot<0>::bind(device, {});
+        ContentRedirectionDeviceConformanceResult result{};
+        if (ContentRedirection_RunDeviceConformanceTests(abi, &testConfig, &result) != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+            return 1;
+        }
+        failed += result.failed;
+
+        ContentRedirectionLatencyDeviceStats stats{};
+        ContentRedirection_GetLatencyDeviceStats(device, &stats, true);
+        ContentRedirectionDevicePerfResult perf{};
+        if (ContentRedirection_RunDevicePerformanceProfile(abi, &testConfig, &perf) != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+            return 1;
+        }
+        ContentRedirection_GetLatencyDeviceStats(device, &stats, false);
+        printf("  performance profile: %llu ops, %llu seeks, %llu bytes read, %llu bytes written, %.1f ms simulated\n",
+               (unsigned long long) stats.ops, (unsigned long long) stats.seeks, (unsigned long long) stats.bytesRead,
+               (unsigned long long) stats.bytesWritten, stats.simulatedUs / 1000.0);
+
+        ContentRedirection_DestroyLatencyDevice(device);
+    }
+    // Stops the readahead thread of the lib.
+    ContentRedirection_DeInitLibrary();
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,113 @@
+/**
+ * Host benchmark for the layer filters of "ContentRedirection_SetLayerFilter", see include/content_redirection/layer_filter.h.
+ * Simulates a stack of merge layers with disjoint files. A lookup stats the layers from top to bottom until one has the path.
+ * With filters, layers whose filter rules the path out are skipped. Half of the lookups hit a layer, the other half miss all of them.
+ *
+ * Build: g++ -std=gnu++17 -O2 -Itools/host/include -Isource -Iinclude -o crfilterbench tools/benchmarks/layer_filter.cpp \
+ *            source/layer_filter_builder.cpp
+ *
+ * Usage:
+ *   crfilterbench [layers] [filesPerLayer] [lookups]
+ */
+#include "layer_filter_builder.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    struct Layer {
+        DirSnapshot snapshot;
+        std::vector<uint32_t> blocks;
+        ContentRedirectionLayerFilter filter{};
+    };
+
+    std::string MakePath(uint32_t layer, uint32_t file) {
+        return "/content/Layer" + std::to_string(layer) + "/Dir" + std::to_string(file % 64) + "/File" + std::to_string(file) + ".bin";
+    }
+
+    void Run(std::vector<Layer> &layers, const std::vector<std::string> &lookups, const std::vector<int> &owners, float falsePositiveRate) {
+        uint64_t filterBytes = 0;
+        for (auto &layer : layers) {
+            LayerFilterBuilder::Build(layer.snapshot, falsePositiveRate, layer.blocks, layer.filter);
+            filterBytes += layer.blocks.size() * sizeof(uint32_t);
+        }
+
+        uint64_t statsWithout = 0;
+        uint64_t statsWith    = 0;
+        uint64_t probes       = 0;
+        uint64_t falseHits    = 0;
+        const auto start      = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < lookups.size(); i++) {
+            const int owner = owners[i];
+            for (int l = 0; l < static_cast<int>(layers.size()); l++) {
+                statsWithout++;
+                if (l == owner) {
+                    break;
+                }
+            }
+            for (int l = 0; l < static_cast<int>(layers.size()); l++) {
+                const bool mayContain = ContentRedirection_LayerFilterMayContain(&layers[l].filter, lookups[i].c_str());
+                if (l != owner) {
+                    probes++;
+                    falseHits += mayContain;
+                }
+                if (mayContain) {
+                    statsWith++;
+                }
+                if (l == owner) {
+                    break;
+                }
+            }
+        }
+        const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        const size_t entries = layers.size() * layers[0].snapshot.size();
+        printf("target FP %.2f%%: %.1f bits/entry, stat calls %llu -> %llu, measured FP %.2f%%, %.0f ns/lookup\n",
+               falsePositiveRate * 100, filterBytes * 8.0 / entries, (unsigned long long) statsWithout, (unsigned long long) statsWith,
+               probes ? falseHits * 100.0 / probes : 0.0, elapsed / lookups.size());
+    }
+} // namespace
+
+int main(int argc, char **argv) {
+    const uint32_t numLayers     = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10;
+    const uint32_t filesPerLayer = argc > 2 ? strtoul(argv[2], nullptr, 10) : 2000;
+    const uint32_t numLookups    = argc > 3 ? strtoul(argv[3], nullptr, 10) : 20000;
+    if (numLayers == 0 || filesPerLayer == 0 || numLookups == 0) {
+        fprintf(stderr, "Usage:\n"
+                        "  %s [layers] [filesPerLayer] [lookups]\n",
+                argv[0]);
+        return 1;
+    }
+
+    std::vector<Layer> layers(numLayers);
+    for (uint32_t l = 0; l < numLayers; l++) {
+        for (uint32_t f = 0; f < filesPerLayer; f++) {
+            layers[l].snapshot[MakePath(l, f)] = {};
+        }
+    }
+
+    std::mt19937 rng(1);
+    std::vector<std::string> lookups;
+    std::vector<int> owners;
+    for (uint32_t i = 0; i < numLookups; i++) {
+        const uint32_t layer = rng() % numLayers;
+        if (i % 2 == 0) {
+            lookups.push_back(MakePath(layer, rng() % filesPerLayer));
+            owners.push_back(static_cast<int>(layer));
+        } else {
+            // Same directories, but files no layer has.
+            lookups.push_back(MakePath(layer, filesPerLayer + rng() % filesPerLayer));
+            owners.push_back(-1);
+        }
+    }
+
+    printf("%u layers with %u files, %u lookups\n", numLayers, filesPerLayer, numLookups);
+    for (const float rate : {0.01f, 0.001f}) {
+        Run(layers, lookups, owners, rate);
+    }
+    return 0;
+}
@@ -0,0 +1,134 @@
+/**
+ * Host check for the emulated layer priorities, see "ContentRedirection_SetLayerPriorities".
+ * A stand-in module of API version 3 keeps the layers in adding order, like a module without native layer priorities.
+ * Every change of the priorities removes and re-adds layers, the stand-in can be told to fail one of these adds.
+ * A failed re-add has to return the error and leave the module with the layers in their previous order.
+ *
+ * Build: g++ -std=gnu++17 -O2 -Itools/host/include -Itools/host -Isource -Iinclude -o crlayerordertest tools/benchmarks/layer_order.cpp \
+ *            tools/host/host_support.cpp tools/host/posix_devoptab.cpp source/[a-z]*.cpp -lpthread
+ *
+ * Usage:
+ *   crlayerordertest
+ */
+#include "host_module.h"
+
+#include <content_redirection/redirection.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+    struct ModuleLayer {
+        CRLayerHandle handle;
+        std::string name;
+        bool active;
+    };
+
+    std::vector<ModuleLayer> sModuleLayers;
+    CRLayerHandle sNextHandle = 1;
+    /**
+     * Number of adds that succeed before one fails, negative if no add fails.
+     */
+    int32_t sAddsUntilFailure = -1;
+
+    ContentRedirectionApiErrorType ModuleGetVersion(ContentRedirectionVersion *outVersion) {
+        *outVersion = 3;
+        return CONTENT_REDIRECTION_API_ERROR_NONE;
+    }
+
+    ContentRedirectionApiErrorType ModuleAdd(CRLayerHandle *handlePtr, const char *layerName) {
+        if (sAddsUntilFailure == 0) {
+            sAddsUntilFailure = -1;
+            return CONTENT_REDIRECTION_API_ERROR_NO_MEMORY;
+        }
+        if (sAddsUntilFailure > 0) {
+            sAddsUntilFailure--;
+        }
+        *handlePtr = sNextHandle++;
+        sModuleLayers.push_back({*handlePtr, layerName, true});
+        return CONTENT_REDIRECTION_API_ERROR_NONE;
+    }
+
+    ContentRedirectionApiErrorType ModuleAddFSLayer(CRLayerHandle *handlePtr, const char *layerName, const char *, FSLayerType) {
+        return ModuleAdd(handlePtr, layerName);
+    }
+
+    ContentRedirectionApiErrorType ModuleAddFSLayerEx(CRLayerHandle *handlePtr, const char *layerName, const char *, const char *, FSLayerTypeEx) {
+        return ModuleAdd(handlePtr, layerName);
+    }
+
+    ContentRedirectionApiErrorType ModuleRemoveFSLayer(CRLayerHandle handle) {
+        for (auto it = sModuleLayers.begin(); it != sModuleLayers.end(); ++it) {
+            if (it->handle == handle) {
+                sModuleLayers.erase(it);
+                return CONTENT_REDIRECTION_API_ERROR_NONE;
+            }
+        }
+        return CONTENT_REDIRECTION_API_ERROR_LAYER_NOT_FOUND;
+    }
+
+    ContentRedirectionApiErrorType ModuleSetActive(CRLayerHandle handle, bool active) {
+        for (auto &layer : sModuleLayers) {
+            if (layer.handle == handle) {
+                layer.active = active;
+                return CONTENT_REDIRECTION_API_ERROR_NONE;
+            }
+        }
+        return CONTENT_REDIRECTION_API_ERROR_LAYER_NOT_FOUND;
+    }
+
+    /**
+     * Returns the layers of the module in adding order, inactive layers are marked with a "-".
+     */
+    std::string ModuleOrder() {
+        std::string order;
+        for (const auto &layer : sModuleLayers) {
+            order += (order.empty() ? "" : " ") + layer.name + (layer.active ? "" : "-");
+        }
+        return order;
+    }
+
+    bool Check(const char *name, ContentRedirectionStatus res, ContentRedirectionStatus expectedRes, const char *expectedOrder) {
+        const std::string order = ModuleOrder();
+        const bool ok           = res == expectedRes && order == expectedOrder;
+        printf("%-40s %s, module order \"%s\"\n", name, ContentRedirection_GetStatusStr(res), order.c_str());
+        if (!ok) {
+            printf("  FAIL: expected %s, module order \"%s\"\n", ContentRedirection_GetStatusStr(expectedRes), expectedOrder);
+        }
+        return ok;
+    }
+} // namespace
+
+int main() {
+    HostModule_SetExport("CRGetVersion", reinterpret_cast<void *>(ModuleGetVersion));
+    HostModule_SetExport("CRAddFSLayer", reinterpret_cast<void *>(ModuleAddFSLayer));
+    HostModule_SetExport("CRAddFSLayerEx", reinterpret_cast<void *>(ModuleAddFSLayerEx));
+    HostModule_SetExport("CRRemoveFSLayer", reinterpret_cast<void *>(ModuleRemoveFSLayer));
+    HostModule_SetExport("CRSetActive", reinterpret_cast<void *>(ModuleSetActive));
+    if (ContentRedirection_InitLibrary() != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+        return 1;
+    }
+
+    CRLayerHandle a, b, c;
+    auto res = ContentRedirection_AddFSLayerWithPriority(&a, "A", "fs:/vol/external01/A", FS_LAYER_TYPE_CONTENT_MERGE, 0);
+    res      = res == CONTENT_REDIRECTION_RESULT_SUCCESS ? ContentRedirection_AddFSLayerWithPriority(&b, "B", "fs:/vol/external01/B", FS_LAYER_TYPE_CONTENT_MERGE, 10) : res;
+    res      = res == CONTENT_REDIRECTION_RESULT_SUCCESS ? ContentRedirection_AddFSLayerExWithPriority(&c, "C", "/vol/content", "fs:/vol/external01/C", FS_LAYER_TYPE_EX_REPLACE_DIRECTORY, 5) : res;
+    res      = res == CONTENT_REDIRECTION_RESULT_SUCCESS ? ContentRedirection_SetActive(b, false) : res;
+    bool ok  = Check("add A (0), B (10), C (5), disable B", res, CONTENT_REDIRECTION_RESULT_SUCCESS, "A C B-");
+
+    // Moving A to the top re-adds all three layers, the second add fails.
+    sAddsUntilFailure = 1;
+    ok                = Check("raise A to 20, second re-add fails", ContentRedirection_SetLayerPriority(a, 20), CONTENT_REDIRECTION_RESULT_NO_MEMORY, "A C B-") && ok;
+
+    // Without the failure the next change re-orders all layers.
+    ok = Check("lower C to 1", ContentRedirection_SetLayerPriority(c, 1), CONTENT_REDIRECTION_RESULT_SUCCESS, "C B- A") && ok;
+
+    sAddsUntilFailure = 0;
+    ok                = Check("lower B to -1, first re-add fails", ContentRedirection_SetLayerPriority(b, -1), CONTENT_REDIRECTION_RESULT_NO_MEMORY, "C B- A") && ok;
+    ok                = Check("remove C", ContentRedirection_RemoveFSLayer(c), CONTENT_REDIRECTION_RESULT_SUCCESS, "B- A") && ok;
+
+    ContentRedirection_DeInitLibrary();
+    HostModule_Clear();
+    printf("%s\n", ok ? "ok" : "failed");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,299 @@
+/**
+ * Host benchmark for the pattern layers of "ContentRedirection_AddFSLayerPattern", see include/content_redirection/pattern_layer.h.
+ * Measures the lookup cost of the compiled automaton against a linear scan over per-file rules, the compile time of larger rule sets,
+ * how fast a rule set that needs too many states is rejected, and compares the automaton with a backtracking glob matcher on random rules.
+ *
+ * Build: g++ -std=gnu++17 -O2 -Itools/host/include -Isource -Iinclude -o crpatternbench tools/benchmarks/pattern_layer.cpp \
+ *            tools/host/host_support.cpp source/[a-z]*.cpp -lpthread
+ *
+ * Usage:
+ *   crpatternbench
+ */
+#include "pattern_compiler.h"
+
+#include <chrono>
+#include <content_redirection/redirection.h>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <strings.h>
+#include <vector>
+
+namespace {
+    constexpr uint32_t NUM_PATHS      = 5000;
+    constexpr uint32_t LOOKUP_ROUNDS  = 20;
+    constexpr uint32_t FUZZ_RULE_SETS = 3000;
+
+    using Clock = std::chrono::steady_clock;
+
+    double ElapsedNs(Clock::time_point start) {
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    }
+
+    std::vector<std::string> MakePaths() {
+        std::vector<std::string> paths;
+        for (uint32_t i = 0; i < NUM_PATHS; i++) {
+            const char *extension = i % 2 == 0 ? "BFRES" : (i % 4 == 1 ? "bntx" : "sarc");
+            paths.push_back("Model/Dir" + std::to_string(i % 50) + "/Object" + std::to_string(i) + "." + extension);
+        }
+        return paths;
+    }
+
+    /**
+     * Looks up every path and expands the template of the matching rule, like the module does for every open.
+     */
+    double LookupNs(const PatternAutomaton &automaton, const std::vector<std::string> &paths, uint32_t *matchesOut) {
+        char out[256];
+        uint32_t matches = 0;
+        const auto start = Clock::now();
+        for (uint32_t round = 0; round < LOOKUP_ROUNDS; round++) {
+            for (const auto &path : paths) {
+                const uint32_t rule = ContentRedirection_MatchPattern(&automaton.dfa, path.c_str());
+                if (rule != CONTENT_REDIRECTION_PATTERN_NO_MATCH) {
+                    matches += ContentRedirection_ExpandPatternTemplate(automaton.dfa.replacementTemplates[rule], path.c_str(), out, sizeof(out));
+                }
+            }
+        }
+        *matchesOut = matches / LOOKUP_ROUNDS;
+        return ElapsedNs(start) / (LOOKUP_ROUNDS * paths.size());
+    }
+
+    /**
+     * One FS_LAYER_TYPE_EX_REPLACE_FILE layer per file, every lookup compares the path with the target of each layer.
+     */
+    double LinearLookupNs(const std::vector<std::string> &targets, const std::vector<std::string> &paths, uint32_t *matchesOut) {
+        uint32_t matches = 0;
+        const auto start = Clock::now();
+        for (uint32_t round = 0; round < LOOKUP_ROUNDS; round++) {
+            for (const auto &path : paths) {
+                for (const auto &target : targets) {
+                    if (strcasecmp(target.c_str(), path.c_str()) == 0) {
+                        matches++;
+                        break;
+                    }
+                }
+            }
+        }
+        *matchesOut = matches / LOOKUP_ROUNDS;
+        return ElapsedNs(start) / (LOOKUP_ROUNDS * paths.size());
+    }
+
+    char Lower(char c) {
+        return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+    }
+
+    /**
+     * Backtracking matcher with the semantics documented for ContentRedirectionPatternRule, "path" is lower-cased.
+     */
+    bool GlobMatch(const char *p, const char *s) {
+        if (*p == '\0') {
+            return *s == '\0';
+        }
+        if (p[0] == '*' && p[1] == '*') {
+            while (*p == '*') {
+                p++;
+            }
+            if (*p == '/') {
+                // Nothing, or anything that ends with a '/'.
+                if (GlobMatch(p + 1, s)) {
+                    return true;
+                }
+                for (const char *c = s; *c; c++) {
+                    if (*c == '/' && GlobMatch(p + 1, c + 1)) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+            for (const char *c = s;; c++) {
+                if (GlobMatch(p, c)) {
+                    return true;
+                }
+                if (*c == '\0') {
+                    return false;
+                }
+            }
+        }
+        if (*p == '*') {
+            for (const char *c = s;; c++) {
+                if (GlobMatch(p + 1, c)) {
+                    return true;
+                }
+                if (*c == '\0' || *c == '/') {
+                    return false;
+                }
+            }
+        }
+        if (*s == '\0') {
+            return false;
+        }
+        if (*p == '?') {
+            return *s != '/' && GlobMatch(p + 1, s + 1);
+        }
+        if (*p == '[') {
+            p++;
+            const bool negate = *p == '!' || *p == '^';
+            if (negate) {
+                p++;
+            }
+            bool found = false;
+            for (bool first = true; *p != ']' || first; first = false) {
+                const char lo = Lower(*p++);
+                char hi       = lo;
+                if (*p == '-' && p[1] != ']') {
+                    hi = Lower(p[1]);
+                    p += 2;
+                }
+                found |= *s >= lo && *s <= hi;
+            }
+            return *s != '/' && found != negate && GlobMatch(p + 1, s + 1);
+        }
+        if (*p == '\\') {
+            p++;
+        }
+        return Lower(*p) == *s && GlobMatch(p + 1, s + 1);
+    }
+
+    std::string RandomPattern(std::mt19937 &rng) {
+        static const char *const tokens[] = {"a", "b", ".", "/", "*", "**", "**/", "?", "[ab]", "[!a]", "[a-b]", "\\*", "B"};
+        std::string pattern;
+        const uint32_t length = 1 + rng() % 6;
+        for (uint32_t i = 0; i < length; i++) {
+            pattern += tokens[rng() % (sizeof(tokens) / sizeof(tokens[0]))];
+        }
+        return pattern;
+    }
+
+    std::string RandomPath(std::mt19937 &rng) {
+        static const char chars[] = {'a', 'b', 'A', 'B', '.', '/', '*'};
+        std::string path;
+        const uint32_t length = rng() % 9;
+        for (uint32_t i = 0; i < length; i++) {
+            path += chars[rng() % sizeof(chars)];
+        }
+        return path;
+    }
+
+    /**
+     * Returns the number of paths for which the automaton and the backtracking matcher disagree.
+     */
+    uint32_t Fuzz(uint32_t *ruleSetsOut) {
+        std::mt19937 rng(1);
+        uint32_t mismatches = 0;
+        uint32_t ruleSets   = 0;
+        while (ruleSets < FUZZ_RULE_SETS) {
+            std::vector<std::string> patterns(1 + rng() % 4);
+            std::vector<ContentRedirectionPatternRule> rules;
+            for (auto &pattern : patterns) {
+                // A pattern that only consists of '/' is rejected by the compiler.
+                do {
+                    pattern = RandomPattern(rng);
+                } while (pattern.find_first_not_of('/') == std::string::npos);
+                rules.push_back({pattern.c_str(), "{path}"});
+            }
+            PatternAutomaton automaton;
+            if (PatternCompiler::Compile(rules.data(), rules.size(), automaton) != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+                printf("  failed to compile \"%s\"\n", patterns[0].c_str());
+                mismatches++;
+                continue;
+            }
+            ruleSets++;
+            for (uint32_t i = 0; i < 200; i++) {
+                const std::string path = RandomPath(rng);
+                std::string lower;
+                for (const char c : path) {
+                    lower += Lower(c);
+                }
+                uint32_t expected = CONTENT_REDIRECTION_PATTERN_NO_MATCH;
+                for (uint32_t r = 0; r < patterns.size(); r++) {
+                    const char *pattern = patterns[r].c_str();
+                    while (*pattern == '/') {
+                        pattern++;
+                    }
+                    if (GlobMatch(pattern, lower.c_str())) {
+                        expected = r;
+                        break;
+                    }
+                }
+                if (ContentRedirection_MatchPattern(&automaton.dfa, path.c_str()) != expected) {
+                    if (mismatches++ < 10) {
+                        printf("  mismatch: path \"%s\", first pattern \"%s\", expected rule %u\n", path.c_str(), patterns[0].c_str(), expected);
+                    }
+                }
+            }
+        }
+        *ruleSetsOut = ruleSets;
+        return mismatches;
+    }
+} // namespace
+
+int main() {
+    const auto paths = MakePaths();
+    printf("%u paths, %u of them *.bfres\n", NUM_PATHS, NUM_PATHS / 2);
+
+    {
+        const ContentRedirectionPatternRule rule = {"**/*.bfres", "fast:/bfres/{path}"};
+        PatternAutomaton automaton;
+        if (PatternCompiler::Compile(&rule, 1, automaton) != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+            return 1;
+        }
+        uint32_t matches;
+        const double ns = LookupNs(automaton, paths, &matches);
+        printf("one \"**/*.bfres\" rule:        %5.0f ns/lookup, %u matches (%u states, %u byte table)\n",
+               ns, matches, automaton.dfa.numStates, automaton.dfa.numStates * automaton.dfa.numClasses * 2);
+    }
+    {
+        std::vector<std::string> targets;
+        for (const auto &path : paths) {
+            if (path.size() > 6 && strcasecmp(path.c_str() + path.size() - 6, ".bfres") == 0) {
+                targets.push_back(path);
+            }
+        }
+        uint32_t matches;
+        const double ns = LinearLookupNs(targets, paths, &matches);
+        printf("%u per-file rules, linear:  %5.0f ns/lookup, %u matches\n", static_cast<uint32_t>(targets.size()), ns, matches);
+    }
+    {
+        std::vector<std::string> patterns;
+        std::vector<ContentRedirectionPatternRule> rules;
+        for (uint32_t i = 0; i < 200; i++) {
+            patterns.push_back("**/*.ext" + std::to_string(i));
+        }
+        patterns.push_back("**/*.bfres");
+        for (const auto &pattern : patterns) {
+            rules.push_back({pattern.c_str(), "fast:/{name}"});
+        }
+        PatternAutomaton automaton;
+        const auto start = Clock::now();
+        if (PatternCompiler::Compile(rules.data(), rules.size(), automaton) != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+            return 1;
+        }
+        const double compileMs = ElapsedNs(start) / 1e6;
+        uint32_t matches;
+        const double ns = LookupNs(automaton, paths, &matches);
+        printf("%u \"**/*.extN\" rules:          %5.0f ns/lookup, %u matches (%u states, %.0f ms compile)\n",
+               static_cast<uint32_t>(rules.size()), ns, matches, automaton.dfa.numStates, compileMs);
+    }
+
+    // "**/*a" followed by n "?" needs 2^(n+1) states, more than a state id can hold for n >= 15.
+    for (const uint32_t n : {12, 14, 15, 20}) {
+        const std::string pattern = "**/*a" + std::string(n, '?');
+        const ContentRedirectionPatternRule rule = {pattern.c_str(), "{path}"};
+        PatternAutomaton automaton;
+        const auto start = Clock::now();
+        const auto res   = PatternCompiler::Compile(&rule, 1, automaton);
+        printf("\"**/*a\" + %2u \"?\": %s after %.0f ms", n, res == CONTENT_REDIRECTION_RESULT_SUCCESS ? "compiled" : "rejected", ElapsedNs(start) / 1e6);
+        if (res == CONTENT_REDIRECTION_RESULT_SUCCESS) {
+            printf(" (%u states)", automaton.dfa.numStates);
+        }
+        printf("\n");
+    }
+
+    uint32_t ruleSets;
+    const uint32_t mismatches = Fuzz(&ruleSets);
+    printf("fuzzing: %u random rule sets, %u mismatches against a backtracking matcher\n", ruleSets, mismatches);
+
+    // Stops the readahead thread of the lib.
+    ContentRedirection_DeInitLibrary();
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,194 @@
+/**
+ * Host benchmark for the streaming readahead of the devoptab wrapper, see ContentRedirectionDeviceOptions::readAheadBufferSize.
+ * A file on a host directory is read through a latency device that delays every call, once without and once with readahead.
+ * The reader consumes each chunk for a short while, like a game decoding a stream. Afterwards random seeks and short sequential
+ * runs check that readahead never returns wrong data.
+ *
+ * Build: g++ -std=gnu++17 -O2 -Itools/host/include -Itools/host -Isource -Iinclude -o crreadaheadbench tools/benchmarks/read_ahead.cpp \
+ *            tools/host/host_support.cpp tools/host/posix_devoptab.cpp source/[a-z]*.cpp -lpthread
+ * Add -fsanitize=thread to check the readahead thread for data races.
+ *
+ * Usage:
+ *   crreadaheadbench <hostDir>
+ */
+#include "posix_devoptab.h"
+
+#include <chrono>
+#include <content_redirection/latency_device.h>
+#include <content_redirection/read_ahead.h>
+#include <content_redirection/redirection.h>
+#include <cstddef>
+#include <cstdio>
+#include <fcntl.h>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    constexpr uint32_t FILE_SIZE      = 4 * 1024 * 1024;
+    constexpr uint32_t CHUNK_SIZE     = 8 * 1024;
+    constexpr uint32_t DEVICE_US      = 300;
+    constexpr uint32_t CONSUMER_US    = 100;
+    constexpr uint32_t RANDOM_RUNS    = 500;
+    constexpr const char *FILE_NAME   = "crreadahead.bin";
+    constexpr const char *DEVICE_PATH = "slow:/crreadahead.bin";
+
+    uint8_t Pattern(uint64_t offset) {
+        return static_cast<uint8_t>((offset * 2654435761u) >> 13);
+    }
+
+    bool CreateFile(const std::string &path) {
+        FILE *file = fopen(path.c_str(), "wb");
+        if (file == nullptr) {
+            return false;
+        }
+        std::vector<uint8_t> data(FILE_SIZE);
+        for (uint32_t i = 0; i < FILE_SIZE; i++) {
+            data[i] = Pattern(i);
+        }
+        const bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+        return fclose(file) == 0 && ok;
+    }
+
+    /**
+     * Returns the number of bytes that differ from the pattern.
+     */
+    int64_t Verify(const char *buffer, uint64_t offset, size_t len) {
+        int64_t mismatches = 0;
+        for (size_t i = 0; i < len; i++) {
+            mismatches += static_cast<uint8_t>(buffer[i]) != Pattern(offset + i);
+        }
+        return mismatches;
+    }
+
+    struct OpenFile {
+        const ContentRedirectionDeviceABI *abi;
+        std::vector<std::max_align_t> fileStruct;
+        void *fd = nullptr;
+
+        // The wrapper only exports alloc_file_struct with useSlabPool, the module allocates "structSize" bytes otherwise.
+        explicit OpenFile(const ContentRedirectionDeviceABI *abi) : abi(abi), fileStruct((abi->structSize + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t) + 1) {
+            if (abi->open(abi->deviceData, fileStruct.data(), DEVICE_PATH, O_RDONLY, 0) >= 0) {
+                fd = fileStruct.data();
+            }
+        }
+
+        ~OpenFile() {
+            if (fd != nullptr) {
+                abi->close(abi->deviceData, fd);
+            }
+        }
+    };
+
+    int64_t ReadSequential(const ContentRedirectionDeviceABI *abi, double *msOut) {
+        OpenFile file(abi);
+        if (file.fd == nullptr) {
+            return -1;
+        }
+        std::vector<char> chunk(CHUNK_SIZE);
+        int64_t mismatches = 0;
+        uint64_t offset    = 0;
+        const auto start   = std::chrono::steady_clock::now();
+        while (offset < FILE_SIZE) {
+            const ssize_t res = abi->read(abi->deviceData, file.fd, chunk.data(), chunk.size());
+            if (res <= 0) {
+                return -1;
+            }
+            mismatches += Verify(chunk.data(), offset, res);
+            offset += res;
+            std::this_thread::sleep_for(std::chrono::microseconds(CONSUMER_US));
+        }
+        *msOut = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return mismatches;
+    }
+
+    int64_t ReadRandom(const ContentRedirectionDeviceABI *abi) {
+        OpenFile file(abi);
+        if (file.fd == nullptr) {
+            return -1;
+        }
+        std::mt19937 rng(1);
+        std::vector<char> buffer(64 * 1024);
+        int64_t mismatches = 0;
+        for (uint32_t run = 0; run < RANDOM_RUNS; run++) {
+            uint64_t offset = rng() % FILE_SIZE;
+            if (abi->seek(abi->deviceData, file.fd, static_cast<int64_t>(offset), SEEK_SET) != static_cast<int64_t>(offset)) {
+                return -1;
+            }
+            // Runs of small reads switch the file to streaming mode, the next seek has to discard the readahead.
+            const uint32_t reads = 1 + rng() % 12;
+            for (uint32_t i = 0; i < reads && offset < FILE_SIZE; i++) {
+                const size_t len  = 1 + rng() % (i % 4 == 3 ? buffer.size() : 4096);
+                const ssize_t res = abi->read(abi->deviceData, file.fd, buffer.data(), len);
+                const size_t want = std::min<uint64_t>(len, FILE_SIZE - offset);
+                if (res != static_cast<ssize_t>(want)) {
+                    return -1;
+                }
+                mismatches += Verify(buffer.data(), offset, res);
+                offset += res;
+            }
+        }
+        return mismatches;
+    }
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage:\n"
+                        "  %s <hostDir>\n"
+                        "      Creates <hostDir>/%s and reads it through a latency device.\n",
+                argv[0], FILE_NAME);
+        return 1;
+    }
+    if (CreatePosixDevoptab("host", argv[1]) == nullptr || !CreateFile(std::string(argv[1]) + "/" + FILE_NAME)) {
+        return 1;
+    }
+
+    ContentRedirectionLatencyDeviceConfig config{};
+    config.name            = "slow";
+    config.basePath        = "host:/";
+    config.profile.perOpUs = DEVICE_US;
+    const devoptab_t *device;
+    if (ContentRedirection_CreateLatencyDevice(&config, &device) != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+        return 1;
+    }
+
+    ContentRedirectionDeviceOptions readAhead;
+    readAhead.readAheadBufferSize = 64 * 1024;
+    const auto *plainAbi          = CR_DevoptabWrapper::RuntimeSlot<0>::bind(device, {});
+    const auto *readAheadAbi      = CR_DevoptabWrapper::RuntimeSlot<1>::bind(device, readAhead);
+
+    printf("%u KiB file, %u KiB reads, %u us per device call, %u us consumer delay per read\n", FILE_SIZE / 1024, CHUNK_SIZE / 1024, DEVICE_US, CONSUMER_US);
+    double plainMs     = 0;
+    double readAheadMs = 0;
+    int64_t mismatches = ReadSequential(plainAbi, &plainMs);
+    if (mismatches < 0) {
+        return 1;
+    }
+    ContentRedirection_ResetReadAheadStats();
+    const int64_t readAheadMismatches = ReadSequential(readAheadAbi, &readAheadMs);
+    if (readAheadMismatches < 0) {
+        return 1;
+    }
+    mismatches += readAheadMismatches;
+    ContentRedirectionReadAheadStats stats{};
+    ContentRedirection_GetReadAheadStats(&stats);
+    printf("sequential: %.0f ms without readahead, %.0f ms with readahead (%u hits, %u stalls, %u underruns)\n",
+           plainMs, readAheadMs, stats.hits, stats.stalls, stats.underruns);
+
+    ContentRedirection_ResetReadAheadStats();
+    const int64_t randomMismatches = ReadRandom(readAheadAbi);
+    if (randomMismatches < 0) {
+        return 1;
+    }
+    mismatches += randomMismatches;
+    ContentRedirection_GetReadAheadStats(&stats);
+    printf("random: %u runs (%u streams, %u cancelled readaheads)\n", RANDOM_RUNS, stats.streams, stats.cancelled);
+    printf("%lld mismatching bytes\n", (long long) mismatches);
+
+    ContentRedirection_DestroyLatencyDevice(device);
+    // Stops the readahead thread of the lib.
+    ContentRedirection_DeInitLibrary();
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,301 @@
+/**
+ * Host runner for the tiered device of "ContentRedirection_CreateTieredDevice".
+ * Two latency devices on host directories form the tiers: "hot" without latency and "sd" with the SD card profile.
+ * The runner checks that reads fall through to the slow tier, that files are promoted into the fast tier after
+ * "promoteAfterReads" reads within its budget, that a write evicts the promoted copy and frees its budget, that renames
+ * don't leave same-named copies in other tiers and that only the reserved directory of the lib is cleared.
+ * The delays are only simulated, the reported time is the sum of the injected delays of the slow tier.
+ *
+ * Build: g++ -std=gnu++17 -O2 -Itools/host/include -Itools/host -Isource -Iinclude -o crtieredbench tools/benchmarks/tiered_device.cpp \
+ *            tools/host/host_support.cpp tools/host/posix_devoptab.cpp source/[a-z]*.cpp -lpthread
+ *
+ * Usage:
+ *   crtieredbench <hostDir>
+ */
+#include "posix_devoptab.h"
+
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <content_redirection/devoptab_backend.h>
+#include <content_redirection/latency_device.h>
+#include <content_redirection/redirection.h>
+#include <content_redirection/tiered_device.h>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+using CR_DevoptabWrapper::Backend;
+
+namespace {
+    constexpr uint32_t FILE_SIZE          = 256 * 1024;
+    constexpr uint32_t PROMOTE_AFTER      = 2;
+    constexpr uint32_t PROMOTION_WAIT_MS  = 5000;
+    constexpr const char *HOT_DIR         = "crtiered-hot";
+    constexpr const char *SD_DIR          = "crtiered-sd";
+    constexpr const char *PROMOTED_SUBDIR = "/.libcontentredirection/promoted";
+
+    std::string sHostDir;
+    const devoptab_t *sTiered = nullptr;
+    const devoptab_t *sSd     = nullptr;
+    int sTieredId             = -1;
+    uint32_t sFailed          = 0;
+
+    void Check(bool ok, const char *what) {
+        if (!ok) {
+            printf("  FAIL: %s\n", what);
+            sFailed++;
+        }
+    }
+
+    uint8_t Pattern(uint32_t seed, uint32_t offset) {
+        return static_cast<uint8_t>(((offset + seed * 977) * 2654435761u) >> 13);
+    }
+
+    std::string HostPath(const char *tierDir, const std::string &rel) {
+        return sHostDir + "/" + tierDir + rel;
+    }
+
+    bool HostFileExists(const std::string &path) {
+        struct stat st {};
+        return ::stat(path.c_str(), &st) == 0;
+    }
+
+    bool WriteHostFile(const std::string &path, uint32_t seed, uint32_t size) {
+        FILE *file = fopen(path.c_str(), "wb");
+        if (file == nullptr) {
+            return false;
+        }
+        std::vector<uint8_t> data(size);
+        for (uint32_t i = 0; i < size; i++) {
+            data[i] = Pattern(seed, i);
+        }
+        const bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+        return fclose(file) == 0 && ok;
+    }
+
+    /**
+     * Memory for a file struct of the tiered device, like the module allocates it.
+     */
+    struct FileStruct {
+        std::vector<std::max_align_t> data = std::vector<std::max_align_t>(sTiered->structSize / sizeof(std::max_align_t) + 1);
+
+        void *get() {
+            return data.data();
+        }
+    };
+
+    struct ReadResult {
+        bool ok;              /**< The file has been read completely and matches the pattern */
+        uint64_t sdBytesRead; /**< Bytes read from the slow tier */
+        double sdMs;          /**< Simulated time spent by the slow tier */
+    };
+
+    ReadResult ReadFile(const char *path, uint32_t seed) {
+        ContentRedirectionLatencyDeviceStats stats{};
+        ContentRedirection_GetLatencyDeviceStats(sSd, &stats, true);
+
+        ReadResult result{true, 0, 0};
+        FileStruct file;
+        if (Backend::open(sTiered, file.get(), path, O_RDONLY, 0) < 0) {
+            result.ok = false;
+        } else {
+            std::vector<char> buffer(64 * 1024);
+            uint32_t offset = 0;
+            while (true) {
+                const ssize_t res = Backend::read(sTiered, file.get(), buffer.data(), buffer.size());
+                if (res <= 0) {
+                    result.ok = result.ok && res == 0;
+                    break;
+                }
+                for (ssize_t i = 0; i < res; i++) {
+                    result.ok = result.ok && static_cast<uint8_t>(buffer[i]) == Pattern(seed, offset + i);
+                }
+                offset += res;
+            }
+            result.ok = result.ok && offset == FILE_SIZE;
+            Backend::close(sTiered, file.get());
+        }
+
+        ContentRedirection_GetLatencyDeviceStats(sSd, &stats, true);
+        result.sdBytesRead = stats.bytesRead;
+        result.sdMs        = stats.simulatedUs / 1000.0;
+        return result;
+    }
+
+    /**
+     * Reads the file until it's served by the fast tier. Returns the number of reads, 0 if it hasn't been promoted in time.
+     */
+    uint32_t ReadUntilPromoted(const char *path, uint32_t seed) {
+        const auto start = std::chrono::steady_clock::now();
+        for (uint32_t reads = 1;; reads++) {
+            const auto result = ReadFile(path, seed);
+            if (!result.ok) {
+                return 0;
+            }
+            if (result.sdBytesRead == 0) {
+                return reads;
+            }
+            if (std::chrono::steady_clock::now() - start > std::chrono::milliseconds(PROMOTION_WAIT_MS)) {
+                return 0;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+
+    bool ListingContains(const char *path, const char *name) {
+        std::vector<std::max_align_t> dirState(sTiered->dirStateSize / sizeof(std::max_align_t) + 1);
+        if (Backend::diropen(sTiered, sTieredId, dirState.data(), path) < 0) {
+            return false;
+        }
+        bool found = false;
+        char entry[NAME_MAX + 1];
+        CR_Stat st{};
+        while (Backend::dirnext(sTiered, sTieredId, dirState.data(), entry, &st) >= 0) {
+            found = found || strcmp(entry, name) == 0;
+        }
+        Backend::dirclose(sTiered, sTieredId, dirState.data());
+        return found;
+    }
+
+    const devoptab_t *CreateTier(const char *name, const char *basePath, ContentRedirectionLatencyProfileType type) {
+        ContentRedirectionLatencyDeviceConfig config{};
+        config.name         = name;
+        config.basePath     = basePath;
+        config.seed         = 1;
+        config.simulateOnly = true;
+        const devoptab_t *device;
+        if (ContentRedirection_GetLatencyProfile(type, &config.profile) != CONTENT_REDIRECTION_RESULT_SUCCESS ||
+            ContentRedirection_CreateLatencyDevice(&config, &device) != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+            return nullptr;
+        }
+        // The tier paths of the tiered device have to belong to registered devices.
+        return AddDevice(device) >= 0 ? device : nullptr;
+    }
+
+    bool CreateHostTree() {
+        for (const char *dir : {HOT_DIR, SD_DIR}) {
+            if (::mkdir(HostPath(dir, "").c_str(), 0777) != 0 || ::mkdir(HostPath(dir, "/content").c_str(), 0777) != 0) {
+                return false;
+            }
+        }
+        // User data that happens to look like a cache directory has to survive, a leftover promoted copy has to be deleted.
+        return ::mkdir(HostPath(HOT_DIR, "/.crpromoted").c_str(), 0777) == 0 &&
+               ::mkdir(HostPath(HOT_DIR, "/.libcontentredirection").c_str(), 0777) == 0 &&
+               ::mkdir(HostPath(HOT_DIR, PROMOTED_SUBDIR).c_str(), 0777) == 0 &&
+               WriteHostFile(HostPath(HOT_DIR, "/.crpromoted/save.bin"), 9, FILE_SIZE) &&
+               WriteHostFile(HostPath(HOT_DIR, std::string(PROMOTED_SUBDIR) + "/stale.bin"), 9, FILE_SIZE) &&
+               WriteHostFile(HostPath(SD_DIR, "/content/a.bin"), 1, FILE_SIZE) &&
+               WriteHostFile(HostPath(SD_DIR, "/content/b.bin"), 2, FILE_SIZE) &&
+               WriteHostFile(HostPath(SD_DIR, "/content/c.bin"), 3, FILE_SIZE) &&
+               WriteHostFile(HostPath(HOT_DIR, "/content/d.bin"), 4, FILE_SIZE) &&
+               WriteHostFile(HostPath(SD_DIR, "/content/d.bin"), 5, FILE_SIZE);
+    }
+
+    void RunChecks() {
+        Check(!HostFileExists(HostPath(HOT_DIR, std::string(PROMOTED_SUBDIR) + "/stale.bin")), "promoted copies of an earlier session have been deleted");
+        Check(HostFileExists(HostPath(HOT_DIR, "/.crpromoted/save.bin")), "files outside of the reserved directory are kept");
+        Check(ReadFile("tiered:/.crpromoted/save.bin", 9).ok, "files outside of the reserved directory are visible");
+        Check(!ListingContains("tiered:/", ".libcontentredirection"), "the reserved directory is hidden from listings");
+
+        auto result = ReadFile("tiered:/content/a.bin", 1);
+        printf("fallthrough: a.bin read from the sd tier, %.1f ms simulated\n", result.sdMs);
+        Check(result.ok && result.sdBytesRead == FILE_SIZE, "a file that only exists in the slow tier is read from it");
+        const double sdMs = result.sdMs;
+
+        uint32_t reads = ReadUntilPromoted("tiered:/content/a.bin", 1);
+        result         = ReadFile("tiered:/content/a.bin", 1);
+        printf("promotion: a.bin served by the hot tier after %u reads, %.1f ms simulated on the sd tier (%.1f ms before)\n", reads + 1, result.sdMs, sdMs);
+        Check(reads != 0 && result.ok, "a file read often enough is promoted into the fast tier");
+        Check(HostFileExists(HostPath(HOT_DIR, std::string(PROMOTED_SUBDIR) + "/content/a.bin")), "the promoted copy is stored in the reserved directory");
+
+        Check(ReadUntilPromoted("tiered:/content/b.bin", 2) != 0, "a second file fits into the budget");
+        for (uint32_t i = 0; i < PROMOTE_AFTER * 2; i++) {
+            ReadFile("tiered:/content/c.bin", 3);
+        }
+        // There is no way to wait for the worker, give it enough time to promote c.bin if it wrongly would.
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        result = ReadFile("tiered:/content/c.bin", 3);
+        printf("budget: c.bin still read from the sd tier with a full hot tier, %.1f ms simulated\n", result.sdMs);
+        Check(result.ok && result.sdBytesRead == FILE_SIZE, "files beyond the promotion budget are read from the slow tier");
+
+        FileStruct file;
+        std::vector<char> data(FILE_SIZE);
+        for (uint32_t i = 0; i < FILE_SIZE; i++) {
+            data[i] = static_cast<char>(Pattern(6, i));
+        }
+        bool written = Backend::open(sTiered, file.get(), "tiered:/content/a.bin", O_WRONLY | O_TRUNC, 0) >= 0;
+        if (written) {
+            written = Backend::write(sTiered, file.get(), data.data(), data.size()) == static_cast<ssize_t>(data.size());
+            written = Backend::close(sTiered, file.get()) >= 0 && written;
+        }
+        Check(written, "the original can be written");
+        Check(!HostFileExists(HostPath(HOT_DIR, std::string(PROMOTED_SUBDIR) + "/content/a.bin")), "writing the original evicts the promoted copy");
+        result = ReadFile("tiered:/content/a.bin", 6);
+        Check(result.ok && result.sdBytesRead == FILE_SIZE, "the modified original is read after the eviction");
+        reads = ReadUntilPromoted("tiered:/content/c.bin", 3);
+        printf("eviction: writing a.bin dropped its copy, c.bin promoted into the freed budget after %u reads\n", reads);
+        Check(reads != 0, "the eviction frees the budget of the promoted copy");
+
+        CR_Stat st{};
+        Check(Backend::rename(sTiered, "tiered:/content/d.bin", "tiered:/content/e.bin") >= 0, "a file in several tiers can be renamed");
+        Check(Backend::stat(sTiered, "tiered:/content/d.bin", &st) == -ENOENT, "the old name doesn't resolve to a copy in a slower tier");
+        Check(ReadFile("tiered:/content/e.bin", 4).ok, "the new name resolves to the renamed file of the fastest tier");
+        Check(!HostFileExists(HostPath(SD_DIR, "/content/d.bin")), "the shadowed copy in the slower tier has been dropped");
+    }
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage:\n"
+                        "  %s <hostDir>\n"
+                        "      Runs the tiered device on <hostDir>, the scratch directories <hostDir>/%s and <hostDir>/%s must not exist.\n",
+                argv[0], HOT_DIR, SD_DIR);
+        return 1;
+    }
+    sHostDir = argv[1];
+    if (CreatePosixDevoptab("host", argv[1]) == nullptr || !CreateHostTree()) {
+        return 1;
+    }
+    const devoptab_t *hot = CreateTier("hot", (std::string("host:/") + HOT_DIR).c_str(), CONTENT_REDIRECTION_LATENCY_PROFILE_NONE);
+    sSd                   = CreateTier("sd", (std::string("host:/") + SD_DIR).c_str(), CONTENT_REDIRECTION_LATENCY_PROFILE_SD);
+    if (hot == nullptr || sSd == nullptr) {
+        return 1;
+    }
+
+    // The hot tier has room for two promoted files.
+    const ContentRedirectionTierConfig tiers[] = {
+            {"hot:/", 2 * FILE_SIZE},
+            {"sd:/", 0},
+    };
+    ContentRedirectionTieredDeviceConfig config{};
+    config.name              = "tiered";
+    config.tiers             = tiers;
+    config.numTiers          = 2;
+    config.promoteAfterReads = PROMOTE_AFTER;
+    if (ContentRedirection_CreateTieredDevice(&config, &sTiered) != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+        return 1;
+    }
+    sTieredId = AddDevice(sTiered);
+    if (sTieredId < 0) {
+        return 1;
+    }
+
+    RunChecks();
+    printf("%u failed\n", sFailed);
+
+    RemoveDevice("tiered");
+    ContentRedirection_DestroyTieredDevice(sTiered);
+    RemoveDevice("hot");
+    RemoveDevice("sd");
+    ContentRedirection_DestroyLatencyDevice(hot);
+    ContentRedirection_DestroyLatencyDevice(sSd);
+    // Stops the readahead thread of the lib.
+    ContentRedirection_DeInitLibrary();
+    return sFailed == 0 ? 0 : 1;
+}
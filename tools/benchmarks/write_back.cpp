@@ -0,0 +1,147 @@
+/**
+ * Host benchmark for the write-back buffer of the devoptab wrapper, see ContentRedirectionDeviceOptions::writeBackBufferSize.
+ * A save file is written through a latency device with the SD card profile like a game writes it: many small records of
+ * varying size, followed by a seek back to the start to fill in the header. This is done once without and once with write-back,
+ * afterwards the file on the host is compared byte by byte. The delays are only simulated, the reported time is the sum of the injected delays.
+ *
+ * Build: g++ -std=gnu++17 -O2 -Itools/host/include -Itools/host -Isource -Iinclude -o crwritebackbench tools/benchmarks/write_back.cpp \
+ *            tools/host/host_support.cpp tools/host/posix_devoptab.cpp source/[a-z]*.cpp -lpthread
+ *
+ * Usage:
+ *   crwritebackbench <hostDir>
+ */
+#include "posix_devoptab.h"
+
+#include <algorithm>
+#include <content_redirection/latency_device.h>
+#include <content_redirection/redirection.h>
+#include <cstddef>
+#include <cstdio>
+#include <fcntl.h>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    constexpr uint32_t SAVE_SIZE      = 512 * 1024;
+    constexpr uint32_t HEADER_SIZE    = 64;
+    constexpr uint32_t MAX_RECORD     = 512;
+    constexpr const char *FILE_NAME   = "crwriteback.sav";
+    constexpr const char *DEVICE_PATH = "slow:/crwriteback.sav";
+
+    uint8_t Pattern(uint64_t offset) {
+        return static_cast<uint8_t>((offset * 2654435761u) >> 11);
+    }
+
+    /**
+     * Writes the save via "abi", returns false if a call failed.
+     */
+    bool WriteSave(const ContentRedirectionDeviceABI *abi) {
+        // The wrapper only exports alloc_file_struct with useSlabPool, the module allocates "structSize" bytes otherwise.
+        std::vector<std::max_align_t> fileStruct((abi->structSize + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t) + 1);
+        void *fd = fileStruct.data();
+        if (abi->open(abi->deviceData, fd, DEVICE_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0666) < 0) {
+            return false;
+        }
+        std::vector<char> data(SAVE_SIZE);
+        for (uint32_t i = 0; i < SAVE_SIZE; i++) {
+            data[i] = static_cast<char>(Pattern(i));
+        }
+
+        // The header is written as zeros first and filled in once the size of the records is known.
+        std::vector<char> zeros(HEADER_SIZE);
+        bool ok = abi->write(abi->deviceData, fd, zeros.data(), zeros.size()) == HEADER_SIZE;
+        std::mt19937 rng(1);
+        for (uint32_t offset = HEADER_SIZE; ok && offset < SAVE_SIZE;) {
+            const uint32_t len = std::min<uint32_t>(4 + rng() % MAX_RECORD, SAVE_SIZE - offset);
+            ok                 = abi->write(abi->deviceData, fd, data.data() + offset, len) == len;
+            offset += len;
+        }
+        ok = ok && abi->seek(abi->deviceData, fd, 0, SEEK_SET) == 0 && abi->write(abi->deviceData, fd, data.data(), HEADER_SIZE) == HEADER_SIZE;
+        ok = ok && abi->fsync(abi->deviceData, fd) >= 0;
+        return abi->close(abi->deviceData, fd) >= 0 && ok;
+    }
+
+    /**
+     * Returns the number of bytes of the file on the host that differ from the pattern, or -1 if it can't be read.
+     */
+    int64_t Verify(const std::string &path) {
+        FILE *file = fopen(path.c_str(), "rb");
+        if (file == nullptr) {
+            return -1;
+        }
+        std::vector<uint8_t> data(SAVE_SIZE + 1);
+        const size_t size = fread(data.data(), 1, data.size(), file);
+        fclose(file);
+        if (size != SAVE_SIZE) {
+            return -1;
+        }
+        int64_t mismatches = 0;
+        for (uint32_t i = 0; i < SAVE_SIZE; i++) {
+            mismatches += data[i] != Pattern(i);
+        }
+        return mismatches;
+    }
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage:\n"
+                        "  %s <hostDir>\n"
+                        "      Writes <hostDir>/%s through a latency device.\n",
+                argv[0], FILE_NAME);
+        return 1;
+    }
+    if (CreatePosixDevoptab("host", argv[1]) == nullptr) {
+        return 1;
+    }
+
+    ContentRedirectionLatencyDeviceConfig config{};
+    config.name         = "slow";
+    config.basePath     = "host:/";
+    config.seed         = 1;
+    config.simulateOnly = true;
+    const devoptab_t *device;
+    if (ContentRedirection_GetLatencyProfile(CONTENT_REDIRECTION_LATENCY_PROFILE_SD, &config.profile) != CONTENT_REDIRECTION_RESULT_SUCCESS ||
+        ContentRedirection_CreateLatencyDevice(&config, &device) != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+        return 1;
+    }
+
+    ContentRedirectionDeviceOptions writeBack;
+    writeBack.writeBackBufferSize = 64 * 1024;
+    const auto *plainAbi          = CR_DevoptabWrapper::RuntimeSlot<0>::bind(device, {});
+    const auto *writeBackAbi      = CR_DevoptabWrapper::RuntimeSlot<1>::bind(device, writeBack);
+
+    printf("%u KiB save, records of 4 to %u bytes, SD card profile\n", SAVE_SIZE / 1024, MAX_RECORD + 3);
+    const std::string hostPath = std::string(argv[1]) + "/" + FILE_NAME;
+    int64_t mismatches         = 0;
+    const struct {
+        const char *name;
+        const ContentRedirectionDeviceABI *abi;
+    } runs[] = {
+            {"without write-back", plainAbi},
+            {"with 64 KiB write-back", writeBackAbi},
+    };
+    for (const auto &run : runs) {
+        ContentRedirectionLatencyDeviceStats stats{};
+        ContentRedirection_GetLatencyDeviceStats(device, &stats, true);
+        if (!WriteSave(run.abi)) {
+            fprintf(stderr, "Failed to write the save %s\n", run.name);
+            return 1;
+        }
+        ContentRedirection_GetLatencyDeviceStats(device, &stats, true);
+        const int64_t cur = Verify(hostPath);
+        if (cur < 0) {
+            return 1;
+        }
+        mismatches += cur;
+        printf("%s: %.1f ms simulated, %llu device calls, %llu seeks\n", run.name, stats.simulatedUs / 1000.0,
+               (unsigned long long) stats.ops, (unsigned long long) stats.seeks);
+    }
+    printf("%lld mismatching bytes\n", (long long) mismatches);
+
+    ContentRedirection_DestroyLatencyDevice(device);
+    // Stops the readahead thread of the lib.
+    ContentRedirection_DeInitLibrary();
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,326 @@
+/**
+ * Host tool to create and apply the byte-range patches of FS_LAYER_TYPE_EX_PATCH_FILE layers,
+ * see include/content_redirection/patch_layer.h for the format.
+ *
+ * Build: g++ -std=c++17 -O2 -o crpatch tools/crpatch/crpatch.cpp
+ *
+ * Usage:
+ *   crpatch create <original> <modified> <patch> [mergeGap]
+ *   crpatch apply <original> <patch> <output>
+ */
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+    constexpr uint32_t PATCH_MAGIC       = 0x43525054; // "CRPT"
+    constexpr uint32_t PATCH_VERSION     = 1;
+    constexpr uint32_t PATCH_MAX_EXTENTS = 0x10000; // CONTENT_REDIRECTION_PATCH_MAX_EXTENTS
+    constexpr size_t HEADER_SIZE         = 32;
+    constexpr size_t EXTENT_SIZE         = 24;
+    constexpr size_t CHUNK_SIZE          = 1024 * 1024;
+    /**
+     * Unchanged bytes between two changed ranges are included in the patch if that's smaller than another extent.
+     */
+    constexpr uint64_t DEFAULT_MERGE_GAP = EXTENT_SIZE;
+
+    struct Extent {
+        uint64_t offset;
+        uint64_t length;
+    };
+
+    struct File {
+        explicit File(FILE *f) : f(f) {}
+        ~File() {
+            if (f) {
+                fclose(f);
+            }
+        }
+        File(const File &)            = delete;
+        File &operator=(const File &) = delete;
+        FILE *f;
+    };
+
+    void WriteU32(uint8_t *p, uint32_t value) {
+        p[0] = value >> 24;
+        p[1] = value >> 16;
+        p[2] = value >> 8;
+        p[3] = value;
+    }
+
+    void WriteU64(uint8_t *p, uint64_t value) {
+        WriteU32(p, value >> 32);
+        WriteU32(p + 4, static_cast<uint32_t>(value));
+    }
+
+    uint32_t ReadU32(const uint8_t *p) {
+        return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | (uint32_t) p[3];
+    }
+
+    uint64_t ReadU64(const uint8_t *p) {
+        return (uint64_t) ReadU32(p) << 32 | ReadU32(p + 4);
+    }
+
+    bool GetSize(FILE *f, uint64_t &size) {
+        if (fseeko(f, 0, SEEK_END) != 0) {
+            return false;
+        }
+        const off_t pos = ftello(f);
+        if (pos < 0 || fseeko(f, 0, SEEK_SET) != 0) {
+            return false;
+        }
+        size = static_cast<uint64_t>(pos);
+        return true;
+    }
+
+    bool ReadAt(FILE *f, uint64_t offset, void *buffer, size_t len) {
+        return fseeko(f, static_cast<off_t>(offset), SEEK_SET) == 0 && fread(buffer, 1, len, f) == len;
+    }
+
+    /**
+     * Compares both files and returns the ranges of the modified file that differ from the original file.
+     * Everything beyond the end of the original file is different.
+     */
+    bool Diff(FILE *original, uint64_t originalSize, FILE *modified, uint64_t modifiedSize, uint64_t mergeGap, std::vector<Extent> &extents) {
+        std::vector<uint8_t> a(CHUNK_SIZE);
+        std::vector<uint8_t> b(CHUNK_SIZE);
+        const uint64_t common = std::min(originalSize, modifiedSize);
+        bool open             = false;
+        uint64_t start        = 0;
+        uint64_t end          = 0;
+
+        auto addDifference = [&](uint64_t from, uint64_t to) {
+            if (open && from - end <= mergeGap) {
+                end = to;
+                return;
+            }
+            if (open) {
+                extents.push_back({start, end - start});
+            }
+            open  = true;
+            start = from;
+            end   = to;
+        };
+
+        for (uint64_t offset = 0; offset < common; offset += CHUNK_SIZE) {
+            const size_t len = static_cast<size_t>(std::min<uint64_t>(CHUNK_SIZE, common - offset));
+            if (!ReadAt(original, offset, a.data(), len) || !ReadAt(modified, offset, b.data(), len)) {
+                return false;
+            }
+            if (memcmp(a.data(), b.data(), len) == 0) {
+                continue;
+            }
+            for (size_t i = 0; i < len; i++) {
+                if (a[i] == b[i]) {
+                    continue;
+                }
+                size_t j = i + 1;
+                while (j < len && a[j] != b[j]) {
+                    j++;
+                }
+                addDifference(offset + i, offset + j);
+                i = j;
+            }
+        }
+        if (modifiedSize > common) {
+            addDifference(common, modifiedSize);
+        }
+        if (open) {
+            extents.push_back({start, end - start});
+        }
+
+        // The length of an extent is stored as 32 bit value.
+        std::vector<Extent> split;
+        for (const auto &extent : extents) {
+            for (uint64_t pos = 0; pos < extent.length; pos += UINT32_MAX) {
+                split.push_back({extent.offset + pos, std::min<uint64_t>(UINT32_MAX, extent.length - pos)});
+            }
+        }
+        extents.swap(split);
+        return true;
+    }
+
+    int Create(const char *originalPath, const char *modifiedPath, const char *patchPath, uint64_t mergeGap) {
+        File original(fopen(originalPath, "rb"));
+        File modified(fopen(modifiedPath, "rb"));
+        if (!original.f || !modified.f) {
+            fprintf(stderr, "Failed to open \"%s\" or \"%s\"\n", originalPath, modifiedPath);
+            return 1;
+        }
+        uint64_t originalSize = 0;
+        uint64_t modifiedSize = 0;
+        if (!GetSize(original.f, originalSize) || !GetSize(modified.f, modifiedSize)) {
+            fprintf(stderr, "Failed to get the size of the input files\n");
+            return 1;
+        }
+
+        std::vector<Extent> extents;
+        while (true) {
+            extents.clear();
+            if (!Diff(original.f, originalSize, modified.f, modifiedSize, mergeGap, extents)) {
+                fprintf(stderr, "Failed to read the input files\n");
+                return 1;
+            }
+            if (extents.size() <= PATCH_MAX_EXTENTS) {
+                break;
+            }
+            // Too many small changes, merge more of them.
+            mergeGap = std::max<uint64_t>(mergeGap * 2, 1);
+        }
+
+        File patch(fopen(patchPath, "wb"));
+        if (!patch.f) {
+            fprintf(stderr, "Failed to create \"%s\"\n", patchPath);
+            return 1;
+        }
+        std::vector<uint8_t> table(HEADER_SIZE + extents.size() * EXTENT_SIZE);
+        WriteU32(&table[0], PATCH_MAGIC);
+        WriteU32(&table[4], PATCH_VERSION);
+        WriteU64(&table[8], originalSize);
+        WriteU64(&table[16], modifiedSize);
+        WriteU32(&table[24], static_cast<uint32_t>(extents.size()));
+        uint64_t dataOffset = table.size();
+        uint64_t dataSize   = 0;
+        for (size_t i = 0; i < extents.size(); i++) {
+            uint8_t *entry = &table[HEADER_SIZE + i * EXTENT_SIZE];
+            WriteU64(entry, extents[i].offset);
+            WriteU64(entry + 8, dataOffset);
+            WriteU32(entry + 16, static_cast<uint32_t>(extents[i].length));
+            dataOffset += extents[i].length;
+            dataSize += extents[i].length;
+        }
+        if (fwrite(table.data(), 1, table.size(), patch.f) != table.size()) {
+            fprintf(stderr, "Failed to write \"%s\"\n", patchPath);
+            return 1;
+        }
+
+        std::vector<uint8_t> buffer(CHUNK_SIZE);
+        for (const auto &extent : extents) {
+            for (uint64_t pos = 0; pos < extent.length; pos += CHUNK_SIZE) {
+                const size_t len = static_cast<size_t>(std::min<uint64_t>(CHUNK_SIZE, extent.length - pos));
+                if (!ReadAt(modified.f, extent.offset + pos, buffer.data(), len) || fwrite(buffer.data(), 1, len, patch.f) != len) {
+                    fprintf(stderr, "Failed to write \"%s\"\n", patchPath);
+                    return 1;
+                }
+            }
+        }
+        if (fflush(patch.f) != 0) {
+            fprintf(stderr, "Failed to write \"%s\"\n", patchPath);
+            return 1;
+        }
+        printf("%zu extents, %llu bytes of data, patch file has %llu bytes\n", extents.size(), static_cast<unsigned long long>(dataSize),
+               static_cast<unsigned long long>(dataOffset));
+        return 0;
+    }
+
+    /**
+     * Writes the patched file like the patch device reads it, e.g. to check a patch before shipping it.
+     */
+    int Apply(const char *originalPath, const char *patchPath, const char *outputPath) {
+        File original(fopen(originalPath, "rb"));
+        File patch(fopen(patchPath, "rb"));
+        if (!original.f || !patch.f) {
+            fprintf(stderr, "Failed to open \"%s\" or \"%s\"\n", originalPath, patchPath);
+            return 1;
+        }
+        uint64_t originalSize = 0;
+        uint64_t patchSize    = 0;
+        uint8_t header[HEADER_SIZE];
+        if (!GetSize(original.f, originalSize) || !GetSize(patch.f, patchSize) || !ReadAt(patch.f, 0, header, sizeof(header)) ||
+            ReadU32(header) != PATCH_MAGIC || ReadU32(header + 4) != PATCH_VERSION || ReadU32(header + 28) != 0) {
+            fprintf(stderr, "\"%s\" is no valid patch file\n", patchPath);
+            return 1;
+        }
+        if (ReadU64(header + 8) != originalSize) {
+            fprintf(stderr, "The patch has been created for a file of %llu bytes, \"%s\" has %llu bytes\n", static_cast<unsigned long long>(ReadU64(header + 8)),
+                    originalPath, static_cast<unsigned long long>(originalSize));
+            return 1;
+        }
+        const uint64_t patchedSize = ReadU64(header + 16);
+        const uint32_t numExtents  = ReadU32(header + 24);
+        if (numExtents > PATCH_MAX_EXTENTS || HEADER_SIZE + static_cast<uint64_t>(numExtents) * EXTENT_SIZE > patchSize) {
+            fprintf(stderr, "\"%s\" is no valid patch file\n", patchPath);
+            return 1;
+        }
+        std::vector<uint8_t> table(numExtents * EXTENT_SIZE);
+        if (!table.empty() && !ReadAt(patch.f, HEADER_SIZE, table.data(), table.size())) {
+            fprintf(stderr, "Failed to read \"%s\"\n", patchPath);
+            return 1;
+        }
+
+        File output(fopen(outputPath, "wb"));
+        if (!output.f) {
+            fprintf(stderr, "Failed to create \"%s\"\n", outputPath);
+            return 1;
+        }
+        std::vector<uint8_t> buffer(CHUNK_SIZE);
+        // Copies "len" bytes at "offset" of "src" to the output, bytes beyond the end of "src" are 0.
+        auto copy = [&](FILE *src, uint64_t srcSize, uint64_t offset, uint64_t len) {
+            for (uint64_t pos = 0; pos < len; pos += CHUNK_SIZE) {
+                const size_t cur     = static_cast<size_t>(std::min<uint64_t>(CHUNK_SIZE, len - pos));
+                const uint64_t begin = offset + pos;
+                const size_t avail   = begin < srcSize ? static_cast<size_t>(std::min<uint64_t>(cur, srcSize - begin)) : 0;
+                if (avail > 0 && !ReadAt(src, begin, buffer.data(), avail)) {
+                    return false;
+                }
+                memset(buffer.data() + avail, 0, cur - avail);
+                if (fwrite(buffer.data(), 1, cur, output.f) != cur) {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        uint64_t pos = 0;
+        for (uint32_t i = 0; i <= numExtents; i++) {
+            uint64_t offset = patchedSize, dataOffset = 0, length = 0;
+            if (i < numExtents) {
+                const uint8_t *entry = &table[i * EXTENT_SIZE];
+                offset               = ReadU64(entry);
+                dataOffset           = ReadU64(entry + 8);
+                length               = ReadU32(entry + 16);
+                if (ReadU32(entry + 20) != 0) {
+                    fprintf(stderr, "Extent %u of \"%s\" is invalid\n", i, patchPath);
+                    return 1;
+                }
+            }
+            if (offset < pos || offset > patchedSize || length > patchedSize - offset || dataOffset > patchSize || length > patchSize - dataOffset) {
+                fprintf(stderr, "Extent %u of \"%s\" is invalid\n", i, patchPath);
+                return 1;
+            }
+            if (!copy(original.f, originalSize, pos, offset - pos) || !copy(patch.f, patchSize, dataOffset, length)) {
+                fprintf(stderr, "Failed to write \"%s\"\n", outputPath);
+                return 1;
+            }
+            pos = offset + length;
+        }
+        if (fflush(output.f) != 0) {
+            fprintf(stderr, "Failed to write \"%s\"\n", outputPath);
+            return 1;
+        }
+        return 0;
+    }
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc >= 5 && argc <= 6 && strcmp(argv[1], "create") == 0) {
+        const uint64_t mergeGap = argc == 6 ? strtoull(argv[5], nullptr, 10) : DEFAULT_MERGE_GAP;
+        return Create(argv[2], argv[3], argv[4], mergeGap);
+    }
+    if (argc == 5 && strcmp(argv[1], "apply") == 0) {
+        return Apply(argv[2], argv[3], argv[4]);
+    }
+    fprintf(stderr, "Usage:\n"
+                    "  %s create <original> <modified> <patch> [mergeGap]\n"
+                    "      Creates a patch that turns <original> into <modified>. Unchanged ranges of up to [mergeGap] bytes (default %llu)\n"
+                    "      between two changes are included in the patch.\n"
+                    "  %s apply <original> <patch> <output>\n"
+                    "      Writes the patched file to <output>.\n",
+            argv[0], static_cast<unsigned long long>(DEFAULT_MERGE_GAP), argv[0]);
+    return 1;
+}
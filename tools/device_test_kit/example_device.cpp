@@ -0,0 +1,244 @@
+#include "example_device.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace {
+    struct Device {
+        ContentRedirectionDeviceABI abi{};
+        std::string name;
+        std::string root;
+    };
+
+    struct File {
+        int fd;
+    };
+
+    struct Dir {
+        DIR *dir;
+    };
+
+    Device sDevice;
+
+    /**
+     * Returns the host path of "name:/path", or an empty string if the path belongs to another device.
+     */
+    std::string HostPath(const char *path) {
+        const char *colon = strchr(path, ':');
+        if (colon != nullptr) {
+            if (std::string(path, colon) != sDevice.name) {
+                return {};
+            }
+            path = colon + 1;
+        }
+        return sDevice.root + "/" + path;
+    }
+
+    void ToCRStat(const struct stat &src, CR_Stat *dst) {
+        dst->dev     = src.st_dev;
+        dst->ino     = src.st_ino;
+        dst->mode    = src.st_mode;
+        dst->nlink   = src.st_nlink;
+        dst->uid     = src.st_uid;
+        dst->gid     = src.st_gid;
+        dst->rdev    = src.st_rdev;
+        dst->size    = src.st_size;
+        dst->atime   = src.st_atime;
+        dst->mtime   = src.st_mtime;
+        dst->ctime   = src.st_ctime;
+        dst->blksize = src.st_blksize;
+        dst->blocks  = src.st_blocks;
+    }
+
+    template<typename T>
+    T Result(T res) {
+        return res < 0 ? -errno : res;
+    }
+
+    int Open(void *, void *fileStruct, const char *path, int flags, uint32_t mode) {
+        const std::string host = HostPath(path);
+        if (host.empty()) {
+            return -ENODEV;
+        }
+        const int fd = ::open(host.c_str(), flags, mode);
+        if (fd < 0) {
+            return -errno;
+        }
+        static_cast<File *>(fileStruct)->fd = fd;
+        return 0;
+    }
+
+    int Close(void *, void *fileStruct) {
+        return Result(::close(static_cast<File *>(fileStruct)->fd));
+    }
+
+    ssize_t Write(void *, void *fileStruct, const char *ptr, size_t len) {
+        return Result(::write(static_cast<File *>(fileStruct)->fd, ptr, len));
+    }
+
+    ssize_t Read(void *, void *fileStruct, char *ptr, size_t len) {
+        return Result(::read(static_cast<File *>(fileStruct)->fd, ptr, len));
+    }
+
+    int64_t Seek(void *, void *fileStruct, int64_t pos, int dir) {
+        return Result<int64_t>(::lseek(static_cast<File *>(fileStruct)->fd, pos, dir));
+    }
+
+    int FStat(void *, void *fileStruct, CR_Stat *st) {
+        struct stat hostSt {};
+        if (::fstat(static_cast<File *>(fileStruct)->fd, &hostSt) < 0) {
+            return -errno;
+        }
+        ToCRStat(hostSt, st);
+        return 0;
+    }
+
+    template<int (*F)(const char *, struct stat *)>
+    int StatPath(void *, const char *path, CR_Stat *st) {
+        struct stat hostSt {};
+        if (F(HostPath(path).c_str(), &hostSt) < 0) {
+            return -errno;
+        }
+        ToCRStat(hostSt, st);
+        return 0;
+    }
+
+    int Unlink(void *, const char *path) {
+        return Result(::unlink(HostPath(path).c_str()));
+    }
+
+    int Rename(void *, const char *oldName, const char *newName) {
+        return Result(::rename(HostPath(oldName).c_str(), HostPath(newName).c_str()));
+    }
+
+    int Mkdir(void *, const char *path, uint32_t mode) {
+        return Result(::mkdir(HostPath(path).c_str(), mode));
+    }
+
+    int DirOpen(void *, void *dirStruct, const char *path) {
+        DIR *dir = opendir(HostPath(path).c_str());
+        if (dir == nullptr) {
+            return -errno;
+        }
+        static_cast<Dir *>(dirStruct)->dir = dir;
+        return 0;
+    }
+
+    int DirReset(void *, void *dirStruct) {
+        rewinddir(static_cast<Dir *>(dirStruct)->dir);
+        return 0;
+    }
+
+    int DirNext(void *, void *dirStruct, char *filename, CR_Stat *filestat) {
+        DIR *dir = static_cast<Dir *>(dirStruct)->dir;
+        dirent *entry;
+        do {
+            errno = 0;
+            entry = readdir(dir);
+            if (entry == nullptr) {
+                return errno != 0 ? -errno : -ENOENT;
+            }
+        } while (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0);
+        struct stat hostSt {};
+        if (fstatat(dirfd(dir), entry->d_name, &hostSt, 0) < 0) {
+            return -errno;
+        }
+        strncpy(filename, entry->d_name, NAME_MAX);
+        filename[NAME_MAX] = '\0';
+        ToCRStat(hostSt, filestat);
+        return 0;
+    }
+
+    int DirClose(void *, void *dirStruct) {
+        return Result(closedir(static_cast<Dir *>(dirStruct)->dir));
+    }
+
+    int StatVfs(void *, const char *path, CR_Statvfs *buf) {
+        struct statvfs hostBuf {};
+        if (::statvfs(HostPath(path).c_str(), &hostBuf) < 0) {
+            return -errno;
+        }
+        buf->bsize   = hostBuf.f_bsize;
+        buf->frsize  = hostBuf.f_frsize;
+        buf->blocks  = hostBuf.f_blocks;
+        buf->bfree   = hostBuf.f_bfree;
+        buf->bavail  = hostBuf.f_bavail;
+        buf->files   = hostBuf.f_files;
+        buf->ffree   = hostBuf.f_ffree;
+        buf->favail  = hostBuf.f_favail;
+        buf->fsid    = hostBuf.f_fsid;
+        buf->flag    = hostBuf.f_flag;
+        buf->namemax = hostBuf.f_namemax;
+        return 0;
+    }
+
+    int FTruncate(void *, void *fileStruct, int64_t len) {
+        return Result(::ftruncate(static_cast<File *>(fileStruct)->fd, len));
+    }
+
+    int FSync(void *, void *fileStruct) {
+        return Result(::fsync(static_cast<File *>(fileStruct)->fd));
+    }
+
+    int Chmod(void *, const char *path, uint32_t mode) {
+        return Result(::chmod(HostPath(path).c_str(), mode));
+    }
+
+    int FChmod(void *, void *fileStruct, uint32_t mode) {
+        return Result(::fchmod(static_cast<File *>(fileStruct)->fd, mode));
+    }
+
+    int Rmdir(void *, const char *path) {
+        return Result(::rmdir(HostPath(path).c_str()));
+    }
+
+    int Utimes(void *, const char *path, const CR_Timeval times[2]) {
+        const timeval hostTimes[2] = {{static_cast<time_t>(times[0].tv_sec), static_cast<suseconds_t>(times[0].tv_usec)},
+                                      {static_cast<time_t>(times[1].tv_sec), static_cast<suseconds_t>(times[1].tv_usec)}};
+        return Result(::utimes(HostPath(path).c_str(), hostTimes));
+    }
+} // namespace
+
+const ContentRedirectionDeviceABI *CreateExampleDevice(const char *name, const char *hostRoot) {
+    sDevice.name = name;
+    sDevice.root = hostRoot;
+
+    auto &abi        = sDevice.abi;
+    abi.magic        = CONTENT_REDIRECTION_DEVICE_MAGIC;
+    abi.version      = 1;
+    abi.name         = sDevice.name.c_str();
+    abi.structSize   = sizeof(File);
+    abi.dirStateSize = sizeof(Dir);
+    abi.deviceData   = &sDevice;
+    abi.open         = Open;
+    abi.close        = Close;
+    abi.write        = Write;
+    abi.read         = Read;
+    abi.seek         = Seek;
+    abi.fstat        = FStat;
+    abi.stat         = StatPath<::stat>;
+    abi.unlink       = Unlink;
+    abi.rename       = Rename;
+    abi.mkdir        = Mkdir;
+    abi.diropen      = DirOpen;
+    abi.dirreset     = DirReset;
+    abi.dirnext      = DirNext;
+    abi.dirclose     = DirClose;
+    abi.statvfs      = StatVfs;
+    abi.ftruncate    = FTruncate;
+    abi.fsync        = FSync;
+    abi.chmod        = Chmod;
+    abi.fchmod       = FChmod;
+    abi.rmdir        = Rmdir;
+    abi.lstat        = StatPath<::lstat>;
+    abi.utimes       = Utimes;
+    return &abi;
+}
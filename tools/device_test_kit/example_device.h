@@ -0,0 +1,10 @@
+#pragma once
+
+#include <content_redirection/defines.h>
+
+/**
+ * Example ContentRedirectionDeviceABI that maps "<name>:/path" to "<hostRoot>/path" via POSIX calls.
+ * It only fills the version 1 entries and reports version 1, like a minimal third-party device would.
+ * The returned device stays valid until the program exits.
+ */
+const ContentRedirectionDeviceABI *CreateExampleDevice(const char *name, const char *hostRoot);
@@ -0,0 +1,50 @@
+/**
+ * Host runner for the device test kit, see include/content_redirection/device_test_kit.h.
+ * Runs the conformance suite and optionally the performance profile against the example device in example_device.cpp,
+ * which maps a host directory. Other devices can be tested by replacing the call to "CreateExampleDevice".
+ *
+ * Build: g++ -std=c++17 -O2 -Iinclude -o crdevtest tools/device_test_kit/main.cpp tools/device_test_kit/example_device.cpp \
+ *            source/device_test_kit.cpp -lpthread
+ *
+ * Usage:
+ *   crdevtest <hostDir> [perf]
+ */
+#include "example_device.h"
+
+#include <content_redirection/device_test_kit.h>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+    void PrintLine(void *, const char *line) {
+        printf("%s\n", line);
+    }
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 3 || (argc == 3 && strcmp(argv[2], "perf") != 0)) {
+        fprintf(stderr, "Usage:\n"
+                        "  %s <hostDir> [perf]\n"
+                        "      Tests the example device on <hostDir>, the scratch directory <hostDir>/crtest must not exist.\n"
+                        "      \"perf\" also runs the performance profile.\n",
+                argv[0]);
+        return 1;
+    }
+    const ContentRedirectionDeviceABI *device = CreateExampleDevice("example", argv[1]);
+
+    ContentRedirectionDeviceTestConfig config{};
+    config.scratchDir = "example:/crtest";
+    config.print      = PrintLine;
+
+    ContentRedirectionDeviceConformanceResult result{};
+    if (ContentRedirection_RunDeviceConformanceTests(device, &config, &result) != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+        return 1;
+    }
+    if (argc == 3) {
+        ContentRedirectionDevicePerfResult perf{};
+        if (ContentRedirection_RunDevicePerformanceProfile(device, &config, &perf) != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+            return 1;
+        }
+    }
+    return result.failed == 0 ? 0 : 1;
+}
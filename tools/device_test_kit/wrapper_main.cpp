@@ -0,0 +1,219 @@
+/**
+ * Host runner that tests the devoptab wrapper (devoptab_cpp_wrapper.h) with the device test kit: a POSIX devoptab on a host directory
+ * is wrapped with several sets of ContentRedirectionDeviceOptions and every resulting ContentRedirectionDeviceABI runs the conformance suite.
+ * The native *at modes also check that the openat, fstatat and diropenat hooks of the device are used, or not used with snapshots.
+ * A plain ContentRedirection_AddDevice is checked against a stand-in module that only knows device version 1.
+ * The lib is built for the host with the stand-ins in tools/host.
+ *
+ * Build: g++ -std=gnu++17 -O2 -Itools/host/include -Itools/host -Isource -Iinclude -o crwrappertest tools/device_test_kit/wrapper_main.cpp \
+ *            tools/host/host_support.cpp tools/host/posix_devoptab.cpp source/[a-z]*.cpp -lpthread
+ *
+ * Usage:
+ *   crwrappertest <hostDir>
+ */
+#include "host_module.h"
+#include "posix_devoptab.h"
+
+#include <algorithm>
+#include <content_redirection/device_test_kit.h>
+#include <content_redirection/redirection.h>
+#include <content_redirection/slab_pool.h>
+#include <cstdio>
+#include <string>
+
+namespace {
+    struct Mode {
+        const char *name;
+        ContentRedirectionDeviceOptions options;
+        bool usesAtHooks; /**< The native openat, fstatat and diropenat hooks of the POSIX devoptab have to be called */
+    };
+
+    ContentRedirectionDeviceOptions WriteBack() {
+        ContentRedirectionDeviceOptions options;
+        options.writeBackBufferSize = 64 * 1024;
+        return options;
+    }
+
+    ContentRedirectionDeviceOptions ReadAhead() {
+        ContentRedirectionDeviceOptions options;
+        options.readAheadBufferSize      = 64 * 1024;
+        options.readAheadSequentialReads = 1;
+        return options;
+    }
+
+    ContentRedirectionDeviceOptions Snapshots() {
+        ContentRedirectionDeviceOptions options;
+        options.dirSnapshotMaxBytes = 64 * 1024;
+        return options;
+    }
+
+    ContentRedirectionDeviceOptions ContentCache() {
+        ContentRedirectionDeviceOptions options;
+        options.contentCacheMaxFileSize = 256 * 1024;
+        return options;
+    }
+
+    ContentRedirectionDeviceOptions MetadataCache() {
+        ContentRedirectionDeviceOptions options;
+        options.metadataCache       = true;
+        options.dirSnapshotMaxBytes = 64 * 1024;
+        return options;
+    }
+
+    ContentRedirectionDeviceOptions NativeAt() {
+        ContentRedirectionDeviceOptions options;
+        SetPosixAtHooks(options);
+        return options;
+    }
+
+    ContentRedirectionDeviceOptions NativeAtWriteBack() {
+        ContentRedirectionDeviceOptions options = NativeAt();
+        options.writeBackBufferSize             = 64 * 1024;
+        options.readAheadBufferSize             = 64 * 1024;
+        options.readAheadSequentialReads        = 1;
+        return options;
+    }
+
+    ContentRedirectionDeviceOptions NativeAtSnapshots() {
+        ContentRedirectionDeviceOptions options = NativeAt();
+        options.dirSnapshotMaxBytes             = 64 * 1024;
+        return options;
+    }
+
+    ContentRedirectionDeviceOptions SlabPool() {
+        ContentRedirectionDeviceOptions options = Snapshots();
+        options.writeBackBufferSize             = 64 * 1024;
+        options.useSlabPool                     = true;
+        return options;
+    }
+
+    ContentRedirectionDeviceOptions All() {
+        ContentRedirectionDeviceOptions options = MetadataCache();
+        options.writeBackBufferSize             = 64 * 1024;
+        options.readAheadBufferSize             = 64 * 1024;
+        options.contentCacheMaxFileSize         = 16 * 1024;
+        options.statManyDirScanThreshold        = 2;
+        options.copyRangeBufferSize             = 256 * 1024;
+        return options;
+    }
+
+    /**
+     * Sums up the slots and the malloc fallbacks of all classes of the slab pool.
+     */
+    ContentRedirectionSlabClassStats SlabTotals() {
+        ContentRedirectionSlabClassStats classes[16];
+        const uint32_t numClasses = std::min<uint32_t>(ContentRedirection_GetSlabPoolStats(classes, 16), 16);
+        ContentRedirectionSlabClassStats total{};
+        for (uint32_t i = 0; i < numClasses; i++) {
+            total.capacity += classes[i].capacity;
+            total.fallbackAllocations += classes[i].fallbackAllocations;
+        }
+        return total;
+    }
+
+    uint32_t sAddedDeviceVersion = 0;
+
+    ContentRedirectionApiErrorType ModuleGetVersion(ContentRedirectionVersion *outVersion) {
+        *outVersion = 3; // The first version with CRAddDeviceABI, which only knows device version 1.
+        return CONTENT_REDIRECTION_API_ERROR_NONE;
+    }
+
+    ContentRedirectionApiErrorType ModuleAddDeviceABI(const ContentRedirectionDeviceABI *device, int *resultOut) {
+        sAddedDeviceVersion = device->version;
+        *resultOut          = 0;
+        return CONTENT_REDIRECTION_API_ERROR_NONE;
+    }
+
+    ContentRedirectionApiErrorType ModuleRemoveDeviceABI(const char *, int *resultOut) {
+        *resultOut = 0;
+        return CONTENT_REDIRECTION_API_ERROR_NONE;
+    }
+
+    /**
+     * Adds the device via a plain ContentRedirection_AddDevice to a stand-in module, which has to see device version 1.
+     */
+    bool CheckPlainAddDevice(const devoptab_t *device) {
+        HostModule_SetExport("CRGetVersion", reinterpret_cast<void *>(ModuleGetVersion));
+        HostModule_SetExport("CRAddDeviceABI", reinterpret_cast<void *>(ModuleAddDeviceABI));
+        HostModule_SetExport("CRRemoveDeviceABI", reinterpret_cast<void *>(ModuleRemoveDeviceABI));
+        int result   = -1;
+        bool success = ContentRedirection_InitLibrary() == CONTENT_REDIRECTION_RESULT_SUCCESS &&
+                       ContentRedirection_AddDevice(device, &result) == CONTENT_REDIRECTION_RESULT_SUCCESS && result == 0;
+        success      = success && ContentRedirection_RemoveDevice(device->name, &result) == CONTENT_REDIRECTION_RESULT_SUCCESS;
+        HostModule_Clear();
+        printf("plain AddDevice: device version %u\n", sAddedDeviceVersion);
+        if (!success || sAddedDeviceVersion != 1) {
+            printf("  FAIL: ContentRedirection_AddDevice has to add the device with version 1\n");
+            return false;
+        }
+        return true;
+    }
+
+    void PrintLine(void *, const char *line) {
+        printf("  %s\n", line);
+    }
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage:\n"
+                        "  %s <hostDir>\n"
+                        "      Tests the wrapper around a POSIX devoptab on <hostDir>, the scratch directories <hostDir>/crtest-* must not exist.\n",
+                argv[0]);
+        return 1;
+    }
+    const devoptab_t *device = CreatePosixDevoptab("posix", argv[1]);
+    if (device == nullptr) {
+        return 1;
+    }
+
+    const Mode modes[] = {
+            {"default", {}, false},
+            {"writeBack", WriteBack(), false},
+            {"readAhead", ReadAhead(), false},
+            {"snapshots", Snapshots(), false},
+            {"contentCache", ContentCache(), false},
+            {"metadataCache", MetadataCache(), false},
+            {"nativeAt", NativeAt(), true},
+            {"nativeAtWriteBack", NativeAtWriteBack(), true},
+            // Snapshots close the directory of the device, the wrapper has to fall back to open, stat and diropen.
+            {"nativeAtSnapshots", NativeAtSnapshots(), false},
+            {"slabPool", SlabPool(), false},
+            {"all", All(), false},
+    };
+    uint32_t failed = CheckPlainAddDevice(device) ? 0 : 1;
+    for (const auto &mode : modes) {
+        printf("%s\n", mode.name);
+        const std::string scratchDir = std::string("posix:/crtest-") + mode.name;
+
+        ContentRedirectionDeviceTestConfig config{};
+        config.scratchDir = scratchDir.c_str();
+        config.print      = PrintLine;
+
+        ContentRedirectionDeviceConformanceResult result{};
+        const auto slabBefore    = SlabTotals();
+        const auto *abi          = CR_DevoptabWrapper::RuntimeSlot<0>::bind(device, mode.options);
+        const auto slabBound     = SlabTotals();
+        const uint32_t hookCalls = GetPosixAtHookCalls();
+        if (ContentRedirection_RunDeviceConformanceTests(abi, &config, &result) != CONTENT_REDIRECTION_RESULT_SUCCESS) {
+            return 1;
+        }
+        failed += result.failed;
+        if (!mode.options.useSlabPool && ((abi->version >= 4 && abi->alloc_file_struct != nullptr) || slabBound.capacity != slabBefore.capacity)) {
+            printf("  FAIL: the device uses the slab pool without \"useSlabPool\"\n");
+            failed++;
+        }
+        // File and dir structs have to fit into the classes of the pool, including the state of the wrapper.
+        if (mode.options.useSlabPool && (abi->alloc_dir_struct == nullptr || SlabTotals().fallbackAllocations != slabBound.fallbackAllocations)) {
+            printf("  FAIL: file or dir structs have not been allocated from the slab pool\n");
+            failed++;
+        }
+        if ((GetPosixAtHookCalls() != hookCalls) != mode.usesAtHooks) {
+            printf("  FAIL: the native openat, fstatat and diropenat hooks were %s\n", mode.usesAtHooks ? "not called" : "called");
+            failed++;
+        }
+    }
+    // Stops the readahead thread of the lib.
+    ContentRedirection_DeInitLibrary();
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+/**
+ * Stand-in for the exports of the "homebrew_content_redirection" module in host builds, e.g. to test how the lib talks to modules of
+ * different versions. As long as no export is set, OSDynLoad_Acquire fails like on a console without the module.
+ * Has to be set up before "ContentRedirection_InitLibrary" is called, the lib looks up the exports once.
+ */
+void HostModule_SetExport(const char *name, void *function);
+
+/**
+ * Removes all exports.
+ */
+void HostModule_Clear();
@@ -0,0 +1,120 @@
+/**
+ * Host implementations of the newlib and coreinit functions the lib uses, see tools/host/include.
+ */
+#include "host_module.h"
+
+#include <coreinit/debug.h>
+#include <coreinit/dynload.h>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <sys/iosupport.h>
+
+const devoptab_t *devoptab_list[STD_MAX] = {};
+
+namespace {
+    std::mutex sDeviceMutex;
+    thread_local _reent sReent;
+    std::map<std::string, void *> sModuleExports;
+
+    /**
+     * Returns the length of the device name of "name", which is either a device name or a path like "dev:/file".
+     */
+    size_t DeviceNameLength(const char *name) {
+        const char *colon = strchr(name, ':');
+        return colon != nullptr ? colon - name : strlen(name);
+    }
+} // namespace
+
+extern "C" _reent *__getreent(void) {
+    return &sReent;
+}
+
+extern "C" void OSReport(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+}
+
+extern "C" int FindDevice(const char *name) {
+    if (name == nullptr) {
+        return -1;
+    }
+    const size_t len = DeviceNameLength(name);
+    std::lock_guard lock(sDeviceMutex);
+    for (int i = 0; i < STD_MAX; i++) {
+        const devoptab_t *dev = devoptab_list[i];
+        if (dev != nullptr && strlen(dev->name) == len && strncmp(dev->name, name, len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+extern "C" const devoptab_t *GetDeviceOpTab(const char *name) {
+    const int index = FindDevice(name);
+    return index >= 0 ? devoptab_list[index] : nullptr;
+}
+
+extern "C" int AddDevice(const devoptab_t *device) {
+    if (FindDevice(device->name) >= 0) {
+        return -1;
+    }
+    std::lock_guard lock(sDeviceMutex);
+    // Like newlib, the first slots are reserved for stdin, stdout and stderr.
+    for (int i = 3; i < STD_MAX; i++) {
+        if (devoptab_list[i] == nullptr) {
+            devoptab_list[i] = device;
+            return i;
+        }
+    }
+    return -1;
+}
+
+extern "C" int RemoveDevice(const char *name) {
+    const int index = FindDevice(name);
+    if (index < 0) {
+        return -1;
+    }
+    std::lock_guard lock(sDeviceMutex);
+    devoptab_list[index] = nullptr;
+    return index;
+}
+
+void HostModule_SetExport(const char *name, void *function) {
+    if (function != nullptr) {
+        sModuleExports[name] = function;
+    } else {
+        sModuleExports.erase(name);
+    }
+}
+
+void HostModule_Clear() {
+    sModuleExports.clear();
+}
+
+extern "C" OSDynLoad_Error OSDynLoad_Acquire(const char *, OSDynLoad_Module *outModule) {
+    if (sModuleExports.empty()) {
+        *outModule = nullptr;
+        return OS_DYNLOAD_MODULE_NOT_FOUND;
+    }
+    *outModule = &sModuleExports;
+    return OS_DYNLOAD_OK;
+}
+
+extern "C" OSDynLoad_Error OSDynLoad_FindExport(OSDynLoad_Module, OSDynLoad_ExportType, const char *name, void **outAddr) {
+    const auto it = sModuleExports.find(name);
+    if (it == sModuleExports.end()) {
+        *outAddr = nullptr;
+        return OS_DYNLOAD_MODULE_NOT_FOUND;
+    }
+    *outAddr = it->second;
+    return OS_DYNLOAD_OK;
+}
+
+extern "C" void OSDynLoad_Release(OSDynLoad_Module) {
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+// Host stand-in for coreinit/debug.h of wut, OSReport prints to stderr.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void OSReport(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
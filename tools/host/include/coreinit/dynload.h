@@ -0,0 +1,27 @@
+#pragma once
+
+// Host stand-in for coreinit/dynload.h of wut. There is no module on the host, OSDynLoad_Acquire always fails.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void *OSDynLoad_Module;
+
+typedef enum OSDynLoad_Error {
+    OS_DYNLOAD_OK               = 0,
+    OS_DYNLOAD_MODULE_NOT_FOUND = 0xBAD10001,
+} OSDynLoad_Error;
+
+typedef enum OSDynLoad_ExportType {
+    OS_DYNLOAD_EXPORT_FUNC = 0,
+    OS_DYNLOAD_EXPORT_DATA = 1,
+} OSDynLoad_ExportType;
+
+OSDynLoad_Error OSDynLoad_Acquire(const char *name, OSDynLoad_Module *outModule);
+OSDynLoad_Error OSDynLoad_FindExport(OSDynLoad_Module module, OSDynLoad_ExportType exportType, const char *name, void **outAddr);
+void OSDynLoad_Release(OSDynLoad_Module module);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,20 @@
+#pragma once
+
+// Host stand-in for the reentrancy struct of newlib, only the members devoptabs use.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct _reent {
+    int _errno;
+    void *deviceData;
+};
+
+struct _reent *__getreent(void);
+
+#define _REENT (__getreent())
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,249 @@
+#include "posix_devoptab.h"
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <content_redirection/redirection.h>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+    struct Device {
+        devoptab_t devoptab{};
+        std::string name;
+        std::string root;
+    };
+
+    struct File {
+        int fd;
+    };
+
+    struct Dir {
+        DIR *dir;
+    };
+
+    std::vector<std::unique_ptr<Device>> sDevices;
+    std::atomic<uint32_t> sAtHookCalls{0};
+
+    std::string HostPath(_reent *r, const char *path) {
+        const auto *device = static_cast<const Device *>(r->deviceData);
+        const char *colon  = strchr(path, ':');
+        return device->root + "/" + (colon != nullptr ? colon + 1 : path);
+    }
+
+    template<typename T>
+    T Result(_reent *r, T res) {
+        if (res < 0) {
+            r->_errno = errno;
+            return -1;
+        }
+        return res;
+    }
+
+    int Open(_reent *r, void *fileStruct, const char *path, int flags, int mode) {
+        const int fd = ::open(HostPath(r, path).c_str(), flags, mode);
+        if (fd < 0) {
+            r->_errno = errno;
+            return -1;
+        }
+        static_cast<File *>(fileStruct)->fd = fd;
+        return 0;
+    }
+
+    int Close(_reent *r, void *fileStruct) {
+        return Result(r, ::close(static_cast<File *>(fileStruct)->fd));
+    }
+
+    ssize_t Write(_reent *r, void *fileStruct, const char *ptr, size_t len) {
+        return Result(r, ::write(static_cast<File *>(fileStruct)->fd, ptr, len));
+    }
+
+    ssize_t Read(_reent *r, void *fileStruct, char *ptr, size_t len) {
+        return Result(r, ::read(static_cast<File *>(fileStruct)->fd, ptr, len));
+    }
+
+    off_t Seek(_reent *r, void *fileStruct, off_t pos, int dir) {
+        return Result(r, ::lseek(static_cast<File *>(fileStruct)->fd, pos, dir));
+    }
+
+    int FStat(_reent *r, void *fileStruct, struct stat *st) {
+        return Result(r, ::fstat(static_cast<File *>(fileStruct)->fd, st));
+    }
+
+    int Stat(_reent *r, const char *path, struct stat *st) {
+        return Result(r, ::stat(HostPath(r, path).c_str(), st));
+    }
+
+    int LStat(_reent *r, const char *path, struct stat *st) {
+        return Result(r, ::lstat(HostPath(r, path).c_str(), st));
+    }
+
+    int Unlink(_reent *r, const char *path) {
+        return Result(r, ::unlink(HostPath(r, path).c_str()));
+    }
+
+    int Rename(_reent *r, const char *oldName, const char *newName) {
+        return Result(r, ::rename(HostPath(r, oldName).c_str(), HostPath(r, newName).c_str()));
+    }
+
+    int Mkdir(_reent *r, const char *path, int mode) {
+        return Result(r, ::mkdir(HostPath(r, path).c_str(), mode));
+    }
+
+    int Rmdir(_reent *r, const char *path) {
+        return Result(r, ::rmdir(HostPath(r, path).c_str()));
+    }
+
+    DIR_ITER *DirOpen(_reent *r, DIR_ITER *dirState, const char *path) {
+        DIR *dir = opendir(HostPath(r, path).c_str());
+        if (dir == nullptr) {
+            r->_errno = errno;
+            return nullptr;
+        }
+        static_cast<Dir *>(dirState->dirStruct)->dir = dir;
+        return dirState;
+    }
+
+    int DirReset(_reent *, DIR_ITER *dirState) {
+        rewinddir(static_cast<Dir *>(dirState->dirStruct)->dir);
+        return 0;
+    }
+
+    int DirNext(_reent *r, DIR_ITER *dirState, char *filename, struct stat *filestat) {
+        DIR *dir = static_cast<Dir *>(dirState->dirStruct)->dir;
+        dirent *entry;
+        do {
+            errno = 0;
+            entry = readdir(dir);
+            if (entry == nullptr) {
+                r->_errno = errno != 0 ? errno : ENOENT;
+                return -1;
+            }
+        } while (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0);
+        if (fstatat(dirfd(dir), entry->d_name, filestat, 0) < 0) {
+            r->_errno = errno;
+            return -1;
+        }
+        strncpy(filename, entry->d_name, NAME_MAX);
+        filename[NAME_MAX] = '\0';
+        return 0;
+    }
+
+    int DirClose(_reent *r, DIR_ITER *dirState) {
+        return Result(r, closedir(static_cast<Dir *>(dirState->dirStruct)->dir));
+    }
+
+    int StatVfs(_reent *r, const char *path, struct statvfs *buf) {
+        return Result(r, ::statvfs(HostPath(r, path).c_str(), buf));
+    }
+
+    int FTruncate(_reent *r, void *fileStruct, off_t len) {
+        return Result(r, ::ftruncate(static_cast<File *>(fileStruct)->fd, len));
+    }
+
+    int FSync(_reent *r, void *fileStruct) {
+        return Result(r, ::fsync(static_cast<File *>(fileStruct)->fd));
+    }
+
+    int Chmod(_reent *r, const char *path, mode_t mode) {
+        return Result(r, ::chmod(HostPath(r, path).c_str(), mode));
+    }
+
+    int FChmod(_reent *r, void *fileStruct, mode_t mode) {
+        return Result(r, ::fchmod(static_cast<File *>(fileStruct)->fd, mode));
+    }
+
+    int Utimes(_reent *r, const char *path, const struct timeval times[2]) {
+        return Result(r, ::utimes(HostPath(r, path).c_str(), times));
+    }
+
+    int OpenAt(void *, void *dirStruct, void *fileStruct, const char *path, int flags, uint32_t mode) {
+        sAtHookCalls++;
+        const int fd = ::openat(dirfd(static_cast<Dir *>(dirStruct)->dir), path, flags, mode);
+        if (fd < 0) {
+            return -errno;
+        }
+        static_cast<File *>(fileStruct)->fd = fd;
+        return 0;
+    }
+
+    int FStatAt(void *, void *dirStruct, const char *path, CR_Stat *st) {
+        sAtHookCalls++;
+        struct stat hostSt {};
+        if (::fstatat(dirfd(static_cast<Dir *>(dirStruct)->dir), path, &hostSt, 0) < 0) {
+            return -errno;
+        }
+        CR_DevoptabWrapper::Backend::stat_to_cr_stat(hostSt, st);
+        return 0;
+    }
+
+    int DirOpenAt(void *, void *parentDirStruct, void *dirStruct, const char *path) {
+        sAtHookCalls++;
+        const int fd = ::openat(dirfd(static_cast<Dir *>(parentDirStruct)->dir), path, O_RDONLY | O_DIRECTORY);
+        if (fd < 0) {
+            return -errno;
+        }
+        DIR *dir = fdopendir(fd);
+        if (dir == nullptr) {
+            const int error = errno;
+            ::close(fd);
+            return -error;
+        }
+        static_cast<Dir *>(dirStruct)->dir = dir;
+        return 0;
+    }
+} // namespace
+
+const devoptab_t *CreatePosixDevoptab(const char *name, const char *hostRoot) {
+    auto device  = std::make_unique<Device>();
+    device->name = name;
+    device->root = hostRoot;
+
+    auto &d        = device->devoptab;
+    d.name         = device->name.c_str();
+    d.structSize   = sizeof(File);
+    d.open_r       = Open;
+    d.close_r      = Close;
+    d.write_r      = Write;
+    d.read_r       = Read;
+    d.seek_r       = Seek;
+    d.fstat_r      = FStat;
+    d.stat_r       = Stat;
+    d.unlink_r     = Unlink;
+    d.rename_r     = Rename;
+    d.mkdir_r      = Mkdir;
+    d.dirStateSize = sizeof(Dir);
+    d.diropen_r    = DirOpen;
+    d.dirreset_r   = DirReset;
+    d.dirnext_r    = DirNext;
+    d.dirclose_r   = DirClose;
+    d.statvfs_r    = StatVfs;
+    d.ftruncate_r  = FTruncate;
+    d.fsync_r      = FSync;
+    d.deviceData   = device.get();
+    d.chmod_r      = Chmod;
+    d.fchmod_r     = FChmod;
+    d.rmdir_r      = Rmdir;
+    d.lstat_r      = LStat;
+    d.utimes_r     = Utimes;
+    if (AddDevice(&d) < 0) {
+        return nullptr;
+    }
+    sDevices.push_back(std::move(device));
+    return &sDevices.back()->devoptab;
+}
+
+void SetPosixAtHooks(ContentRedirectionDeviceOptions &options) {
+    options.openat    = OpenAt;
+    options.fstatat   = FStatAt;
+    options.diropenat = DirOpenAt;
+}
+
+uint32_t GetPosixAtHookCalls() {
+    return sAtHookCalls;
+}
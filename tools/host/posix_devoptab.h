@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <sys/iosupport.h>
+
+struct ContentRedirectionDeviceOptions;
+
+/**
+ * Creates a newlib devoptab that maps "<name>:/path" to "<hostRoot>/path" via POSIX calls and registers it via AddDevice.
+ * Stands in for the devices of the console (e.g. "fs:" or "sd:") in host builds. The devoptab stays valid until the program exits.
+ * Returns nullptr if a device with the name already exists.
+ */
+const devoptab_t *CreatePosixDevoptab(const char *name, const char *hostRoot);
+
+/**
+ * Sets the native openat, fstatat and diropenat hooks of "options" for a devoptab created via CreatePosixDevoptab.
+ * The hooks resolve the path relative to the host directory of the open dirStruct via openat(2), fstatat(2) and fdopendir(3).
+ */
+void SetPosixAtHooks(ContentRedirectionDeviceOptions &options);
+
+/**
+ * Returns how often the hooks set via SetPosixAtHooks have been called.
+ */
+uint32_t GetPosixAtHookCalls();